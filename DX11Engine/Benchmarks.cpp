@@ -0,0 +1,476 @@
+#include "Benchmarks.h"
+#include "RenderQueue.h"
+#include "Material.h"
+#include "FrustumCuller.h"
+#include "OcclusionCuller.h"
+#include "ConeCuller.h"
+#include "ClusterGrid.h"
+#include "LightManager.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Sorts a queue of packets with a scene-like spread of
+// keys (few passes and shaders, many materials and meshes,
+// random depths) and compares against std::sort
+// --------------------------------------------------------
+void Benchmarks::RenderQueueSort(unsigned int packetCount)
+{
+	const int iterations = 20;
+
+	std::mt19937 rng(1234);
+	std::vector<unsigned long long> keys(packetCount);
+	for (unsigned int i = 0; i < packetCount; i++)
+	{
+		keys[i] = RenderQueue::MakeKey(
+			RenderPassOpaque,
+			rng() % 4,
+			rng() % 256,
+			rng() % 64,
+			(rng() % 100000) / 100000.0f);
+	}
+
+	RenderQueue queue;
+	double radixMs = 0.0;
+	for (int it = 0; it < iterations; it++)
+	{
+		queue.Clear();
+		for (unsigned int i = 0; i < packetCount; i++)
+			queue.Add(keys[i], i);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		queue.Sort();
+		auto end = std::chrono::high_resolution_clock::now();
+		radixMs += std::chrono::duration<double, std::milli>(end - start).count();
+	}
+
+	std::vector<RenderPacket> packets(packetCount);
+	double stdMs = 0.0;
+	for (int it = 0; it < iterations; it++)
+	{
+		for (unsigned int i = 0; i < packetCount; i++)
+			packets[i] = { keys[i], i };
+
+		auto start = std::chrono::high_resolution_clock::now();
+		std::sort(packets.begin(), packets.end(),
+			[](const RenderPacket& a, const RenderPacket& b) { return a.key < b.key; });
+		auto end = std::chrono::high_resolution_clock::now();
+		stdMs += std::chrono::duration<double, std::milli>(end - start).count();
+	}
+
+	// Make sure both agree before reporting anything
+	bool matches = true;
+	for (unsigned int i = 0; i < packetCount; i++)
+		matches &= queue.GetPackets()[i].key == packets[i].key;
+
+	printf("Render queue sort, %u packets: radix %.3f ms, std::sort %.3f ms%s\n",
+		packetCount,
+		radixMs / iterations,
+		stdMs / iterations,
+		matches ? "" : " (RESULTS DIFFER)");
+}
+
+// --------------------------------------------------------
+// Binds materials as if drawing drawCount objects, cycling
+// through the list so every bind is a real material change.
+// Compares the prebuilt binding tables against rebuilding
+// them for every bind, which costs the same name lookups
+// the material used to do on each bind.
+// --------------------------------------------------------
+void Benchmarks::MaterialBind(const std::vector<std::shared_ptr<Material>>& materials, unsigned int drawCount)
+{
+	if (materials.empty()) return;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (unsigned int i = 0; i < drawCount; i++)
+		materials[i % materials.size()]->PrepareMaterial();
+	auto end = std::chrono::high_resolution_clock::now();
+	double tableMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+	start = std::chrono::high_resolution_clock::now();
+	for (unsigned int i = 0; i < drawCount; i++)
+	{
+		materials[i % materials.size()]->InvalidateBindingTable();
+		materials[i % materials.size()]->PrepareMaterial();
+	}
+	end = std::chrono::high_resolution_clock::now();
+	double lookupMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+	printf("Material bind, %u draws: binding tables %.3f ms, name lookups %.3f ms\n",
+		drawCount,
+		tableMs,
+		lookupMs);
+}
+
+// --------------------------------------------------------
+// Rasterizes a grid of building-like boxes seen from street
+// level and times it and the box tests against the budget.
+// Tests/OcclusionCullerTests checks the results against a
+// reference rasterizer.
+// --------------------------------------------------------
+void Benchmarks::OcclusionCull(unsigned int occludeeCount)
+{
+	const int iterations = 20;
+
+	// Unit cube, as an occluder mesh
+	std::vector<XMFLOAT3> cube =
+	{
+		XMFLOAT3(-0.5f, -0.5f, -0.5f), XMFLOAT3(0.5f, -0.5f, -0.5f), XMFLOAT3(0.5f, 0.5f, -0.5f), XMFLOAT3(-0.5f, 0.5f, -0.5f),
+		XMFLOAT3(-0.5f, -0.5f, 0.5f), XMFLOAT3(0.5f, -0.5f, 0.5f), XMFLOAT3(0.5f, 0.5f, 0.5f), XMFLOAT3(-0.5f, 0.5f, 0.5f)
+	};
+	std::vector<unsigned int> cubeIndices =
+	{
+		0, 2, 1, 0, 3, 2,	4, 5, 6, 4, 6, 7,	0, 1, 5, 0, 5, 4,
+		3, 7, 6, 3, 6, 2,	0, 4, 7, 0, 7, 3,	1, 2, 6, 1, 6, 5
+	};
+
+	std::mt19937 rng(3456);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	std::vector<XMFLOAT4X4> buildings;
+	for (int x = -6; x <= 6; x++)
+	{
+		for (int z = 0; z < 12; z++)
+		{
+			XMFLOAT4X4 world;
+			XMStoreFloat4x4(&world,
+				XMMatrixScaling(2.0f + unit(rng) * 1.5f, 2.0f + unit(rng) * 6.0f, 2.0f + unit(rng) * 1.5f) *
+				XMMatrixTranslation(x * 4.0f, 0.0f, z * 4.0f));
+			buildings.push_back(world);
+		}
+	}
+
+	std::vector<BoundingBox> boxes(occludeeCount);
+	for (unsigned int i = 0; i < occludeeCount; i++)
+	{
+		boxes[i] = BoundingBox(
+			XMFLOAT3((unit(rng) - 0.5f) * 60.0f, unit(rng) * 3.0f, unit(rng) * 60.0f),
+			XMFLOAT3(0.3f, 0.3f, 0.3f));
+	}
+
+	XMMATRIX viewProjection =
+		XMMatrixLookAtLH(XMVectorSet(0, 2, -10, 0), XMVectorSet(0, 2, 0, 0), XMVectorSet(0, 1, 0, 0)) *
+		XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 200.0f);
+
+	OcclusionCuller culler;
+	std::vector<unsigned int> visible;
+	double rasterizeMs = 0.0, cullMs = 0.0, frameMs = 0.0;
+	for (int it = 0; it < iterations; it++)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		culler.Begin(viewProjection);
+		for (const XMFLOAT4X4& world : buildings)
+			culler.AddOccluder(cube.data(), cubeIndices.data(), (unsigned int)cubeIndices.size(), XMLoadFloat4x4(&world));
+		culler.Rasterize();
+		auto middle = std::chrono::high_resolution_clock::now();
+
+		visible.clear();
+		culler.Cull(boxes, visible);
+		auto end = std::chrono::high_resolution_clock::now();
+
+		culler.EndFrame();
+		rasterizeMs += std::chrono::duration<double, std::milli>(middle - start).count();
+		cullMs += std::chrono::duration<double, std::milli>(end - middle).count();
+		frameMs += culler.GetLastFrameMilliseconds();
+	}
+
+	printf("Occlusion cull, %u boxes on %u threads, %u triangles: rasterize %.3f ms, test %.3f ms, %u visible\n",
+		occludeeCount,
+		ThreadPool::GetInstance().GetThreadCount(),
+		culler.GetTriangleCount(),
+		rasterizeMs / iterations,
+		cullMs / iterations,
+		(unsigned int)visible.size());
+
+	printf("Occlusion budget: %.3f ms per frame against %.3f ms%s\n",
+		frameMs / iterations,
+		culler.GetBudget(),
+		frameMs / iterations > culler.GetBudget() ? " (OVER BUDGET)" : "");
+}
+
+// A random point inside a cone, for checking nothing holding one is culled
+static XMFLOAT3 PointInCone(const Cone& cone, std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	XMVECTOR direction = XMLoadFloat3(&cone.direction);
+	XMVECTOR side = XMVector3Normalize(XMVector3Cross(direction,
+		fabsf(cone.direction.y) < 0.9f ? XMVectorSet(0, 1, 0, 0) : XMVectorSet(1, 0, 0, 0)));
+	XMVECTOR up = XMVector3Cross(direction, side);
+
+	float cosAngle = cone.cosHalfAngle + (1.0f - cone.cosHalfAngle) * unit(rng);
+	float sinAngle = sqrtf(max(0.0f, 1.0f - cosAngle * cosAngle));
+	float around = XM_2PI * unit(rng);
+	XMVECTOR ray = XMVectorAdd(XMVectorScale(direction, cosAngle),
+		XMVectorScale(XMVectorAdd(XMVectorScale(side, cosf(around)), XMVectorScale(up, sinf(around))), sinAngle));
+
+	XMFLOAT3 point;
+	XMStoreFloat3(&point, XMVectorAdd(XMLoadFloat3(&cone.apex), XMVectorScale(ray, cone.range * unit(rng))));
+	return point;
+}
+
+// --------------------------------------------------------
+// Culls a field of boxes against random spot light cones
+// and cones against random views, comparing the SIMD tests
+// with the scalar ones.  Boxes and views around random
+// points inside the cones check no test culls what a cone
+// reaches, and the boxes culled that the range spheres
+// would keep show what the cones save.
+// --------------------------------------------------------
+void Benchmarks::ConeCull(unsigned int coneCount, unsigned int boxCount)
+{
+	const unsigned int samplesPerCone = 16;
+	const unsigned int viewCount = 64;
+
+	std::mt19937 rng(5678);
+	std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::uniform_real_distribution<float> signedUnit(-1.0f, 1.0f);
+
+	std::vector<Cone> cones(coneCount);
+	for (unsigned int i = 0; i < coneCount; i++)
+	{
+		Light light = {};
+		light.Type = LIGHT_TYPE_SPOT;
+		light.Position = XMFLOAT3(position(rng), position(rng), position(rng));
+		light.Direction = XMFLOAT3(signedUnit(rng), signedUnit(rng), signedUnit(rng) + 0.01f);
+		light.Range = 2.0f + unit(rng) * 10.0f;
+		light.SpotFalloff = 1.0f + unit(rng) * 127.0f;
+		cones[i] = ConeCuller::FromLight(light);
+	}
+
+	std::vector<BoundingBox> boxes(boxCount);
+	for (BoundingBox& box : boxes)
+	{
+		box.Center = XMFLOAT3(position(rng), position(rng), position(rng));
+		box.Extents = XMFLOAT3(0.2f + unit(rng) * 2.0f, 0.2f + unit(rng) * 2.0f, 0.2f + unit(rng) * 2.0f);
+	}
+
+	// Boxes, packed once like ObjectLightSelector does
+	std::vector<BoxLanes> lanes;
+	ConeCuller::PackBoxes(boxes, lanes);
+	std::vector<unsigned char> hits;
+	unsigned int boxesDiffer = 0;
+	unsigned long long coneHits = 0, sphereHits = 0;
+	double simdMs = 0.0, scalarMs = 0.0;
+	for (const Cone& cone : cones)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		ConeCuller::CullBoxes(cone, lanes, boxCount, hits);
+		auto middle = std::chrono::high_resolution_clock::now();
+		for (unsigned int b = 0; b < boxCount; b++)
+			boxesDiffer += ConeCuller::IntersectsBox(cone, boxes[b]) != (hits[b] != 0);
+		auto end = std::chrono::high_resolution_clock::now();
+		simdMs += std::chrono::duration<double, std::milli>(middle - start).count();
+		scalarMs += std::chrono::duration<double, std::milli>(end - middle).count();
+
+		for (unsigned int b = 0; b < boxCount; b++)
+		{
+			const BoundingBox& box = boxes[b];
+			float dx = max(0.0f, fabsf(cone.apex.x - box.Center.x) - box.Extents.x);
+			float dy = max(0.0f, fabsf(cone.apex.y - box.Center.y) - box.Extents.y);
+			float dz = max(0.0f, fabsf(cone.apex.z - box.Center.z) - box.Extents.z);
+			sphereHits += dx * dx + dy * dy + dz * dz <= cone.range * cone.range;
+			coneHits += hits[b];
+		}
+	}
+
+	std::vector<BoundingBox> sampleBoxes(samplesPerCone);
+	unsigned int boxMisses = 0;
+	for (const Cone& cone : cones)
+	{
+		for (BoundingBox& box : sampleBoxes)
+		{
+			box.Center = PointInCone(cone, rng);
+			box.Extents = XMFLOAT3(unit(rng), unit(rng), unit(rng));
+		}
+		ConeCuller::PackBoxes(sampleBoxes, lanes);
+		ConeCuller::CullBoxes(cone, lanes, samplesPerCone, hits);
+		for (unsigned char hit : hits)
+			boxMisses += hit == 0;
+	}
+
+	printf("Cone culling, %u cones against %u boxes: SIMD %.3f ms, scalar %.3f ms, %.1f%% of range sphere hits culled%s%s\n",
+		coneCount,
+		boxCount,
+		simdMs,
+		scalarMs,
+		sphereHits > 0 ? 100.0 * (sphereHits - coneHits) / sphereHits : 0.0,
+		boxesDiffer == 0 ? "" : " (RESULTS DIFFER)",
+		boxMisses == 0 ? "" : " (CULLS A CONE'S BOX)");
+
+	// Views, looking from around the field at points in a cone, so
+	// every view sees at least one
+	XMMATRIX proj = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 200.0f);
+	std::vector<unsigned char> visible;
+	unsigned int viewsDiffer = 0, viewMisses = 0;
+	unsigned long long visibleCount = 0;
+	double viewMs = 0.0;
+	for (unsigned int v = 0; v < viewCount; v++)
+	{
+		XMFLOAT3 eye(position(rng), position(rng), position(rng));
+		XMFLOAT3 target = PointInCone(cones[v % coneCount], rng);
+		XMVECTOR forward = XMVectorSubtract(XMLoadFloat3(&target), XMLoadFloat3(&eye));
+		XMFLOAT4 planes[6];
+		FrustumCuller::ExtractPlanes(XMMatrixLookToLH(XMLoadFloat3(&eye), forward, XMVectorSet(0, 1, 0, 0)) * proj, planes);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		ConeCuller::CullCones(cones, planes, visible);
+		auto end = std::chrono::high_resolution_clock::now();
+		viewMs += std::chrono::duration<double, std::milli>(end - start).count();
+
+		for (unsigned int i = 0; i < coneCount; i++)
+		{
+			viewsDiffer += ConeCuller::IntersectsFrustum(cones[i], planes) != (visible[i] != 0);
+			visibleCount += visible[i];
+		}
+		viewMisses += visible[v % coneCount] == 0;
+	}
+
+	printf("Cone culling, %u cones against %u views: %.3f ms per view, %.1f%% visible%s%s\n",
+		coneCount,
+		viewCount,
+		viewMs / viewCount,
+		100.0 * visibleCount / ((double)coneCount * viewCount),
+		viewsDiffer == 0 ? "" : " (RESULTS DIFFER)",
+		viewMisses == 0 ? "" : " (CULLS A VISIBLE CONE)");
+}
+
+// --------------------------------------------------------
+// Moves a few of many lights each frame and mirrors them
+// the way Game does: only the changed ranges are copied to
+// a stand-in for the light buffer, and only the slices the
+// moved cones touch are binned again.  The mirror and the
+// incremental grid are checked against the lights and a
+// full rebuild every frame, and the bytes copied compared
+// with copying everything.
+// --------------------------------------------------------
+void Benchmarks::LightUpdates(unsigned int lightCount, unsigned int frameCount, unsigned int movesPerFrame)
+{
+	const unsigned int uploadGap = 3;
+
+	std::mt19937 rng(6789);
+	std::uniform_real_distribution<float> position(-40.0f, 40.0f);
+	std::uniform_real_distribution<float> depth(1.0f, 150.0f);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	// The lights are placed in view space, so the view never moves
+	LightManager manager;
+	std::vector<LightHandle> handles(lightCount);
+	for (unsigned int i = 0; i < lightCount; i++)
+	{
+		Light light = {};
+		light.Type = i % 2 ? LIGHT_TYPE_SPOT : LIGHT_TYPE_POINT;
+		light.Position = XMFLOAT3(position(rng), position(rng), depth(rng));
+		light.Direction = XMFLOAT3(unit(rng) - 0.5f, unit(rng) - 0.5f, unit(rng) - 0.5f);
+		light.Range = 1.0f + unit(rng) * 4.0f;
+		light.SpotFalloff = 1.0f + unit(rng) * 31.0f;
+		light.Color = XMFLOAT3(1, 1, 1);
+		light.Intensity = 1.0f;
+		handles[i] = manager.Add(light);
+	}
+
+	float fov = XM_PIDIV4;
+	float yScale = 1.0f / tanf(fov * 0.5f);
+	ClusterGrid incremental, full;
+	incremental.SetProjection(yScale * 9.0f / 16.0f, yScale, 0.1f, 200.0f);
+	full.SetProjection(yScale * 9.0f / 16.0f, yScale, 0.1f, 200.0f);
+
+	std::vector<Light> mirror;
+	std::vector<Cone> cones(lightCount);
+	std::vector<unsigned int> indices(lightCount);
+	std::vector<LightRange> ranges;
+	std::vector<unsigned int> changed;
+	unsigned int seenVersion = 0;
+	unsigned long long bytes = 0, rebinned = 0;
+	unsigned int mirrorsDiffer = 0, gridsDiffer = 0, staleHandles = 0;
+	double updateMs = 0.0, buildMs = 0.0;
+	for (unsigned int f = 0; f <= frameCount; f++)
+	{
+		// Frame 0 uploads and bins everything, as a first frame would
+		for (unsigned int m = 0; m < movesPerFrame && f > 0; m++)
+		{
+			unsigned int i = (unsigned int)(unit(rng) * lightCount) % lightCount;
+
+			// Every so often a light is replaced instead, taking the same slot
+			Light light = *manager.Get(handles[i]);
+			light.Position.x += unit(rng) - 0.5f;
+			light.Position.z += unit(rng) - 0.5f;
+			if (m % 8 == 7)
+			{
+				LightHandle old = handles[i];
+				manager.Remove(old);
+				handles[i] = manager.Add(light);
+				staleHandles += manager.IsValid(old) || manager.Get(old) != nullptr;
+			}
+			else
+			{
+				manager.Set(handles[i], light);
+			}
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+		mirror.resize(manager.GetSlotCount());
+		manager.GetChangedRanges(seenVersion, uploadGap, ranges);
+		for (const LightRange& range : ranges)
+		{
+			memcpy(&mirror[range.first], &manager.GetLights()[range.first], sizeof(Light) * range.count);
+			bytes += sizeof(Light) * range.count;
+		}
+		seenVersion = manager.GetVersion();
+
+		// Ranges can take in lights that didn't change, so compare cones
+		changed.clear();
+		for (const LightRange& range : ranges)
+		{
+			for (unsigned int i = range.first; i < range.first + range.count; i++)
+			{
+				Cone cone = ConeCuller::FromLight(manager.GetLight(i));
+				if (f == 0 || memcmp(&cone, &cones[i], sizeof(Cone)) != 0)
+					changed.push_back(i);
+				cones[i] = cone;
+				indices[i] = i;
+			}
+		}
+		if (f == 0)
+		{
+			incremental.Build(cones, indices);
+			rebinned += lightCount;
+		}
+		else
+		{
+			rebinned += incremental.Update(cones, indices, changed);
+		}
+		auto middle = std::chrono::high_resolution_clock::now();
+		full.Build(cones, indices);
+		auto end = std::chrono::high_resolution_clock::now();
+		updateMs += std::chrono::duration<double, std::milli>(middle - start).count();
+		buildMs += std::chrono::duration<double, std::milli>(end - middle).count();
+
+		mirrorsDiffer += memcmp(mirror.data(), manager.GetLights().data(), sizeof(Light) * mirror.size()) != 0;
+		gridsDiffer += incremental.GetLightIndices() != full.GetLightIndices() ||
+			memcmp(incremental.GetRanges().data(), full.GetRanges().data(), sizeof(ClusterRange) * ClusterGrid::ClusterCount) != 0;
+	}
+
+	printf("Light updates, %u of %u lights moving for %u frames: %.1f KB uploaded per frame of %.1f KB, %.1f lights rebinned, %.3f ms against %.3f ms rebuilding%s%s%s\n",
+		movesPerFrame,
+		lightCount,
+		frameCount,
+		bytes / 1024.0 / (frameCount + 1),
+		sizeof(Light) * lightCount / 1024.0,
+		(double)rebinned / (frameCount + 1),
+		updateMs / (frameCount + 1),
+		buildMs / (frameCount + 1),
+		mirrorsDiffer == 0 ? "" : " (MIRROR DIFFERS)",
+		gridsDiffer == 0 ? "" : " (RESULTS DIFFER)",
+		staleHandles == 0 ? "" : " (STALE HANDLE WORKS)");
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+class Material;
+
+// --------------------------------------------------------
+// CPU micro-benchmarks for the renderer's hot paths.  Each
+// one prints its timings to the console, so they're only
+// run on request in debug builds (see Game::RunBenchmarks).
+// Frustum culling, the scene BVH and the light budget are
+// timed by their tests instead (Tests/FrustumCullerTests,
+// Tests/DynamicBVHTests and Tests/LightBudgetTests).
+// --------------------------------------------------------
+class Benchmarks
+{
+public:
+	static void RenderQueueSort(unsigned int packetCount);
+	static void MaterialBind(const std::vector<std::shared_ptr<Material>>& materials, unsigned int drawCount);
+	static void OcclusionCull(unsigned int occludeeCount);
+	static void ConeCull(unsigned int coneCount, unsigned int boxCount);
+	static void LightUpdates(unsigned int lightCount, unsigned int frameCount, unsigned int movesPerFrame);
+};
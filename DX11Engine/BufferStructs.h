@@ -7,4 +7,15 @@ struct VertexShaderExternalData
 	DirectX::XMFLOAT4X4 worldMatrix;
 	DirectX::XMFLOAT4X4 viewMatrix;
 	DirectX::XMFLOAT4X4 projectionMatrix;
+};
+
+// Per-instance data read by the instanced vertex shaders, which must
+// match their WORLD_PER_INSTANCE, WORLDINVTRANSPOSE_PER_INSTANCE,
+// LIGHTS_PER_INSTANCE and LIGHTMAPRECT_PER_INSTANCE inputs
+struct InstanceData
+{
+	DirectX::XMFLOAT4X4 world;
+	DirectX::XMFLOAT4X4 worldInvTranspose;
+	DirectX::XMUINT4 lights;			// The entity's ObjectLightList
+	DirectX::XMFLOAT4 lightmapRect;		// Lightmap uv scale in xy, offset in zw, zero if not lightmapped
 };
\ No newline at end of file
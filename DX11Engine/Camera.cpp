@@ -1,11 +1,15 @@
 #include "Camera.h"
 #include "Input.h"
+#include <cmath>
 
 using namespace DirectX;
 
 Camera::Camera(float x, float y, float z, float aspectRatio)
 {
 	// Set up the initial transform and matrices
+	nearClip = 0.01f;
+	farClip = 100.0f;
+	fieldOfView = XM_PIDIV4;	// 45 degrees
 	transform.SetPosition(x, y, z);
 	UpdateViewMatrix();
 	UpdateProjectionMatrix(aspectRatio);
@@ -112,10 +116,10 @@ void Camera::UpdateViewMatrix()
 void Camera::UpdateProjectionMatrix(float aspectRatio)
 {
 	XMMATRIX proj = XMMatrixPerspectiveFovLH(
-		XM_PIDIV4,      // fov (45 degrees currently)
+		fieldOfView,    // vertical fov
 		aspectRatio,    // aspect ratio of window
-		0.01f,          // near plane (close to 0 but not 0)
-		100.0f          // far plane (ideally not more than 1000)
+		nearClip,       // near plane (close to 0 but not 0)
+		farClip         // far plane (ideally not more than 1000)
 	);
 	XMStoreFloat4x4(&projectionMatrix, proj);
 }
@@ -134,3 +138,19 @@ DirectX::XMFLOAT4X4 Camera::GetProjectionMatrix()
 {
 	return projectionMatrix;
 }
+
+float Camera::GetNearClip()
+{
+	return nearClip;
+}
+
+float Camera::GetFarClip()
+{
+	return farClip;
+}
+
+float Camera::GetProjectionScale()
+{
+	// Same as the projection matrix's y scale
+	return 1.0f / tanf(fieldOfView * 0.5f);
+}
@@ -18,12 +18,20 @@ public:
 	Transform* GetTransform();
 	DirectX::XMFLOAT4X4 GetViewMatrix();
 	DirectX::XMFLOAT4X4 GetProjectionMatrix();
+	float GetNearClip();
+	float GetFarClip();
+	float GetProjectionScale();	// Half screen heights per unit of size at unit distance
 
 private:
 	// Camera matrices
 	DirectX::XMFLOAT4X4 viewMatrix;
 	DirectX::XMFLOAT4X4 projectionMatrix;
 
+	// Projection info
+	float nearClip;
+	float farClip;
+	float fieldOfView;
+
 	// Transform info
 	Transform transform;
 };
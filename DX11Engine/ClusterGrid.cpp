@@ -0,0 +1,282 @@
+#include "ClusterGrid.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+
+using namespace DirectX;
+
+// Columns padded to whole vectors
+static const unsigned int ColumnVectors = (ClusterGrid::TilesX + 3) / 4;
+
+void ClusterGrid::SetProjection(float p_xScale, float p_yScale, float p_nearClip, float p_farClip)
+{
+	xScale = p_xScale;
+	yScale = p_yScale;
+	nearClip = p_nearClip;
+	farClip = p_farClip;
+}
+
+unsigned int ClusterGrid::ClusterIndex(unsigned int x, unsigned int y, unsigned int slice)
+{
+	return (slice * TilesY + y) * TilesX + x;
+}
+
+float ClusterGrid::GetSliceDepth(unsigned int slice)
+{
+	return nearClip * powf(farClip / nearClip, (float)slice / Slices);
+}
+
+// --------------------------------------------------------
+// Tiles are even in normalized device coordinates, so an
+// edge's view space position grows with depth.  The bounds
+// cover both ends of the slice.
+// --------------------------------------------------------
+void ClusterGrid::GetClusterBounds(unsigned int x, unsigned int y, unsigned int slice, XMFLOAT3& boundsMin, XMFLOAT3& boundsMax)
+{
+	float nearDepth = GetSliceDepth(slice);
+	float farDepth = GetSliceDepth(slice + 1);
+
+	float left = (2.0f * x / TilesX - 1.0f) / xScale;
+	float right = (2.0f * (x + 1) / TilesX - 1.0f) / xScale;
+	float top = (1.0f - 2.0f * y / TilesY) / yScale;
+	float bottom = (1.0f - 2.0f * (y + 1) / TilesY) / yScale;
+
+	boundsMin = XMFLOAT3(
+		std::min(left * nearDepth, left * farDepth),
+		std::min(bottom * nearDepth, bottom * farDepth),
+		nearDepth);
+	boundsMax = XMFLOAT3(
+		std::max(right * nearDepth, right * farDepth),
+		std::max(top * nearDepth, top * farDepth),
+		farDepth);
+}
+
+void ClusterGrid::Build(const std::vector<Cone>& cones, const std::vector<unsigned int>& lightIndices)
+{
+	ThreadPool::GetInstance().ParallelFor(Slices, [&](unsigned int slice)
+	{
+		sliceLists[slice].hits.clear();
+		BinSlice(slice, cones, lightIndices, sliceLists[slice].hits);
+		SortSlice(slice);
+	});
+	JoinSlices();
+}
+
+unsigned int ClusterGrid::Update(const std::vector<Cone>& cones, const std::vector<unsigned int>& lightIndices, const std::vector<unsigned int>& changedLights)
+{
+	// Nothing to keep before the first build
+	if (ranges.empty())
+	{
+		Build(cones, lightIndices);
+		return (unsigned int)cones.size();
+	}
+
+	changedMask.clear();
+	for (unsigned int light : changedLights)
+	{
+		if (light >= changedMask.size())
+			changedMask.resize(light + 1, 0);
+		changedMask[light] = 1;
+	}
+
+	changedCones.clear();
+	changedIndices.clear();
+	for (unsigned int s = 0; s < cones.size(); s++)
+	{
+		if (lightIndices[s] < changedMask.size() && changedMask[lightIndices[s]])
+		{
+			changedCones.push_back(cones[s]);
+			changedIndices.push_back(lightIndices[s]);
+		}
+	}
+
+	ThreadPool::GetInstance().ParallelFor(Slices, [&](unsigned int slice)
+	{
+		SliceLists& lists = sliceLists[slice];
+		lists.freshHits.clear();
+		BinSlice(slice, changedCones, changedIndices, lists.freshHits);
+		MergeSlice(slice);
+		SortSlice(slice);
+	});
+	JoinSlices();
+	return (unsigned int)changedCones.size();
+}
+
+// --------------------------------------------------------
+// Joins the slices' lists, moving their offsets along
+// --------------------------------------------------------
+void ClusterGrid::JoinSlices()
+{
+	ranges.resize(ClusterCount);
+	lightIndexList.clear();
+	for (unsigned int slice = 0; slice < Slices; slice++)
+	{
+		SliceLists& lists = sliceLists[slice];
+		unsigned int base = (unsigned int)lightIndexList.size();
+		unsigned int offset = 0;
+		for (unsigned int c = 0; c < TilesX * TilesY; c++)
+		{
+			ranges[slice * TilesX * TilesY + c] = { base + offset, lists.counts[c] };
+			offset += lists.counts[c];
+		}
+		lightIndexList.insert(lightIndexList.end(), lists.indices.begin(), lists.indices.end());
+	}
+}
+
+// --------------------------------------------------------
+// Finds every cluster in one slice each cone touches, adding
+// cluster and light pairs to hits in the cones' order
+// --------------------------------------------------------
+void ClusterGrid::BinSlice(unsigned int slice, const std::vector<Cone>& cones, const std::vector<unsigned int>& lightIndices, std::vector<unsigned int>& hits)
+{
+
+	// Per column and row bounds for this slice
+	XMFLOAT4 columnMin[ColumnVectors], columnMax[ColumnVectors];
+	float rowMin[TilesY], rowMax[TilesY];
+	float* columnMinLanes = &columnMin[0].x;
+	float* columnMaxLanes = &columnMax[0].x;
+	for (unsigned int x = 0; x < ColumnVectors * 4; x++)
+	{
+		XMFLOAT3 boundsMin, boundsMax;
+		GetClusterBounds(std::min(x, TilesX - 1), 0, slice, boundsMin, boundsMax);
+
+		// Padded lanes can never be hit
+		columnMinLanes[x] = x < TilesX ? boundsMin.x : FLT_MAX;
+		columnMaxLanes[x] = x < TilesX ? boundsMax.x : FLT_MAX;
+	}
+	for (unsigned int y = 0; y < TilesY; y++)
+	{
+		XMFLOAT3 boundsMin, boundsMax;
+		GetClusterBounds(0, y, slice, boundsMin, boundsMax);
+		rowMin[y] = boundsMin.y;
+		rowMax[y] = boundsMax.y;
+	}
+	float sliceNear = GetSliceDepth(slice);
+	float sliceFar = GetSliceDepth(slice + 1);
+
+	// The same bounds as boxes, for the cone tests
+	XMVECTOR half = XMVectorReplicate(0.5f);
+	BoxLanes columnBoxes[ColumnVectors];
+	for (unsigned int v = 0; v < ColumnVectors; v++)
+	{
+		XMVECTOR boundsMin = XMLoadFloat4(&columnMin[v]);
+		XMVECTOR boundsMax = XMLoadFloat4(&columnMax[v]);
+		columnBoxes[v].centerX = XMVectorAdd(XMVectorMultiply(boundsMin, half), XMVectorMultiply(boundsMax, half));
+		columnBoxes[v].extentX = XMVectorMultiply(XMVectorSubtract(boundsMax, boundsMin), half);
+		columnBoxes[v].centerZ = XMVectorReplicate((sliceNear + sliceFar) * 0.5f);
+		columnBoxes[v].extentZ = XMVectorReplicate((sliceFar - sliceNear) * 0.5f);
+	}
+
+	XMVECTOR zero = XMVectorZero();
+	for (unsigned int s = 0; s < cones.size(); s++)
+	{
+		const Cone& cone = cones[s];
+		const XMFLOAT4& sphere = cone.sphere;
+		bool narrow = !ConeCuller::IsSphere(cone);
+		float radiusSq = sphere.w * sphere.w;
+
+		// Distance to the slab first, most spheres miss most slices
+		float dz = std::max(0.0f, std::max(sliceNear - sphere.z, sphere.z - sliceFar));
+		float remaining = radiusSq - dz * dz;
+		if (remaining < 0.0f)
+			continue;
+
+		// Squared distances to each column's bounds, four at a time
+		XMVECTOR centerX = XMVectorReplicate(sphere.x);
+		XMVECTOR columnDistSq[ColumnVectors];
+		for (unsigned int v = 0; v < ColumnVectors; v++)
+		{
+			XMVECTOR below = XMVectorSubtract(XMLoadFloat4(&columnMin[v]), centerX);
+			XMVECTOR above = XMVectorSubtract(centerX, XMLoadFloat4(&columnMax[v]));
+			XMVECTOR distance = XMVectorMax(zero, XMVectorMax(below, above));
+			columnDistSq[v] = XMVectorMultiply(distance, distance);
+		}
+
+		for (unsigned int y = 0; y < TilesY; y++)
+		{
+			float dy = std::max(0.0f, std::max(rowMin[y] - sphere.y, sphere.y - rowMax[y]));
+			float rowRemaining = remaining - dy * dy;
+			if (rowRemaining < 0.0f)
+				continue;
+
+			XMVECTOR limit = XMVectorReplicate(rowRemaining);
+			XMVECTOR rowCenter = XMVectorReplicate((rowMin[y] + rowMax[y]) * 0.5f);
+			XMVECTOR rowExtent = XMVectorReplicate((rowMax[y] - rowMin[y]) * 0.5f);
+			for (unsigned int v = 0; v < ColumnVectors; v++)
+			{
+				XMVECTOR hit = XMVectorLessOrEqual(columnDistSq[v], limit);
+				if (narrow)
+				{
+					columnBoxes[v].centerY = rowCenter;
+					columnBoxes[v].extentY = rowExtent;
+					hit = XMVectorAndInt(hit, ConeCuller::IntersectBoxes(cone, columnBoxes[v]));
+				}
+
+				uint32_t lanes[4];
+				XMStoreInt4(lanes, hit);
+				for (unsigned int lane = 0; lane < 4; lane++)
+				{
+					if (lanes[lane])
+					{
+						hits.push_back(y * TilesX + v * 4 + lane);
+						hits.push_back(lightIndices[s]);
+					}
+				}
+			}
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Drops the changed lights' old hits and merges their fresh
+// ones in.  Both are in light order, so the result is too.
+// --------------------------------------------------------
+void ClusterGrid::MergeSlice(unsigned int slice)
+{
+	SliceLists& lists = sliceLists[slice];
+	const std::vector<unsigned int>& fresh = lists.freshHits;
+	std::vector<unsigned int>& merged = lists.mergedHits;
+	merged.clear();
+
+	size_t f = 0;
+	for (size_t h = 0; h < lists.hits.size(); h += 2)
+	{
+		unsigned int light = lists.hits[h + 1];
+		if (light < changedMask.size() && changedMask[light])
+			continue;
+
+		for (; f < fresh.size() && fresh[f + 1] < light; f += 2)
+			merged.insert(merged.end(), fresh.begin() + f, fresh.begin() + f + 2);
+		merged.push_back(lists.hits[h]);
+		merged.push_back(light);
+	}
+	merged.insert(merged.end(), fresh.begin() + f, fresh.end());
+	lists.hits.swap(merged);
+}
+
+// --------------------------------------------------------
+// Sorts a slice's hits by cluster (a counting sort) so each
+// cluster's lights are together and keep the hits' order
+// --------------------------------------------------------
+void ClusterGrid::SortSlice(unsigned int slice)
+{
+	SliceLists& lists = sliceLists[slice];
+	lists.counts.assign(TilesX * TilesY, 0);
+	for (size_t h = 0; h < lists.hits.size(); h += 2)
+		lists.counts[lists.hits[h]]++;
+
+	std::vector<unsigned int> starts(TilesX * TilesY);
+	unsigned int total = 0;
+	for (unsigned int c = 0; c < TilesX * TilesY; c++)
+	{
+		starts[c] = total;
+		total += lists.counts[c];
+	}
+
+	lists.indices.resize(total);
+	for (size_t h = 0; h < lists.hits.size(); h += 2)
+		lists.indices[starts[lists.hits[h]]++] = lists.hits[h + 1];
+}
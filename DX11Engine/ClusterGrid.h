@@ -0,0 +1,99 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+#include "ConeCuller.h"
+
+// Where one cluster's lights are in the light index list
+struct ClusterRange
+{
+	unsigned int offset;
+	unsigned int count;
+};
+
+// --------------------------------------------------------
+// Splits the camera's view into clusters - screen tiles
+// times depth slices spaced exponentially, so clusters stay
+// roughly cube shaped with distance - and lists the lights
+// whose range reaches each one.  The pixel shader finds its
+// cluster and only loops over that cluster's lights.
+//
+// Lights are view space cones (see ConeCuller), binned by
+// their bounding spheres first.  A cluster's bounds in each
+// axis depend only on its column, row or slice, so a
+// sphere's squared distance to every cluster is the sum of
+// three per-axis terms, and four columns are tested at once.
+// Spot lights' hits are then narrowed to the clusters their
+// cone touches, again four columns at a time.  Slices are
+// binned in parallel on the ThreadPool.  When only some
+// lights moved, just those are binned again and merged
+// into each slice's earlier hits.
+//
+// The grid only produces the ranges and index list; the
+// caller uploads them for the shader, whose CLUSTER_ values
+// have to match the sizes below.
+// --------------------------------------------------------
+class ClusterGrid
+{
+public:
+	// Must match the CLUSTER_ defines in ShaderInclude.hlsli
+	static const unsigned int TilesX = 16;
+	static const unsigned int TilesY = 9;
+	static const unsigned int Slices = 24;
+	static const unsigned int ClusterCount = TilesX * TilesY * Slices;
+
+	// xScale, yScale - the camera projection matrix's _11 and _22
+	void SetProjection(float xScale, float yScale, float nearClip, float farClip);
+
+	// Bins view space cones into the clusters they touch.  The index
+	// lists hold lightIndices' values, in the order the cones were given.
+	void Build(const std::vector<Cone>& cones, const std::vector<unsigned int>& lightIndices);
+
+	// Bins only changedLights (light index values) again: their
+	// earlier hits are dropped, and those still in lightIndices are
+	// binned afresh.  Requires changedLights and lightIndices both
+	// ascending, and the projection unchanged since the last build;
+	// the lists then come out exactly as Build() would make them.
+	// Returns how many lights were binned.
+	unsigned int Update(const std::vector<Cone>& cones, const std::vector<unsigned int>& lightIndices, const std::vector<unsigned int>& changedLights);
+
+	// Clusters are ordered by slice, then row (top first), then column
+	static unsigned int ClusterIndex(unsigned int x, unsigned int y, unsigned int slice);
+	void GetClusterBounds(unsigned int x, unsigned int y, unsigned int slice, DirectX::XMFLOAT3& boundsMin, DirectX::XMFLOAT3& boundsMax);
+
+	// View depth of a slice's near side, Slices gives the far clip
+	float GetSliceDepth(unsigned int slice);
+
+	const std::vector<ClusterRange>& GetRanges() { return ranges; }
+	const std::vector<unsigned int>& GetLightIndices() { return lightIndexList; }
+
+private:
+	void BinSlice(unsigned int slice, const std::vector<Cone>& cones, const std::vector<unsigned int>& lightIndices, std::vector<unsigned int>& hits);
+	void MergeSlice(unsigned int slice);
+	void SortSlice(unsigned int slice);
+	void JoinSlices();
+
+	float xScale = 1.0f;
+	float yScale = 1.0f;
+	float nearClip = 0.1f;
+	float farClip = 100.0f;
+
+	std::vector<ClusterRange> ranges;
+	std::vector<unsigned int> lightIndexList;
+
+	// Each slice is binned into its own lists, then they're joined
+	struct SliceLists
+	{
+		std::vector<unsigned int> hits;			// Cluster (within the slice) and light pairs, by light
+		std::vector<unsigned int> counts;
+		std::vector<unsigned int> indices;
+		std::vector<unsigned int> freshHits;	// Changed lights' hits, while updating
+		std::vector<unsigned int> mergedHits;
+	};
+	SliceLists sliceLists[Slices];
+
+	// The lights being binned again, while updating
+	std::vector<unsigned char> changedMask;
+	std::vector<Cone> changedCones;
+	std::vector<unsigned int> changedIndices;
+};
@@ -0,0 +1,65 @@
+# --------------------------------------------------------
+# Compiles every lighting variant of PixelShader.hlsl (see
+# ShaderPermutations.h) next to the other .cso files, one
+# fxc process per variant, as many at once as there are
+# processors.  Run after FxCompile by the project's
+# CompileShaderVariants target.
+#
+# The setups and file names must match ShaderPermutations,
+# which Tests/ShaderPermutationsTests checks against the
+# assignments and file name below.
+# --------------------------------------------------------
+param(
+	[Parameter(Mandatory = $true)][string]$Fxc,
+	[Parameter(Mandatory = $true)][string]$OutDir,
+	[string]$Source = "$PSScriptRoot\PixelShader.hlsl",
+	[string]$Configuration = "Debug"
+)
+
+$maxDirectionalLights = 2
+$localLightBuckets = @(0, 8, 32)
+
+$flags = if ($Configuration -eq "Debug") { @("/Od", "/Zi") } else { @("/O3") }
+
+$variants = @()
+foreach ($d in 0..$maxDirectionalLights) {
+	foreach ($l in $localLightBuckets) {
+		foreach ($s in 0..1) {
+			foreach ($n in 0..1) {
+				$variants += [pscustomobject]@{
+					Output = Join-Path $OutDir "PixelShader_d${d}_l${l}_s${s}_n${n}.cso"
+					Defines = @("/DDIRECTIONAL_LIGHTS=$d", "/DLOCAL_LIGHT_LIMIT=$l", "/DSHADOWS=$s", "/DNORMAL_MAP=$n")
+				}
+			}
+		}
+	}
+}
+
+$running = @()
+$failed = 0
+$throttle = [Environment]::ProcessorCount
+foreach ($variant in $variants) {
+	while (@($running | Where-Object { -not $_.HasExited }).Count -ge $throttle) {
+		Start-Sleep -Milliseconds 50
+	}
+
+	$arguments = @("/nologo", "/T", "ps_5_0", "/E", "main") + $flags + $variant.Defines + @("/Fo", "`"$($variant.Output)`"", "`"$Source`"")
+	$process = Start-Process -FilePath $Fxc -ArgumentList $arguments -NoNewWindow -PassThru
+
+	# Holding the handle keeps the exit code readable after it exits
+	$null = $process.Handle
+	$running += $process
+}
+
+foreach ($process in $running) {
+	$process.WaitForExit()
+	if ($process.ExitCode -ne 0) {
+		$failed++
+	}
+}
+
+if ($failed -gt 0) {
+	Write-Error "$failed of $($variants.Count) pixel shader variants failed to compile"
+	exit 1
+}
+Write-Host "Compiled $($variants.Count) pixel shader variants"
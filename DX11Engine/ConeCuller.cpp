@@ -0,0 +1,264 @@
+#include "ConeCuller.h"
+#include "ShadowViews.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// How far past its apex a cone reaches along a unit axis:
+// its whole range if the axis is inside the cone, otherwise
+// to the edge direction nearest the axis
+// --------------------------------------------------------
+static float Reach(const Cone& cone, float axisX, float axisY, float axisZ)
+{
+	float along = axisX * cone.direction.x + axisY * cone.direction.y + axisZ * cone.direction.z;
+	float nearest = along >= cone.cosHalfAngle ? 1.0f :
+		along * cone.cosHalfAngle + sqrtf(std::max(0.0f, 1.0f - along * along)) * cone.sinHalfAngle;
+	return cone.range * std::max(nearest, 0.0f);
+}
+
+Cone ConeCuller::MakeCone(XMFLOAT3 apex, XMFLOAT3 direction, float halfAngle, float range)
+{
+	Cone cone;
+	cone.apex = apex;
+	cone.range = range;
+	XMStoreFloat3(&cone.direction, XMVector3Normalize(XMLoadFloat3(&direction)));
+
+	// Exactly -1 at pi, so IsSphere() can tell
+	halfAngle = std::max(0.0f, halfAngle);
+	cone.cosHalfAngle = halfAngle >= XM_PI ? -1.0f : cosf(halfAngle);
+	cone.sinHalfAngle = halfAngle >= XM_PI ? 0.0f : sinf(halfAngle);
+
+	// Wide cones are bounded by the sphere through their rim, narrow
+	// ones by the sphere through their apex and rim
+	XMVECTOR apexVec = XMLoadFloat3(&apex);
+	XMVECTOR directionVec = XMLoadFloat3(&cone.direction);
+	if (cone.cosHalfAngle <= 0.0f)
+	{
+		cone.sphere = XMFLOAT4(apex.x, apex.y, apex.z, range);
+	}
+	else if (cone.cosHalfAngle < XM_1DIVSQRT2)
+	{
+		XMStoreFloat4(&cone.sphere, XMVectorSetW(XMVectorAdd(apexVec, XMVectorScale(directionVec, range * cone.cosHalfAngle)), range * cone.sinHalfAngle));
+	}
+	else
+	{
+		float radius = range / (2.0f * cone.cosHalfAngle);
+		XMStoreFloat4(&cone.sphere, XMVectorSetW(XMVectorAdd(apexVec, XMVectorScale(directionVec, radius)), radius));
+	}
+
+	cone.boundsMin = XMFLOAT3(apex.x - Reach(cone, -1, 0, 0), apex.y - Reach(cone, 0, -1, 0), apex.z - Reach(cone, 0, 0, -1));
+	cone.boundsMax = XMFLOAT3(apex.x + Reach(cone, 1, 0, 0), apex.y + Reach(cone, 0, 1, 0), apex.z + Reach(cone, 0, 0, 1));
+	return cone;
+}
+
+Cone ConeCuller::FromLight(const Light& light)
+{
+	if (light.Type == LIGHT_TYPE_SPOT)
+		return MakeCone(light.Position, light.Direction, ShadowViews::SpotHalfAngle(light.SpotFalloff), light.Range);
+
+	return MakeCone(light.Position, XMFLOAT3(0.0f, 0.0f, 1.0f), XM_PI, light.Range);
+}
+
+XMVECTOR ConeCuller::IntersectBoxes(const Cone& cone, const BoxLanes& boxes)
+{
+	XMVECTOR zero = XMVectorZero();
+	XMVECTOR apexX = XMVectorReplicate(cone.apex.x);
+	XMVECTOR apexY = XMVectorReplicate(cone.apex.y);
+	XMVECTOR apexZ = XMVectorReplicate(cone.apex.z);
+	XMVECTOR range = XMVectorReplicate(cone.range);
+
+	// Overlaps the cone's box
+	XMVECTOR overlap = XMVectorTrueInt();
+	const float* coneMin = &cone.boundsMin.x;
+	const float* coneMax = &cone.boundsMax.x;
+	const XMVECTOR* centers[3] = { &boxes.centerX, &boxes.centerY, &boxes.centerZ };
+	const XMVECTOR* extents[3] = { &boxes.extentX, &boxes.extentY, &boxes.extentZ };
+	for (int axis = 0; axis < 3; axis++)
+	{
+		XMVECTOR coneCenter = XMVectorReplicate((coneMin[axis] + coneMax[axis]) * 0.5f);
+		XMVECTOR coneExtent = XMVectorReplicate((coneMax[axis] - coneMin[axis]) * 0.5f);
+		XMVECTOR gap = XMVectorAbs(XMVectorSubtract(*centers[axis], coneCenter));
+		overlap = XMVectorAndInt(overlap, XMVectorLessOrEqual(gap, XMVectorAdd(*extents[axis], coneExtent)));
+	}
+
+	// Reaches into the range sphere
+	XMVECTOR dx = XMVectorMax(zero, XMVectorSubtract(XMVectorAbs(XMVectorSubtract(boxes.centerX, apexX)), boxes.extentX));
+	XMVECTOR dy = XMVectorMax(zero, XMVectorSubtract(XMVectorAbs(XMVectorSubtract(boxes.centerY, apexY)), boxes.extentY));
+	XMVECTOR dz = XMVectorMax(zero, XMVectorSubtract(XMVectorAbs(XMVectorSubtract(boxes.centerZ, apexZ)), boxes.extentZ));
+	XMVECTOR distanceSq = XMVectorAdd(XMVectorAdd(XMVectorMultiply(dx, dx), XMVectorMultiply(dy, dy)), XMVectorMultiply(dz, dz));
+	XMVECTOR inRange = XMVectorLessOrEqual(distanceSq, XMVectorMultiply(range, range));
+
+	// Most boxes are far from most cones
+	XMVECTOR nearby = XMVectorAndInt(overlap, inRange);
+	if (XMVector4EqualInt(nearby, XMVectorFalseInt()))
+		return nearby;
+
+	// The box's sphere outside the cone's sides, past its cap or behind it
+	XMVECTOR radius = XMVectorSqrt(XMVectorAdd(XMVectorAdd(
+		XMVectorMultiply(boxes.extentX, boxes.extentX), XMVectorMultiply(boxes.extentY, boxes.extentY)), XMVectorMultiply(boxes.extentZ, boxes.extentZ)));
+	XMVECTOR vx = XMVectorSubtract(boxes.centerX, apexX);
+	XMVECTOR vy = XMVectorSubtract(boxes.centerY, apexY);
+	XMVECTOR vz = XMVectorSubtract(boxes.centerZ, apexZ);
+	XMVECTOR lengthSq = XMVectorAdd(XMVectorAdd(XMVectorMultiply(vx, vx), XMVectorMultiply(vy, vy)), XMVectorMultiply(vz, vz));
+	XMVECTOR along = XMVectorAdd(XMVectorAdd(
+		XMVectorMultiply(vx, XMVectorReplicate(cone.direction.x)), XMVectorMultiply(vy, XMVectorReplicate(cone.direction.y))), XMVectorMultiply(vz, XMVectorReplicate(cone.direction.z)));
+	XMVECTOR across = XMVectorSqrt(XMVectorMax(zero, XMVectorSubtract(lengthSq, XMVectorMultiply(along, along))));
+	XMVECTOR sideDistance = XMVectorSubtract(
+		XMVectorMultiply(across, XMVectorReplicate(cone.cosHalfAngle)), XMVectorMultiply(along, XMVectorReplicate(cone.sinHalfAngle)));
+
+	XMVECTOR outside = XMVectorOrInt(XMVectorGreater(sideDistance, radius), XMVectorGreater(along, XMVectorAdd(radius, range)));
+	if (cone.cosHalfAngle >= 0.0f)
+		outside = XMVectorOrInt(outside, XMVectorLess(along, XMVectorNegate(radius)));
+
+	return XMVectorAndCInt(nearby, outside);
+}
+
+XMVECTOR ConeCuller::OutsideFrustum(const Cone* cones, unsigned int count, const XMFLOAT4 planes[6])
+{
+	XMFLOAT4 apexX, apexY, apexZ, directionX, directionY, directionZ, range, cosHalfAngle, sinHalfAngle;
+	float* lanes[9] = { &apexX.x, &apexY.x, &apexZ.x, &directionX.x, &directionY.x, &directionZ.x, &range.x, &cosHalfAngle.x, &sinHalfAngle.x };
+	for (unsigned int lane = 0; lane < 4; lane++)
+	{
+		const Cone& cone = cones[std::min(lane, count - 1)];
+		lanes[0][lane] = cone.apex.x;
+		lanes[1][lane] = cone.apex.y;
+		lanes[2][lane] = cone.apex.z;
+		lanes[3][lane] = cone.direction.x;
+		lanes[4][lane] = cone.direction.y;
+		lanes[5][lane] = cone.direction.z;
+		lanes[6][lane] = cone.range;
+		lanes[7][lane] = cone.cosHalfAngle;
+		lanes[8][lane] = cone.sinHalfAngle;
+	}
+	XMVECTOR ax = XMLoadFloat4(&apexX), ay = XMLoadFloat4(&apexY), az = XMLoadFloat4(&apexZ);
+	XMVECTOR dx = XMLoadFloat4(&directionX), dy = XMLoadFloat4(&directionY), dz = XMLoadFloat4(&directionZ);
+	XMVECTOR r = XMLoadFloat4(&range);
+	XMVECTOR c = XMLoadFloat4(&cosHalfAngle);
+	XMVECTOR s = XMLoadFloat4(&sinHalfAngle);
+	XMVECTOR zero = XMVectorZero();
+	XMVECTOR one = XMVectorReplicate(1.0f);
+
+	XMVECTOR outside = XMVectorFalseInt();
+	for (int p = 0; p < 6; p++)
+	{
+		XMVECTOR nx = XMVectorReplicate(planes[p].x);
+		XMVECTOR ny = XMVectorReplicate(planes[p].y);
+		XMVECTOR nz = XMVectorReplicate(planes[p].z);
+		XMVECTOR apexDistance = XMVectorAdd(
+			XMVectorAdd(XMVectorMultiply(nx, ax), XMVectorMultiply(ny, ay)),
+			XMVectorAdd(XMVectorMultiply(nz, az), XMVectorReplicate(planes[p].w)));
+
+		// Reach() along the plane's normal
+		XMVECTOR along = XMVectorAdd(XMVectorAdd(XMVectorMultiply(nx, dx), XMVectorMultiply(ny, dy)), XMVectorMultiply(nz, dz));
+		XMVECTOR edge = XMVectorAdd(XMVectorMultiply(along, c),
+			XMVectorMultiply(XMVectorSqrt(XMVectorMax(zero, XMVectorSubtract(one, XMVectorMultiply(along, along)))), s));
+		XMVECTOR nearest = XMVectorSelect(edge, one, XMVectorGreaterOrEqual(along, c));
+		XMVECTOR reach = XMVectorMultiply(r, XMVectorMax(nearest, zero));
+
+		outside = XMVectorOrInt(outside, XMVectorLess(XMVectorAdd(apexDistance, reach), zero));
+	}
+	return outside;
+}
+
+void ConeCuller::PackBoxes(const std::vector<BoundingBox>& boxes, std::vector<BoxLanes>& lanes)
+{
+	unsigned int count = (unsigned int)boxes.size();
+	lanes.resize((count + 3) / 4);
+	for (unsigned int first = 0; first < count; first += 4)
+	{
+		XMFLOAT4 centerX, centerY, centerZ, extentX, extentY, extentZ;
+		float* values[6] = { &centerX.x, &centerY.x, &centerZ.x, &extentX.x, &extentY.x, &extentZ.x };
+		for (unsigned int lane = 0; lane < 4; lane++)
+		{
+			const BoundingBox& box = boxes[std::min(first + lane, count - 1)];
+			values[0][lane] = box.Center.x;
+			values[1][lane] = box.Center.y;
+			values[2][lane] = box.Center.z;
+			values[3][lane] = box.Extents.x;
+			values[4][lane] = box.Extents.y;
+			values[5][lane] = box.Extents.z;
+		}
+
+		BoxLanes& boxLanes = lanes[first / 4];
+		boxLanes.centerX = XMLoadFloat4(&centerX);
+		boxLanes.centerY = XMLoadFloat4(&centerY);
+		boxLanes.centerZ = XMLoadFloat4(&centerZ);
+		boxLanes.extentX = XMLoadFloat4(&extentX);
+		boxLanes.extentY = XMLoadFloat4(&extentY);
+		boxLanes.extentZ = XMLoadFloat4(&extentZ);
+	}
+}
+
+void ConeCuller::CullBoxes(const Cone& cone, const std::vector<BoxLanes>& lanes, unsigned int boxCount, std::vector<unsigned char>& hits)
+{
+	// Padded lanes aren't stored
+	hits.resize(boxCount);
+	for (unsigned int first = 0; first < boxCount; first += 4)
+	{
+		uint32_t mask[4];
+		XMStoreInt4(mask, IntersectBoxes(cone, lanes[first / 4]));
+		for (unsigned int lane = 0; lane < 4 && first + lane < boxCount; lane++)
+			hits[first + lane] = mask[lane] ? 1 : 0;
+	}
+}
+
+void ConeCuller::CullCones(const std::vector<Cone>& cones, const XMFLOAT4 planes[6], std::vector<unsigned char>& visible)
+{
+	unsigned int count = (unsigned int)cones.size();
+	visible.resize(count);
+	for (unsigned int first = 0; first < count; first += 4)
+	{
+		uint32_t mask[4];
+		XMStoreInt4(mask, OutsideFrustum(&cones[first], std::min(4u, count - first), planes));
+		for (unsigned int lane = 0; lane < 4 && first + lane < count; lane++)
+			visible[first + lane] = mask[lane] ? 0 : 1;
+	}
+}
+
+bool ConeCuller::IntersectsBox(const Cone& cone, const BoundingBox& box)
+{
+	const float* apex = &cone.apex.x;
+	const float* coneMin = &cone.boundsMin.x;
+	const float* coneMax = &cone.boundsMax.x;
+	const float* center = &box.Center.x;
+	const float* extents = &box.Extents.x;
+
+	float distanceSq = 0.0f;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float gap = fabsf(center[axis] - (coneMin[axis] + coneMax[axis]) * 0.5f);
+		if (gap > extents[axis] + (coneMax[axis] - coneMin[axis]) * 0.5f)
+			return false;
+
+		float d = std::max(0.0f, fabsf(center[axis] - apex[axis]) - extents[axis]);
+		distanceSq += d * d;
+	}
+	if (distanceSq > cone.range * cone.range)
+		return false;
+
+	float radius = sqrtf(extents[0] * extents[0] + extents[1] * extents[1] + extents[2] * extents[2]);
+	float vx = center[0] - apex[0], vy = center[1] - apex[1], vz = center[2] - apex[2];
+	float lengthSq = vx * vx + vy * vy + vz * vz;
+	float along = vx * cone.direction.x + vy * cone.direction.y + vz * cone.direction.z;
+	float across = sqrtf(std::max(0.0f, lengthSq - along * along));
+	if (across * cone.cosHalfAngle - along * cone.sinHalfAngle > radius)
+		return false;
+	if (along > radius + cone.range)
+		return false;
+	return cone.cosHalfAngle < 0.0f || along >= -radius;
+}
+
+bool ConeCuller::IntersectsFrustum(const Cone& cone, const XMFLOAT4 planes[6])
+{
+	for (int p = 0; p < 6; p++)
+	{
+		float apexDistance = planes[p].x * cone.apex.x + planes[p].y * cone.apex.y + planes[p].z * cone.apex.z + planes[p].w;
+		if (apexDistance + Reach(cone, planes[p].x, planes[p].y, planes[p].z) < 0.0f)
+			return false;
+	}
+	return true;
+}
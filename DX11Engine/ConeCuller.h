@@ -0,0 +1,80 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <vector>
+#include "Lights.h"
+
+// --------------------------------------------------------
+// The volume a light reaches: every direction within the
+// half angle of its direction, out to its range, so a cone
+// with a spherical cap.  Point lights are cones with a half
+// angle of pi, which the same tests treat as their range's
+// sphere.  Made by ConeCuller, which fills in the bounds.
+// --------------------------------------------------------
+struct Cone
+{
+	DirectX::XMFLOAT3 apex;
+	float range;
+	DirectX::XMFLOAT3 direction;	// Unit length
+	float cosHalfAngle;
+	float sinHalfAngle;
+	DirectX::XMFLOAT4 sphere;		// The smallest sphere around it, radius in w
+	DirectX::XMFLOAT3 boundsMin;	// The smallest box around it
+	DirectX::XMFLOAT3 boundsMax;
+};
+
+// Four boxes, one to a lane
+struct BoxLanes
+{
+	DirectX::XMVECTOR centerX, centerY, centerZ;
+	DirectX::XMVECTOR extentX, extentY, extentZ;
+};
+
+// --------------------------------------------------------
+// Culls boxes and views against cones, so spot lights only
+// cost where their cone reaches instead of everywhere in
+// their range.
+//
+// A box touches a cone if it overlaps the cone's box and
+// range sphere, and its bounding sphere isn't outside the
+// cone's sides or past its cap.  A cone is outside a view
+// if for some plane the furthest the cone reaches along the
+// plane's normal still falls short of it, which is exact
+// for a capped cone.  Both tests are conservative, like
+// FrustumCuller's.
+//
+// The SIMD tests take one cone against four boxes, or four
+// cones against one view, and agree with the scalar ones
+// (ConeCullerTests checks them against each other).
+// --------------------------------------------------------
+class ConeCuller
+{
+public:
+	static Cone MakeCone(DirectX::XMFLOAT3 apex, DirectX::XMFLOAT3 direction, float halfAngle, float range);
+
+	// Spot lights out to ShadowViews::SpotHalfAngle(), point lights all round
+	static Cone FromLight(const Light& light);
+
+	static bool IsSphere(const Cone& cone) { return cone.cosHalfAngle <= -1.0f; }
+
+	// All ones in the lanes of the boxes that touch the cone
+	static DirectX::XMVECTOR IntersectBoxes(const Cone& cone, const BoxLanes& boxes);
+
+	// All ones in the lanes of the cones (up to four, the last one
+	// repeated) entirely outside the inward facing planes
+	static DirectX::XMVECTOR OutsideFrustum(const Cone* cones, unsigned int count, const DirectX::XMFLOAT4 planes[6]);
+
+	// Boxes four to a BoxLanes, the last one repeated, so many cones
+	// can be tested against them without packing them again
+	static void PackBoxes(const std::vector<DirectX::BoundingBox>& boxes, std::vector<BoxLanes>& lanes);
+
+	// The same tests over whole lists, four at a time, with hits and
+	// visible ending up the same size as the lists
+	static void CullBoxes(const Cone& cone, const std::vector<BoxLanes>& lanes, unsigned int boxCount, std::vector<unsigned char>& hits);
+	static void CullCones(const std::vector<Cone>& cones, const DirectX::XMFLOAT4 planes[6], std::vector<unsigned char>& visible);
+
+	// One at a time, for checking the SIMD tests
+	static bool IntersectsBox(const Cone& cone, const DirectX::BoundingBox& box);
+	static bool IntersectsFrustum(const Cone& cone, const DirectX::XMFLOAT4 planes[6]);
+};
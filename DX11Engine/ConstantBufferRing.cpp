@@ -0,0 +1,123 @@
+#include "ConstantBufferRing.h"
+
+ConstantBufferRing::ConstantBufferRing(Microsoft::WRL::ComPtr<ID3D11Device> p_device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int sizeInBytes)
+	: allocator(sizeInBytes, ConstantAlignment)
+{
+	device = p_device;
+	supported = false;
+	hasDiscarded = false;
+	frameIndex = 0;
+
+	// Offset binding needs an 11.1 context, and the driver must
+	// allow offsets and NO_OVERWRITE on dynamic constant buffers
+	if (FAILED(context.As(&context1)))
+		return;
+
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options));
+	if (!options.ConstantBufferOffsetting || !options.MapNoOverwriteOnDynamicConstantBuffer)
+		return;
+
+	// The ring itself
+	D3D11_BUFFER_DESC desc = {};
+	desc.ByteWidth = sizeInBytes;
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	if (FAILED(device->CreateBuffer(&desc, 0, buffer.GetAddressOf())))
+		return;
+
+	// Event queries act as our per-frame fences
+	D3D11_QUERY_DESC queryDesc = {};
+	queryDesc.Query = D3D11_QUERY_EVENT;
+	for (unsigned int i = 0; i < MaxQueries; i++)
+	{
+		Microsoft::WRL::ComPtr<ID3D11Query> query;
+		device->CreateQuery(&queryDesc, query.GetAddressOf());
+		freeQueries.push_back(query);
+	}
+
+	supported = true;
+}
+
+ConstantBufferRing::~ConstantBufferRing()
+{
+}
+
+// --------------------------------------------------------
+// Frees ring space from any frames the GPU has finished
+// --------------------------------------------------------
+void ConstantBufferRing::BeginFrame()
+{
+	if (!supported) return;
+
+	while (!pendingFrames.empty())
+	{
+		// Don't flush, we only want to know if it's done already
+		BOOL done = FALSE;
+		HRESULT hr = context1->GetData(pendingFrames.front().query.Get(), &done, sizeof(done), D3D11_ASYNC_GETDATA_DONOTFLUSH);
+		if (hr != S_OK || !done)
+			break;
+
+		allocator.Retire(pendingFrames.front().frameIndex);
+		freeQueries.push_back(pendingFrames.front().query);
+		pendingFrames.pop_front();
+	}
+}
+
+// --------------------------------------------------------
+// Fences everything written this frame.  If every query is
+// still in flight, this frame's ranges join the next fence.
+// --------------------------------------------------------
+void ConstantBufferRing::EndFrame()
+{
+	if (!supported) return;
+
+	if (!freeQueries.empty())
+	{
+		PendingFrame pending = { frameIndex, freeQueries.back() };
+		freeQueries.pop_back();
+
+		context1->End(pending.query.Get());
+		allocator.Fence(frameIndex);
+		pendingFrames.push_back(pending);
+	}
+
+	frameIndex++;
+}
+
+// --------------------------------------------------------
+// Copies constant data into the next free range of the ring
+//
+// data - the data to copy
+// size - the size of the data in bytes
+// firstConstant, numConstants - receive the range to pass
+//                               to *SetConstantBuffers1()
+//
+// Returns false if the ring is full
+// --------------------------------------------------------
+bool ConstantBufferRing::Write(const void* data, unsigned int size, UINT& firstConstant, UINT& numConstants)
+{
+	if (!supported) return false;
+
+	unsigned int offset = 0;
+	if (!allocator.Allocate(size, offset))
+		return false;
+
+	// The first map has to discard, after that the fences
+	// guarantee we never touch a range the GPU might be reading
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	D3D11_MAP mapType = hasDiscarded ? D3D11_MAP_WRITE_NO_OVERWRITE : D3D11_MAP_WRITE_DISCARD;
+	if (FAILED(context1->Map(buffer.Get(), 0, mapType, 0, &mapped)))
+		return false;
+
+	memcpy((unsigned char*)mapped.pData + offset, data, size);
+	context1->Unmap(buffer.Get(), 0);
+	hasDiscarded = true;
+
+	// Ranges are measured in 16-byte constants, and the count
+	// must also be a multiple of 16
+	firstConstant = offset / 16;
+	numConstants = ((size + ConstantAlignment - 1) / ConstantAlignment) * (ConstantAlignment / 16);
+	return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <wrl/client.h>
+#include <vector>
+#include <deque>
+#include "RingAllocator.h"
+
+// --------------------------------------------------------
+// One large dynamic constant buffer that every shader's
+// constants are written into, bound per draw by offset with
+// the Direct3D 11.1 *SetConstantBuffers1() functions.
+//
+// Writes use MAP_WRITE_NO_OVERWRITE, and an event query per
+// frame tells us when the GPU is done with older ranges.
+// IsSupported() is false when the driver can't do offset
+// binding, and shaders keep using their own buffers.
+// --------------------------------------------------------
+class ConstantBufferRing
+{
+public:
+	ConstantBufferRing(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int sizeInBytes);
+	~ConstantBufferRing();
+
+	bool IsSupported() { return supported; }
+
+	// Frame boundaries for fencing
+	void BeginFrame();
+	void EndFrame();
+
+	// Copies data into the ring, returning the range to bind
+	bool Write(const void* data, unsigned int size, UINT& firstConstant, UINT& numConstants);
+
+	unsigned long long GetFrameIndex() { return frameIndex; }
+	ID3D11Buffer* GetBuffer() { return buffer.Get(); }
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> GetContext1() { return context1; }
+
+private:
+	// Offsets must be a multiple of 16 constants (256 bytes)
+	static const unsigned int ConstantAlignment = 256;
+	static const unsigned int MaxQueries = 4;
+
+	struct PendingFrame
+	{
+		unsigned long long frameIndex;
+		Microsoft::WRL::ComPtr<ID3D11Query> query;
+	};
+
+	bool supported;
+	bool hasDiscarded;
+	unsigned long long frameIndex;
+
+	RingAllocator allocator;
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> context1;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+
+	std::deque<PendingFrame> pendingFrames;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11Query>> freeQueries;
+};
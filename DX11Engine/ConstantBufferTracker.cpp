@@ -0,0 +1,82 @@
+#include "ConstantBufferTracker.h"
+
+#include <algorithm>
+#include <cstring>
+
+void ConstantBufferTracker::Init(unsigned int p_size)
+{
+	size = p_size;
+	uploadedData.assign(size, 0);
+	dirtyStart = 0;
+	dirtyEnd = size;
+	hasUploaded = false;
+	compareBudget = CompareBudgetMax;
+	uploadsSinceCompare = 0;
+}
+
+void ConstantBufferTracker::MarkDirty(unsigned int offset, unsigned int p_size)
+{
+	if (p_size == 0) return;
+
+	if (dirtyStart == dirtyEnd)
+	{
+		// Nothing dirty yet, so this becomes the range
+		dirtyStart = offset;
+		dirtyEnd = offset + p_size;
+	}
+	else
+	{
+		dirtyStart = std::min(dirtyStart, offset);
+		dirtyEnd = std::max(dirtyEnd, offset + p_size);
+	}
+}
+
+// --------------------------------------------------------
+// Clean buffers never need uploading, and the dirty range
+// is compared against the last uploaded data since Set*()
+// calls often write the same values again
+// --------------------------------------------------------
+bool ConstantBufferTracker::NeedsUpload(const unsigned char* localData)
+{
+	if (dirtyStart == dirtyEnd)
+		return false;
+
+	// Nothing to compare against until the first upload
+	if (!hasUploaded)
+		return true;
+
+	// Periodically give buffers that stopped comparing another chance
+	if (compareBudget <= 0 && uploadsSinceCompare >= CompareRetryInterval)
+		compareBudget = 1;
+
+	if (compareBudget <= 0)
+		return true;
+
+	uploadsSinceCompare = 0;
+	bool changed = memcmp(
+		localData + dirtyStart,
+		uploadedData.data() + dirtyStart,
+		dirtyEnd - dirtyStart) != 0;
+
+	if (changed)
+	{
+		compareBudget--;
+		return true;
+	}
+
+	// Same data as the GPU already has, so the range is clean again
+	compareBudget = CompareBudgetMax;
+	dirtyStart = dirtyEnd = 0;
+	return false;
+}
+
+void ConstantBufferTracker::FinishUpload(const unsigned char* localData)
+{
+	memcpy(
+		uploadedData.data() + dirtyStart,
+		localData + dirtyStart,
+		dirtyEnd - dirtyStart);
+	dirtyStart = dirtyEnd = 0;
+	hasUploaded = true;
+	uploadsSinceCompare++;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+
+// --------------------------------------------------------
+// Decides when a constant buffer's local data needs to go
+// to the GPU.  Only bytes in the dirty range have been set
+// since the last upload, and a mirror of what the GPU holds
+// lets rewrites of the same values be skipped.
+//
+// Comparing is only worth it while it keeps finding
+// unchanged data, so buffers that always change (like per
+// object data) stop comparing after a few misses and just
+// check back every CompareRetryInterval uploads.
+//
+// The caller does the actual upload, so this class has no
+// knowledge of Direct3D.
+// --------------------------------------------------------
+class ConstantBufferTracker
+{
+public:
+	// How many missed comparisons a buffer gets before it stops
+	// comparing, and how often it tries again after that
+	static const int CompareBudgetMax = 4;
+	static const int CompareRetryInterval = 64;
+
+	// Sizes the mirror, with the whole buffer dirty since the GPU
+	// copy starts out undefined
+	void Init(unsigned int size);
+
+	// Grows the dirty range to include the given bytes
+	void MarkDirty(unsigned int offset, unsigned int size);
+
+	// False if localData matches what was last uploaded, in which
+	// case the dirty range is cleared
+	bool NeedsUpload(const unsigned char* localData);
+
+	// Records that the GPU now holds localData
+	void FinishUpload(const unsigned char* localData);
+
+	bool IsDirty() const { return dirtyStart != dirtyEnd; }
+	unsigned int GetDirtyStart() const { return dirtyStart; }
+	unsigned int GetDirtyEnd() const { return dirtyEnd; }
+	bool HasUploaded() const { return hasUploaded; }
+	bool IsComparing() const { return compareBudget > 0; }
+
+private:
+	std::vector<unsigned char> uploadedData;
+	unsigned int size = 0;
+	unsigned int dirtyStart = 0;
+	unsigned int dirtyEnd = 0;
+	bool hasUploaded = false;
+	int compareBudget = 0;			// Comparisons left before giving up on this buffer
+	int uploadsSinceCompare = 0;
+};
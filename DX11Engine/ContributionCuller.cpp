@@ -0,0 +1,101 @@
+#include "ContributionCuller.h"
+
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Measures size in pixels through a perspective projection
+// --------------------------------------------------------
+void ContributionCuller::SetPerspective(float projectionScale, float viewportHeight, float minPixels)
+{
+	orthographic = false;
+
+	// Clip space spans two units over the viewport's height
+	pixelsPerUnit = projectionScale * viewportHeight * 0.5f;
+	minSize = minPixels;
+}
+
+// --------------------------------------------------------
+// Measures size in texels of a square orthographic map
+// --------------------------------------------------------
+void ContributionCuller::SetOrthographic(float projectionSize, unsigned int resolution, float minTexels)
+{
+	orthographic = true;
+	pixelsPerUnit = resolution / projectionSize;
+	minSize = minTexels;
+}
+
+// --------------------------------------------------------
+// Projected diameter of a sphere.  For perspective this is
+// the size of the sphere's silhouette, which doesn't change
+// as the camera turns, so entities near the edge of the
+// screen don't pop as the view rotates.
+// --------------------------------------------------------
+float ContributionCuller::ProjectedSize(XMFLOAT3 eyePosition, const BoundingSphere& sphere)
+{
+	if (orthographic)
+		return 2.0f * sphere.Radius * pixelsPerUnit;
+
+	float dx = sphere.Center.x - eyePosition.x;
+	float dy = sphere.Center.y - eyePosition.y;
+	float dz = sphere.Center.z - eyePosition.z;
+	float distanceSq = dx * dx + dy * dy + dz * dz;
+	float radiusSq = sphere.Radius * sphere.Radius;
+
+	// Inside the sphere it covers the whole view
+	if (distanceSq <= radiusSq)
+		return FLT_MAX;
+
+	return 2.0f * sphere.Radius * pixelsPerUnit / sqrtf(distanceSq - radiusSq);
+}
+
+// --------------------------------------------------------
+// Something already shown stays until it drops below the
+// size threshold or passes its draw distance plus the band;
+// something hidden needs the size threshold plus the band
+// and to be inside its draw distance to come back
+// --------------------------------------------------------
+bool ContributionCuller::Keep(float projectedSize, float distance, float drawDistance, bool wasKept)
+{
+	float sizeThreshold = wasKept ? minSize : minSize * (1.0f + hysteresis);
+	if (projectedSize < sizeThreshold)
+		return false;
+
+	if (drawDistance <= 0.0f)
+		return true;
+
+	float distanceLimit = wasKept ? drawDistance * (1.0f + hysteresis) : drawDistance;
+	return distance <= distanceLimit;
+}
+
+void ContributionCuller::Cull(
+	XMFLOAT3 eyePosition,
+	const std::vector<BoundingSphere>& spheres,
+	const std::vector<float>& drawDistances,
+	std::vector<unsigned int>& entities)
+{
+	unsigned int keptCount = 0;
+	for (unsigned int i = 0; i < entities.size(); i++)
+	{
+		unsigned int entity = entities[i];
+
+		// Entities not seen before count as shown
+		if (entity >= kept.size())
+			kept.resize(entity + 1, 1);
+
+		const BoundingSphere& sphere = spheres[i];
+		float dx = sphere.Center.x - eyePosition.x;
+		float dy = sphere.Center.y - eyePosition.y;
+		float dz = sphere.Center.z - eyePosition.z;
+		float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+
+		bool keep = Keep(ProjectedSize(eyePosition, sphere), distance, drawDistances[i], kept[entity] != 0);
+		kept[entity] = keep;
+		if (keep)
+			entities[keptCount++] = entity;
+	}
+
+	entities.resize(keptCount);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <vector>
+
+// --------------------------------------------------------
+// Drops entities that would cover too little of a view to
+// be worth a draw, and entities past their draw distance.
+//
+// Size is the bounding sphere's diameter in pixels for a
+// perspective view, or in shadow map texels for an
+// orthographic one.  Each entity's last result is kept so
+// the thresholds can have a hysteresis band: something
+// hidden has to grow past the size threshold (or come
+// inside its draw distance) by the band's fraction before
+// it returns, so an entity sitting right on a threshold
+// doesn't flicker in and out.
+//
+// Only bounding spheres and entity indices go in, so it
+// runs before anything is recorded for the GPU.  Use one
+// per view, as the hysteresis state is kept per entity.
+// --------------------------------------------------------
+class ContributionCuller
+{
+public:
+	// projectionScale - the projection matrix's y scale, 1 / tan(fovY / 2)
+	// viewportHeight  - in pixels
+	void SetPerspective(float projectionScale, float viewportHeight, float minPixels);
+
+	// projectionSize - width and height of the view volume in world units
+	void SetOrthographic(float projectionSize, unsigned int resolution, float minTexels);
+
+	void SetHysteresis(float fraction) { hysteresis = fraction; }
+
+	// Removes culled entities from a list of entity indices.  Spheres
+	// and draw distances (0 for none) line up with the list, and draw
+	// distance is measured from eyePosition.
+	void Cull(
+		DirectX::XMFLOAT3 eyePosition,
+		const std::vector<DirectX::BoundingSphere>& spheres,
+		const std::vector<float>& drawDistances,
+		std::vector<unsigned int>& entities);
+
+	// Diameter in pixels or texels, depending on the projection
+	float ProjectedSize(DirectX::XMFLOAT3 eyePosition, const DirectX::BoundingSphere& sphere);
+
+	// The decision for one entity, given whether it was kept last time
+	bool Keep(float projectedSize, float distance, float drawDistance, bool wasKept);
+
+	// Forgets every entity's last result
+	void Reset() { kept.clear(); }
+
+private:
+	bool orthographic = false;
+	float pixelsPerUnit = 0.0f;		// At unit distance for perspective
+	float minSize = 0.0f;
+	float hysteresis = 0.1f;
+
+	std::vector<unsigned char> kept;	// Per entity index, last result
+};
@@ -1,12 +1,17 @@
 #include "ShaderInclude.hlsli"
 
-// Declaring constant buffer
-cbuffer ExternalData : register(b0)
+// Uploaded once per frame
+cbuffer PerFrame : register(b0)
 {
-	float4 colorTint;
 	float totalTime;
 }
 
+// Uploaded only when the bound material changes
+cbuffer PerMaterial : register(b1)
+{
+	float4 colorTint;
+}
+
 // --------------------------------------------------------
 // The entry point (main method) for our pixel shader
 // 
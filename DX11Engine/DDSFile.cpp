@@ -0,0 +1,269 @@
+#include "DDSFile.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+using namespace DirectX;
+
+// Layouts from the DDS documentation, "DDS_HEADER" and "DDS_HEADER_DXT10"
+struct DDSPixelFormat
+{
+	uint32_t size;
+	uint32_t flags;
+	uint32_t fourCC;
+	uint32_t rgbBitCount;
+	uint32_t rBitMask;
+	uint32_t gBitMask;
+	uint32_t bBitMask;
+	uint32_t aBitMask;
+};
+
+struct DDSHeader
+{
+	uint32_t size;
+	uint32_t flags;
+	uint32_t height;
+	uint32_t width;
+	uint32_t pitchOrLinearSize;
+	uint32_t depth;
+	uint32_t mipMapCount;
+	uint32_t reserved1[11];
+	DDSPixelFormat pixelFormat;
+	uint32_t caps;
+	uint32_t caps2;
+	uint32_t caps3;
+	uint32_t caps4;
+	uint32_t reserved2;
+};
+
+struct DDSHeaderDX10
+{
+	uint32_t dxgiFormat;
+	uint32_t resourceDimension;
+	uint32_t miscFlag;
+	uint32_t arraySize;
+	uint32_t miscFlags2;
+};
+
+static const uint32_t DDSMagic = 0x20534444;				// "DDS "
+static const uint32_t FourCCDX10 = 0x30315844;			// "DX10"
+static const uint32_t FourCCRGBA16Float = 113;			// D3DFMT_A16B16G16R16F
+static const uint32_t FourCCRGBA32Float = 116;			// D3DFMT_A32B32G32R32F
+static const uint32_t HeaderFlags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000;	// Caps, height, width, pixel format, mip count
+static const uint32_t PixelFormatFourCC = 0x4;
+static const uint32_t PixelFormatRGB = 0x40;
+static const uint32_t CapsTexture = 0x1000;
+static const uint32_t CapsComplex = 0x8;
+static const uint32_t CapsMipMap = 0x400000;
+static const uint32_t Caps2CubeMap = 0x200 | 0xFC00;		// And all six faces
+static const uint32_t DimensionTexture2D = 3;
+static const uint32_t MiscTextureCube = 0x4;
+
+static void WriteHeaders(std::ofstream& file, unsigned int width, unsigned int height, unsigned int mipCount, DDSFormat format, bool cube)
+{
+	DDSHeader header = {};
+	header.size = sizeof(DDSHeader);
+	header.flags = HeaderFlags;
+	header.height = height;
+	header.width = width;
+	header.mipMapCount = mipCount;
+	header.pixelFormat.size = sizeof(DDSPixelFormat);
+	header.pixelFormat.flags = PixelFormatFourCC;
+	header.pixelFormat.fourCC = FourCCDX10;
+	header.caps = CapsTexture | (mipCount > 1 || cube ? CapsComplex : 0) | (mipCount > 1 ? CapsMipMap : 0);
+	header.caps2 = cube ? Caps2CubeMap : 0;
+
+	DDSHeaderDX10 headerDX10 = {};
+	headerDX10.dxgiFormat = format;
+	headerDX10.resourceDimension = DimensionTexture2D;
+	headerDX10.miscFlag = cube ? MiscTextureCube : 0;
+	headerDX10.arraySize = 1;
+
+	file.write((const char*)&DDSMagic, sizeof(DDSMagic));
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)&headerDX10, sizeof(headerDX10));
+}
+
+// --------------------------------------------------------
+// Faces are stored one after another, each with its whole
+// mip chain
+// --------------------------------------------------------
+bool DDSFile::WriteCubeMap(const std::string& path, const std::vector<CubeFaces>& mips)
+{
+	if (mips.empty())
+		return false;
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	WriteHeaders(file, mips[0].size, mips[0].size, (unsigned int)mips.size(), DDSFormatR32G32B32A32Float, true);
+	for (unsigned int face = 0; face < 6; face++)
+	{
+		for (size_t mip = 0; mip < mips.size(); mip++)
+		{
+			const std::vector<XMFLOAT4>& texels = mips[mip].faces[face];
+			file.write((const char*)texels.data(), texels.size() * sizeof(XMFLOAT4));
+		}
+	}
+
+	file.close();
+	return !file.fail();
+}
+
+bool DDSFile::WriteTexture(const std::string& path, unsigned int width, unsigned int height, const std::vector<XMFLOAT2>& texels)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	WriteHeaders(file, width, height, 1, DDSFormatR32G32Float, false);
+	file.write((const char*)texels.data(), texels.size() * sizeof(XMFLOAT2));
+
+	file.close();
+	return !file.fail();
+}
+
+bool DDSFile::WriteTexture(const std::string& path, unsigned int width, unsigned int height, const std::vector<XMFLOAT4>& texels)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	WriteHeaders(file, width, height, 1, DDSFormatR32G32B32A32Float, false);
+	file.write((const char*)texels.data(), texels.size() * sizeof(XMFLOAT4));
+
+	file.close();
+	return !file.fail();
+}
+
+static float HalfToFloat(uint16_t half)
+{
+	uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+	uint32_t exponent = (half >> 10) & 0x1F;
+	uint32_t mantissa = half & 0x3FF;
+
+	uint32_t bits;
+	if (exponent == 0x1F)
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	else if (exponent != 0)
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	else if (mantissa == 0)
+		bits = sign;
+	else
+	{
+		// Denormal, renormalize it
+		exponent = 113;
+		while (!(mantissa & 0x400))
+		{
+			mantissa <<= 1;
+			exponent--;
+		}
+		bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+	}
+
+	float result;
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+static unsigned int BytesPerTexel(DDSFormat format)
+{
+	switch (format)
+	{
+	case DDSFormatR32G32B32A32Float: return 16;
+	case DDSFormatR16G16B16A16Float: return 8;
+	case DDSFormatR8G8B8A8Unorm:
+	case DDSFormatR8G8B8A8UnormSRGB:
+	case DDSFormatB8G8R8A8Unorm:
+	case DDSFormatB8G8R8A8UnormSRGB: return 4;
+	default: return 0;
+	}
+}
+
+static XMFLOAT4 DecodeTexel(const unsigned char* texel, DDSFormat format)
+{
+	switch (format)
+	{
+	case DDSFormatR32G32B32A32Float:
+	{
+		XMFLOAT4 result;
+		memcpy(&result, texel, sizeof(result));
+		return result;
+	}
+	case DDSFormatR16G16B16A16Float:
+	{
+		uint16_t halves[4];
+		memcpy(halves, texel, sizeof(halves));
+		return XMFLOAT4(HalfToFloat(halves[0]), HalfToFloat(halves[1]), HalfToFloat(halves[2]), HalfToFloat(halves[3]));
+	}
+	case DDSFormatB8G8R8A8Unorm:
+	case DDSFormatB8G8R8A8UnormSRGB:
+		return XMFLOAT4(texel[2] / 255.0f, texel[1] / 255.0f, texel[0] / 255.0f, texel[3] / 255.0f);
+	default:
+		return XMFLOAT4(texel[0] / 255.0f, texel[1] / 255.0f, texel[2] / 255.0f, texel[3] / 255.0f);
+	}
+}
+
+// --------------------------------------------------------
+// Works out the format from either header, then reads the
+// first mip of each face and skips the rest of its chain
+// --------------------------------------------------------
+bool DDSFile::ReadCubeMap(const std::string& path, CubeFaces& cube)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	uint32_t magic = 0;
+	DDSHeader header = {};
+	bool valid =
+		file.read((char*)&magic, sizeof(magic)) && magic == DDSMagic &&
+		file.read((char*)&header, sizeof(header)) &&
+		(header.caps2 & Caps2CubeMap) == Caps2CubeMap &&
+		header.width == header.height;
+
+	DDSFormat format = DDSFormatUnknown;
+	if (valid && (header.pixelFormat.flags & PixelFormatFourCC))
+	{
+		if (header.pixelFormat.fourCC == FourCCDX10)
+		{
+			DDSHeaderDX10 headerDX10 = {};
+			valid = file.read((char*)&headerDX10, sizeof(headerDX10)) && headerDX10.arraySize == 1;
+			format = (DDSFormat)headerDX10.dxgiFormat;
+		}
+		else if (header.pixelFormat.fourCC == FourCCRGBA16Float)
+			format = DDSFormatR16G16B16A16Float;
+		else if (header.pixelFormat.fourCC == FourCCRGBA32Float)
+			format = DDSFormatR32G32B32A32Float;
+	}
+	else if (valid && (header.pixelFormat.flags & PixelFormatRGB) && header.pixelFormat.rgbBitCount == 32)
+	{
+		format = header.pixelFormat.rBitMask == 0xFF ? DDSFormatR8G8B8A8Unorm : DDSFormatB8G8R8A8Unorm;
+	}
+
+	unsigned int texelBytes = BytesPerTexel(format);
+	if (!valid || texelBytes == 0)
+		return false;
+
+	// Every mip after the first is skipped
+	unsigned int size = header.width;
+	unsigned int mipCount = header.mipMapCount > 0 ? header.mipMapCount : 1;
+	long chainBytes = 0;
+	for (unsigned int mip = 1, mipSize = size / 2; mip < mipCount; mip++, mipSize /= 2)
+		chainBytes += (long)(mipSize > 0 ? mipSize : 1) * (mipSize > 0 ? mipSize : 1) * texelBytes;
+
+	std::vector<unsigned char> raw((size_t)size * size * texelBytes);
+	cube.size = size;
+	for (unsigned int face = 0; face < 6 && valid; face++)
+	{
+		valid = (bool)file.read((char*)raw.data(), raw.size());
+		file.seekg(chainBytes, std::ios::cur);
+		cube.faces[face].resize((size_t)size * size);
+		for (size_t i = 0; i < cube.faces[face].size() && valid; i++)
+			cube.faces[face][i] = DecodeTexel(&raw[i * texelBytes], format);
+	}
+
+	return valid;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+
+// The few DXGI formats DDSFile reads or writes, with DXGI's values, so
+// it doesn't need the D3D headers
+enum DDSFormat
+{
+	DDSFormatUnknown = 0,
+	DDSFormatR32G32B32A32Float = 2,
+	DDSFormatR16G16B16A16Float = 10,
+	DDSFormatR32G32Float = 16,
+	DDSFormatR8G8B8A8Unorm = 28,
+	DDSFormatR8G8B8A8UnormSRGB = 29,
+	DDSFormatB8G8R8A8Unorm = 87,
+	DDSFormatB8G8R8A8UnormSRGB = 91,
+};
+
+// A cube map's six faces at one size, in D3D11's face order
+// (+X, -X, +Y, -Y, +Z, -Z), each size * size texels, rows top first
+struct CubeFaces
+{
+	unsigned int size;
+	std::vector<DirectX::XMFLOAT4> faces[6];
+};
+
+// --------------------------------------------------------
+// Reads and writes uncompressed DDS files, so baked data
+// can be saved for CreateDDSTextureFromFile() by tools that
+// have no device.  Writes use the DX10 header.  Reads take
+// only the top mip and don't decode block compression.
+// --------------------------------------------------------
+class DDSFile
+{
+public:
+	// A float cube map, each entry one mip level, largest first
+	static bool WriteCubeMap(const std::string& path, const std::vector<CubeFaces>& mips);
+
+	// A 2D float texture with two or four channels
+	static bool WriteTexture(const std::string& path, unsigned int width, unsigned int height, const std::vector<DirectX::XMFLOAT2>& texels);
+	static bool WriteTexture(const std::string& path, unsigned int width, unsigned int height, const std::vector<DirectX::XMFLOAT4>& texels);
+
+	// The top mip of a cube map, as stored (sRGB data isn't linearized)
+	static bool ReadCubeMap(const std::string& path, CubeFaces& cube);
+};
@@ -1,5 +1,8 @@
 #include "DXCore.h"
 #include "Input.h"
+#include "RenderStats.h"
+#include "StateCache.h"
+#include "ThreadPool.h"
 
 #include <WindowsX.h>
 #include <sstream>
@@ -76,6 +79,9 @@ DXCore::~DXCore()
 
 	// Delete input manager singleton
 	delete& Input::GetInstance();
+
+	// Stop the worker threads
+	delete& ThreadPool::GetInstance();
 }
 
 // --------------------------------------------------------
@@ -215,6 +221,9 @@ HRESULT DXCore::InitDirectX()
 		context.GetAddressOf());	// Pointer to our Device Context pointer
 	if (FAILED(hr)) return hr;
 
+	// Redundant state changes are filtered out before reaching the context
+	StateCache::GetInstance().Initialize(context);
+
 	// The above function created the back buffer render target
 	// for us, but we need a reference to it
 	ID3D11Texture2D* backBufferTexture = 0;
@@ -264,7 +273,7 @@ HRESULT DXCore::InitDirectX()
 
 	// Bind the views to the pipeline, so rendering properly 
 	// uses their underlying textures
-	context->OMSetRenderTargets(
+	StateCache::GetInstance().OMSetRenderTargets(
 		1, 
 		backBufferRTV.GetAddressOf(), 
 		depthStencilView.Get());
@@ -348,7 +357,7 @@ void DXCore::OnResize()
 
 	// Bind the views to the pipeline, so rendering properly 
 	// uses their underlying textures
-	context->OMSetRenderTargets(
+	StateCache::GetInstance().OMSetRenderTargets(
 		1, 
 		backBufferRTV.GetAddressOf(), // This requires a pointer to a pointer (an array of pointers), so we get the address of the pointer
 		depthStencilView.Get());
@@ -410,8 +419,9 @@ HRESULT DXCore::Run()
 			Update(deltaTime, totalTime);
 			Draw(deltaTime, totalTime);
 
-			// Frame is over, notify the input manager
+			// Frame is over, notify the input manager and stats
 			Input::GetInstance().EndOfFrame();
+			RenderStats::GetInstance().EndOfFrame();
 		}
 	}
 
@@ -461,6 +471,7 @@ void DXCore::UpdateTimer()
 //  - The window's width & height
 //  - The current FPS and ms/frame
 //  - The version of DirectX actually being used (usually 11)
+//  - Render stats from the most recent frame
 // --------------------------------------------------------
 void DXCore::UpdateTitleBarStats()
 {
@@ -496,6 +507,24 @@ void DXCore::UpdateTitleBarStats()
 	default:                     output << "    DX ???";  break;
 	}
 
+	// Append the last frame's render stats
+	const FrameCounters& frame = RenderStats::GetInstance().GetLastFrame();
+	output <<
+		"    CB Uploads: "	<< frame.constantBufferUploads <<
+		" (" << frame.constantBufferBytes / 1024.0f << "KB, " <<
+		frame.constantBufferSkips << " skipped)" <<
+		"    Draws: " << frame.drawCalls <<
+		" (" << frame.instancesDrawn << " objects)" <<
+		"    State Changes: " << frame.shaderChanges + frame.materialChanges + frame.meshChanges <<
+		" (" << frame.stateCallsIssued << " calls issued, " << frame.stateCallsFiltered << " filtered)" <<
+		"    Culled: " << frame.entitiesCulled << " (" << frame.shadowCastersCulled << " shadow)" <<
+		"    Skipped: " << frame.entitiesSkipped << " (" << frame.shadowCastersSkipped << " shadow)" <<
+		"    Occluded: " << frame.entitiesOccluded << " (" << frame.occludersRasterized << " occluders, " <<
+		frame.occlusionMicroseconds << "/" << frame.occlusionBudgetMicroseconds << "us)" <<
+		"    Shadow Tiles: " << frame.shadowTilesRedrawn << " (" << frame.shadowTilesSkipped << " cached)" <<
+		"    Light Uploads: " << frame.lightUploads << " (" << frame.lightUploadBytes << " bytes, " << frame.lightUploadsSkipped << " skipped)" <<
+		"    Lights: " << frame.lightsShaded << " (" << frame.lightsCulled << " culled, " << frame.lightsRebinned << " rebinned)";
+
 	// Actually update the title bar and reset fps data
 	SetWindowText(hWnd, output.str().c_str());
 	fpsFrameCount = 0;
@@ -0,0 +1,689 @@
+#include "DynamicBVH.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+DynamicBVH::DynamicBVH(float p_fatMargin, float p_rebuildFraction)
+{
+	fatMargin = p_fatMargin;
+	rebuildFraction = p_rebuildFraction;
+	root = NullNode;
+	freeList = NullNode;
+	leafCount = 0;
+	reinsertsSinceRebuild = 0;
+}
+
+// --------------------------------------------------------
+// Box helpers
+// --------------------------------------------------------
+DynamicBVH::Bounds DynamicBVH::ToBounds(const BoundingBox& box)
+{
+	Bounds b;
+	b.min = XMFLOAT3(box.Center.x - box.Extents.x, box.Center.y - box.Extents.y, box.Center.z - box.Extents.z);
+	b.max = XMFLOAT3(box.Center.x + box.Extents.x, box.Center.y + box.Extents.y, box.Center.z + box.Extents.z);
+	return b;
+}
+
+DynamicBVH::Bounds DynamicBVH::Union(const Bounds& a, const Bounds& b)
+{
+	Bounds u;
+	u.min = XMFLOAT3(std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y), std::min(a.min.z, b.min.z));
+	u.max = XMFLOAT3(std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y), std::max(a.max.z, b.max.z));
+	return u;
+}
+
+float DynamicBVH::SurfaceArea(const Bounds& b)
+{
+	float dx = b.max.x - b.min.x;
+	float dy = b.max.y - b.min.y;
+	float dz = b.max.z - b.min.z;
+	return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+bool DynamicBVH::Contains(const Bounds& outer, const Bounds& inner)
+{
+	return
+		outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z &&
+		outer.max.x >= inner.max.x && outer.max.y >= inner.max.y && outer.max.z >= inner.max.z;
+}
+
+// --------------------------------------------------------
+// Node pool - freed nodes are chained through their parent
+// index and reused before the pool grows
+// --------------------------------------------------------
+int DynamicBVH::AllocateNode()
+{
+	if (freeList == NullNode)
+	{
+		nodes.push_back(Node());
+		freeList = (int)nodes.size() - 1;
+		nodes[freeList].parent = NullNode;
+	}
+
+	int node = freeList;
+	freeList = nodes[node].parent;
+
+	Node& n = nodes[node];
+	n.parent = NullNode;
+	n.child1 = NullNode;
+	n.child2 = NullNode;
+	n.height = 0;
+	n.userData = 0;
+	return node;
+}
+
+void DynamicBVH::FreeNode(int node)
+{
+	nodes[node].parent = freeList;
+	nodes[node].height = -1;
+	freeList = node;
+}
+
+// --------------------------------------------------------
+// Adds a box to the tree
+//
+// userData - returned by queries that find this box
+// --------------------------------------------------------
+int DynamicBVH::Insert(const BoundingBox& box, unsigned int userData)
+{
+	int leaf = AllocateNode();
+	Bounds tight = ToBounds(box);
+
+	Node& n = nodes[leaf];
+	n.tightBox = tight;
+	n.box.min = XMFLOAT3(tight.min.x - fatMargin, tight.min.y - fatMargin, tight.min.z - fatMargin);
+	n.box.max = XMFLOAT3(tight.max.x + fatMargin, tight.max.y + fatMargin, tight.max.z + fatMargin);
+	n.userData = userData;
+
+	InsertLeaf(leaf);
+	leafCount++;
+	return leaf;
+}
+
+// --------------------------------------------------------
+// Removes a box that was added with Insert()
+// --------------------------------------------------------
+void DynamicBVH::Remove(int proxy)
+{
+	RemoveLeaf(proxy);
+	FreeNode(proxy);
+	leafCount--;
+}
+
+// --------------------------------------------------------
+// Updates a box.  The tree is only changed if the new box
+// has left the leaf's fat box.
+// --------------------------------------------------------
+bool DynamicBVH::Move(int proxy, const BoundingBox& box)
+{
+	Bounds tight = ToBounds(box);
+	nodes[proxy].tightBox = tight;
+	if (Contains(nodes[proxy].box, tight))
+		return false;
+
+	RemoveLeaf(proxy);
+
+	Node& n = nodes[proxy];
+	n.box.min = XMFLOAT3(tight.min.x - fatMargin, tight.min.y - fatMargin, tight.min.z - fatMargin);
+	n.box.max = XMFLOAT3(tight.max.x + fatMargin, tight.max.y + fatMargin, tight.max.z + fatMargin);
+
+	InsertLeaf(proxy);
+	reinsertsSinceRebuild++;
+	return true;
+}
+
+// --------------------------------------------------------
+// Call once per frame after moving things.  Reinsertion
+// keeps the tree valid but greedy, so once a set fraction
+// of the leaves have been reinserted the tree is rebuilt.
+// --------------------------------------------------------
+void DynamicBVH::Update()
+{
+	if (leafCount > 0 && reinsertsSinceRebuild > rebuildFraction * leafCount)
+		Rebuild();
+}
+
+// --------------------------------------------------------
+// Removes everything
+// --------------------------------------------------------
+void DynamicBVH::Clear()
+{
+	nodes.clear();
+	root = NullNode;
+	freeList = NullNode;
+	leafCount = 0;
+	reinsertsSinceRebuild = 0;
+}
+
+// --------------------------------------------------------
+// Finds the best sibling for a leaf by walking down from
+// the root, choosing whichever child would grow the total
+// surface area the least, then joins them under a new node
+// --------------------------------------------------------
+void DynamicBVH::InsertLeaf(int leaf)
+{
+	if (root == NullNode)
+	{
+		root = leaf;
+		nodes[root].parent = NullNode;
+		return;
+	}
+
+	Bounds leafBox = nodes[leaf].box;
+	int index = root;
+	while (!nodes[index].IsLeaf())
+	{
+		const Node& n = nodes[index];
+		float area = SurfaceArea(n.box);
+		float combinedArea = SurfaceArea(Union(n.box, leafBox));
+
+		// Cost of making a new parent for this node and the leaf
+		float cost = 2.0f * combinedArea;
+
+		// Minimum cost of pushing the leaf further down the tree
+		float inheritanceCost = 2.0f * (combinedArea - area);
+
+		float childCost[2];
+		int children[2] = { n.child1, n.child2 };
+		for (int c = 0; c < 2; c++)
+		{
+			const Node& child = nodes[children[c]];
+			float unionArea = SurfaceArea(Union(child.box, leafBox));
+			childCost[c] = (child.IsLeaf() ? unionArea : unionArea - SurfaceArea(child.box)) + inheritanceCost;
+		}
+
+		if (cost < childCost[0] && cost < childCost[1])
+			break;
+
+		index = childCost[0] < childCost[1] ? children[0] : children[1];
+	}
+
+	int sibling = index;
+
+	// Create a new parent for the sibling and the leaf
+	int oldParent = nodes[sibling].parent;
+	int newParent = AllocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].box = Union(leafBox, nodes[sibling].box);
+	nodes[newParent].height = nodes[sibling].height + 1;
+	nodes[newParent].child1 = sibling;
+	nodes[newParent].child2 = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	if (oldParent != NullNode)
+	{
+		if (nodes[oldParent].child1 == sibling)
+			nodes[oldParent].child1 = newParent;
+		else
+			nodes[oldParent].child2 = newParent;
+	}
+	else
+	{
+		root = newParent;
+	}
+
+	// Fix up the ancestors
+	Refit(nodes[leaf].parent);
+}
+
+// --------------------------------------------------------
+// Detaches a leaf, replacing its parent with its sibling
+// --------------------------------------------------------
+void DynamicBVH::RemoveLeaf(int leaf)
+{
+	if (leaf == root)
+	{
+		root = NullNode;
+		return;
+	}
+
+	int parent = nodes[leaf].parent;
+	int grandParent = nodes[parent].parent;
+	int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+	if (grandParent != NullNode)
+	{
+		if (nodes[grandParent].child1 == parent)
+			nodes[grandParent].child1 = sibling;
+		else
+			nodes[grandParent].child2 = sibling;
+
+		nodes[sibling].parent = grandParent;
+		FreeNode(parent);
+		Refit(grandParent);
+	}
+	else
+	{
+		root = sibling;
+		nodes[sibling].parent = NullNode;
+		FreeNode(parent);
+	}
+}
+
+// --------------------------------------------------------
+// Walks from a node to the root, rebalancing and updating
+// each node's box and height from its children
+// --------------------------------------------------------
+void DynamicBVH::Refit(int index)
+{
+	while (index != NullNode)
+	{
+		index = Balance(index);
+
+		Node& n = nodes[index];
+		n.height = 1 + std::max(nodes[n.child1].height, nodes[n.child2].height);
+		n.box = Union(nodes[n.child1].box, nodes[n.child2].box);
+
+		index = n.parent;
+	}
+}
+
+// --------------------------------------------------------
+// If one child of A is more than one level taller than the
+// other, rotates the taller child up into A's place.
+// Returns the index of the node now in A's place.
+// --------------------------------------------------------
+int DynamicBVH::Balance(int iA)
+{
+	Node& A = nodes[iA];
+	if (A.IsLeaf() || A.height < 2)
+		return iA;
+
+	int iB = A.child1;
+	int iC = A.child2;
+	Node& B = nodes[iB];
+	Node& C = nodes[iC];
+	int balance = C.height - B.height;
+
+	// Rotate C up
+	if (balance > 1)
+	{
+		int iF = C.child1;
+		int iG = C.child2;
+		Node& F = nodes[iF];
+		Node& G = nodes[iG];
+
+		// Swap A and C
+		C.child1 = iA;
+		C.parent = A.parent;
+		A.parent = iC;
+
+		if (C.parent != NullNode)
+		{
+			if (nodes[C.parent].child1 == iA) nodes[C.parent].child1 = iC;
+			else nodes[C.parent].child2 = iC;
+		}
+		else
+		{
+			root = iC;
+		}
+
+		// The shorter of C's children goes to A
+		if (F.height > G.height)
+		{
+			C.child2 = iF;
+			A.child2 = iG;
+			G.parent = iA;
+			A.box = Union(B.box, G.box);
+			C.box = Union(A.box, F.box);
+			A.height = 1 + std::max(B.height, G.height);
+			C.height = 1 + std::max(A.height, F.height);
+		}
+		else
+		{
+			C.child2 = iG;
+			A.child2 = iF;
+			F.parent = iA;
+			A.box = Union(B.box, F.box);
+			C.box = Union(A.box, G.box);
+			A.height = 1 + std::max(B.height, F.height);
+			C.height = 1 + std::max(A.height, G.height);
+		}
+
+		return iC;
+	}
+
+	// Rotate B up
+	if (balance < -1)
+	{
+		int iD = B.child1;
+		int iE = B.child2;
+		Node& D = nodes[iD];
+		Node& E = nodes[iE];
+
+		// Swap A and B
+		B.child1 = iA;
+		B.parent = A.parent;
+		A.parent = iB;
+
+		if (B.parent != NullNode)
+		{
+			if (nodes[B.parent].child1 == iA) nodes[B.parent].child1 = iB;
+			else nodes[B.parent].child2 = iB;
+		}
+		else
+		{
+			root = iB;
+		}
+
+		// The shorter of B's children goes to A
+		if (D.height > E.height)
+		{
+			B.child2 = iD;
+			A.child1 = iE;
+			E.parent = iA;
+			A.box = Union(C.box, E.box);
+			B.box = Union(A.box, D.box);
+			A.height = 1 + std::max(C.height, E.height);
+			B.height = 1 + std::max(A.height, D.height);
+		}
+		else
+		{
+			B.child2 = iE;
+			A.child1 = iD;
+			D.parent = iA;
+			A.box = Union(C.box, D.box);
+			B.box = Union(A.box, E.box);
+			A.height = 1 + std::max(C.height, D.height);
+			B.height = 1 + std::max(A.height, E.height);
+		}
+
+		return iB;
+	}
+
+	return iA;
+}
+
+// --------------------------------------------------------
+// Throws away the internal nodes and builds new ones from
+// the leaves, splitting each range at the median centroid
+// along its longest axis
+// --------------------------------------------------------
+void DynamicBVH::Rebuild()
+{
+	reinsertsSinceRebuild = 0;
+	if (root == NullNode)
+		return;
+
+	std::vector<int> leaves;
+	leaves.reserve(leafCount);
+	for (int i = 0; i < (int)nodes.size(); i++)
+	{
+		if (nodes[i].height < 0)
+			continue;
+
+		if (nodes[i].IsLeaf())
+			leaves.push_back(i);
+		else
+			FreeNode(i);
+	}
+
+	root = BuildRange(leaves.data(), (int)leaves.size());
+	nodes[root].parent = NullNode;
+}
+
+int DynamicBVH::BuildRange(int* leaves, int count)
+{
+	if (count == 1)
+		return leaves[0];
+
+	// Bounds of the leaves' centers decide the split axis
+	XMFLOAT3 cMin(FLT_MAX, FLT_MAX, FLT_MAX);
+	XMFLOAT3 cMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (int i = 0; i < count; i++)
+	{
+		const Bounds& b = nodes[leaves[i]].box;
+		float x = b.min.x + b.max.x, y = b.min.y + b.max.y, z = b.min.z + b.max.z;
+		cMin = XMFLOAT3(std::min(cMin.x, x), std::min(cMin.y, y), std::min(cMin.z, z));
+		cMax = XMFLOAT3(std::max(cMax.x, x), std::max(cMax.y, y), std::max(cMax.z, z));
+	}
+
+	float dx = cMax.x - cMin.x, dy = cMax.y - cMin.y, dz = cMax.z - cMin.z;
+	int axis = (dx >= dy && dx >= dz) ? 0 : (dy >= dz ? 1 : 2);
+
+	// Centers are compared doubled (min + max), which doesn't change the order
+	int mid = count / 2;
+	std::nth_element(leaves, leaves + mid, leaves + count, [this, axis](int a, int b)
+		{
+			const Bounds& ba = nodes[a].box;
+			const Bounds& bb = nodes[b].box;
+			return (&ba.min.x)[axis] + (&ba.max.x)[axis] < (&bb.min.x)[axis] + (&bb.max.x)[axis];
+		});
+
+	int child1 = BuildRange(leaves, mid);
+	int child2 = BuildRange(leaves + mid, count - mid);
+
+	int node = AllocateNode();
+	nodes[node].child1 = child1;
+	nodes[node].child2 = child2;
+	nodes[node].box = Union(nodes[child1].box, nodes[child2].box);
+	nodes[node].height = 1 + std::max(nodes[child1].height, nodes[child2].height);
+	nodes[child1].parent = node;
+	nodes[child2].parent = node;
+	return node;
+}
+
+// --------------------------------------------------------
+// Adds every leaf under a node without testing them, for
+// subtrees already known to be inside a query volume
+// --------------------------------------------------------
+void DynamicBVH::CollectLeaves(int node, std::vector<unsigned int>& results)
+{
+	const Node& n = nodes[node];
+	if (n.IsLeaf())
+	{
+		results.push_back(n.userData);
+		return;
+	}
+
+	CollectLeaves(n.child1, results);
+	CollectLeaves(n.child2, results);
+}
+
+// --------------------------------------------------------
+// Finds every leaf at least partly inside a volume
+//
+// planes - inward facing and normalized, such as from
+//          FrustumCuller::ExtractPlanes()
+// --------------------------------------------------------
+void DynamicBVH::QueryFrustum(const XMFLOAT4 planes[6], std::vector<unsigned int>& results)
+{
+	if (root == NullNode)
+		return;
+
+	// 0 = outside, 1 = crossing a plane, 2 = fully inside
+	auto classify = [planes](const Bounds& b)
+	{
+		float cx = (b.min.x + b.max.x) * 0.5f, ex = (b.max.x - b.min.x) * 0.5f;
+		float cy = (b.min.y + b.max.y) * 0.5f, ey = (b.max.y - b.min.y) * 0.5f;
+		float cz = (b.min.z + b.max.z) * 0.5f, ez = (b.max.z - b.min.z) * 0.5f;
+
+		int result = 2;
+		for (int p = 0; p < 6; p++)
+		{
+			const XMFLOAT4& pl = planes[p];
+			float distance = pl.x * cx + pl.y * cy + pl.z * cz + pl.w;
+			float radius = fabsf(pl.x) * ex + fabsf(pl.y) * ey + fabsf(pl.z) * ez;
+			if (distance + radius < 0.0f) return 0;
+			if (distance - radius < 0.0f) result = 1;
+		}
+		return result;
+	};
+
+	stack.clear();
+	stack.push_back(root);
+	while (!stack.empty())
+	{
+		int index = stack.back();
+		stack.pop_back();
+
+		const Node& n = nodes[index];
+		int side = classify(n.box);
+		if (side == 0)
+			continue;
+
+		if (n.IsLeaf())
+		{
+			// The fat box touched the volume, so check the real one
+			if (side == 2 || classify(n.tightBox) != 0)
+				results.push_back(n.userData);
+		}
+		else if (side == 2)
+		{
+			CollectLeaves(index, results);
+		}
+		else
+		{
+			stack.push_back(n.child1);
+			stack.push_back(n.child2);
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Finds every leaf overlapping a sphere
+// --------------------------------------------------------
+void DynamicBVH::QuerySphere(const BoundingSphere& sphere, std::vector<unsigned int>& results)
+{
+	if (root == NullNode)
+		return;
+
+	float radiusSq = sphere.Radius * sphere.Radius;
+	auto overlaps = [&sphere, radiusSq](const Bounds& b)
+	{
+		// Distance from the sphere's center to the closest point in the box
+		float dx = std::max(std::max(b.min.x - sphere.Center.x, 0.0f), sphere.Center.x - b.max.x);
+		float dy = std::max(std::max(b.min.y - sphere.Center.y, 0.0f), sphere.Center.y - b.max.y);
+		float dz = std::max(std::max(b.min.z - sphere.Center.z, 0.0f), sphere.Center.z - b.max.z);
+		return dx * dx + dy * dy + dz * dz <= radiusSq;
+	};
+
+	stack.clear();
+	stack.push_back(root);
+	while (!stack.empty())
+	{
+		const Node& n = nodes[stack.back()];
+		stack.pop_back();
+
+		if (!overlaps(n.box))
+			continue;
+
+		if (n.IsLeaf())
+		{
+			if (overlaps(n.tightBox))
+				results.push_back(n.userData);
+		}
+		else
+		{
+			stack.push_back(n.child1);
+			stack.push_back(n.child2);
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Finds every leaf overlapping a box
+// --------------------------------------------------------
+void DynamicBVH::QueryBox(const BoundingBox& box, std::vector<unsigned int>& results)
+{
+	if (root == NullNode)
+		return;
+
+	Bounds query = ToBounds(box);
+	auto overlaps = [&query](const Bounds& b)
+	{
+		return
+			b.min.x <= query.max.x && b.max.x >= query.min.x &&
+			b.min.y <= query.max.y && b.max.y >= query.min.y &&
+			b.min.z <= query.max.z && b.max.z >= query.min.z;
+	};
+
+	stack.clear();
+	stack.push_back(root);
+	while (!stack.empty())
+	{
+		const Node& n = nodes[stack.back()];
+		stack.pop_back();
+
+		if (!overlaps(n.box))
+			continue;
+
+		if (n.IsLeaf())
+		{
+			if (overlaps(n.tightBox))
+				results.push_back(n.userData);
+		}
+		else
+		{
+			stack.push_back(n.child1);
+			stack.push_back(n.child2);
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Finds the closest leaf hit by a ray.  Subtrees farther
+// away than the best hit so far are skipped.
+// --------------------------------------------------------
+bool DynamicBVH::RayCast(XMFLOAT3 origin, XMFLOAT3 direction, float maxDistance, unsigned int& hitUserData, float& hitDistance)
+{
+	if (root == NullNode)
+		return false;
+
+	// Zero components become huge rather than infinite, which avoids 0 * inf
+	XMFLOAT3 inv(
+		1.0f / (fabsf(direction.x) > 1e-12f ? direction.x : 1e-12f),
+		1.0f / (fabsf(direction.y) > 1e-12f ? direction.y : 1e-12f),
+		1.0f / (fabsf(direction.z) > 1e-12f ? direction.z : 1e-12f));
+
+	float best = maxDistance;
+	bool hit = false;
+
+	// Distance to where the ray enters a box, or -1 for a miss
+	auto slabs = [&origin, &inv](const Bounds& b, float maxT)
+	{
+		float t1 = (b.min.x - origin.x) * inv.x, t2 = (b.max.x - origin.x) * inv.x;
+		float tMin = std::min(t1, t2), tMax = std::max(t1, t2);
+		t1 = (b.min.y - origin.y) * inv.y; t2 = (b.max.y - origin.y) * inv.y;
+		tMin = std::max(tMin, std::min(t1, t2)); tMax = std::min(tMax, std::max(t1, t2));
+		t1 = (b.min.z - origin.z) * inv.z; t2 = (b.max.z - origin.z) * inv.z;
+		tMin = std::max(tMin, std::min(t1, t2)); tMax = std::min(tMax, std::max(t1, t2));
+
+		tMin = std::max(tMin, 0.0f);
+		return (tMin <= tMax && tMin <= maxT) ? tMin : -1.0f;
+	};
+
+	stack.clear();
+	stack.push_back(root);
+	while (!stack.empty())
+	{
+		const Node& n = nodes[stack.back()];
+		stack.pop_back();
+
+		if (slabs(n.box, best) < 0.0f)
+			continue;
+
+		if (n.IsLeaf())
+		{
+			float t = slabs(n.tightBox, best);
+			if (t >= 0.0f)
+			{
+				best = t;
+				hitUserData = n.userData;
+				hit = true;
+			}
+		}
+		else
+		{
+			stack.push_back(n.child1);
+			stack.push_back(n.child2);
+		}
+	}
+
+	if (hit)
+		hitDistance = best;
+	return hit;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <vector>
+
+// --------------------------------------------------------
+// A bounding volume hierarchy over boxes that move, such as
+// the scene's entities.
+//
+// Each leaf stores a "fat" box - the real box grown by a
+// margin - so small movements stay inside it and don't
+// touch the tree at all.  Larger ones remove the leaf and
+// reinsert it where it adds the least surface area, then
+// refit and rebalance its ancestors on the way back up.
+// Update() rebuilds the whole tree top down once enough
+// leaves have been reinserted that its quality may have
+// dropped.
+//
+// Queries test the fat boxes while walking the tree, and
+// the real boxes at the leaves, so results are exact.
+// --------------------------------------------------------
+class DynamicBVH
+{
+public:
+	static const int NullNode = -1;
+
+	DynamicBVH(float fatMargin = 0.1f, float rebuildFraction = 0.25f);
+
+	// Leaves are identified by the proxy returned from Insert()
+	int Insert(const DirectX::BoundingBox& box, unsigned int userData);
+	void Remove(int proxy);
+	bool Move(int proxy, const DirectX::BoundingBox& box);	// True if the leaf was reinserted
+	void Update();		// Rebuilds when enough leaves have moved
+	void Rebuild();		// Top down rebuild of the whole tree
+	void Clear();
+
+	unsigned int GetUserData(int proxy) { return nodes[proxy].userData; }
+	unsigned int GetLeafCount() { return leafCount; }
+	int GetHeight() { return root == NullNode ? 0 : nodes[root].height; }
+
+	// Queries append the user data of every leaf they find
+	void QueryFrustum(const DirectX::XMFLOAT4 planes[6], std::vector<unsigned int>& results);
+	void QuerySphere(const DirectX::BoundingSphere& sphere, std::vector<unsigned int>& results);
+	void QueryBox(const DirectX::BoundingBox& box, std::vector<unsigned int>& results);
+
+	// Finds the closest leaf along a ray, within maxDistance
+	// direction - must be normalized
+	bool RayCast(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, unsigned int& hitUserData, float& hitDistance);
+
+private:
+	struct Bounds
+	{
+		DirectX::XMFLOAT3 min;
+		DirectX::XMFLOAT3 max;
+	};
+
+	struct Node
+	{
+		Bounds box;			// Fat box for leaves, union of children otherwise
+		Bounds tightBox;	// Leaves only - the box that was inserted
+		int parent;			// Next free node while on the free list
+		int child1;
+		int child2;
+		int height;			// 0 for leaves, -1 while free
+		unsigned int userData;
+
+		bool IsLeaf() const { return child1 == NullNode; }
+	};
+
+	static Bounds ToBounds(const DirectX::BoundingBox& box);
+	static Bounds Union(const Bounds& a, const Bounds& b);
+	static float SurfaceArea(const Bounds& b);
+	static bool Contains(const Bounds& outer, const Bounds& inner);
+
+	int AllocateNode();
+	void FreeNode(int node);
+	void InsertLeaf(int leaf);
+	void RemoveLeaf(int leaf);
+	int Balance(int node);
+	void Refit(int node);
+	int BuildRange(int* leaves, int count);
+	void CollectLeaves(int node, std::vector<unsigned int>& results);
+
+	std::vector<Node> nodes;
+	std::vector<int> stack;		// Reused by queries
+	int root;
+	int freeList;
+	unsigned int leafCount;
+	unsigned int reinsertsSinceRebuild;
+	float fatMargin;
+	float rebuildFraction;
+};
@@ -0,0 +1,119 @@
+#include "FrustumCuller.h"
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Removes all boxes
+// --------------------------------------------------------
+void FrustumCuller::Clear()
+{
+	count = 0;
+	centerX.clear(); centerY.clear(); centerZ.clear();
+	extentX.clear(); extentY.clear(); extentZ.clear();
+}
+
+// --------------------------------------------------------
+// Adds a box, which gets the next index
+// --------------------------------------------------------
+void FrustumCuller::Add(const BoundingBox& worldBox)
+{
+	// Arrays may have been padded by the last Cull()
+	centerX.resize(count); centerY.resize(count); centerZ.resize(count);
+	extentX.resize(count); extentY.resize(count); extentZ.resize(count);
+
+	centerX.push_back(worldBox.Center.x);
+	centerY.push_back(worldBox.Center.y);
+	centerZ.push_back(worldBox.Center.z);
+	extentX.push_back(worldBox.Extents.x);
+	extentY.push_back(worldBox.Extents.y);
+	extentZ.push_back(worldBox.Extents.z);
+	count++;
+}
+
+// --------------------------------------------------------
+// Finds the six planes bounding a view-projection matrix's
+// clip space (Gribb/Hartmann), using Direct3D's 0-1 depth.
+// Works for perspective and orthographic projections.
+// --------------------------------------------------------
+void FrustumCuller::ExtractPlanes(FXMMATRIX viewProjection, XMFLOAT4 planes[6])
+{
+	// Row vectors are multiplied on the left, so the clip space
+	// x, y, z and w values come from the matrix's columns
+	XMMATRIX columns = XMMatrixTranspose(viewProjection);
+	XMVECTOR x = columns.r[0];
+	XMVECTOR y = columns.r[1];
+	XMVECTOR z = columns.r[2];
+	XMVECTOR w = columns.r[3];
+
+	XMVECTOR p[6] =
+	{
+		XMVectorAdd(w, x),		// Left:   -w <= x
+		XMVectorSubtract(w, x),	// Right:   x <= w
+		XMVectorAdd(w, y),		// Bottom: -w <= y
+		XMVectorSubtract(w, y),	// Top:     y <= w
+		z,						// Near:    0 <= z
+		XMVectorSubtract(w, z)	// Far:     z <= w
+	};
+
+	for (int i = 0; i < 6; i++)
+		XMStoreFloat4(&planes[i], XMPlaneNormalize(p[i]));
+}
+
+// --------------------------------------------------------
+// A box is outside when it is fully behind any one plane,
+// which is checked by comparing the center's distance to
+// the plane against the box's projected radius.  This can
+// keep a few boxes near the volume's corners, which is the
+// usual trade for a test this cheap.
+// --------------------------------------------------------
+void FrustumCuller::Cull(FXMMATRIX viewProjection, std::vector<unsigned int>& visible)
+{
+	XMFLOAT4 planes[6];
+	ExtractPlanes(viewProjection, planes);
+
+	// Pad to a multiple of four - padded lanes are ignored below
+	unsigned int padded = (count + 3) & ~3u;
+	centerX.resize(padded); centerY.resize(padded); centerZ.resize(padded);
+	extentX.resize(padded); extentY.resize(padded); extentZ.resize(padded);
+
+	// Splat each plane's components (and their absolute values) once
+	XMVECTOR nx[6], ny[6], nz[6], nw[6], ax[6], ay[6], az[6];
+	for (int p = 0; p < 6; p++)
+	{
+		nx[p] = XMVectorReplicate(planes[p].x);
+		ny[p] = XMVectorReplicate(planes[p].y);
+		nz[p] = XMVectorReplicate(planes[p].z);
+		nw[p] = XMVectorReplicate(planes[p].w);
+		ax[p] = XMVectorAbs(nx[p]);
+		ay[p] = XMVectorAbs(ny[p]);
+		az[p] = XMVectorAbs(nz[p]);
+	}
+
+	XMVECTOR zero = XMVectorZero();
+	for (unsigned int i = 0; i < padded; i += 4)
+	{
+		XMVECTOR cx = XMLoadFloat4((const XMFLOAT4*)&centerX[i]);
+		XMVECTOR cy = XMLoadFloat4((const XMFLOAT4*)&centerY[i]);
+		XMVECTOR cz = XMLoadFloat4((const XMFLOAT4*)&centerZ[i]);
+		XMVECTOR ex = XMLoadFloat4((const XMFLOAT4*)&extentX[i]);
+		XMVECTOR ey = XMLoadFloat4((const XMFLOAT4*)&extentY[i]);
+		XMVECTOR ez = XMLoadFloat4((const XMFLOAT4*)&extentZ[i]);
+
+		XMVECTOR outside = XMVectorFalseInt();
+		for (int p = 0; p < 6; p++)
+		{
+			// Signed distance of the center, plus the box's reach toward the plane
+			XMVECTOR distance = XMVectorMultiplyAdd(cx, nx[p], XMVectorMultiplyAdd(cy, ny[p], XMVectorMultiplyAdd(cz, nz[p], nw[p])));
+			XMVECTOR radius = XMVectorMultiplyAdd(ex, ax[p], XMVectorMultiplyAdd(ey, ay[p], XMVectorMultiply(ez, az[p])));
+			outside = XMVectorOrInt(outside, XMVectorLess(XMVectorAdd(distance, radius), zero));
+		}
+
+		uint32_t lanes[4];
+		XMStoreInt4(lanes, outside);
+		for (unsigned int lane = 0; lane < 4 && i + lane < count; lane++)
+		{
+			if (!lanes[lane])
+				visible.push_back(i + lane);
+		}
+	}
+}
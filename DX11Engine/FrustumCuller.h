@@ -0,0 +1,35 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <vector>
+
+// --------------------------------------------------------
+// Tests a list of world space boxes against a view volume,
+// four boxes at a time.  Boxes are kept as separate arrays
+// of centers and extents (one per axis) so each SIMD lane
+// holds a different box.
+//
+// Works with any view-projection matrix, so the same list
+// can be culled against the camera's perspective frustum
+// and a light's orthographic volume.
+// --------------------------------------------------------
+class FrustumCuller
+{
+public:
+	void Clear();
+	void Add(const DirectX::BoundingBox& worldBox);
+	unsigned int GetCount() { return count; }
+
+	// Appends the index (order of Add() calls) of every box that is
+	// at least partly inside the volume
+	void Cull(DirectX::FXMMATRIX viewProjection, std::vector<unsigned int>& visible);
+
+	// Inward facing, normalized planes: left, right, bottom, top, near, far
+	static void ExtractPlanes(DirectX::FXMMATRIX viewProjection, DirectX::XMFLOAT4 planes[6]);
+
+private:
+	unsigned int count = 0;
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ;
+};
@@ -4,11 +4,17 @@
 #include "BufferStructs.h"
 #include "WICTextureLoader.h"
 #include "DDSTextureLoader.h"
+#include "Benchmarks.h"
+#include "StateCache.h"
 
 // Needed for a helper function to read compiled shader files from the hard drive
 #pragma comment(lib, "d3dcompiler.lib")
 #include <d3dcompiler.h>
 #include <memory>
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <fstream>
 
 // For the DirectX Math library
 using namespace DirectX;
@@ -60,6 +66,12 @@ Game::~Game()
 // --------------------------------------------------------
 void Game::Init()
 {
+	// Constant buffers are written into one big ring and bound by offset
+	// when the driver supports it, rather than updating a buffer per draw
+	constantBufferRing = std::make_shared<ConstantBufferRing>(device, context, 4 * 1024 * 1024);
+	if (constantBufferRing->IsSupported())
+		ISimpleShader::UploadRing = constantBufferRing;
+
 	// Helper methods for loading shaders, creating some basic
 	// geometry to draw and some simple camera matrices.
 	//  - You'll be expanding and/or replacing these later
@@ -73,15 +85,13 @@ void Game::Init()
 	XMFLOAT4 white = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
 
 	// Lights
-	ambientLight = XMFLOAT3(0, 0, 0);
-
 	Light directionalLight1 = {};
 	directionalLight1.Type = LIGHT_TYPE_DIRECTIONAL;
 	directionalLight1.Direction = XMFLOAT3(0, -1, 1);
 	directionalLight1.Color = XMFLOAT3(1, 1, 1);
 	directionalLight1.Intensity = 0.75f;
 
-	lightsVector.push_back(directionalLight1);
+	lightManager.Add(directionalLight1);
 
 	Light directionalLight2 = {};
 	directionalLight2.Type = LIGHT_TYPE_DIRECTIONAL;
@@ -89,7 +99,7 @@ void Game::Init()
 	directionalLight2.Color = XMFLOAT3(1, 1, 1);
 	directionalLight2.Intensity = 0.25f;
 
-	//lightsVector.push_back(directionalLight2);
+	//lightManager.Add(directionalLight2);
 
 	Light directionalLight3 = {};
 	directionalLight3.Type = LIGHT_TYPE_DIRECTIONAL;
@@ -97,7 +107,7 @@ void Game::Init()
 	directionalLight3.Color = XMFLOAT3(1, 1, 1);
 	directionalLight3.Intensity = 0.5f;
 
-	//lightsVector.push_back(directionalLight3);
+	//lightManager.Add(directionalLight3);
 
 	Light pointLight1 = {};
 	pointLight1.Type = LIGHT_TYPE_POINT;
@@ -106,7 +116,7 @@ void Game::Init()
 	pointLight1.Range = 3.0f;
 	pointLight1.Position = XMFLOAT3(3.25f, -1.5f, -1);
 
-	lightsVector.push_back(pointLight1);
+	lightManager.Add(pointLight1);
 
 	Light pointLight2 = {};
 	pointLight2.Type = LIGHT_TYPE_POINT;
@@ -115,7 +125,7 @@ void Game::Init()
 	pointLight2.Range = 3.0f;
 	pointLight2.Position = XMFLOAT3(-3.25f, -1.5f, -1);
 
-	lightsVector.push_back(pointLight2);
+	lightManager.Add(pointLight2);
 
 	Light pointLight3 = {};
 	pointLight3.Type = LIGHT_TYPE_POINT;
@@ -124,7 +134,18 @@ void Game::Init()
 	pointLight3.Range = 3.0f;
 	pointLight3.Position = XMFLOAT3(0, -1.2f, 5.5f);
 
-	lightsVector.push_back(pointLight3);
+	lightManager.Add(pointLight3);
+
+	Light spotLight1 = {};
+	spotLight1.Type = LIGHT_TYPE_SPOT;
+	spotLight1.Color = XMFLOAT3(1, 1, 1);
+	spotLight1.Intensity = 1.0f;
+	spotLight1.Range = 6.0f;
+	spotLight1.Position = XMFLOAT3(0, 2.0f, 0);
+	spotLight1.Direction = XMFLOAT3(0, -1, 0);
+	spotLight1.SpotFalloff = 8.0f;
+
+	lightManager.Add(spotLight1);
 
 	// Loading Textures and Specular Maps
 	CreateWICTextureFromFile(device.Get(), 
@@ -239,43 +260,52 @@ void Game::Init()
 	basicSamplerDescription.MaxLOD = D3D11_FLOAT32_MAX;
 	device->CreateSamplerState(&basicSamplerDescription, basicSampler.GetAddressOf());
 
+	// Lookup tables mustn't wrap at their edges
+	D3D11_SAMPLER_DESC clampSamplerDescription = {};
+	clampSamplerDescription.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	clampSamplerDescription.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	clampSamplerDescription.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	clampSamplerDescription.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	clampSamplerDescription.MaxLOD = D3D11_FLOAT32_MAX;
+	device->CreateSamplerState(&clampSamplerDescription, clampSampler.GetAddressOf());
+
 	// Creating Materials
-	cerMat = std::make_shared<Material>(white, 0.15f, vertexShader, pixelShader);
+	cerMat = std::make_shared<Material>(white, 0.15f, instancedVertexShader, pixelShader);
 	cerMat->AddTextureSRV("Albedo", cerTextureSRV);
 	cerMat->AddTextureSRV("NormalMap", cerNormalSRV);
 	cerMat->AddTextureSRV("RoughnessMap", cerRoughnessSRV);
 	cerMat->AddTextureSRV("MetalnessMap", cerMetalnessSRV);
 	cerMat->AddSampler("BasicSampler", basicSampler);
 
-	hr4Mat = std::make_shared<Material>(white, 0.15f, vertexShader, pixelShader);
+	hr4Mat = std::make_shared<Material>(white, 0.15f, instancedVertexShader, pixelShader);
 	hr4Mat->AddTextureSRV("Albedo", hr4TextureSRV);
 	hr4Mat->AddTextureSRV("NormalMap", hr4NormalSRV);
 	hr4Mat->AddTextureSRV("RoughnessMap", hr4RoughnessSRV);
 	hr4Mat->AddTextureSRV("MetalnessMap", hr4MetalnessSRV);
 	hr4Mat->AddSampler("BasicSampler", basicSampler);
 
-	hr5Mat = std::make_shared<Material>(white, 0.15f, vertexShader, pixelShader);
+	hr5Mat = std::make_shared<Material>(white, 0.15f, instancedVertexShader, pixelShader);
 	hr5Mat->AddTextureSRV("Albedo", hr5TextureSRV);
 	hr5Mat->AddTextureSRV("NormalMap", hr5NormalSRV);
 	hr5Mat->AddTextureSRV("RoughnessMap", hr5RoughnessSRV);
 	hr5Mat->AddTextureSRV("MetalnessMap", hr5MetalnessSRV);
 	hr5Mat->AddSampler("BasicSampler", basicSampler);
 
-	stoneMat = std::make_shared<Material>(white, 0.15f, vertexShader, pixelShader);
+	stoneMat = std::make_shared<Material>(white, 0.15f, instancedVertexShader, pixelShader);
 	stoneMat->AddTextureSRV("Albedo", stoneTextureSRV);
 	stoneMat->AddTextureSRV("NormalMap", stoneNormalSRV);
 	stoneMat->AddTextureSRV("RoughnessMap", stoneRoughnessSRV);
 	stoneMat->AddTextureSRV("MetalnessMap", stoneMetalnessSRV);
 	stoneMat->AddSampler("BasicSampler", basicSampler);
 
-	customPSWhiteMat = std::make_shared<Material>(white, 0.15f, vertexShader, customPixelShader);
+	customPSWhiteMat = std::make_shared<Material>(white, 0.15f, instancedVertexShader, customPixelShader);
 
 	CreateBasicGeometry();
 
 	// Tell the input assembler stage of the pipeline what kind of
 	// geometric primitives (points, lines or triangles) we want to draw.  
 	// Essentially: "What kind of shape should the GPU draw with our data?"
-	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	StateCache::GetInstance().IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
 	// Setting the scale of the entities
 	for (int i = 0; i < gameEntitiesVector.size(); i++) 
@@ -360,8 +390,66 @@ void Game::Init()
 	// Initialzing skybox
 	skybox = std::make_shared<Sky>(meshVector[1], basicSampler, device, skyPixelShader, skyVertexShader, skyCubeMapSRV);
 
+	// The sky doesn't change, so its ambient is found once.  Low orders
+	// of spherical harmonics only keep broad changes, so small faces do.
+	skyAmbientResolution = 32;
+	skyAmbientScale = 1.0f;
+	ComputeSkyAmbient();
+	LoadSpecularIBL();
+
 	// Setting up shadow map resources
 	CreateShadowMapResources();
+
+	// Per-instance world matrices, rewritten every frame
+	instanceBuffer = std::make_shared<InstanceBuffer>(device, context, (unsigned int)sizeof(InstanceData));
+
+	// Every light slot, with only the lights that change rewritten
+	lightBuffer = std::make_shared<ShaderBuffer>(device, context, (unsigned int)sizeof(Light), DXGI_FORMAT_UNKNOWN, true);
+
+	// Light cluster ranges and the lights' indices, rebuilt when the view
+	// or the lights change
+	clusterRangeBuffer = std::make_shared<ShaderBuffer>(device, context, (unsigned int)sizeof(ClusterRange), DXGI_FORMAT_R32G32_UINT);
+	clusterIndexBuffer = std::make_shared<ShaderBuffer>(device, context, (unsigned int)sizeof(unsigned int), DXGI_FORMAT_R32_UINT);
+	clusterGlobalLightCount = 0;
+	clusterMaxLocalLights = 0;
+	clusterGridBuilt = false;
+	clusterLightsVersion = 0;
+
+	// Clusters by default, F2 switches to per-object light lists
+	useObjectLightLists = false;
+
+	// At most 64 lights shaded, none covering much less than a
+	// thousandth of the screen at full brightness
+	lightBudget.SetBudget(64, 0.001f);
+	lightBudget.SetFadeTime(0.25f);
+	lightBudget.SetHysteresis(0.2f);
+	shadedLightsVersion = 0;
+
+	// Every entity starts in the BVH, then only moves are applied
+	for (unsigned int i = 0; i < gameEntitiesVector.size(); i++)
+	{
+		entityProxies.push_back(sceneBVH.Insert(gameEntitiesVector[i].GetWorldBox(), i));
+		entityTransformVersions.push_back(gameEntitiesVector[i].GetTransform()->GetVersion());
+	}
+	sceneBVH.Rebuild();
+
+	// Nothing in the scene moves once it's placed, so every shadow is cached
+	for (unsigned int i = 0; i < gameEntitiesVector.size(); i++)
+		gameEntitiesVector[i].SetStatic(true);
+
+	// The floor and buildings are lightmapped, while the traveler sphere
+	// is lit by the probes as anything moving would be
+	for (unsigned int i = 1; i < gameEntitiesVector.size(); i++)
+		gameEntitiesVector[i].SetLightmapped(true);
+	LoadBakedLighting();
+
+	// Anything under a couple of pixels, or a shadow under a texel, is skipped
+	contributionMinPixels = 2.0f;
+	shadowContributionMinTexels = 1.0f;
+
+	// Occluders are only worth drawing if they cover a good part of the screen
+	occluderMinScreenSize = 0.1f;
+	occlusionCuller.SetBudget(0.5f);
 }
 
 // --------------------------------------------------------
@@ -376,16 +464,34 @@ void Game::LoadShaders()
 {
 	vertexShader = std::make_shared<SimpleVertexShader>(device, context, 
 		GetFullPathTo_Wide(L"VertexShader.cso").c_str());
+	instancedVertexShader = std::make_shared<SimpleVertexShader>(device, context,
+		GetFullPathTo_Wide(L"InstancedVertexShader.cso").c_str());
 	pixelShader = std::make_shared<SimplePixelShader>(device, context,
 		GetFullPathTo_Wide(L"PixelShader.cso").c_str());
 	customPixelShader = std::make_shared<SimplePixelShader>(device, context,
 		GetFullPathTo_Wide(L"CustomPS.cso").c_str());
+
+	// Variants are optional, so a missing one isn't an error
+	pixelShaderVariants = std::make_shared<ShaderVariantCache<SimplePixelShader>>(ShaderPermutations::VariantCount,
+		[this](unsigned int key) -> std::shared_ptr<SimplePixelShader>
+		{
+			std::wstring path = GetFullPathTo_Wide(ShaderPermutations::GetFileName(L"PixelShader", key));
+			if (!std::ifstream(path).good())
+				return nullptr;
+
+			std::shared_ptr<SimplePixelShader> variant = std::make_shared<SimplePixelShader>(device, context, path.c_str());
+			return variant->IsShaderValid() ? variant : nullptr;
+		});
+	pixelShaderVariantFrames.assign(ShaderPermutations::VariantCount, 0);
+	frameNumber = 0;
 	skyPixelShader = std::make_shared<SimplePixelShader>(device, context,
 		GetFullPathTo_Wide(L"SkyPixelShader.cso").c_str());
 	skyVertexShader = std::make_shared<SimpleVertexShader>(device, context,
 		GetFullPathTo_Wide(L"SkyVertexShader.cso").c_str());
 	shadowVertexShader = std::make_shared<SimpleVertexShader>(device, context,
 		GetFullPathTo_Wide(L"ShadowVertexShader.cso").c_str());
+	shadowInstancedVertexShader = std::make_shared<SimpleVertexShader>(device, context,
+		GetFullPathTo_Wide(L"ShadowInstancedVertexShader.cso").c_str());
 }
 
 
@@ -433,39 +539,56 @@ void Game::CreateBasicGeometry()
 
 void Game::CreateShadowMapResources()
 {
-	shadowMapResolution = 1024;
-	shadowProjectionSize = 7.0f;
-
-	// Defining shadow description
-	D3D11_TEXTURE2D_DESC shadowDesc = {};
-	shadowDesc.Width = shadowMapResolution;
-	shadowDesc.Height = shadowMapResolution;
-	shadowDesc.ArraySize = 1;
-	shadowDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
-	shadowDesc.CPUAccessFlags = 0;
-	shadowDesc.Format = DXGI_FORMAT_R32_TYPELESS;
-	shadowDesc.MipLevels = 1;
-	shadowDesc.MiscFlags = 0;
-	shadowDesc.SampleDesc.Count = 1;
-	shadowDesc.SampleDesc.Quality = 0;
-	shadowDesc.Usage = D3D11_USAGE_DEFAULT;
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> shadowTexture;
-	device->CreateTexture2D(&shadowDesc, 0, shadowTexture.GetAddressOf());
-
-	// Defining depth stencil
-	D3D11_DEPTH_STENCIL_VIEW_DESC shadowDSDesc = {};
-	shadowDSDesc.Format = DXGI_FORMAT_D32_FLOAT;
-	shadowDSDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
-	shadowDSDesc.Texture2D.MipSlice = 0;
-	device->CreateDepthStencilView(shadowTexture.Get(), &shadowDSDesc, shadowDSV.GetAddressOf());
-
-	// Shadow shader resource view
-	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
-	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	srvDesc.Texture2D.MipLevels = 1;
-	srvDesc.Texture2D.MostDetailedMip = 0;
-	device->CreateShaderResourceView(shadowTexture.Get(), &srvDesc, shadowSRV.GetAddressOf());
+	// A 4096x4096 atlas fits four 1024x1024 cascades and plenty more
+	shadowMapResolution = 4096;
+	shadowMaxTileSize = 1024;
+	shadowMinTileSize = 128;
+	shadowAtlas.Reset(shadowMapResolution, shadowMinTileSize);
+
+	shadowCascadeCount = 4;
+	shadowDistance = 50.0f;
+	shadowSplitLambda = 0.75f;
+	shadowCasterDistance = 50.0f;
+	shadowNearClip = 0.05f;
+	shadowViewCount = 0;
+
+	// Every tile starts out dirty
+	shadowCache.Resize(ShadowLayerCount * ShadowViews::MaxViews);
+
+	// Static and dynamic casters each get an atlas, both laid out the same
+	for (unsigned int layer = 0; layer < ShadowLayerCount; layer++)
+	{
+		// Defining shadow description
+		D3D11_TEXTURE2D_DESC shadowDesc = {};
+		shadowDesc.Width = shadowMapResolution;
+		shadowDesc.Height = shadowMapResolution;
+		shadowDesc.ArraySize = 1;
+		shadowDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+		shadowDesc.CPUAccessFlags = 0;
+		shadowDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+		shadowDesc.MipLevels = 1;
+		shadowDesc.MiscFlags = 0;
+		shadowDesc.SampleDesc.Count = 1;
+		shadowDesc.SampleDesc.Quality = 0;
+		shadowDesc.Usage = D3D11_USAGE_DEFAULT;
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> shadowTexture;
+		device->CreateTexture2D(&shadowDesc, 0, shadowTexture.GetAddressOf());
+
+		// Defining depth stencil
+		D3D11_DEPTH_STENCIL_VIEW_DESC shadowDSDesc = {};
+		shadowDSDesc.Format = DXGI_FORMAT_D32_FLOAT;
+		shadowDSDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+		shadowDSDesc.Texture2D.MipSlice = 0;
+		device->CreateDepthStencilView(shadowTexture.Get(), &shadowDSDesc, shadowDSVs[layer].GetAddressOf());
+
+		// Shadow shader resource view
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MipLevels = 1;
+		srvDesc.Texture2D.MostDetailedMip = 0;
+		device->CreateShaderResourceView(shadowTexture.Get(), &srvDesc, shadowSRVs[layer].GetAddressOf());
+	}
 
 	// Defining custom sampler for rendering shadows
 	D3D11_SAMPLER_DESC shadowSampDesc = {};
@@ -490,58 +613,548 @@ void Game::CreateShadowMapResources()
 	shadowRastDesc.SlopeScaledDepthBias = 1.0f;
 	device->CreateRasterizerState(&shadowRastDesc, &shadowRasterizer);
 
-	// View
-	XMMATRIX shView = XMMatrixLookAtLH(
-		XMVectorSet(0, 20, -20, 0),
-		XMVectorSet(0, 0, 0, 0),
-		XMVectorSet(0, 1, 0, 0));
-	XMStoreFloat4x4(&shadowViewMatrix, shView);
+	// Clearing a tile draws one triangle over it at the far plane,
+	// overwriting whatever depth is already there
+	Vertex clearVertices[3] = {};
+	clearVertices[0].Position = XMFLOAT3(-1.0f, -1.0f, 1.0f);
+	clearVertices[1].Position = XMFLOAT3(-1.0f, 3.0f, 1.0f);
+	clearVertices[2].Position = XMFLOAT3(3.0f, -1.0f, 1.0f);
+	unsigned int clearIndices[3] = { 0, 1, 2 };
+	shadowClearMesh = std::make_shared<Mesh>(clearVertices, 3, clearIndices, 3, device, context);
+
+	D3D11_DEPTH_STENCIL_DESC clearDepthDesc = {};
+	clearDepthDesc.DepthEnable = true;
+	clearDepthDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+	clearDepthDesc.DepthFunc = D3D11_COMPARISON_ALWAYS;
+	device->CreateDepthStencilState(&clearDepthDesc, shadowClearDepthState.GetAddressOf());
+}
+
+// --------------------------------------------------------
+// Sizes each light's tiles by its importance and gives the
+// lights whose size changed new tiles.  If the atlas is too
+// fragmented for them, every light is repacked, largest
+// first, which always fits.
+// --------------------------------------------------------
+void Game::UpdateShadowAtlas()
+{
+	XMFLOAT4X4 view = camera->GetViewMatrix();
+	XMFLOAT4X4 proj = camera->GetProjectionMatrix();
+	XMFLOAT4 planes[6];
+	FrustumCuller::ExtractPlanes(XMLoadFloat4x4(&view) * XMLoadFloat4x4(&proj), planes);
+
+	size_t lightCount = lightManager.GetSlotCount();
+	shadowLightImportance.resize(lightCount);
+	shadowLightTileCounts.resize(lightCount);
+	shadowLightTiles.resize(lightCount);
+	for (size_t i = 0; i < lightCount; i++)
+	{
+		// Lights the budget has faded out cast nothing
+		const Light& light = lightManager.GetLight((unsigned int)i);
+		shadowLightImportance[i] = lightBudget.GetFade((unsigned int)i) > 0.0f ?
+			ShadowAtlas::Importance(light, camera->GetTransform()->GetPosition(), camera->GetProjectionScale(), planes) : 0.0f;
+		shadowLightTileCounts[i] =
+			light.Type == LIGHT_TYPE_DIRECTIONAL ? shadowCascadeCount :
+			light.Type == LIGHT_TYPE_POINT ? ShadowViews::CubeFaces : 1;
+	}
+
+	// Everything has to fit in the constant buffer's view arrays too, so
+	// the least important lights past that go without
+	unsigned int viewTotal = 0;
+	std::vector<unsigned int> order(lightCount);
+	for (unsigned int i = 0; i < lightCount; i++)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return shadowLightImportance[a] > shadowLightImportance[b]; });
+	for (unsigned int i : order)
+	{
+		if (viewTotal + shadowLightTileCounts[i] > ShadowViews::MaxViews)
+			shadowLightImportance[i] = 0.0f;
+		else if (shadowLightImportance[i] > 0.0f)
+			viewTotal += shadowLightTileCounts[i];
+	}
+
+	std::vector<unsigned int> previousSizes = shadowLightSizes;
+	shadowAtlas.ChooseSizes(shadowLightImportance, shadowLightTileCounts, shadowMaxTileSize, shadowLightSizes);
+
+	// Lights that changed size give up their old tiles first
+	for (size_t i = 0; i < lightCount; i++)
+	{
+		if (i < previousSizes.size() && previousSizes[i] == shadowLightSizes[i])
+			continue;
+
+		for (const ShadowTile& tile : shadowLightTiles[i])
+			shadowAtlas.Free(tile);
+		shadowLightTiles[i].clear();
+	}
+
+	// Largest first, as the repack needs
+	std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return shadowLightSizes[a] > shadowLightSizes[b]; });
+	for (int attempt = 0; attempt < 2; attempt++)
+	{
+		bool packed = true;
+		for (unsigned int i : order)
+		{
+			while (shadowLightSizes[i] > 0 && shadowLightTiles[i].size() < shadowLightTileCounts[i])
+			{
+				ShadowTile tile;
+				if (!shadowAtlas.Allocate(shadowLightSizes[i], tile))
+				{
+					packed = false;
+					break;
+				}
+				shadowLightTiles[i].push_back(tile);
+			}
+		}
+
+		if (packed)
+			break;
+
+		shadowAtlas.Clear();
+		for (size_t i = 0; i < lightCount; i++)
+			shadowLightTiles[i].clear();
+	}
+}
+
+// --------------------------------------------------------
+// Fits a cascade to the visible receivers inside it and the
+// casters found by its first BVH query
+// --------------------------------------------------------
+void Game::TightenShadowCascade(unsigned int view)
+{
+	shadowCasterBoxes.clear();
+	for (unsigned int i : visibleShadowCasters[view])
+		shadowCasterBoxes.push_back(gameEntitiesVector[i].GetWorldBox());
 
-	// Change shadowProjectionSize to fit entire scene
-	XMMATRIX shProj = XMMatrixOrthographicLH(shadowProjectionSize, shadowProjectionSize, 0.1f, 100.0f);
-	XMStoreFloat4x4(&shadowProjectionMatrix, shProj);
+	const ShadowTile& tile = shadowViewTiles[view];
+	shadowViews[view] = ShadowCascades::Tighten(shadowViews[view], tile.size, shadowReceiverBoxes, shadowCasterBoxes);
+	shadowMatrices[view] = ShadowViews::AtlasMatrix(shadowViews[view], tile, shadowMapResolution);
+}
+
+// --------------------------------------------------------
+// Builds every shadowed light's views, in its tiles, and
+// tells the light where in the view arrays they start.
+// Cascades are fit to slices of the camera's view, out to
+// shadowDistance, along the light's direction.
+// --------------------------------------------------------
+void Game::UpdateShadowViews()
+{
+	float splits[ShadowCascades::MaxCascades + 1];
+	ShadowCascades::ComputeSplits(camera->GetNearClip(), min(shadowDistance, camera->GetFarClip()), shadowCascadeCount, shadowSplitLambda, splits);
+
+	XMFLOAT4X4 view = camera->GetViewMatrix();
+	XMFLOAT4X4 proj = camera->GetProjectionMatrix();
+
+	shadowViewCount = 0;
+	for (unsigned int i = 0; i < lightManager.GetSlotCount(); i++)
+	{
+		const Light& light = lightManager.GetLight(i);
+		const std::vector<ShadowTile>& tiles = shadowLightTiles[i];
+		if (light.ShadowView != (int)shadowViewCount || light.ShadowViewCount != (int)tiles.size())
+		{
+			Light moved = light;
+			moved.ShadowView = (int)shadowViewCount;
+			moved.ShadowViewCount = (int)tiles.size();
+			lightManager.SetLight(i, moved);
+		}
+
+		for (unsigned int t = 0; t < tiles.size(); t++)
+		{
+			ShadowView& shadowView = shadowViews[shadowViewCount];
+			switch (light.Type)
+			{
+			case LIGHT_TYPE_DIRECTIONAL:
+			{
+				XMFLOAT3 corners[8];
+				ShadowCascades::SliceCorners(XMLoadFloat4x4(&view), proj._11, proj._22, splits[t], splits[t + 1], corners);
+				shadowView = ShadowCascades::Fit(corners, light.Direction, tiles[t].size, shadowCasterDistance);
+				break;
+			}
+
+			case LIGHT_TYPE_POINT:
+				shadowView = ShadowViews::CubeFace(light.Position, t, shadowNearClip, light.Range, tiles[t].size);
+				break;
+
+			case LIGHT_TYPE_SPOT:
+				shadowView = ShadowViews::Spot(light.Position, light.Direction, ShadowViews::SpotHalfAngle(light.SpotFalloff), shadowNearClip, light.Range, tiles[t].size);
+				break;
+			}
+
+			shadowViewTiles[shadowViewCount] = tiles[t];
+			shadowViewLights[shadowViewCount] = i;
+			shadowMatrices[shadowViewCount] = ShadowViews::AtlasMatrix(shadowView, tiles[t], shadowMapResolution);
+			shadowTiles[shadowViewCount] = ShadowViews::AtlasBounds(tiles[t], shadowMapResolution);
+			shadowViewCount++;
+		}
+	}
+
+	// Unused views forget what they held, as other views may draw over
+	// their old tiles before they're used again
+	for (unsigned int layer = 0; layer < ShadowLayerCount; layer++)
+		for (unsigned int v = shadowViewCount; v < ShadowViews::MaxViews; v++)
+			shadowCache.Invalidate(layer * ShadowViews::MaxViews + v);
 }
 
 void Game::RenderShadowMap()
 {
-	// Set up pipeline to render shadow map
-	context->OMSetRenderTargets(0, 0, shadowDSV.Get());
-	context->ClearDepthStencilView(shadowDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
-	context->RSSetState(shadowRasterizer.Get());
-	
-	// Set up viewport
+	// Nothing to do if every tile still holds what it would be drawn with
+	bool anyDirty = false;
+	for (unsigned int layer = 0; layer < ShadowLayerCount; layer++)
+		for (unsigned int v = 0; v < shadowViewCount; v++)
+			anyDirty |= shadowTilesDirty[layer][v];
+	if (!anyDirty)
+		return;
+
+	StateCache::GetInstance().RSSetState(shadowRasterizer.Get());
+	StateCache::GetInstance().SetShader(ShaderStagePS, nullptr);
+
+	for (unsigned int layer = 0; layer < ShadowLayerCount; layer++)
+	{
+		StateCache::GetInstance().OMSetRenderTargets(0, 0, shadowDSVs[layer].Get());
+
+		// Each view draws into its own tile of the atlas
+		for (unsigned int v = 0; v < shadowViewCount; v++)
+		{
+			if (!shadowTilesDirty[layer][v])
+				continue;
+
+			D3D11_VIEWPORT tileViewport = {};
+			tileViewport.TopLeftX = (float)shadowViewTiles[v].x;
+			tileViewport.TopLeftY = (float)shadowViewTiles[v].y;
+			tileViewport.Width = (float)shadowViewTiles[v].size;
+			tileViewport.Height = (float)shadowViewTiles[v].size;
+			tileViewport.MaxDepth = 1.0f;
+			context->RSSetViewports(1, &tileViewport);
+			ClearShadowTile();
+
+			// Turn on custom shadow vertex shader, the view's matrices are shared by its casters
+			shadowInstancedVertexShader->SetShader();
+			shadowInstancedVertexShader->SetMatrix4x4("view", shadowViews[v].view);
+			shadowInstancedVertexShader->SetMatrix4x4("projection", shadowViews[v].projection);
+			shadowInstancedVertexShader->CopyBufferData("PerPass");
+
+			// Shadow batches ignore materials, so there's one per mesh
+			const std::vector<InstanceBatch>& batches = shadowBatchers[layer][v].GetBatches();
+			for (size_t b = 0; b < batches.size(); b++)
+			{
+				batches[b].mesh->BindInstanced(instanceBuffer->GetBuffer(), instanceBuffer->GetStride());
+				batches[b].mesh->DrawInstanced(batches[b].instanceCount, shadowInstanceOffsets[layer][v] + batches[b].firstInstance);
+			}
+		}
+	}
+
+	// Reset render states
+	StateCache::GetInstance().OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), depthStencilView.Get());
 	D3D11_VIEWPORT vp = {};
-	vp.TopLeftX = 0.0f;
-	vp.TopLeftY = 0.0f;
-	vp.Width = (float)shadowMapResolution;
-	vp.Height = (float)shadowMapResolution;
-	vp.MinDepth = 0.0f;
 	vp.MaxDepth = 1.0f;
+	vp.Width = (float)this->width;
+	vp.Height = (float)this->height;
 	context->RSSetViewports(1, &vp);
+	StateCache::GetInstance().RSSetState(0);
+}
 
-	// Turn on custom shadow vertex shader
+// --------------------------------------------------------
+// Resets the current viewport's tile of the bound shadow
+// atlas to the far plane.  ClearDepthStencilView can only
+// clear the whole texture, so a triangle covering the tile
+// is drawn at depth 1 with the depth test off instead.
+// --------------------------------------------------------
+void Game::ClearShadowTile()
+{
+	XMFLOAT4X4 identity;
+	XMStoreFloat4x4(&identity, XMMatrixIdentity());
+
+	StateCache::GetInstance().OMSetDepthStencilState(shadowClearDepthState.Get(), 0);
 	shadowVertexShader->SetShader();
-	shadowVertexShader->SetMatrix4x4("view", shadowViewMatrix);
-	shadowVertexShader->SetMatrix4x4("projection", shadowProjectionMatrix);
-	context->PSSetShader(0, 0, 0);
+	shadowVertexShader->SetMatrix4x4("view", identity);
+	shadowVertexShader->SetMatrix4x4("projection", identity);
+	shadowVertexShader->CopyBufferData("PerPass");
+	shadowVertexShader->SetMatrix4x4("world", identity);
+	shadowVertexShader->CopyBufferData("PerObject");
+	shadowClearMesh->Draw();
+	StateCache::GetInstance().OMSetDepthStencilState(nullptr, 0);
+}
 
-	// Loop through all objects and draw shadows
-	for (int i = 0; i < gameEntitiesVector.size(); i++)
+
+// --------------------------------------------------------
+// Returns how far a point is between a view's near and far
+// planes, from 0 to 1, for sorting draws front to back
+// --------------------------------------------------------
+static float ViewDepth(const XMFLOAT4X4& view, XMFLOAT3 position, float nearClip, float farClip)
+{
+	// Only the view space Z is needed
+	float z = position.x * view._13 + position.y * view._23 + position.z * view._33 + view._43;
+	return (z - nearClip) / (farClip - nearClip);
+}
+
+// --------------------------------------------------------
+// Moves the BVH leaves of entities whose transforms have
+// changed since last frame
+// --------------------------------------------------------
+void Game::UpdateSceneBVH()
+{
+	for (unsigned int i = 0; i < gameEntitiesVector.size(); i++)
 	{
-		// Set world matrix for vertex shader calculation
-		shadowVertexShader->SetMatrix4x4("world", gameEntitiesVector[i].GetTransform()->GetWorldMatrix());
-		shadowVertexShader->CopyAllBufferData();
-		
-		// Draw
-		gameEntitiesVector[i].GetMesh()->Draw();
+		unsigned int version = gameEntitiesVector[i].GetTransform()->GetVersion();
+		if (version == entityTransformVersions[i])
+			continue;
+
+		sceneBVH.Move(entityProxies[i], gameEntitiesVector[i].GetWorldBox());
+		entityTransformVersions[i] = version;
 	}
+	sceneBVH.Update();
+}
 
-	// Reset render states
-	context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), depthStencilView.Get());
-	vp.Width = (float)this->width;
-	vp.Height = (float)this->height;
-	context->RSSetViewports(1, &vp);
-	context->RSSetState(0);
+// --------------------------------------------------------
+// Removes entities from a pass's list that are too small
+// to matter or past their draw distance
+// --------------------------------------------------------
+void Game::CullByContribution(ContributionCuller& culler, std::vector<unsigned int>& entities)
+{
+	contributionSpheres.clear();
+	contributionDrawDistances.clear();
+	for (unsigned int i : entities)
+	{
+		contributionSpheres.push_back(gameEntitiesVector[i].GetWorldSphere());
+		contributionDrawDistances.push_back(gameEntitiesVector[i].GetDrawDistance());
+	}
+
+	culler.Cull(camera->GetTransform()->GetPosition(), contributionSpheres, contributionDrawDistances, entities);
+}
+
+// --------------------------------------------------------
+// Removes entities hidden behind others from the visible
+// list.  The occluders are the visible entities that are
+// largest on screen, up to the culler's limit, which it
+// lowers when a frame's culling goes over its time budget.
+// --------------------------------------------------------
+void Game::CullOccludedEntities(const XMFLOAT4X4& view, const XMFLOAT4X4& proj)
+{
+	XMMATRIX viewMat = XMLoadFloat4x4(&view);
+
+	// Screen size is the sphere's radius over its view depth, scaled by the projection
+	occluderCandidates.clear();
+	for (unsigned int i : visibleEntities)
+	{
+		const BoundingSphere& sphere = gameEntitiesVector[i].GetWorldSphere();
+		float depth = XMVectorGetZ(XMVector3Transform(XMLoadFloat3(&sphere.Center), viewMat));
+		float size = sphere.Radius * camera->GetProjectionScale() / max(depth, camera->GetNearClip());
+		if (size >= occluderMinScreenSize)
+			occluderCandidates.push_back({ size, i });
+	}
+
+	std::sort(occluderCandidates.begin(), occluderCandidates.end(),
+		[](const std::pair<float, unsigned int>& a, const std::pair<float, unsigned int>& b) { return a.first > b.first; });
+	if (occluderCandidates.size() > occlusionCuller.GetOccluderLimit())
+		occluderCandidates.resize(occlusionCuller.GetOccluderLimit());
+
+	occlusionCuller.Begin(viewMat * XMLoadFloat4x4(&proj));
+	for (const std::pair<float, unsigned int>& candidate : occluderCandidates)
+	{
+		std::shared_ptr<Mesh> mesh = gameEntitiesVector[candidate.second].GetMesh();
+		XMFLOAT4X4 world = gameEntitiesVector[candidate.second].GetTransform()->GetWorldMatrix();
+		occlusionCuller.AddOccluder(
+			mesh->GetPositions().data(),
+			mesh->GetIndices().data(),
+			(unsigned int)mesh->GetIndices().size(),
+			XMLoadFloat4x4(&world));
+	}
+	occlusionCuller.Rasterize();
+
+	occludeeBoxes.clear();
+	for (unsigned int i : visibleEntities)
+		occludeeBoxes.push_back(gameEntitiesVector[i].GetWorldBox());
+
+	// Results index into the list that was tested, so map them back to entities
+	occludeeVisible.clear();
+	occlusionCuller.Cull(occludeeBoxes, occludeeVisible);
+	for (unsigned int i = 0; i < occludeeVisible.size(); i++)
+		visibleEntities[i] = visibleEntities[occludeeVisible[i]];
+
+	FrameCounters& stats = RenderStats::GetInstance().GetCurrentFrame();
+	stats.entitiesOccluded += (unsigned int)(visibleEntities.size() - occludeeVisible.size());
+	stats.occludersRasterized += (unsigned int)occluderCandidates.size();
+	visibleEntities.resize(occludeeVisible.size());
+
+	occlusionCuller.EndFrame();
+	stats.occlusionMicroseconds += (unsigned int)(occlusionCuller.GetLastFrameMilliseconds() * 1000.0f);
+	stats.occlusionBudgetMicroseconds = (unsigned int)(occlusionCuller.GetBudget() * 1000.0f);
+}
+
+// --------------------------------------------------------
+// Culls the entities against the camera and the shadow
+// light, sorts the survivors into batches for the main and
+// shadow passes, then uploads their world matrices in batch
+// order so each batch's instances are contiguous in the
+// instance buffer.  The main pass's instances come first,
+// followed by each shadow tile's that needs redrawing.
+// --------------------------------------------------------
+void Game::BuildInstanceBatches()
+{
+	XMFLOAT4X4 view = camera->GetViewMatrix();
+	XMFLOAT4X4 proj = camera->GetProjectionMatrix();
+
+	// World bounds are only rebuilt for entities that moved
+	UpdateSceneBVH();
+
+	// Query order depends on the tree's shape, so it's sorted to keep
+	// ties in the render queue stable from frame to frame
+	XMFLOAT4 planes[6];
+	FrustumCuller::ExtractPlanes(XMLoadFloat4x4(&view) * XMLoadFloat4x4(&proj), planes);
+	visibleEntities.clear();
+	sceneBVH.QueryFrustum(planes, visibleEntities);
+	std::sort(visibleEntities.begin(), visibleEntities.end());
+
+	unsigned int entityCount = (unsigned int)gameEntitiesVector.size();
+	FrameCounters& stats = RenderStats::GetInstance().GetCurrentFrame();
+	stats.entitiesCulled += entityCount - (unsigned int)visibleEntities.size();
+
+	// Viewport height can change with the window
+	unsigned int beforeContribution = (unsigned int)visibleEntities.size();
+	contributionCuller.SetPerspective(camera->GetProjectionScale(), (float)height, contributionMinPixels);
+	CullByContribution(contributionCuller, visibleEntities);
+	stats.entitiesSkipped += beforeContribution - (unsigned int)visibleEntities.size();
+
+	// Only the camera's list - a hidden entity's shadow may still be seen
+	CullOccludedEntities(view, proj);
+
+	// Only what the camera sees needs shadows on it
+	shadowReceiverBoxes.clear();
+	for (unsigned int i : visibleEntities)
+		shadowReceiverBoxes.push_back(gameEntitiesVector[i].GetWorldBox());
+
+	// The same boxes pick each entity's lights, all in one batch
+	entityLightLists.resize(entityCount);
+	if (useObjectLightLists)
+	{
+		objectLightSelector.Select(shadedLights, shadowReceiverBoxes, visibleLightLists);
+		for (size_t i = 0; i < visibleEntities.size(); i++)
+			entityLightLists[visibleEntities[i]] = visibleLightLists[i];
+	}
+
+	// Each shadow view only draws the casters inside its own volume
+	UpdateShadowAtlas();
+	UpdateShadowViews();
+	for (unsigned int v = 0; v < shadowViewCount; v++)
+	{
+		const ShadowView& shadowView = shadowViews[v];
+		FrustumCuller::ExtractPlanes(XMLoadFloat4x4(&shadowView.view) * XMLoadFloat4x4(&shadowView.projection), planes);
+		visibleShadowCasters[v].clear();
+		sceneBVH.QueryFrustum(planes, visibleShadowCasters[v]);
+
+		// Cascades shrink to their receivers and the casters that reach them
+		if (lightManager.GetLight(shadowViewLights[v]).Type == LIGHT_TYPE_DIRECTIONAL)
+		{
+			TightenShadowCascade(v);
+			FrustumCuller::ExtractPlanes(XMLoadFloat4x4(&shadowView.view) * XMLoadFloat4x4(&shadowView.projection), planes);
+			visibleShadowCasters[v].clear();
+			sceneBVH.QueryFrustum(planes, visibleShadowCasters[v]);
+		}
+
+		std::sort(visibleShadowCasters[v].begin(), visibleShadowCasters[v].end());
+		stats.shadowCastersCulled += entityCount - (unsigned int)visibleShadowCasters[v].size();
+
+		// Texel size differs per cascade, so each has its own threshold.  Spot
+		// and point views are already limited to the light's range.
+		if (lightManager.GetLight(shadowViewLights[v]).Type != LIGHT_TYPE_DIRECTIONAL)
+			continue;
+
+		beforeContribution = (unsigned int)visibleShadowCasters[v].size();
+		shadowContributionCullers[v].SetOrthographic(2.0f / shadowView.projection._11, shadowViewTiles[v].size, shadowContributionMinTexels);
+		CullByContribution(shadowContributionCullers[v], visibleShadowCasters[v]);
+		stats.shadowCastersSkipped += beforeContribution - (unsigned int)visibleShadowCasters[v].size();
+	}
+
+	// Opaque draws are grouped by state, then front to back for early-Z
+	mainBatcher.Begin();
+	for (unsigned int i : visibleEntities)
+	{
+		Mesh* mesh = gameEntitiesVector[i].GetMesh().get();
+		Material* mat = gameEntitiesVector[i].GetMaterial().get();
+		XMFLOAT3 position = gameEntitiesVector[i].GetTransform()->GetPosition();
+
+		mainBatcher.Add(
+			RenderQueue::MakeKey(
+				RenderPassOpaque,
+				mat->GetPixelShader()->GetShaderID(),
+				mat->GetID(),
+				mesh->GetID(),
+				ViewDepth(view, position, camera->GetNearClip(), camera->GetFarClip())),
+			mesh, mat, i);
+	}
+	mainBatcher.Build();
+
+	// Each view's casters are split into the static and dynamic layers,
+	// and a layer's tile is only batched if the cache says it's changed.
+	// Shadow casters only need the mesh, nearest to the light first.
+	for (unsigned int layer = 0; layer < ShadowLayerCount; layer++)
+	{
+		for (unsigned int v = 0; v < shadowViewCount; v++)
+		{
+			shadowLayerCasters.clear();
+			shadowCasterKeys.clear();
+			for (unsigned int i : visibleShadowCasters[v])
+			{
+				if (gameEntitiesVector[i].IsStatic() != (layer == ShadowLayerStatic))
+					continue;
+
+				shadowLayerCasters.push_back(i);
+				shadowCasterKeys.push_back(ShadowCache::CasterKey(i, gameEntitiesVector[i].GetTransform()->GetVersion()));
+			}
+
+			InstanceBatcher& batcher = shadowBatchers[layer][v];
+			batcher.Begin();
+			shadowTilesDirty[layer][v] = shadowCache.Update(layer * ShadowViews::MaxViews + v, shadowMatrices[v], shadowCasterKeys);
+			if (!shadowTilesDirty[layer][v])
+			{
+				batcher.Build();
+				stats.shadowTilesSkipped++;
+				continue;
+			}
+
+			const ShadowView& shadowView = shadowViews[v];
+			for (unsigned int i : shadowLayerCasters)
+			{
+				Mesh* mesh = gameEntitiesVector[i].GetMesh().get();
+				XMFLOAT3 position = gameEntitiesVector[i].GetTransform()->GetPosition();
+
+				batcher.Add(
+					RenderQueue::MakeKey(
+						RenderPassShadow, 0, 0,
+						mesh->GetID(),
+						ViewDepth(shadowView.view, position, shadowView.depthNear, shadowView.depthFar)),
+					mesh, nullptr, i);
+			}
+			batcher.Build();
+			stats.shadowTilesRedrawn++;
+		}
+	}
+
+	// Main pass instances first, then each shadow tile's in turn
+	instanceData.clear();
+	AppendInstances(mainBatcher.GetInstanceOrder());
+	for (unsigned int layer = 0; layer < ShadowLayerCount; layer++)
+	{
+		for (unsigned int v = 0; v < shadowViewCount; v++)
+		{
+			shadowInstanceOffsets[layer][v] = (unsigned int)instanceData.size();
+			AppendInstances(shadowBatchers[layer][v].GetInstanceOrder());
+		}
+	}
+
+	instanceBuffer->Write(instanceData.data(), (unsigned int)instanceData.size());
+}
+
+void Game::AppendInstances(const std::vector<unsigned int>& entities)
+{
+	for (unsigned int entity : entities)
+	{
+		Transform* transform = gameEntitiesVector[entity].GetTransform();
+		InstanceData instance;
+		instance.world = transform->GetWorldMatrix();
+		instance.worldInvTranspose = transform->GetWorldInverseTransposeMatrix();
+		memcpy(&instance.lights, entityLightLists[entity].packed, sizeof(instance.lights));
+		instance.lightmapRect = entityLightmapRects[entity];
+		instanceData.push_back(instance);
+	}
 }
 
 
@@ -570,8 +1183,454 @@ void Game::Update(float deltaTime, float totalTime)
 	if (Input::GetInstance().KeyDown(VK_ESCAPE))
 		Quit();
 
+	if (Input::GetInstance().KeyPress(VK_F2))
+		useObjectLightLists = !useObjectLightLists;
+
 	// Calling camera update
 	camera->Update(deltaTime);
+
+#if defined(DEBUG) || defined(_DEBUG)
+	// Benchmark results go to the console window, which only exists in debug
+	if (Input::GetInstance().KeyPress(VK_F1))
+		RunBenchmarks();
+#endif
+}
+
+// --------------------------------------------------------
+// Reads the sky back and projects it to spherical harmonics
+// for the pixel shader's ambient.  The coefficients are set
+// once here and go up with the rest of PerFrame.
+// --------------------------------------------------------
+void Game::ComputeSkyAmbient()
+{
+	for (unsigned int c = 0; c < SphericalHarmonics::CoefficientCount; c++)
+	{
+		skyAmbientSH[c] = XMFLOAT4(0, 0, 0, 0);
+		skyRadianceSH[c] = XMFLOAT3(0, 0, 0);
+	}
+
+	std::vector<XMFLOAT4> faces[6];
+	bool captured = skybox->CaptureFaces(device, context, skyAmbientResolution, faces);
+
+	ResetRenderTarget();
+
+	if (captured)
+	{
+		// The sky texture is gamma encoded like the albedo maps
+		for (std::vector<XMFLOAT4>& face : faces)
+		{
+			for (XMFLOAT4& texel : face)
+				texel = XMFLOAT4(powf(texel.x, 2.2f), powf(texel.y, 2.2f), powf(texel.z, 2.2f), 1.0f);
+		}
+
+		XMFLOAT3 coefficients[SphericalHarmonics::CoefficientCount];
+		SphericalHarmonics::ProjectCubeMap(faces, skyAmbientResolution, coefficients);
+		for (unsigned int c = 0; c < SphericalHarmonics::CoefficientCount; c++)
+			skyRadianceSH[c] = XMFLOAT3(coefficients[c].x * skyAmbientScale, coefficients[c].y * skyAmbientScale, coefficients[c].z * skyAmbientScale);
+		SphericalHarmonics::ConvolveDiffuse(coefficients);
+		for (unsigned int c = 0; c < SphericalHarmonics::CoefficientCount; c++)
+			skyAmbientSH[c] = XMFLOAT4(coefficients[c].x * skyAmbientScale, coefficients[c].y * skyAmbientScale, coefficients[c].z * skyAmbientScale, 0.0f);
+	}
+
+	pixelShader->SetData("ambientSH", skyAmbientSH, sizeof(skyAmbientSH));
+}
+
+// --------------------------------------------------------
+// Loads the prefiltered sky and BRDF lookup for specular
+// image based light.  If either hasn't been baked yet, the
+// sky is read back and both are baked and saved first, so
+// it's only slow the first time.
+// --------------------------------------------------------
+void Game::LoadSpecularIBL()
+{
+	std::string specularPath = GetFullPathTo("../../Assets/Textures/SunnySpecularIBL.dds");
+	std::string brdfPath = GetFullPathTo("../../Assets/Textures/BRDFLookup.dds");
+	std::wstring specularPathWide = GetFullPathTo_Wide(L"../../Assets/Textures/SunnySpecularIBL.dds");
+	std::wstring brdfPathWide = GetFullPathTo_Wide(L"../../Assets/Textures/BRDFLookup.dds");
+
+	for (int attempt = 0; attempt < 2; attempt++)
+	{
+		specularIBLSRV.Reset();
+		brdfLookupSRV.Reset();
+		if (SUCCEEDED(CreateDDSTextureFromFile(device.Get(), context.Get(), specularPathWide.c_str(), nullptr, specularIBLSRV.GetAddressOf())) &&
+			SUCCEEDED(CreateDDSTextureFromFile(device.Get(), context.Get(), brdfPathWide.c_str(), nullptr, brdfLookupSRV.GetAddressOf())))
+			return;
+
+		if (attempt > 0)
+			break;
+
+		CubeFaces sky;
+		sky.size = iblBakeSettings.specularSize;
+		bool captured = skybox->CaptureFaces(device, context, sky.size, sky.faces);
+		ResetRenderTarget();
+		if (!captured || !IBLBaker::BakeFiles(sky, specularPath, brdfPath, iblBakeSettings))
+			break;
+	}
+
+	// Unbound textures read as black, so there's just no specular ambient
+	printf("Specular IBL unavailable\n");
+	specularIBLSRV.Reset();
+	brdfLookupSRV.Reset();
+}
+
+// --------------------------------------------------------
+// Loads the lightmap and irradiance probes, baking and
+// saving them first if they haven't been.  The bake takes
+// the lightmapped entities where they are now, so the
+// files must be deleted to rebake after the scene changes.
+// Point lights are baked, while directional lights stay
+// real time for their cascaded shadows and specular.
+// --------------------------------------------------------
+void Game::LoadBakedLighting()
+{
+	entityLightmapRects.assign(gameEntitiesVector.size(), XMFLOAT4(0, 0, 0, 0));
+
+	// The lightmapped entities' triangles in world space, and the
+	// whole scene's bounds for the probes
+	std::vector<LightmapInstance> instances;
+	std::vector<unsigned int> instanceEntities;
+	XMFLOAT3 sceneMin(FLT_MAX, FLT_MAX, FLT_MAX), sceneMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (unsigned int i = 0; i < gameEntitiesVector.size(); i++)
+	{
+		GameEntity& entity = gameEntitiesVector[i];
+		const BoundingBox& box = entity.GetWorldBox();
+		sceneMin = XMFLOAT3(
+			std::min(sceneMin.x, box.Center.x - box.Extents.x),
+			std::min(sceneMin.y, box.Center.y - box.Extents.y),
+			std::min(sceneMin.z, box.Center.z - box.Extents.z));
+		sceneMax = XMFLOAT3(
+			std::max(sceneMax.x, box.Center.x + box.Extents.x),
+			std::max(sceneMax.y, box.Center.y + box.Extents.y),
+			std::max(sceneMax.z, box.Center.z + box.Extents.z));
+
+		if (!entity.IsLightmapped())
+			continue;
+
+		std::shared_ptr<Mesh> mesh = entity.GetMesh();
+		XMFLOAT4X4 world = entity.GetTransform()->GetWorldMatrix();
+		XMFLOAT4X4 worldInvTranspose = entity.GetTransform()->GetWorldInverseTransposeMatrix();
+		XMMATRIX worldMat = XMLoadFloat4x4(&world);
+		XMMATRIX normalMat = XMLoadFloat4x4(&worldInvTranspose);
+
+		LightmapInstance instance;
+		const std::vector<XMFLOAT3>& positions = mesh->GetPositions();
+		const std::vector<XMFLOAT3>& normals = mesh->GetNormals();
+		instance.positions.resize(positions.size());
+		instance.normals.resize(normals.size());
+		for (size_t v = 0; v < positions.size(); v++)
+		{
+			XMStoreFloat3(&instance.positions[v], XMVector3TransformCoord(XMLoadFloat3(&positions[v]), worldMat));
+			XMStoreFloat3(&instance.normals[v], XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&normals[v]), normalMat)));
+		}
+		instance.lightmapUVs = mesh->GetLightmapUVs();
+		instance.indices = mesh->GetIndices();
+
+		// The albedo maps are all roughly mid grey
+		XMFLOAT4 tint = entity.GetMaterial()->GetColor();
+		instance.albedo = XMFLOAT3(tint.x * 0.5f, tint.y * 0.5f, tint.z * 0.5f);
+		instance.rect = XMFLOAT4(0, 0, 0, 0);
+
+		instances.push_back(instance);
+		instanceEntities.push_back(i);
+	}
+
+	probeGrid = LightmapBaker::PlaceProbes(sceneMin, sceneMax, lightmapBakeSettings);
+	bool loaded = LightmapBaker::PackAtlas(instances, lightmapBakeSettings);
+
+	for (unsigned int i = 0; i < lightManager.GetSlotCount(); i++)
+	{
+		Light light = lightManager.GetLight(i);
+		light.Baked = light.Type == LIGHT_TYPE_POINT && lightManager.IsLive(i) ? 1 : 0;
+		lightManager.SetLight(i, light);
+	}
+
+	std::string lightmapPath = GetFullPathTo("../../Assets/Textures/Lightmap.dds");
+	std::string probePath = GetFullPathTo("../../Assets/Textures/IrradianceProbes.dds");
+	std::wstring lightmapPathWide = GetFullPathTo_Wide(L"../../Assets/Textures/Lightmap.dds");
+	std::wstring probePathWide = GetFullPathTo_Wide(L"../../Assets/Textures/IrradianceProbes.dds");
+
+	for (int attempt = 0; attempt < 2 && loaded; attempt++)
+	{
+		lightmapSRV.Reset();
+		probeSRV.Reset();
+		if (SUCCEEDED(CreateDDSTextureFromFile(device.Get(), context.Get(), lightmapPathWide.c_str(), nullptr, lightmapSRV.GetAddressOf())) &&
+			SUCCEEDED(CreateDDSTextureFromFile(device.Get(), context.Get(), probePathWide.c_str(), nullptr, probeSRV.GetAddressOf())))
+			break;
+
+		loaded = attempt == 0 &&
+			LightmapBaker::BakeFiles(instances, lightManager.GetLights(), skyRadianceSH, lightmapBakeSettings, probeGrid, lightmapPath, probePath);
+	}
+
+	if (loaded)
+	{
+		for (unsigned int i = 0; i < instances.size(); i++)
+			entityLightmapRects[instanceEntities[i]] = instances[i].rect;
+	}
+	else
+	{
+		// Everything's lit at runtime as before
+		printf("Baked lighting unavailable\n");
+		lightmapSRV.Reset();
+		probeSRV.Reset();
+		for (unsigned int i = 0; i < lightManager.GetSlotCount(); i++)
+		{
+			Light light = lightManager.GetLight(i);
+			light.Baked = 0;
+			lightManager.SetLight(i, light);
+		}
+	}
+
+	pixelShader->SetFloat3("probeOrigin", probeGrid.origin);
+	pixelShader->SetInt("probesLoaded", loaded ? 1 : 0);
+	pixelShader->SetFloat3("probeSpacing", probeGrid.spacing);
+	pixelShader->SetData("probeCounts", probeGrid.counts, sizeof(probeGrid.counts));
+}
+
+// --------------------------------------------------------
+// Puts back the back buffer and its viewport after drawing
+// somewhere else
+// --------------------------------------------------------
+void Game::ResetRenderTarget()
+{
+	StateCache::GetInstance().OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), depthStencilView.Get());
+	D3D11_VIEWPORT vp = {};
+	vp.MaxDepth = 1.0f;
+	vp.Width = (float)this->width;
+	vp.Height = (float)this->height;
+	context->RSSetViewports(1, &vp);
+}
+
+// --------------------------------------------------------
+// Scores the lights for the camera's view and moves their
+// fades on.  A fade changing changes what the shaders see,
+// so those lights are shaded and uploaded again like any
+// other light change.
+// --------------------------------------------------------
+void Game::UpdateLightBudget(float deltaTime)
+{
+	XMFLOAT4X4 view = camera->GetViewMatrix();
+	XMFLOAT4X4 proj = camera->GetProjectionMatrix();
+	XMFLOAT4 planes[6];
+	FrustumCuller::ExtractPlanes(XMLoadFloat4x4(&view) * XMLoadFloat4x4(&proj), planes);
+
+	lightBudget.Update(lightManager.GetLights(), camera->GetTransform()->GetPosition(), camera->GetProjectionScale(), planes, deltaTime);
+	BuildShadedLights();
+	for (unsigned int i : lightBudget.GetFadeChanges())
+	{
+		ShadeLight(i);
+		lightUploadQueue.Queue(i);
+	}
+
+	FrameCounters& stats = RenderStats::GetInstance().GetCurrentFrame();
+	unsigned int shadedCount = (unsigned int)lightBudget.GetActiveLights().size();
+	stats.lightsShaded += shadedCount;
+	stats.lightsCulled += lightManager.GetLiveCount() - shadedCount;
+}
+
+// --------------------------------------------------------
+// Shades the lights changed since the last call and queues
+// them for upload
+// --------------------------------------------------------
+void Game::BuildShadedLights()
+{
+	shadedLights.resize(lightManager.GetSlotCount());
+	lightManager.GetChangedRanges(shadedLightsVersion, 0, shadedChangedRanges);
+	for (const LightRange& range : shadedChangedRanges)
+	{
+		for (unsigned int i = range.first; i < range.first + range.count; i++)
+			ShadeLight(i);
+		lightUploadQueue.Queue(range);
+	}
+	shadedLightsVersion = lightManager.GetVersion();
+}
+
+// Copies a light to shadedLights with its intensity scaled by its fade
+void Game::ShadeLight(unsigned int index)
+{
+	shadedLights[index] = lightManager.GetLight(index);
+	shadedLights[index].Intensity *= lightBudget.GetFade(index);
+}
+
+// --------------------------------------------------------
+// Copies the shaded lights queued since the last upload to
+// their structured buffer, leaving the rest of it alone.
+// Ranges that fail to copy stay queued for the next frame.
+// --------------------------------------------------------
+void Game::UploadLights()
+{
+	// The shadow views may have changed since the budget's copy
+	BuildShadedLights();
+
+	FrameCounters& stats = RenderStats::GetInstance().GetCurrentFrame();
+	if (lightUploadQueue.IsEmpty())
+	{
+		stats.lightUploadsSkipped++;
+		return;
+	}
+
+	lightUploadQueue.Flush([&](const LightRange& range)
+	{
+		if (!lightBuffer->WriteRange(&shadedLights[range.first], range.first, range.count))
+			return false;
+
+		stats.lightUploads++;
+		stats.lightUploadBytes += (unsigned int)(sizeof(Light) * range.count);
+		return true;
+	});
+}
+
+// --------------------------------------------------------
+// Bins the budget's point and spot lights into the camera's
+// clusters by the volume they reach, as view space cones,
+// and uploads the grid.  Directional lights go first in the
+// index buffer and the shader offsets the clusters' ranges
+// past them.
+//
+// A new view moves every cone, so everything's binned
+// again.  Otherwise only the lights whose cones moved, or
+// that came or went, are, and if there are none the grid
+// on the GPU is still current.
+// --------------------------------------------------------
+void Game::BuildLightClusters()
+{
+	XMFLOAT4X4 view = camera->GetViewMatrix();
+	XMFLOAT4X4 proj = camera->GetProjectionMatrix();
+	XMMATRIX viewMat = XMLoadFloat4x4(&view);
+
+	bool rebuild = !clusterGridBuilt ||
+		memcmp(&view, &clusterView, sizeof(view)) != 0 ||
+		memcmp(&proj, &clusterProjection, sizeof(proj)) != 0;
+	clusterGrid.SetProjection(proj._11, proj._22, camera->GetNearClip(), camera->GetFarClip());
+
+	unsigned int slotCount = lightManager.GetSlotCount();
+	clusterConesByLight.resize(slotCount);
+	clusterBinned.resize(slotCount, 0);
+	clusterNowBinned.assign(slotCount, 0);
+	clusterLightChanged.assign(slotCount, 0);
+	lightManager.GetChangedRanges(clusterLightsVersion, 0, clusterChangedRanges);
+	for (const LightRange& range : clusterChangedRanges)
+		std::fill(clusterLightChanged.begin() + range.first, clusterLightChanged.begin() + range.first + range.count, 1);
+
+	// Lights whose cone moved, or that the budget added or dropped,
+	// are binned again.  Changes that leave a light's cone where it
+	// was (its color, intensity or shadow views) don't touch the grid.
+	std::vector<unsigned int> globalLights;
+	clusterRebinLights.clear();
+	clusterLightCones.clear();
+	clusterLightIndices.clear();
+	for (unsigned int i : lightBudget.GetActiveLights())
+	{
+		const Light& light = lightManager.GetLight(i);
+		if (light.Type == LIGHT_TYPE_DIRECTIONAL)
+		{
+			globalLights.push_back(i);
+			continue;
+		}
+
+		if (rebuild || clusterLightChanged[i] || !clusterBinned[i])
+		{
+			Light viewLight = light;
+			XMStoreFloat3(&viewLight.Position, XMVector3Transform(XMLoadFloat3(&light.Position), viewMat));
+			XMStoreFloat3(&viewLight.Direction, XMVector3TransformNormal(XMLoadFloat3(&light.Direction), viewMat));
+			Cone cone = ConeCuller::FromLight(viewLight);
+			if (!rebuild && (!clusterBinned[i] || memcmp(&cone, &clusterConesByLight[i], sizeof(Cone)) != 0))
+				clusterRebinLights.push_back(i);
+			clusterConesByLight[i] = cone;
+		}
+
+		clusterNowBinned[i] = 1;
+		clusterLightCones.push_back(clusterConesByLight[i]);
+		clusterLightIndices.push_back(i);
+	}
+
+	// Lights the budget dropped leave the grid
+	for (unsigned int i = 0; i < slotCount && !rebuild; i++)
+	{
+		if (clusterBinned[i] && !clusterNowBinned[i])
+			clusterRebinLights.push_back(i);
+	}
+	std::sort(clusterRebinLights.begin(), clusterRebinLights.end());
+	clusterBinned.swap(clusterNowBinned);
+	clusterLightsVersion = lightManager.GetVersion();
+	clusterView = view;
+	clusterProjection = proj;
+	clusterGridBuilt = true;
+
+	unsigned int rebinned = 0;
+	if (rebuild)
+	{
+		clusterGrid.Build(clusterLightCones, clusterLightIndices);
+		rebinned = (unsigned int)clusterLightCones.size();
+	}
+	else if (!clusterRebinLights.empty())
+	{
+		rebinned = clusterGrid.Update(clusterLightCones, clusterLightIndices, clusterRebinLights);
+	}
+	else if (globalLights == clusterGlobalLights)
+	{
+		return;
+	}
+	RenderStats::GetInstance().GetCurrentFrame().lightsRebinned += rebinned;
+
+	clusterGlobalLights.swap(globalLights);
+	clusterGlobalLightCount = (unsigned int)clusterGlobalLights.size();
+	clusterIndexUpload.assign(clusterGlobalLights.begin(), clusterGlobalLights.end());
+
+	const std::vector<unsigned int>& gridIndices = clusterGrid.GetLightIndices();
+	clusterIndexUpload.insert(clusterIndexUpload.end(), gridIndices.begin(), gridIndices.end());
+
+	const std::vector<ClusterRange>& ranges = clusterGrid.GetRanges();
+	clusterMaxLocalLights = 0;
+	for (const ClusterRange& range : ranges)
+		clusterMaxLocalLights = max(clusterMaxLocalLights, range.count);
+	clusterRangeBuffer->Write(ranges.data(), (unsigned int)ranges.size());
+	clusterIndexBuffer->Write(clusterIndexUpload.data(), (unsigned int)clusterIndexUpload.size());
+}
+
+// --------------------------------------------------------
+// The pixel shader variant for this frame's lights and a
+// material's textures, or pixelShader if none was built
+// for them.  Object light lists can hold any type of light
+// in any order, so they always use pixelShader.
+// --------------------------------------------------------
+std::shared_ptr<SimplePixelShader> Game::SelectPixelShaderVariant(Material* material)
+{
+	if (useObjectLightLists)
+		return pixelShader;
+
+	LightingPermutation permutation;
+	permutation.directionalLights = clusterGlobalLightCount;
+	permutation.localLights = clusterMaxLocalLights;
+	permutation.shadows = shadowViewCount > 0;
+	permutation.normalMap = material->HasTextureSRV("NormalMap");
+
+	unsigned int key = ShaderPermutations::MakeKey(permutation);
+	std::shared_ptr<SimplePixelShader> variant = pixelShaderVariants->Get(key);
+	if (!variant)
+		return pixelShader;
+
+	// Variants share pixelShader's PerFrame layout
+	if (pixelShaderVariantFrames[key] != frameNumber)
+	{
+		const SimpleConstantBuffer* perFrame = pixelShader->GetBufferInfo("PerFrame");
+		variant->SetBufferData("PerFrame", perFrame->LocalDataBuffer, perFrame->Size);
+		variant->CopyBufferData("PerFrame");
+		pixelShaderVariantFrames[key] = frameNumber;
+	}
+	return variant;
+}
+
+// --------------------------------------------------------
+// Times the renderer's hot paths and prints the results
+// --------------------------------------------------------
+void Game::RunBenchmarks()
+{
+	printf("\n--- Benchmarks ---\n");
+	Benchmarks::RenderQueueSort(100000);
+	Benchmarks::MaterialBind({ cerMat, hr4Mat, hr5Mat, stoneMat }, 10000);
+	Benchmarks::OcclusionCull(20000);
+	Benchmarks::ConeCull(1000, 10000);
+	Benchmarks::LightUpdates(4000, 300, 20);
 }
 
 // --------------------------------------------------------
@@ -582,6 +1641,10 @@ void Game::Draw(float deltaTime, float totalTime)
 	// Background color (Cornflower Blue in this case) for clearing
 	const float color[4] = { 0.4f, 0.6f, 0.75f, 0.0f };
 
+	// Reclaim upload ring space the GPU is finished with
+	constantBufferRing->BeginFrame();
+	frameNumber++;
+
 	// Clear the render target and depth buffer (erases what's on the screen)
 	//  - Do this ONCE PER FRAME
 	//  - At the beginning of Draw (before drawing *anything*)
@@ -592,20 +1655,122 @@ void Game::Draw(float deltaTime, float totalTime)
 		1.0f,
 		0);
 
+	// Everything after works from the lights the budget picks
+	UpdateLightBudget(deltaTime);
+
+	// Both the shadow pass and the main pass draw from the same batches
+	BuildInstanceBatches();
+
 	// Render the shadow map (shadow mapping is a 'pre-process')
 	RenderShadowMap();
 
-	// Passing shadow information to shaders
-	vertexShader->SetMatrix4x4("lightView", shadowViewMatrix);
-	vertexShader->SetMatrix4x4("lightProj", shadowProjectionMatrix);
+	// Bin the lights for the camera's view
+	UploadLights();
+	BuildLightClusters();
 
-	pixelShader->SetShaderResourceView("ShadowMap", shadowSRV);
-	pixelShader->SetSamplerState("ShadowSampler", shadowSampler);
+	// Camera and light data is the same for every entity, so upload it once per frame.
+	// The per-object vertex shader gets it too, for materials that can't be instanced
+	std::shared_ptr<SimpleVertexShader> sceneVertexShaders[] = { instancedVertexShader, vertexShader };
+	for (auto& vs : sceneVertexShaders)
+	{
+		vs->SetMatrix4x4("view", camera->GetViewMatrix());
+		vs->SetMatrix4x4("projection", camera->GetProjectionMatrix());
+		vs->CopyBufferData("PerFrame");
+	}
 
-	// Call draw on all game entities before drawing skybox
-	for (int i = 0; i < gameEntitiesVector.size(); i++)
+	pixelShader->SetFloat3("cameraPosition", camera->GetTransform()->GetPosition());
+	pixelShader->SetInt("globalLightCount", (int)clusterGlobalLightCount);
+	pixelShader->SetInt("objectLightLists", useObjectLightLists ? 1 : 0);
+
+	// Turns a pixel's position and view depth into its cluster, with
+	// slices spaced exponentially between the near and far clips
+	float sliceScale = ClusterGrid::Slices / logf(camera->GetFarClip() / camera->GetNearClip());
+	pixelShader->SetFloat4("clusterScale", XMFLOAT4(
+		(float)ClusterGrid::TilesX / width,
+		(float)ClusterGrid::TilesY / height,
+		sliceScale,
+		-logf(camera->GetNearClip()) * sliceScale));
+	pixelShader->SetData("shadowMatrices", shadowMatrices, sizeof(XMFLOAT4X4) * shadowViewCount);
+	pixelShader->SetData("shadowTiles", shadowTiles, sizeof(XMFLOAT4) * shadowViewCount);
+	pixelShader->CopyBufferData("PerFrame");
+
+	// Passing shadow information to shaders
+	pixelShader->SetShaderResourceView("StaticShadowMap", shadowSRVs[ShadowLayerStatic]);
+	pixelShader->SetShaderResourceView("DynamicShadowMap", shadowSRVs[ShadowLayerDynamic]);
+	pixelShader->SetSamplerState("ShadowSampler", shadowSampler);
+	pixelShader->SetShaderResourceView("Lights", lightBuffer->GetSRV());
+	pixelShader->SetShaderResourceView("SpecularIBL", specularIBLSRV);
+	pixelShader->SetShaderResourceView("BRDFLookup", brdfLookupSRV);
+	pixelShader->SetShaderResourceView("Lightmap", lightmapSRV);
+	pixelShader->SetShaderResourceView("ProbeSH", probeSRV);
+	pixelShader->SetSamplerState("ClampSampler", clampSampler);
+	pixelShader->SetFloat("specularIBLMips", (float)iblBakeSettings.specularMips);
+	pixelShader->SetShaderResourceView("ClusterRanges", clusterRangeBuffer->GetSRV());
+	pixelShader->SetShaderResourceView("ClusterLightIndices", clusterIndexBuffer->GetSRV());
+
+	// Draw each batch of game entities before drawing skybox.  Batches
+	// are in sort key order, so shaders, materials and meshes are only
+	// bound when they differ from the previous batch's
+	const std::vector<InstanceBatch>& batches = mainBatcher.GetBatches();
+	const std::vector<unsigned int>& order = mainBatcher.GetInstanceOrder();
+	Material* currentMaterial = nullptr;
+	SimpleVertexShader* currentVS = nullptr;
+	SimplePixelShader* currentPS = nullptr;
+	Mesh* currentMesh = nullptr;
+	for (size_t b = 0; b < batches.size(); b++)
 	{
-		gameEntitiesVector[i].Draw(camera, ambientLight, lightsVector);
+		const InstanceBatch& batch = batches[b];
+		std::shared_ptr<SimpleVertexShader> vs = batch.material->GetVertexShader();
+		std::shared_ptr<SimplePixelShader> ps = batch.material->GetPixelShader();
+		if (ps == pixelShader)
+			ps = SelectPixelShaderVariant(batch.material);
+
+		if (vs.get() != currentVS)
+		{
+			vs->SetShader();
+			currentVS = vs.get();
+		}
+
+		// A different variant has its own PerMaterial buffer to fill
+		if (ps.get() != currentPS)
+		{
+			ps->SetShader();
+			currentPS = ps.get();
+			currentMaterial = nullptr;
+		}
+
+		if (batch.material != currentMaterial)
+		{
+			batch.material->PrepareMaterial(ps.get());
+			currentMaterial = batch.material;
+		}
+
+		// Materials without an instanced vertex shader fall back to a draw per entity
+		if (vs->GetPerInstanceCompatible())
+		{
+			if (batch.mesh != currentMesh)
+			{
+				batch.mesh->BindInstanced(instanceBuffer->GetBuffer(), instanceBuffer->GetStride());
+				currentMesh = batch.mesh;
+			}
+
+			batch.mesh->DrawInstanced(batch.instanceCount, batch.firstInstance);
+		}
+		else
+		{
+			for (unsigned int i = 0; i < batch.instanceCount; i++)
+			{
+				unsigned int entity = order[batch.firstInstance + i];
+				vs->SetData("objectLights", entityLightLists[entity].packed, sizeof(ObjectLightList));
+				vs->SetFloat4("lightmapRect", entityLightmapRects[entity]);
+				gameEntitiesVector[entity].Draw();
+			}
+
+			// GameEntity::Draw() binds its own shaders and buffers
+			currentVS = nullptr;
+			currentPS = nullptr;
+			currentMesh = nullptr;
+		}
 	}
 
 	// Drawing skybox after all other game entities
@@ -613,14 +1778,15 @@ void Game::Draw(float deltaTime, float totalTime)
 
 	// Essentially resetting the shadow map resource
 	ID3D11ShaderResourceView* nullSRVs[16] = {};
-	context->PSSetShaderResources(0, 16, nullSRVs);
+	StateCache::GetInstance().SetShaderResources(ShaderStagePS, 0, 16, nullSRVs);
 
 	// Present the back buffer to the user
 	//  - Puts the final frame we're drawing into the window so the user can see it
 	//  - Do this exactly ONCE PER FRAME (always at the very end of the frame)
 	swapChain->Present(vsync ? 1 : 0, 0);
+	constantBufferRing->EndFrame();
 
 	// Due to the usage of a more sophisticated swap chain,
 	// the render target must be re-bound after every call to Present()
-	context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), depthStencilView.Get());
+	StateCache::GetInstance().OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), depthStencilView.Get());
 }
\ No newline at end of file
@@ -12,6 +12,29 @@
 #include "Material.h"
 #include "Lights.h"
 #include "Sky.h"
+#include "ConstantBufferRing.h"
+#include "InstanceBatcher.h"
+#include "InstanceBuffer.h"
+#include "FrustumCuller.h"
+#include "DynamicBVH.h"
+#include "OcclusionCuller.h"
+#include "ContributionCuller.h"
+#include "ShadowCascades.h"
+#include "ShadowCache.h"
+#include "ShadowAtlas.h"
+#include "ShadowViews.h"
+#include "ClusterGrid.h"
+#include "ObjectLightSelector.h"
+#include "LightBudget.h"
+#include "LightManager.h"
+#include "LightUploadQueue.h"
+#include "SphericalHarmonics.h"
+#include "IBLBaker.h"
+#include "LightmapBaker.h"
+#include "ShaderBuffer.h"
+#include "ShaderPermutations.h"
+#include "ShaderVariantCache.h"
+#include "BufferStructs.h"
 
 class Game 
 	: public DXCore
@@ -27,6 +50,7 @@ public:
 	void OnResize();
 	void Update(float deltaTime, float totalTime);
 	void Draw(float deltaTime, float totalTime);
+	void RunBenchmarks();
 
 private:
 
@@ -42,19 +66,70 @@ private:
 	//    Component Object Model, which DirectX objects do
 	//  - More info here: https://github.com/Microsoft/DirectXTK/wiki/ComPtr
 
+	// Per-frame upload ring shared by all shaders' constant buffers
+	std::shared_ptr<ConstantBufferRing> constantBufferRing;
+
 	// Shaders and shader-related constructs
 	std::shared_ptr<SimplePixelShader> pixelShader;
 	std::shared_ptr<SimpleVertexShader> vertexShader;
+	std::shared_ptr<SimpleVertexShader> instancedVertexShader;
 
 	// Custom Pixel Shader
 	std::shared_ptr<SimplePixelShader> customPixelShader;
 
+	// Pixel shader variants - the main pass swaps pixelShader for a variant
+	// compiled for this frame's lights when one was built (see
+	// ShaderPermutations.h), and each variant used in a frame gets a copy
+	// of pixelShader's PerFrame data
+	std::shared_ptr<SimplePixelShader> SelectPixelShaderVariant(Material* material);
+	std::shared_ptr<ShaderVariantCache<SimplePixelShader>> pixelShaderVariants;
+	std::vector<unsigned int> pixelShaderVariantFrames;		// The frame each variant last got PerFrame
+	unsigned int frameNumber;
+
 	// Game Entities Vector
 	std::vector<GameEntity> gameEntitiesVector;
 
 	// Mesh Vector
 	std::vector<std::shared_ptr<Mesh>> meshVector;
 
+	// Instanced drawing - entities are sorted into batches once per frame
+	// for each pass and their world matrices written to the instance buffer
+	void BuildInstanceBatches();
+	void AppendInstances(const std::vector<unsigned int>& entities);
+	InstanceBatcher mainBatcher;
+	InstanceBatcher shadowBatchers[ShadowLayerCount][ShadowViews::MaxViews];
+	unsigned int shadowInstanceOffsets[ShadowLayerCount][ShadowViews::MaxViews];	// Where each tile's instances start
+	std::vector<InstanceData> instanceData;
+	std::shared_ptr<InstanceBuffer> instanceBuffer;
+
+	// Culling - the BVH holds every entity's world box, refit as they move,
+	// and each pass's query gives the entity indices inside its volume
+	void UpdateSceneBVH();
+	DynamicBVH sceneBVH;
+	std::vector<int> entityProxies;
+	std::vector<unsigned int> entityTransformVersions;
+	std::vector<unsigned int> visibleEntities;
+	std::vector<unsigned int> visibleShadowCasters[ShadowViews::MaxViews];
+
+	// Contribution - entities too small in a pass's view or past their
+	// draw distance are skipped, each pass with its own threshold
+	void CullByContribution(ContributionCuller& culler, std::vector<unsigned int>& entities);
+	ContributionCuller contributionCuller;
+	ContributionCuller shadowContributionCullers[ShadowViews::MaxViews];	// Only used by cascades
+	float contributionMinPixels;
+	float shadowContributionMinTexels;
+	std::vector<DirectX::BoundingSphere> contributionSpheres;
+	std::vector<float> contributionDrawDistances;
+
+	// Occlusion - the largest visible entities on screen are drawn into
+	// a CPU depth buffer, which hides the entities behind them
+	void CullOccludedEntities(const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& proj);
+	OcclusionCuller occlusionCuller;
+	float occluderMinScreenSize;	// Bounding sphere radius over half the screen's height
+	std::vector<std::pair<float, unsigned int>> occluderCandidates;
+	std::vector<DirectX::BoundingBox> occludeeBoxes;
+	std::vector<unsigned int> occludeeVisible;
+
 	// Camera
 	std::shared_ptr<Camera> camera;
 
@@ -65,9 +140,88 @@ private:
 	std::shared_ptr<Material> stoneMat;
 	std::shared_ptr<Material> customPSWhiteMat;
 
-	// Lights
-	DirectX::XMFLOAT3 ambientLight;
-	std::vector<Light> lightsVector;
+	// Lights, in slots that keep their index in the light buffer
+	LightManager lightManager;
+
+	// Ambient - the sky cube map projected to spherical harmonics, already
+	// convolved for diffuse, padded to float4s for the cbuffer
+	void ComputeSkyAmbient();
+	unsigned int skyAmbientResolution;	// Of each face when the sky is read back
+	float skyAmbientScale;
+	DirectX::XMFLOAT4 skyAmbientSH[SphericalHarmonics::CoefficientCount];
+	DirectX::XMFLOAT3 skyRadianceSH[SphericalHarmonics::CoefficientCount];	// Before convolving, for baking
+
+	// Specular ambient - the sky prefiltered by roughness down a cube map's
+	// mips and a BRDF lookup, baked once to DDS files (see IBLBaker.h)
+	void LoadSpecularIBL();
+	void ResetRenderTarget();
+	IBLBakeSettings iblBakeSettings;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> specularIBLSRV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> brdfLookupSRV;
+
+	// Baked lighting - lightmapped entities share one lightmap and the
+	// rest blend the irradiance probes around them, both path traced once
+	// and saved to DDS files (see LightmapBaker.h).  Lights marked Baked
+	// are left out of the light loop on lightmapped surfaces.
+	void LoadBakedLighting();
+	LightmapBakeSettings lightmapBakeSettings;
+	ProbeGrid probeGrid;
+	std::vector<DirectX::XMFLOAT4> entityLightmapRects;		// Uv scale in xy, offset in zw, zero if not lightmapped
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> lightmapSRV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> probeSRV;
+
+	// The lights live in a structured buffer that grows as lights are added,
+	// and only the ranges of lights that changed are copied to it
+	void UploadLights();
+	std::shared_ptr<ShaderBuffer> lightBuffer;
+	LightUploadQueue lightUploadQueue;		// Since the last upload
+
+	// Light budget - only the lights that matter most to the camera's view
+	// are shaded, fading in and out as they're picked and dropped.  The
+	// shaders see shadedLights, the lights with their fades applied, and
+	// lights faded all the way out are left out of clusters and shadows.
+	void UpdateLightBudget(float deltaTime);
+	void BuildShadedLights();
+	void ShadeLight(unsigned int index);
+	LightBudget lightBudget;
+	std::vector<Light> shadedLights;
+	unsigned int shadedLightsVersion;		// lightManager's, when last shaded
+	std::vector<LightRange> shadedChangedRanges;
+
+	// Light clusters - point and spot lights are binned into a grid over
+	// the camera's view each frame, so a pixel only shades the lights that
+	// reach its cluster.  Directional lights reach everywhere, so they're
+	// listed once at the front of the index buffer instead.
+	void BuildLightClusters();
+	ClusterGrid clusterGrid;
+	std::vector<Cone> clusterLightCones;					// View space
+	std::vector<unsigned int> clusterLightIndices;
+	std::vector<unsigned int> clusterIndexUpload;
+	std::vector<unsigned int> clusterGlobalLights;
+	unsigned int clusterGlobalLightCount;
+	unsigned int clusterMaxLocalLights;		// In the fullest cluster
+	std::shared_ptr<ShaderBuffer> clusterRangeBuffer;
+	std::shared_ptr<ShaderBuffer> clusterIndexBuffer;
+
+	// What the grid was last built for, so only what changed since is
+	// binned again
+	bool clusterGridBuilt;
+	DirectX::XMFLOAT4X4 clusterView;
+	DirectX::XMFLOAT4X4 clusterProjection;
+	unsigned int clusterLightsVersion;		// lightManager's
+	std::vector<Cone> clusterConesByLight;	// Each binned light's view space cone, by light index
+	std::vector<unsigned char> clusterBinned;
+	std::vector<unsigned char> clusterNowBinned;
+	std::vector<unsigned char> clusterLightChanged;
+	std::vector<LightRange> clusterChangedRanges;
+	std::vector<unsigned int> clusterRebinLights;
+
+	// Object light lists - instead of the clusters, each visible entity
+	// is given its brightest lights, passed along with its instance data
+	bool useObjectLightLists;
+	ObjectLightSelector objectLightSelector;
+	std::vector<ObjectLightList> visibleLightLists;		// Same order as visibleEntities
+	std::vector<ObjectLightList> entityLightLists;
 
 	// Shader Resource View for textures
 
@@ -97,6 +251,7 @@ private:
 
 	// Sampler State
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> basicSampler;
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> clampSampler;
 
 	// Sky
 	std::shared_ptr<Sky> skybox;
@@ -106,17 +261,55 @@ private:
 
 	// Shadow mapping helper functions
 	void CreateShadowMapResources();
+	void UpdateShadowAtlas();
+	void UpdateShadowViews();
+	void TightenShadowCascade(unsigned int view);
 	void RenderShadowMap();
+	void ClearShadowTile();
 
-	// Shadow resources
+	// Shadow atlas - every shadowed light gets tiles of one large texture,
+	// sized by how much of the screen the light covers.  A light keeps its
+	// tiles until its size changes, so its cached shadows stay valid.
+	ShadowAtlas shadowAtlas;
 	int shadowMapResolution;
-	float shadowProjectionSize;
+	unsigned int shadowMaxTileSize;
+	unsigned int shadowMinTileSize;
+	std::vector<float> shadowLightImportance;
+	std::vector<unsigned int> shadowLightTileCounts;
+	std::vector<unsigned int> shadowLightSizes;
+	std::vector<std::vector<ShadowTile>> shadowLightTiles;
+
+	// Shadow views - directional lights have cascades refit to slices of
+	// the camera's view every frame, spot lights one view and point lights
+	// one per cube face, each drawn into its own tile
+	unsigned int shadowCascadeCount;
+	float shadowDistance;			// How far from the camera shadows reach
+	float shadowSplitLambda;		// 0 for even cascade splits, 1 for logarithmic
+	float shadowCasterDistance;		// How far towards the light casters are looked for
+	float shadowNearClip;			// For spot and point lights
+	unsigned int shadowViewCount;
+	ShadowView shadowViews[ShadowViews::MaxViews];
+	ShadowTile shadowViewTiles[ShadowViews::MaxViews];
+	unsigned int shadowViewLights[ShadowViews::MaxViews];		// Index into lightManager
+	DirectX::XMFLOAT4X4 shadowMatrices[ShadowViews::MaxViews];	// World space to atlas coordinates
+	DirectX::XMFLOAT4 shadowTiles[ShadowViews::MaxViews];		// Each view's atlas bounds, a texel in
+	std::vector<DirectX::BoundingBox> shadowReceiverBoxes;		// What the camera sees, for fitting cascades
+	std::vector<DirectX::BoundingBox> shadowCasterBoxes;
 	std::shared_ptr<SimpleVertexShader> shadowVertexShader;
-	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> shadowDSV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> shadowSRV;
+	std::shared_ptr<SimpleVertexShader> shadowInstancedVertexShader;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> shadowDSVs[ShadowLayerCount];
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> shadowSRVs[ShadowLayerCount];
+
+	// Shadow caching - static and dynamic casters are drawn into separate
+	// atlases, and a tile in either is only redrawn when it's dirty.  A
+	// tile is cleared by drawing a triangle over it at the far plane.
+	ShadowCache shadowCache;
+	bool shadowTilesDirty[ShadowLayerCount][ShadowViews::MaxViews];
+	std::vector<unsigned int> shadowLayerCasters;
+	std::vector<unsigned long long> shadowCasterKeys;
+	std::shared_ptr<Mesh> shadowClearMesh;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> shadowClearDepthState;
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> shadowSampler;
 	Microsoft::WRL::ComPtr<ID3D11RasterizerState> shadowRasterizer;
-	DirectX::XMFLOAT4X4 shadowViewMatrix;
-	DirectX::XMFLOAT4X4 shadowProjectionMatrix;
 };
 
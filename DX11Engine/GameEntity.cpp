@@ -8,6 +8,11 @@ GameEntity::GameEntity(shared_ptr<Mesh> meshPtr, std::shared_ptr<Material> matPt
 {
 	mesh = meshPtr;
 	mat = matPtr;
+	worldBoundsValid = false;
+	worldBoundsVersion = 0;
+	drawDistance = 0.0f;
+	isStatic = false;
+	isLightmapped = false;
 }
 
 std::shared_ptr<Mesh> GameEntity::GetMesh()
@@ -30,35 +35,77 @@ void GameEntity::SetMaterial(std::shared_ptr<Material> newMatPtr)
 	mat = newMatPtr;
 }
 
-void GameEntity::Draw(std::shared_ptr<Camera> p_camera, DirectX::XMFLOAT3 p_ambient, std::vector<Light> lightsVector)
+float GameEntity::GetDrawDistance()
 {
-	std::shared_ptr<SimpleVertexShader> vs = mat->GetVertexShader();
+	return drawDistance;
+}
 
-	vs->SetMatrix4x4("world", transform.GetWorldMatrix());
-	vs->SetMatrix4x4("worldInvTranspose", transform.GetWorldInverseTransposeMatrix());
-	vs->SetMatrix4x4("view", p_camera->GetViewMatrix());
-	vs->SetMatrix4x4("projection", p_camera->GetProjectionMatrix());
+void GameEntity::SetDrawDistance(float distance)
+{
+	drawDistance = distance;
+}
 
-	vs->CopyAllBufferData();
+bool GameEntity::IsStatic()
+{
+	return isStatic;
+}
 
-	std::shared_ptr<SimplePixelShader> ps = mat->GetPixelShader();
+void GameEntity::SetStatic(bool p_isStatic)
+{
+	isStatic = p_isStatic;
+}
 
-	mat->PrepareMaterial();
+bool GameEntity::IsLightmapped()
+{
+	return isLightmapped;
+}
 
-	ps->SetFloat4("colorTint", mat->GetColor());
-	ps->SetFloat("roughness", mat->GetRoughness());
-	ps->SetFloat3("cameraPosition", p_camera->GetTransform()->GetPosition());
-	ps->SetFloat3("ambient", p_ambient);
-	ps->SetFloat("numLights", lightsVector.size());
+void GameEntity::SetLightmapped(bool p_isLightmapped)
+{
+	isLightmapped = p_isLightmapped;
+}
 
-	for (int i = 0; i < lightsVector.size(); i++)
-	{
-		ps->SetData("lightsArray", &lightsVector[0], sizeof(Light) * (int)lightsVector.size());
-	}
+const DirectX::BoundingBox& GameEntity::GetWorldBox()
+{
+	UpdateWorldBounds();
+	return worldBox;
+}
+
+const DirectX::BoundingSphere& GameEntity::GetWorldSphere()
+{
+	UpdateWorldBounds();
+	return worldSphere;
+}
+
+// --------------------------------------------------------
+// Transforms the mesh's local bounds by the world matrix,
+// only when the transform has changed since the last time
+// --------------------------------------------------------
+void GameEntity::UpdateWorldBounds()
+{
+	if (worldBoundsValid && worldBoundsVersion == transform.GetVersion())
+		return;
+
+	XMFLOAT4X4 world = transform.GetWorldMatrix();
+	XMMATRIX worldMat = XMLoadFloat4x4(&world);
+	mesh->GetLocalBox().Transform(worldBox, worldMat);
+	mesh->GetLocalSphere().Transform(worldSphere, worldMat);
 
-	ps->CopyAllBufferData();
+	worldBoundsValid = true;
+	worldBoundsVersion = transform.GetVersion();
+}
+
+void GameEntity::Draw()
+{
+	std::shared_ptr<SimpleVertexShader> vs = mat->GetVertexShader();
+
+	// Camera, light and material data are uploaded at their own frequency
+	// by Game and Material, so only the per-object buffer changes here
+	vs->SetMatrix4x4("world", transform.GetWorldMatrix());
+	vs->SetMatrix4x4("worldInvTranspose", transform.GetWorldInverseTransposeMatrix());
+	vs->CopyBufferData("PerObject");
 
-	mat->GetVertexShader()->SetShader();
+	vs->SetShader();
 	mat->GetPixelShader()->SetShader();
 
 	// Calling draw on custom meshes
@@ -17,12 +17,38 @@ public:
 	Transform* GetTransform();
 	std::shared_ptr<Material> GetMaterial();
 	void SetMaterial(std::shared_ptr<Material> newMatPtr);
-	void Draw(std::shared_ptr<Camera> p_camera, DirectX::XMFLOAT3 p_ambient, std::vector<Light> lightsVector);
-	
+	void Draw();
+
+	// The mesh's bounds moved into world space, updated when the transform changes
+	const DirectX::BoundingBox& GetWorldBox();
+	const DirectX::BoundingSphere& GetWorldSphere();
+
+	// Distance from the camera past which the entity isn't drawn, 0 for no limit
+	float GetDrawDistance();
+	void SetDrawDistance(float distance);
+
+	// Static entities aren't expected to move, so their shadows are
+	// cached in a layer that's rarely redrawn (see ShadowCache)
+	bool IsStatic();
+	void SetStatic(bool p_isStatic);
+
+	// Lightmapped entities get their diffuse light from a baked lightmap
+	// instead of baked lights and the sky, so they must be static too
+	bool IsLightmapped();
+	void SetLightmapped(bool p_isLightmapped);
 
 private:
 	Transform transform;
 	std::shared_ptr<Mesh> mesh;
 	std::shared_ptr<Material> mat;
+	float drawDistance;
+	bool isStatic;
+	bool isLightmapped;
+
+	void UpdateWorldBounds();
+	DirectX::BoundingBox worldBox;
+	DirectX::BoundingSphere worldSphere;
+	bool worldBoundsValid;
+	unsigned int worldBoundsVersion;	// Transform version the bounds were built from
 };
 
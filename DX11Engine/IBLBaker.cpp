@@ -0,0 +1,292 @@
+#include "IBLBaker.h"
+#include "SphericalHarmonics.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+using namespace DirectX;
+
+static const float Pi = 3.14159265358979f;
+
+// --------------------------------------------------------
+// The i'th of count points spread evenly over the unit
+// square, the same every time
+// --------------------------------------------------------
+static XMFLOAT2 Hammersley(unsigned int i, unsigned int count)
+{
+	unsigned int bits = i;
+	bits = (bits << 16) | (bits >> 16);
+	bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+	bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+	bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+	bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+	return XMFLOAT2((float)i / count, bits * 2.3283064365386963e-10f);
+}
+
+// --------------------------------------------------------
+// A half vector around +Z from the GGX distribution, with
+// alpha being roughness squared like SpecDistribution()
+// --------------------------------------------------------
+static XMFLOAT3 SampleGGX(XMFLOAT2 xi, float alpha)
+{
+	float phi = 2.0f * Pi * xi.x;
+	float cosTheta = sqrtf((1.0f - xi.y) / (1.0f + (alpha * alpha - 1.0f) * xi.y));
+	float sinTheta = sqrtf(1.0f - cosTheta * cosTheta);
+	return XMFLOAT3(sinTheta * cosf(phi), sinTheta * sinf(phi), cosTheta);
+}
+
+static float DistributionGGX(float NdotH, float alpha)
+{
+	float alpha2 = std::max(alpha * alpha, 0.0000001f);
+	float denominator = NdotH * NdotH * (alpha2 - 1.0f) + 1.0f;
+	return alpha2 / (Pi * denominator * denominator);
+}
+
+// --------------------------------------------------------
+// The face and texel coordinates (-1 to 1, v down) a
+// direction passes through, the inverse of
+// SphericalHarmonics::FaceDirection()
+// --------------------------------------------------------
+static unsigned int DirectionToFace(XMFLOAT3 d, float& u, float& v)
+{
+	float ax = fabsf(d.x), ay = fabsf(d.y), az = fabsf(d.z);
+	if (ax >= ay && ax >= az)
+	{
+		u = (d.x > 0.0f ? -d.z : d.z) / ax;
+		v = -d.y / ax;
+		return d.x > 0.0f ? 0 : 1;
+	}
+	if (ay >= az)
+	{
+		u = d.x / ay;
+		v = (d.y > 0.0f ? d.z : -d.z) / ay;
+		return d.y > 0.0f ? 2 : 3;
+	}
+	u = (d.z > 0.0f ? d.x : -d.x) / az;
+	v = -d.y / az;
+	return d.z > 0.0f ? 4 : 5;
+}
+
+// Bilinear within a face, clamped at its edges
+static XMFLOAT4 SampleFace(const CubeFaces& cube, XMFLOAT3 direction)
+{
+	float u, v;
+	unsigned int face = DirectionToFace(direction, u, v);
+	float x = std::min(std::max((u + 1.0f) * 0.5f * cube.size - 0.5f, 0.0f), cube.size - 1.0f);
+	float y = std::min(std::max((v + 1.0f) * 0.5f * cube.size - 0.5f, 0.0f), cube.size - 1.0f);
+	unsigned int x0 = (unsigned int)x, y0 = (unsigned int)y;
+	unsigned int x1 = std::min(x0 + 1, cube.size - 1), y1 = std::min(y0 + 1, cube.size - 1);
+	float fx = x - x0, fy = y - y0;
+
+	const std::vector<XMFLOAT4>& texels = cube.faces[face];
+	XMVECTOR top = XMVectorLerp(XMLoadFloat4(&texels[y0 * cube.size + x0]), XMLoadFloat4(&texels[y0 * cube.size + x1]), fx);
+	XMVECTOR bottom = XMVectorLerp(XMLoadFloat4(&texels[y1 * cube.size + x0]), XMLoadFloat4(&texels[y1 * cube.size + x1]), fx);
+	XMFLOAT4 result;
+	XMStoreFloat4(&result, XMVectorLerp(top, bottom, fy));
+	return result;
+}
+
+// Averages each 2x2 block, down to a single texel per face
+static void BuildSourceChain(const CubeFaces& source, std::vector<CubeFaces>& chain)
+{
+	chain.assign(1, source);
+	while (chain.back().size > 1)
+	{
+		const CubeFaces& larger = chain.back();
+		CubeFaces smaller;
+		smaller.size = larger.size / 2;
+		for (unsigned int face = 0; face < 6; face++)
+		{
+			smaller.faces[face].resize((size_t)smaller.size * smaller.size);
+			for (unsigned int y = 0; y < smaller.size; y++)
+			{
+				for (unsigned int x = 0; x < smaller.size; x++)
+				{
+					const XMFLOAT4* row0 = &larger.faces[face][(size_t)(2 * y) * larger.size + 2 * x];
+					const XMFLOAT4* row1 = row0 + larger.size;
+					XMVECTOR sum = XMVectorAdd(XMVectorAdd(XMLoadFloat4(&row0[0]), XMLoadFloat4(&row0[1])), XMVectorAdd(XMLoadFloat4(&row1[0]), XMLoadFloat4(&row1[1])));
+					XMStoreFloat4(&smaller.faces[face][(size_t)y * smaller.size + x], XMVectorScale(sum, 0.25f));
+				}
+			}
+		}
+		chain.push_back(smaller);
+	}
+}
+
+// --------------------------------------------------------
+// Takes the view direction to be the normal, as the split
+// sum does, and weights each sample by N dot L.  A sample's
+// mip is from the solid angle its probability covers over
+// a source texel's ("GPU-Based Importance Sampling", GPU
+// Gems 3 chapter 20).
+// --------------------------------------------------------
+unsigned long long IBLBaker::PrefilterSpecular(const CubeFaces& source, const IBLBakeSettings& settings, std::vector<CubeFaces>& mips)
+{
+	std::vector<CubeFaces> chain;
+	BuildSourceChain(source, chain);
+	float texelSolidAngle = 4.0f * Pi / (6.0f * source.size * source.size);
+	float maxLevel = (float)(chain.size() - 1);
+
+	mips.resize(settings.specularMips);
+	unsigned int rows = 0;
+	for (unsigned int mip = 0; mip < settings.specularMips; mip++)
+	{
+		mips[mip].size = std::max(settings.specularSize >> mip, 1u);
+		for (unsigned int face = 0; face < 6; face++)
+			mips[mip].faces[face].resize((size_t)mips[mip].size * mips[mip].size);
+		rows += 6 * mips[mip].size;
+	}
+
+	ThreadPool::GetInstance().ParallelFor(rows, [&](unsigned int job)
+	{
+		// Which mip, face and row this job is
+		unsigned int mip = 0;
+		for (; job >= 6 * mips[mip].size; mip++)
+			job -= 6 * mips[mip].size;
+		CubeFaces& target = mips[mip];
+		unsigned int face = job / target.size;
+		unsigned int row = job % target.size;
+
+		float roughness = settings.specularMips > 1 ? (float)mip / (settings.specularMips - 1) : 0.0f;
+		float alpha = roughness * roughness;
+		for (unsigned int column = 0; column < target.size; column++)
+		{
+			XMFLOAT3 normal = SphericalHarmonics::FaceDirection(face,
+				(column + 0.5f) * 2.0f / target.size - 1.0f,
+				(row + 0.5f) * 2.0f / target.size - 1.0f);
+			XMVECTOR n = XMLoadFloat3(&normal);
+
+			// Around the normal
+			XMVECTOR up = fabsf(normal.z) < 0.999f ? XMVectorSet(0, 0, 1, 0) : XMVectorSet(1, 0, 0, 0);
+			XMVECTOR tangentX = XMVector3Normalize(XMVector3Cross(up, n));
+			XMVECTOR tangentY = XMVector3Cross(n, tangentX);
+
+			XMVECTOR sum = XMVectorZero();
+			float weight = 0.0f;
+			for (unsigned int i = 0; i < settings.specularSamples; i++)
+			{
+				XMFLOAT3 h = SampleGGX(Hammersley(i, settings.specularSamples), alpha);
+				XMVECTOR half = XMVectorAdd(XMVectorAdd(XMVectorScale(tangentX, h.x), XMVectorScale(tangentY, h.y)), XMVectorScale(n, h.z));
+				XMVECTOR light = XMVectorSubtract(XMVectorScale(half, 2.0f * h.z), n);
+				float NdotL = XMVectorGetX(XMVector3Dot(n, light));
+				if (NdotL <= 0.0f)
+					continue;
+
+				// With N = V the pdf is D / 4
+				float pdf = DistributionGGX(h.z, alpha) * 0.25f;
+				float sampleSolidAngle = 1.0f / (settings.specularSamples * pdf + 0.0001f);
+				float level = alpha == 0.0f ? 0.0f : std::min(std::max(0.5f * log2f(sampleSolidAngle / texelSolidAngle) + 1.0f, 0.0f), maxLevel);
+
+				// Between the two nearest source levels
+				XMFLOAT3 direction;
+				XMStoreFloat3(&direction, light);
+				unsigned int level0 = (unsigned int)level;
+				unsigned int level1 = std::min(level0 + 1, (unsigned int)maxLevel);
+				XMFLOAT4 sample0 = SampleFace(chain[level0], direction);
+				XMFLOAT4 sample1 = SampleFace(chain[level1], direction);
+				XMVECTOR radiance = XMVectorLerp(XMLoadFloat4(&sample0), XMLoadFloat4(&sample1), level - level0);
+
+				sum = XMVectorAdd(sum, XMVectorScale(radiance, NdotL));
+				weight += NdotL;
+			}
+
+			XMVECTOR color = weight > 0.0f ? XMVectorScale(sum, 1.0f / weight) : XMVectorZero();
+			XMStoreFloat4(&target.faces[face][(size_t)row * target.size + column], XMVectorSetW(color, 1.0f));
+		}
+	});
+
+	unsigned long long texels = 0;
+	for (const CubeFaces& mip : mips)
+		texels += 6ull * mip.size * mip.size;
+	return texels * settings.specularSamples;
+}
+
+// --------------------------------------------------------
+// Integrates the specular BRDF over GGX samples with F0
+// factored out, leaving a scale (x) and bias (y).  The
+// geometry term uses k = alpha / 2, as image based light
+// should.
+// --------------------------------------------------------
+unsigned long long IBLBaker::IntegrateBRDF(const IBLBakeSettings& settings, std::vector<XMFLOAT2>& lookup)
+{
+	unsigned int size = settings.brdfSize;
+	lookup.resize((size_t)size * size);
+
+	ThreadPool::GetInstance().ParallelFor(size, [&](unsigned int row)
+	{
+		float roughness = (row + 0.5f) / size;
+		float alpha = roughness * roughness;
+		float k = alpha * 0.5f;
+
+		for (unsigned int column = 0; column < size; column++)
+		{
+			float NdotV = (column + 0.5f) / size;
+			XMFLOAT3 view(sqrtf(1.0f - NdotV * NdotV), 0.0f, NdotV);
+
+			float scale = 0.0f;
+			float bias = 0.0f;
+			for (unsigned int i = 0; i < settings.brdfSamples; i++)
+			{
+				XMFLOAT3 h = SampleGGX(Hammersley(i, settings.brdfSamples), alpha);
+				float VdotH = view.x * h.x + view.y * h.y + view.z * h.z;
+				float NdotL = 2.0f * VdotH * h.z - view.z;
+				if (NdotL <= 0.0f)
+					continue;
+
+				float NdotH = std::max(h.z, 0.0f);
+				VdotH = std::max(VdotH, 0.0f);
+				float G = (NdotV / (NdotV * (1.0f - k) + k)) * (NdotL / (NdotL * (1.0f - k) + k));
+				float visibility = G * VdotH / (NdotH * NdotV);
+				float fresnel = powf(1.0f - VdotH, 5.0f);
+				scale += (1.0f - fresnel) * visibility;
+				bias += fresnel * visibility;
+			}
+
+			lookup[(size_t)row * size + column] = XMFLOAT2(scale / settings.brdfSamples, bias / settings.brdfSamples);
+		}
+	});
+
+	return (unsigned long long)size * size * settings.brdfSamples;
+}
+
+bool IBLBaker::BakeFiles(const std::string& skyPath, const std::string& specularPath, const std::string& brdfPath, const IBLBakeSettings& settings)
+{
+	CubeFaces sky;
+	if (!DDSFile::ReadCubeMap(skyPath, sky))
+	{
+		printf("IBL bake: couldn't read %s (must be an uncompressed cube map)\n", skyPath.c_str());
+		return false;
+	}
+	return BakeFiles(sky, specularPath, brdfPath, settings);
+}
+
+bool IBLBaker::BakeFiles(const CubeFaces& sky, const std::string& specularPath, const std::string& brdfPath, const IBLBakeSettings& settings)
+{
+	CubeFaces linearSky = sky;
+	for (std::vector<XMFLOAT4>& face : linearSky.faces)
+	{
+		for (XMFLOAT4& texel : face)
+			texel = XMFLOAT4(powf(texel.x, settings.skyGamma), powf(texel.y, settings.skyGamma), powf(texel.z, settings.skyGamma), 1.0f);
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<CubeFaces> mips;
+	unsigned long long specularSamples = PrefilterSpecular(linearSky, settings, mips);
+	auto middle = std::chrono::high_resolution_clock::now();
+	std::vector<XMFLOAT2> lookup;
+	unsigned long long brdfSamples = IntegrateBRDF(settings, lookup);
+	auto end = std::chrono::high_resolution_clock::now();
+
+	double specularMs = std::chrono::duration<double, std::milli>(middle - start).count();
+	double brdfMs = std::chrono::duration<double, std::milli>(end - middle).count();
+	printf("IBL bake, %u threads: specular %.1f ms (%.1f M samples/s), BRDF %.1f ms (%.1f M samples/s)\n",
+		ThreadPool::GetInstance().GetThreadCount(),
+		specularMs, specularSamples / (specularMs * 1000.0),
+		brdfMs, brdfSamples / (brdfMs * 1000.0));
+
+	return DDSFile::WriteCubeMap(specularPath, mips) &&
+		DDSFile::WriteTexture(brdfPath, settings.brdfSize, settings.brdfSize, lookup);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+#include "DDSFile.h"
+
+// How much work a bake does - more samples cost time, not memory
+struct IBLBakeSettings
+{
+	unsigned int specularSize {128};		// Top mip of the prefiltered cube map
+	unsigned int specularMips {6};			// Mip m is for roughness m / (specularMips - 1)
+	unsigned int specularSamples {256};		// GGX samples per texel
+	unsigned int brdfSize {128};			// Lookup table is brdfSize square
+	unsigned int brdfSamples {512};
+	float skyGamma {2.2f};					// The sky's encoding, undone before prefiltering
+};
+
+// --------------------------------------------------------
+// Bakes the split sum approximation's two halves for image
+// based specular lighting (see "Real Shading in Unreal
+// Engine 4", Karis 2013):
+//
+// - The environment, prefiltered with GGX lobes of rising
+//   roughness down a cube map's mips, sampled from a box
+//   filtered copy at the mip that matches each sample's
+//   share of the lobe, so few samples are needed.
+// - The BRDF's scale and bias to F0, by the cosine of the
+//   view angle (u) and roughness (v).
+//
+// Samples come from a Hammersley sequence and texels are
+// independent, so a bake gives the same result on any
+// number of threads.  Rows are spread across the ThreadPool.
+// Game bakes when the files are missing, and Tools/BakeIBL
+// bakes from the command line.
+// --------------------------------------------------------
+class IBLBaker
+{
+public:
+	// Each returns how many samples it took, for throughput
+	static unsigned long long PrefilterSpecular(const CubeFaces& source, const IBLBakeSettings& settings, std::vector<CubeFaces>& mips);
+	static unsigned long long IntegrateBRDF(const IBLBakeSettings& settings, std::vector<DirectX::XMFLOAT2>& lookup);
+
+	// Reads a DDS sky, bakes both and writes them as DDS files,
+	// printing how long each took
+	static bool BakeFiles(const std::string& skyPath, const std::string& specularPath, const std::string& brdfPath, const IBLBakeSettings& settings);
+	static bool BakeFiles(const CubeFaces& sky, const std::string& specularPath, const std::string& brdfPath, const IBLBakeSettings& settings);
+};
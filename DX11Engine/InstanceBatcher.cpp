@@ -0,0 +1,48 @@
+#include "InstanceBatcher.h"
+
+// --------------------------------------------------------
+// Clears the previous frame's entities and batches
+// --------------------------------------------------------
+void InstanceBatcher::Begin()
+{
+	queue.Clear();
+	entries.clear();
+	batches.clear();
+	instanceOrder.clear();
+}
+
+// --------------------------------------------------------
+// Adds a visible entity to be batched
+//
+// sortKey - see RenderQueue::MakeKey()
+// --------------------------------------------------------
+void InstanceBatcher::Add(unsigned long long sortKey, Mesh* mesh, Material* material, unsigned int entityIndex)
+{
+	queue.Add(sortKey, (unsigned int)entries.size());
+	entries.push_back({ mesh, material, entityIndex });
+}
+
+// --------------------------------------------------------
+// Sorts the entities by key, then splits them into batches
+// --------------------------------------------------------
+void InstanceBatcher::Build()
+{
+	queue.Sort();
+
+	const std::vector<RenderPacket>& packets = queue.GetPackets();
+	for (unsigned int i = 0; i < packets.size(); i++)
+	{
+		const Entry& entry = entries[packets[i].payload];
+
+		// Start a new batch whenever the mesh or material changes
+		if (batches.empty() ||
+			batches.back().mesh != entry.mesh ||
+			batches.back().material != entry.material)
+		{
+			batches.push_back({ entry.mesh, entry.material, i, 0 });
+		}
+
+		batches.back().instanceCount++;
+		instanceOrder.push_back(entry.entityIndex);
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include "RenderQueue.h"
+
+class Mesh;
+class Material;
+
+// --------------------------------------------------------
+// A run of instances that share a mesh and material and can
+// be drawn with a single DrawIndexedInstanced() call
+// --------------------------------------------------------
+struct InstanceBatch
+{
+	Mesh* mesh;
+	Material* material;
+	unsigned int firstInstance;		// Index into the instance order
+	unsigned int instanceCount;
+};
+
+// --------------------------------------------------------
+// Sorts entities through a RenderQueue, then groups runs
+// with the same mesh and material so each run can be drawn
+// as one instanced draw.  Only pointers are compared, so
+// no Direct3D objects are touched here.
+//
+// Batches come out in sort key order, and the instances in
+// a batch keep the key's depth order (front to back).
+// --------------------------------------------------------
+class InstanceBatcher
+{
+public:
+	void Begin();
+	void Add(unsigned long long sortKey, Mesh* mesh, Material* material, unsigned int entityIndex);
+	void Build();
+
+	// Results of Build()
+	const std::vector<InstanceBatch>& GetBatches() { return batches; }
+	const std::vector<unsigned int>& GetInstanceOrder() { return instanceOrder; }
+
+private:
+	struct Entry
+	{
+		Mesh* mesh;
+		Material* material;
+		unsigned int entityIndex;
+	};
+
+	RenderQueue queue;
+	std::vector<Entry> entries;					// Indexed by packet payload
+	std::vector<InstanceBatch> batches;
+	std::vector<unsigned int> instanceOrder;	// Entity indices, grouped by batch
+};
@@ -0,0 +1,55 @@
+#include "InstanceBuffer.h"
+#include <cstring>
+
+InstanceBuffer::InstanceBuffer(Microsoft::WRL::ComPtr<ID3D11Device> p_device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> p_context, unsigned int p_stride)
+{
+	device = p_device;
+	context = p_context;
+	stride = p_stride;
+	capacity = 0;
+}
+
+// --------------------------------------------------------
+// Copies the instance data to the GPU, discarding whatever
+// was there last frame
+//
+// data - array of count elements, each "stride" bytes
+// --------------------------------------------------------
+bool InstanceBuffer::Write(const void* data, unsigned int count)
+{
+	if (count == 0) return true;
+	if (count > capacity && !Grow(count)) return false;
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return false;
+
+	memcpy(mapped.pData, data, (size_t)count * stride);
+	context->Unmap(buffer.Get(), 0);
+	return true;
+}
+
+// --------------------------------------------------------
+// Recreates the buffer with room for at least count elements,
+// doubling so a slowly growing scene doesn't reallocate often
+// --------------------------------------------------------
+bool InstanceBuffer::Grow(unsigned int count)
+{
+	unsigned int newCapacity = capacity > 0 ? capacity : 64;
+	while (newCapacity < count)
+		newCapacity *= 2;
+
+	D3D11_BUFFER_DESC desc = {};
+	desc.ByteWidth = newCapacity * stride;
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer> newBuffer;
+	if (FAILED(device->CreateBuffer(&desc, 0, newBuffer.GetAddressOf())))
+		return false;
+
+	buffer = newBuffer;
+	capacity = newCapacity;
+	return true;
+}
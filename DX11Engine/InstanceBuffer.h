@@ -0,0 +1,29 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+
+// --------------------------------------------------------
+// A dynamic vertex buffer holding per-instance data, which
+// is rewritten every frame and grows as needed
+// --------------------------------------------------------
+class InstanceBuffer
+{
+public:
+	InstanceBuffer(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int stride);
+
+	// Replaces the buffer's contents with count elements
+	bool Write(const void* data, unsigned int count);
+
+	ID3D11Buffer* GetBuffer() { return buffer.Get(); }
+	unsigned int GetStride() { return stride; }
+
+private:
+	bool Grow(unsigned int count);
+
+	unsigned int stride;
+	unsigned int capacity;
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+};
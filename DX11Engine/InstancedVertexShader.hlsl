@@ -0,0 +1,46 @@
+#include "ShaderInclude.hlsli"
+
+// Camera data, uploaded once per frame
+cbuffer PerFrame : register(b0)
+{
+	matrix view;
+	matrix projection;
+}
+
+// Regular vertex data from slot 0, plus each instance's matrices, light
+// list and lightmap rect from slot 1 (see InstanceData in BufferStructs.h)
+struct InstancedVertexShaderInput
+{
+	float3 localPosition		: POSITION;
+	float3 normal				: NORMAL;
+	float3 tangent				: TANGENT;
+	float2 uv					: TEXCOORD;
+	float2 lightmapUV			: TEXCOORD1;
+	matrix world				: WORLD_PER_INSTANCE;
+	matrix worldInvTranspose	: WORLDINVTRANSPOSE_PER_INSTANCE;
+	uint4 lights				: LIGHTS_PER_INSTANCE;
+	float4 lightmapRect			: LIGHTMAPRECT_PER_INSTANCE;
+};
+
+// --------------------------------------------------------
+// Same as VertexShader.hlsl, except the world matrices come
+// from the instance buffer instead of a per-object cbuffer
+// --------------------------------------------------------
+VertexToPixel main(InstancedVertexShaderInput input)
+{
+	VertexToPixel output;
+
+	matrix wvp = mul(mul(projection, view), input.world);
+	output.screenPosition = mul(wvp, float4(input.localPosition, 1.0f));
+
+	output.uv = input.uv;
+
+	output.normal = normalize(mul((float3x3)input.worldInvTranspose, input.normal));
+	output.tangent = normalize(mul((float3x3)input.worldInvTranspose, input.tangent));
+	output.worldPosition = mul(input.world, float4(input.localPosition, 1)).xyz;
+	output.lights = input.lights;
+	output.lightmapUV = input.lightmapUV * input.lightmapRect.xy + input.lightmapRect.zw;
+	output.lightmapped = input.lightmapRect.x > 0.0f ? 1 : 0;
+
+	return output;
+}
@@ -0,0 +1,193 @@
+#include "LightBudget.h"
+#include "ConeCuller.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+// Lights per ThreadPool job
+static const unsigned int LightsPerJob = 1024;
+
+static float Brightness(const Light& light)
+{
+	return light.Intensity * (0.2126f * light.Color.x + 0.7152f * light.Color.y + 0.0722f * light.Color.z);
+}
+
+void LightBudget::SetBudget(unsigned int p_maxLights, float p_minScore)
+{
+	maxLights = p_maxLights;
+	minScore = p_minScore;
+}
+
+void LightBudget::Reset()
+{
+	scores.clear();
+	fades.clear();
+	selected.clear();
+	activeLights.clear();
+	fadeChanges.clear();
+	selectedCount = 0;
+}
+
+// --------------------------------------------------------
+// The cone's sphere's silhouette radius, as
+// ShadowAtlas::Importance finds it for a range, squared for
+// roughly the share of the screen it covers
+// --------------------------------------------------------
+float LightBudget::Score(const Light& light, XMFLOAT3 eyePosition, float projectionScale, const XMFLOAT4 planes[6])
+{
+	if (light.Type == LIGHT_TYPE_DIRECTIONAL)
+		return FLT_MAX;
+
+	Cone cone = ConeCuller::FromLight(light);
+	if (!ConeCuller::IntersectsFrustum(cone, planes))
+		return 0.0f;
+
+	float dx = cone.sphere.x - eyePosition.x;
+	float dy = cone.sphere.y - eyePosition.y;
+	float dz = cone.sphere.z - eyePosition.z;
+	float distanceSq = dx * dx + dy * dy + dz * dz;
+	float rangeSq = cone.sphere.w * cone.sphere.w;
+	float size = distanceSq <= rangeSq ? 1.0f : std::min(cone.sphere.w * projectionScale / sqrtf(distanceSq - rangeSq), 1.0f);
+	return size * size * Brightness(light);
+}
+
+bool LightBudget::Update(const std::vector<Light>& lights, XMFLOAT3 eyePosition, float projectionScale, const XMFLOAT4 planes[6], float deltaTime)
+{
+	size_t knownCount = fades.size();
+	size_t lightCount = lights.size();
+	bool changed = lightCount != knownCount;
+	fades.resize(lightCount, 0.0f);
+	selected.resize(lightCount, 0);
+
+	ScoreLights(lights, eyePosition, projectionScale, planes);
+	SelectLights();
+
+	float step = fadeTime > 0.0f ? deltaTime / fadeTime : 1.0f;
+	activeLights.clear();
+	fadeChanges.clear();
+	for (unsigned int i = 0; i < lightCount; i++)
+	{
+		float target = selected[i] ? 1.0f : 0.0f;
+		float fade =
+			i >= knownCount ? target :
+			target > fades[i] ? std::min(fades[i] + step, 1.0f) :
+			target < fades[i] ? std::max(fades[i] - step, 0.0f) :
+			target;
+
+		if (fade != fades[i])
+		{
+			fadeChanges.push_back(i);
+			changed = true;
+		}
+		fades[i] = fade;
+		if (fade > 0.0f)
+			activeLights.push_back(i);
+	}
+	return changed;
+}
+
+// --------------------------------------------------------
+// Same as Score(), four lights to a vector
+// --------------------------------------------------------
+void LightBudget::ScoreLights(const std::vector<Light>& lights, XMFLOAT3 eyePosition, float projectionScale, const XMFLOAT4 planes[6])
+{
+	unsigned int lightCount = (unsigned int)lights.size();
+	scores.resize(lightCount);
+
+	unsigned int jobs = (lightCount + LightsPerJob - 1) / LightsPerJob;
+	ThreadPool::GetInstance().ParallelFor(jobs, [&](unsigned int job)
+	{
+		XMVECTOR eyeX = XMVectorReplicate(eyePosition.x);
+		XMVECTOR eyeY = XMVectorReplicate(eyePosition.y);
+		XMVECTOR eyeZ = XMVectorReplicate(eyePosition.z);
+		XMVECTOR scale = XMVectorReplicate(projectionScale);
+		XMVECTOR one = XMVectorReplicate(1.0f);
+		XMVECTOR tiny = XMVectorReplicate(1e-20f);
+		XMVECTOR maxScore = XMVectorReplicate(FLT_MAX);
+
+		unsigned int end = std::min(lightCount, (job + 1) * LightsPerJob);
+		for (unsigned int first = job * LightsPerJob; first < end; first += 4)
+		{
+			// Padded lanes repeat the last light and aren't stored
+			unsigned int count = std::min(4u, end - first);
+			Cone cones[4];
+			XMFLOAT4 x, y, z, radius, brightness;
+			uint32_t directional[4];
+			float* lanes[5] = { &x.x, &y.x, &z.x, &radius.x, &brightness.x };
+			for (unsigned int lane = 0; lane < 4; lane++)
+			{
+				const Light& light = lights[first + std::min(lane, count - 1)];
+				cones[lane] = ConeCuller::FromLight(light);
+				lanes[0][lane] = cones[lane].sphere.x;
+				lanes[1][lane] = cones[lane].sphere.y;
+				lanes[2][lane] = cones[lane].sphere.z;
+				lanes[3][lane] = cones[lane].sphere.w;
+				lanes[4][lane] = Brightness(light);
+				directional[lane] = light.Type == LIGHT_TYPE_DIRECTIONAL ? 0xFFFFFFFFu : 0u;
+			}
+			XMVECTOR px = XMLoadFloat4(&x);
+			XMVECTOR py = XMLoadFloat4(&y);
+			XMVECTOR pz = XMLoadFloat4(&z);
+			XMVECTOR r = XMLoadFloat4(&radius);
+			XMVECTOR outside = ConeCuller::OutsideFrustum(cones, 4, planes);
+
+			XMVECTOR dx = XMVectorSubtract(px, eyeX);
+			XMVECTOR dy = XMVectorSubtract(py, eyeY);
+			XMVECTOR dz = XMVectorSubtract(pz, eyeZ);
+			XMVECTOR distanceSq = XMVectorAdd(XMVectorAdd(XMVectorMultiply(dx, dx), XMVectorMultiply(dy, dy)), XMVectorMultiply(dz, dz));
+			XMVECTOR rangeSq = XMVectorMultiply(r, r);
+			XMVECTOR inside = XMVectorLessOrEqual(distanceSq, rangeSq);
+
+			XMVECTOR silhouette = XMVectorSqrt(XMVectorMax(XMVectorSubtract(distanceSq, rangeSq), tiny));
+			XMVECTOR size = XMVectorSelect(XMVectorMin(XMVectorDivide(XMVectorMultiply(r, scale), silhouette), one), one, inside);
+			XMVECTOR score = XMVectorMultiply(XMVectorMultiply(size, size), XMLoadFloat4(&brightness));
+			score = XMVectorSelect(score, XMVectorZero(), outside);
+
+			XMVECTOR directionalMask = XMLoadInt4(directional);
+			score = XMVectorSelect(score, maxScore, directionalMask);
+
+			XMFLOAT4 result;
+			XMStoreFloat4(&result, score);
+			const float* resultLanes = &result.x;
+			for (unsigned int lane = 0; lane < 4 && first + lane < end; lane++)
+				scores[first + lane] = resultLanes[lane];
+		}
+	});
+}
+
+// --------------------------------------------------------
+// Keeps the best scoring lights over the threshold, those
+// selected last frame scoring a little higher.  Equal
+// scores go to the earlier light, so the choice doesn't
+// depend on how the partial sort falls.
+// --------------------------------------------------------
+void LightBudget::SelectLights()
+{
+	auto effective = [&](unsigned int i) { return selected[i] ? scores[i] * (1.0f + hysteresis) : scores[i]; };
+
+	candidates.clear();
+	for (unsigned int i = 0; i < scores.size(); i++)
+	{
+		if (scores[i] > 0.0f && effective(i) >= minScore)
+			candidates.push_back(i);
+	}
+
+	if (candidates.size() > maxLights)
+	{
+		std::nth_element(candidates.begin(), candidates.begin() + maxLights, candidates.end(), [&](unsigned int a, unsigned int b)
+		{
+			float scoreA = effective(a), scoreB = effective(b);
+			return scoreA > scoreB || (scoreA == scoreB && a < b);
+		});
+		candidates.resize(maxLights);
+	}
+
+	std::fill(selected.begin(), selected.end(), 0);
+	for (unsigned int i : candidates)
+		selected[i] = 1;
+	selectedCount = (unsigned int)candidates.size();
+}
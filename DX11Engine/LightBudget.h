@@ -0,0 +1,75 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+#include "Lights.h"
+
+// --------------------------------------------------------
+// Decides which lights are worth shading each frame, so a
+// scene can hold far more lights than it ever shades.
+//
+// Point and spot lights are scored by how much of the
+// screen the sphere around their cone covers (its
+// silhouette's radius in half screen heights, squared)
+// times their brightness, and lights whose cone is outside
+// the view score 0 (see ConeCuller).
+// Directional lights always make the cut.  The best
+// maxLights scoring over minScore are selected, with the
+// ones already selected given a hysteresis bonus so two
+// close lights don't trade places every frame.
+//
+// Selected lights fade in and dropped ones fade out over
+// fadeTime instead of popping, so for a moment a few more
+// than maxLights may be shaded.  Lights seen for the first
+// time start fully in or out.
+//
+// Scoring runs four lights at a time with XMVECTORs, in
+// blocks spread across the ThreadPool, and gives exactly
+// what Score() gives each light alone.
+// --------------------------------------------------------
+class LightBudget
+{
+public:
+	void SetBudget(unsigned int p_maxLights, float p_minScore);
+	void SetFadeTime(float seconds) { fadeTime = seconds; }
+	void SetHysteresis(float fraction) { hysteresis = fraction; }
+
+	// Scores every light for the view and moves the fades on by
+	// deltaTime.  Returns true if any fade changed.
+	bool Update(const std::vector<Light>& lights, DirectX::XMFLOAT3 eyePosition, float projectionScale, const DirectX::XMFLOAT4 planes[6], float deltaTime);
+
+	// The same score Update() gives one light
+	static float Score(const Light& light, DirectX::XMFLOAT3 eyePosition, float projectionScale, const DirectX::XMFLOAT4 planes[6]);
+
+	// Lights with any fade left, in light order
+	const std::vector<unsigned int>& GetActiveLights() const { return activeLights; }
+
+	// Lights whose fade the last update changed, in light order
+	const std::vector<unsigned int>& GetFadeChanges() const { return fadeChanges; }
+
+	// 0 to 1, what to scale a light's intensity by
+	float GetFade(unsigned int light) const { return light < fades.size() ? fades[light] : 0.0f; }
+	float GetScore(unsigned int light) const { return light < scores.size() ? scores[light] : 0.0f; }
+	bool IsSelected(unsigned int light) const { return light < selected.size() && selected[light] != 0; }
+	unsigned int GetSelectedCount() const { return selectedCount; }
+
+	// Forgets every light, so the next update starts them fully in or out
+	void Reset();
+
+private:
+	void ScoreLights(const std::vector<Light>& lights, DirectX::XMFLOAT3 eyePosition, float projectionScale, const DirectX::XMFLOAT4 planes[6]);
+	void SelectLights();
+
+	unsigned int maxLights = 64;
+	float minScore = 0.0001f;
+	float fadeTime = 0.25f;
+	float hysteresis = 0.2f;
+
+	std::vector<float> scores;
+	std::vector<float> fades;
+	std::vector<unsigned char> selected;
+	std::vector<unsigned int> candidates;
+	std::vector<unsigned int> activeLights;
+	std::vector<unsigned int> fadeChanges;
+	unsigned int selectedCount = 0;
+};
@@ -0,0 +1,134 @@
+#include "LightManager.h"
+
+#include <algorithm>
+#include <cstring>
+
+// What a free slot holds: no light anywhere, and not directional,
+// which would reach everything
+static Light FreeSlotLight()
+{
+	Light light = {};
+	light.Type = LIGHT_TYPE_POINT;
+	return light;
+}
+
+LightManager::LightManager()
+{
+	liveCount = 0;
+	version = 1;
+}
+
+LightHandle LightManager::Add(const Light& light)
+{
+	unsigned int index;
+	if (!freeSlots.empty())
+	{
+		index = freeSlots.back();
+		freeSlots.pop_back();
+		lights[index] = light;
+	}
+	else
+	{
+		index = (unsigned int)lights.size();
+		lights.push_back(light);
+		lightVersions.push_back(0);
+		generations.push_back(0);
+		live.push_back(0);
+	}
+
+	live[index] = 1;
+	liveCount++;
+	MarkChanged(index);
+	return { index, generations[index] };
+}
+
+bool LightManager::Remove(LightHandle handle)
+{
+	if (!IsValid(handle))
+		return false;
+
+	lights[handle.index] = FreeSlotLight();
+	live[handle.index] = 0;
+	generations[handle.index]++;
+	freeSlots.push_back(handle.index);
+	liveCount--;
+	MarkChanged(handle.index);
+	return true;
+}
+
+bool LightManager::IsValid(LightHandle handle) const
+{
+	return handle.index < lights.size() && live[handle.index] && generations[handle.index] == handle.generation;
+}
+
+const Light* LightManager::Get(LightHandle handle) const
+{
+	return IsValid(handle) ? &lights[handle.index] : nullptr;
+}
+
+bool LightManager::Set(LightHandle handle, const Light& light)
+{
+	if (!IsValid(handle))
+		return false;
+
+	SetLight(handle.index, light);
+	return true;
+}
+
+// --------------------------------------------------------
+// Only marks the light changed if it really is, so code
+// that writes every light every frame (like the shadow
+// view assignment) doesn't dirty the ones that stay put
+// --------------------------------------------------------
+void LightManager::SetLight(unsigned int index, const Light& light)
+{
+	if (memcmp(&lights[index], &light, sizeof(Light)) == 0)
+		return;
+
+	lights[index] = light;
+	MarkChanged(index);
+}
+
+void LightManager::MarkChanged(unsigned int index)
+{
+	lightVersions[index] = ++version;
+}
+
+void LightManager::GetChangedRanges(unsigned int sinceVersion, unsigned int maxGap, std::vector<LightRange>& ranges) const
+{
+	ranges.clear();
+	if (sinceVersion >= version)
+		return;
+
+	unsigned int count = (unsigned int)lights.size();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (lightVersions[i] <= sinceVersion)
+			continue;
+
+		if (!ranges.empty() && i - (ranges.back().first + ranges.back().count) <= maxGap)
+			ranges.back().count = i + 1 - ranges.back().first;
+		else
+			ranges.push_back({ i, 1 });
+	}
+}
+
+void LightManager::MergeRanges(std::vector<LightRange>& ranges, unsigned int maxGap)
+{
+	if (ranges.empty())
+		return;
+
+	std::sort(ranges.begin(), ranges.end(), [](const LightRange& a, const LightRange& b) { return a.first < b.first; });
+
+	size_t kept = 0;
+	for (size_t r = 1; r < ranges.size(); r++)
+	{
+		LightRange& last = ranges[kept];
+		unsigned int lastEnd = last.first + last.count;
+		if (ranges[r].first <= lastEnd || ranges[r].first - lastEnd <= maxGap)
+			last.count = std::max(lastEnd, ranges[r].first + ranges[r].count) - last.first;
+		else
+			ranges[++kept] = ranges[r];
+	}
+	ranges.resize(kept + 1);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+#include "Lights.h"
+
+// Names one light for as long as it lives.  A removed light's handle
+// stops working, even once its slot holds another light.
+struct LightHandle
+{
+	unsigned int index;
+	unsigned int generation;
+};
+
+// A run of lights by index
+struct LightRange
+{
+	unsigned int first;
+	unsigned int count;
+};
+
+// --------------------------------------------------------
+// Owns the scene's lights in a pool of slots.  A light
+// keeps its slot, and so its index in the light buffer,
+// until it's removed.  A removed light's slot holds an
+// unlit point light with no range, so nothing else has to
+// move, and the next light added takes it.
+//
+// Each change bumps a global version and stamps the light
+// with it, and only changes that actually change the light
+// count.  Anything that mirrors the lights (the GPU buffer,
+// culling structures) remembers the version it last saw
+// and asks for the ranges changed since, so lights that
+// stay put cost nothing after the first frame.
+//
+// The lights here are plain data; LightUploadQueue is what
+// gets the changed ones onto the GPU.
+// --------------------------------------------------------
+class LightManager
+{
+public:
+	LightManager();
+
+	LightHandle Add(const Light& light);
+	bool Remove(LightHandle handle);
+	bool IsValid(LightHandle handle) const;
+
+	// Null for a handle that's no longer valid
+	const Light* Get(LightHandle handle) const;
+	bool Set(LightHandle handle, const Light& light);
+
+	// By slot, for code that walks every light
+	const Light& GetLight(unsigned int index) const { return lights[index]; }
+	void SetLight(unsigned int index, const Light& light);
+	bool IsLive(unsigned int index) const { return index < live.size() && live[index] != 0; }
+
+	// Every slot, free ones included, as the light buffer holds them
+	const std::vector<Light>& GetLights() const { return lights; }
+	unsigned int GetSlotCount() const { return (unsigned int)lights.size(); }
+	unsigned int GetLiveCount() const { return liveCount; }
+
+	// Starts at 1, so a version of 0 has seen nothing
+	unsigned int GetVersion() const { return version; }
+	unsigned int GetLightVersion(unsigned int index) const { return lightVersions[index]; }
+
+	// Runs of lights changed after sinceVersion, in index order.  Runs
+	// with at most maxGap unchanged lights between them are joined so
+	// there are fewer of them; with 0 only touching runs are.
+	void GetChangedRanges(unsigned int sinceVersion, unsigned int maxGap, std::vector<LightRange>& ranges) const;
+
+	// Sorts ranges and joins any that overlap or have at most maxGap
+	// lights between them, as GetChangedRanges() does
+	static void MergeRanges(std::vector<LightRange>& ranges, unsigned int maxGap);
+
+private:
+	void MarkChanged(unsigned int index);
+
+	std::vector<Light> lights;
+	std::vector<unsigned int> lightVersions;
+	std::vector<unsigned int> generations;
+	std::vector<unsigned char> live;
+	std::vector<unsigned int> freeSlots;
+	unsigned int liveCount;
+	unsigned int version;
+};
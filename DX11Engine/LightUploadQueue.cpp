@@ -0,0 +1,23 @@
+#include "LightUploadQueue.h"
+
+LightUploadQueue::LightUploadQueue(unsigned int maxGap)
+	: maxGap(maxGap)
+{
+}
+
+unsigned int LightUploadQueue::Flush(const Writer& write)
+{
+	LightManager::MergeRanges(queued, maxGap);
+
+	unsigned int written = 0;
+	size_t failed = 0;
+	for (const LightRange& range : queued)
+	{
+		if (write(range))
+			written++;
+		else
+			queued[failed++] = range;
+	}
+	queued.resize(failed);
+	return written;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include "LightManager.h"
+
+// --------------------------------------------------------
+// Collects the lights to copy to the GPU over a frame:
+// ranges the LightManager reports changed, single lights
+// whose fade moved, in any order and overlapping freely.
+// Flush() sorts and joins them, taking a few unchanged
+// lights along when that saves a copy, and hands each
+// range to a writer.  Ranges the writer fails to copy
+// stay queued for the next flush.
+//
+// Only indices are kept; the writer decides where the
+// lights come from and where they go.
+// --------------------------------------------------------
+class LightUploadQueue
+{
+public:
+	// Copies one range, false if it couldn't
+	using Writer = std::function<bool(const LightRange& range)>;
+
+	// Up to this many unchanged lights between two queued ones are
+	// copied with them, for fewer, larger copies
+	static const unsigned int DefaultMaxGap = 3;
+
+	LightUploadQueue(unsigned int maxGap = DefaultMaxGap);
+
+	void Queue(unsigned int index) { queued.push_back({ index, 1 }); }
+	void Queue(const LightRange& range) { queued.push_back(range); }
+
+	// Returns how many ranges were written
+	unsigned int Flush(const Writer& write);
+
+	bool IsEmpty() const { return queued.empty(); }
+	const std::vector<LightRange>& GetQueued() const { return queued; }
+	unsigned int GetMaxGap() const { return maxGap; }
+
+private:
+	std::vector<LightRange> queued;
+	unsigned int maxGap;
+};
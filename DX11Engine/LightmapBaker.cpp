@@ -0,0 +1,621 @@
+#include "LightmapBaker.h"
+#include "DDSFile.h"
+#include "LightmapUVs.h"
+#include "ShadowViews.h"
+#include "ThreadPool.h"
+#include "TriangleBVH.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+using namespace DirectX;
+
+static const float Pi = 3.14159265358979f;
+
+// Double sided geometry shows its back to about half the rays hitting
+// it, so a probe is only taken to be inside something past this
+static const float InsideBackfaceFraction = 0.6f;
+
+// --------------------------------------------------------
+// Every instance's triangles in one BVH, with what a hit
+// needs to be shaded: three normals and an albedo per
+// triangle, in the order they were given to the BVH
+// --------------------------------------------------------
+struct BakeScene
+{
+	TriangleBVH bvh;
+	std::vector<XMFLOAT3> normals;
+	std::vector<XMFLOAT3> albedos;
+	const std::vector<Light>* lights;
+	const XMFLOAT3* skySH;
+	float offset;				// How far rays start off surfaces
+	unsigned int bounces;
+};
+
+// A xorshift generator, seeded per texel or probe
+struct BakeRandom
+{
+	uint32_t state;
+
+	explicit BakeRandom(uint32_t seed)
+	{
+		// Wang hash, so neighbouring seeds start far apart
+		seed = (seed ^ 61u) ^ (seed >> 16);
+		seed *= 9u;
+		seed ^= seed >> 4;
+		seed *= 0x27d4eb2du;
+		seed ^= seed >> 15;
+		state = seed ? seed : 1u;
+	}
+
+	float Next()
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return (state >> 8) * (1.0f / 16777216.0f);
+	}
+};
+
+static XMFLOAT3 Add(XMFLOAT3 a, XMFLOAT3 b) { return XMFLOAT3(a.x + b.x, a.y + b.y, a.z + b.z); }
+static XMFLOAT3 Multiply(XMFLOAT3 a, XMFLOAT3 b) { return XMFLOAT3(a.x * b.x, a.y * b.y, a.z * b.z); }
+static XMFLOAT3 Scale(XMFLOAT3 a, float s) { return XMFLOAT3(a.x * s, a.y * s, a.z * s); }
+static float Dot(XMFLOAT3 a, XMFLOAT3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+static XMFLOAT3 Normalize(XMFLOAT3 a)
+{
+	float length = sqrtf(Dot(a, a));
+	return length > 0.0f ? Scale(a, 1.0f / length) : XMFLOAT3(0.0f, 1.0f, 0.0f);
+}
+
+// --------------------------------------------------------
+// A direction around a normal, more likely the closer it
+// is to the normal, so averaging what's seen along many of
+// them weighs each by its cosine.  The tangent frame is
+// from "Building an Orthonormal Basis, Revisited" (Duff et
+// al. 2017).
+// --------------------------------------------------------
+static XMFLOAT3 SampleCosine(XMFLOAT3 n, BakeRandom& random)
+{
+	float sign = copysignf(1.0f, n.z);
+	float a = -1.0f / (sign + n.z);
+	float b = n.x * n.y * a;
+	XMFLOAT3 tangent(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+	XMFLOAT3 bitangent(b, sign + n.y * n.y * a, -n.y);
+
+	float r = sqrtf(random.Next());
+	float phi = 2.0f * Pi * random.Next();
+	float x = r * cosf(phi);
+	float y = r * sinf(phi);
+	float z = sqrtf(std::max(1.0f - r * r, 0.0f));
+	return Normalize(Add(Add(Scale(tangent, x), Scale(bitangent, y)), Scale(n, z)));
+}
+
+static XMFLOAT3 SampleSphere(BakeRandom& random)
+{
+	float z = 1.0f - 2.0f * random.Next();
+	float r = sqrtf(std::max(1.0f - z * z, 0.0f));
+	float phi = 2.0f * Pi * random.Next();
+	return XMFLOAT3(r * cosf(phi), r * sinf(phi), z);
+}
+
+static void BuildScene(const std::vector<LightmapInstance>& instances, const std::vector<Light>& lights, const XMFLOAT3* skySH, unsigned int bounces, BakeScene& scene)
+{
+	std::vector<XMFLOAT3> triangleVertices;
+	XMFLOAT3 boundsMin(FLT_MAX, FLT_MAX, FLT_MAX), boundsMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (const LightmapInstance& instance : instances)
+	{
+		for (unsigned int index : instance.indices)
+		{
+			const XMFLOAT3& p = instance.positions[index];
+			triangleVertices.push_back(p);
+			scene.normals.push_back(instance.normals[index]);
+			boundsMin = XMFLOAT3(std::min(boundsMin.x, p.x), std::min(boundsMin.y, p.y), std::min(boundsMin.z, p.z));
+			boundsMax = XMFLOAT3(std::max(boundsMax.x, p.x), std::max(boundsMax.y, p.y), std::max(boundsMax.z, p.z));
+		}
+		scene.albedos.insert(scene.albedos.end(), instance.indices.size() / 3, instance.albedo);
+	}
+	scene.bvh.Build(triangleVertices);
+	scene.lights = &lights;
+	scene.skySH = skySH;
+	scene.bounces = bounces;
+
+	float diagonal = triangleVertices.empty() ? 0.0f : sqrtf(Dot(Add(boundsMax, Scale(boundsMin, -1.0f)), Add(boundsMax, Scale(boundsMin, -1.0f))));
+	scene.offset = std::max(diagonal * 0.0001f, 0.0001f);
+}
+
+// --------------------------------------------------------
+// What a white diffuse surface at a point reflects from the
+// lights that see it, as HandleLightPBR()'s diffuse part
+// does, with a shadow ray per light
+// --------------------------------------------------------
+static XMFLOAT3 DirectLight(const BakeScene& scene, XMFLOAT3 position, XMFLOAT3 normal, bool bakedOnly, unsigned long long& rays)
+{
+	XMFLOAT3 result(0.0f, 0.0f, 0.0f);
+	XMFLOAT3 origin = Add(position, Scale(normal, scene.offset));
+	for (const Light& light : *scene.lights)
+	{
+		if (bakedOnly && !light.Baked)
+			continue;
+
+		XMFLOAT3 toLight;
+		float distance;
+		float attenuation = 1.0f;
+		if (light.Type == LIGHT_TYPE_DIRECTIONAL)
+		{
+			toLight = Normalize(Scale(light.Direction, -1.0f));
+			distance = FLT_MAX;
+		}
+		else
+		{
+			toLight = Add(light.Position, Scale(position, -1.0f));
+			distance = sqrtf(Dot(toLight, toLight));
+			if (distance >= light.Range || distance <= 0.0f)
+				continue;
+			toLight = Scale(toLight, 1.0f / distance);
+
+			// Must match Attenuate() in ShaderInclude.hlsli
+			attenuation = 1.0f - distance * distance / (light.Range * light.Range);
+			attenuation *= attenuation;
+
+			// Must match SpotTerm() in ShaderInclude.hlsli
+			if (light.Type == LIGHT_TYPE_SPOT)
+			{
+				float cosAngle = -Dot(toLight, Normalize(light.Direction));
+				float cosEdge = cosf(ShadowViews::SpotHalfAngle(light.SpotFalloff));
+				float edge = powf(cosEdge, light.SpotFalloff);
+				float spot = edge >= 1.0f ? (cosAngle >= cosEdge ? 1.0f : 0.0f) :
+					std::min(1.0f, std::max(0.0f, (powf(std::max(0.0f, cosAngle), light.SpotFalloff) - edge) / (1.0f - edge)));
+				if (spot <= 0.0f)
+					continue;
+				attenuation *= spot;
+			}
+		}
+
+		float NdotL = Dot(normal, toLight);
+		if (NdotL <= 0.0f)
+			continue;
+
+		rays++;
+		if (scene.bvh.Occluded(origin, toLight, distance))
+			continue;
+
+		result = Add(result, Scale(light.Color, light.Intensity * attenuation * NdotL));
+	}
+	return result;
+}
+
+// --------------------------------------------------------
+// The light arriving at origin from along direction: the
+// sky if nothing's in the way, otherwise what the surface
+// hit reflects, found by following one path off it up to
+// the scene's bounce limit.  backface says whether the
+// first surface hit faced away.
+// --------------------------------------------------------
+static XMFLOAT3 Radiance(const BakeScene& scene, XMFLOAT3 origin, XMFLOAT3 direction, BakeRandom& random, unsigned long long& rays, bool* backface)
+{
+	XMFLOAT3 result(0.0f, 0.0f, 0.0f);
+	XMFLOAT3 throughput(1.0f, 1.0f, 1.0f);
+	for (unsigned int depth = 0; ; depth++)
+	{
+		TriangleHit hit;
+		rays++;
+		if (!scene.bvh.Intersect(origin, direction, FLT_MAX, hit))
+		{
+			XMFLOAT3 sky = SphericalHarmonics::Evaluate(scene.skySH, direction);
+			sky = XMFLOAT3(std::max(sky.x, 0.0f), std::max(sky.y, 0.0f), std::max(sky.z, 0.0f));
+			result = Add(result, Multiply(throughput, sky));
+			break;
+		}
+
+		const XMFLOAT3* n = &scene.normals[hit.triangle * 3];
+		XMFLOAT3 normal = Normalize(Add(Add(Scale(n[0], 1.0f - hit.u - hit.v), Scale(n[1], hit.u)), Scale(n[2], hit.v)));
+		bool facingAway = Dot(normal, direction) > 0.0f;
+		if (facingAway)
+			normal = Scale(normal, -1.0f);
+		if (depth == 0 && backface)
+			*backface = facingAway;
+
+		XMFLOAT3 position = Add(origin, Scale(direction, hit.distance));
+		throughput = Multiply(throughput, scene.albedos[hit.triangle]);
+		result = Add(result, Multiply(throughput, DirectLight(scene, position, normal, false, rays)));
+
+		if (depth >= scene.bounces)
+			break;
+		origin = Add(position, Scale(normal, scene.offset));
+		direction = SampleCosine(normal, random);
+	}
+	return result;
+}
+
+// --------------------------------------------------------
+// Instances are packed tallest first into shelves across
+// the atlas, each a square whose side follows the square
+// root of its area.  If they don't fit, the density drops
+// a step and they're packed again.
+// --------------------------------------------------------
+bool LightmapBaker::PackAtlas(std::vector<LightmapInstance>& instances, const LightmapBakeSettings& settings)
+{
+	std::vector<float> areas(instances.size());
+	for (unsigned int i = 0; i < instances.size(); i++)
+	{
+		const LightmapInstance& instance = instances[i];
+		float area = 0.0f;
+		for (unsigned int t = 0; t + 2 < instance.indices.size(); t += 3)
+		{
+			XMVECTOR p0 = XMLoadFloat3(&instance.positions[instance.indices[t]]);
+			XMVECTOR p1 = XMLoadFloat3(&instance.positions[instance.indices[t + 1]]);
+			XMVECTOR p2 = XMLoadFloat3(&instance.positions[instance.indices[t + 2]]);
+			area += 0.5f * XMVectorGetX(XMVector3Length(XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0))));
+		}
+		areas[i] = area;
+	}
+
+	// Smaller than the charts' padding was planned for and they'd bleed
+	unsigned int maxSide = std::min(settings.maxInstanceSize, settings.atlasSize);
+	unsigned int minSide = std::min(LightmapUVs::ReferenceResolution, maxSide);
+
+	std::vector<unsigned int> sizes(instances.size());
+	std::vector<unsigned int> order(instances.size());
+	for (float density = settings.texelsPerUnit; ; density *= 0.8f)
+	{
+		for (unsigned int i = 0; i < instances.size(); i++)
+		{
+			float side = ceilf(sqrtf(areas[i]) * density);
+			sizes[i] = (unsigned int)std::min(std::max(side, (float)minSide), (float)maxSide);
+			order[i] = i;
+		}
+		std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return sizes[a] > sizes[b]; });
+
+		unsigned int x = 0, y = 0, shelfHeight = 0;
+		bool fits = true;
+		for (unsigned int i : order)
+		{
+			if (x + sizes[i] > settings.atlasSize)
+			{
+				x = 0;
+				y += shelfHeight;
+				shelfHeight = 0;
+			}
+			if (y + sizes[i] > settings.atlasSize)
+			{
+				fits = false;
+				break;
+			}
+
+			float atlas = (float)settings.atlasSize;
+			instances[i].rect = XMFLOAT4(sizes[i] / atlas, sizes[i] / atlas, x / atlas, y / atlas);
+			x += sizes[i];
+			shelfHeight = std::max(shelfHeight, sizes[i]);
+		}
+
+		if (fits)
+			return true;
+
+		// Already as small as they go
+		if (*std::max_element(sizes.begin(), sizes.end()) <= minSide)
+			return false;
+	}
+}
+
+ProbeGrid LightmapBaker::PlaceProbes(XMFLOAT3 boundsMin, XMFLOAT3 boundsMax, const LightmapBakeSettings& settings)
+{
+	ProbeGrid grid = {};
+	const float* low = &boundsMin.x;
+	const float* high = &boundsMax.x;
+	float* origin = &grid.origin.x;
+	float* spacing = &grid.spacing.x;
+	for (unsigned int axis = 0; axis < 3; axis++)
+	{
+		float extent = std::max(high[axis] - low[axis], 0.0f);
+		float wanted = std::max(settings.probeSpacing, 0.0001f);
+		grid.counts[axis] = std::min(std::max((unsigned int)ceilf(extent / wanted), 2u), std::max(settings.maxProbesPerAxis, 2u));
+		spacing[axis] = std::max(extent / grid.counts[axis], 0.0001f);
+		origin[axis] = low[axis] + spacing[axis] * 0.5f;
+	}
+	return grid;
+}
+
+// --------------------------------------------------------
+// Texel centers are found by rasterizing every triangle's
+// lightmap UVs into the atlas, then the tiles holding any
+// are traced in parallel.  Empty texels next to filled
+// ones are filled with their average afterwards, so
+// filtering at chart edges doesn't pull in black.
+// --------------------------------------------------------
+unsigned long long LightmapBaker::BakeLightmap(const std::vector<LightmapInstance>& instances, const std::vector<Light>& lights, const XMFLOAT3 skySH[SphericalHarmonics::CoefficientCount], const LightmapBakeSettings& settings, std::vector<XMFLOAT4>& texels)
+{
+	unsigned int atlasSize = settings.atlasSize;
+	texels.assign((size_t)atlasSize * atlasSize, XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f));
+
+	BakeScene scene;
+	BuildScene(instances, lights, skySH, settings.bounces, scene);
+
+	// Where each texel's center lands on the surface
+	std::vector<XMFLOAT3> positions(texels.size());
+	std::vector<XMFLOAT3> normals(texels.size());
+	std::vector<unsigned char> covered(texels.size(), 0);
+	for (const LightmapInstance& instance : instances)
+	{
+		for (unsigned int t = 0; t + 2 < instance.indices.size(); t += 3)
+		{
+			const unsigned int* corners = &instance.indices[t];
+			XMFLOAT2 uv[3];
+			for (unsigned int c = 0; c < 3; c++)
+			{
+				const XMFLOAT2& lightmapUV = instance.lightmapUVs[corners[c]];
+				uv[c] = XMFLOAT2((lightmapUV.x * instance.rect.x + instance.rect.z) * atlasSize, (lightmapUV.y * instance.rect.y + instance.rect.w) * atlasSize);
+			}
+
+			float area = (uv[1].x - uv[0].x) * (uv[2].y - uv[0].y) - (uv[1].y - uv[0].y) * (uv[2].x - uv[0].x);
+			if (fabsf(area) < 1e-12f)
+				continue;
+
+			int minX = std::max((int)floorf(std::min(std::min(uv[0].x, uv[1].x), uv[2].x)), 0);
+			int minY = std::max((int)floorf(std::min(std::min(uv[0].y, uv[1].y), uv[2].y)), 0);
+			int maxX = std::min((int)ceilf(std::max(std::max(uv[0].x, uv[1].x), uv[2].x)), (int)atlasSize - 1);
+			int maxY = std::min((int)ceilf(std::max(std::max(uv[0].y, uv[1].y), uv[2].y)), (int)atlasSize - 1);
+			for (int y = minY; y <= maxY; y++)
+			{
+				for (int x = minX; x <= maxX; x++)
+				{
+					// Barycentrics of the texel's center, from the signed areas
+					float px = x + 0.5f, py = y + 0.5f;
+					float b1 = ((px - uv[0].x) * (uv[2].y - uv[0].y) - (py - uv[0].y) * (uv[2].x - uv[0].x)) / area;
+					float b2 = ((uv[1].x - uv[0].x) * (py - uv[0].y) - (uv[1].y - uv[0].y) * (px - uv[0].x)) / area;
+					float b0 = 1.0f - b1 - b2;
+					if (b0 < 0.0f || b1 < 0.0f || b2 < 0.0f)
+						continue;
+
+					size_t texel = (size_t)y * atlasSize + x;
+					const XMFLOAT3* p[3] = { &instance.positions[corners[0]], &instance.positions[corners[1]], &instance.positions[corners[2]] };
+					const XMFLOAT3* n[3] = { &instance.normals[corners[0]], &instance.normals[corners[1]], &instance.normals[corners[2]] };
+					positions[texel] = Add(Add(Scale(*p[0], b0), Scale(*p[1], b1)), Scale(*p[2], b2));
+					normals[texel] = Normalize(Add(Add(Scale(*n[0], b0), Scale(*n[1], b1)), Scale(*n[2], b2)));
+					covered[texel] = 1;
+				}
+			}
+		}
+	}
+
+	// Only tiles with something in them are worth a job
+	unsigned int tileSize = std::max(settings.tileSize, 1u);
+	unsigned int tilesPerRow = (atlasSize + tileSize - 1) / tileSize;
+	std::vector<unsigned int> tiles;
+	for (unsigned int tile = 0; tile < tilesPerRow * tilesPerRow; tile++)
+	{
+		unsigned int x0 = (tile % tilesPerRow) * tileSize, y0 = (tile / tilesPerRow) * tileSize;
+		bool any = false;
+		for (unsigned int y = y0; y < std::min(y0 + tileSize, atlasSize) && !any; y++)
+		{
+			for (unsigned int x = x0; x < std::min(x0 + tileSize, atlasSize) && !any; x++)
+				any = covered[(size_t)y * atlasSize + x] != 0;
+		}
+		if (any)
+			tiles.push_back(tile);
+	}
+
+	std::vector<unsigned long long> tileRays(tiles.size(), 0);
+	std::atomic<unsigned int> tilesDone(0);
+	float sampleWeight = 1.0f / std::max(settings.samplesPerTexel, 1u);
+	ThreadPool::GetInstance().ParallelFor((unsigned int)tiles.size(), [&](unsigned int job)
+	{
+		unsigned int tile = tiles[job];
+		unsigned int x0 = (tile % tilesPerRow) * tileSize, y0 = (tile / tilesPerRow) * tileSize;
+		unsigned long long rays = 0;
+		for (unsigned int y = y0; y < std::min(y0 + tileSize, atlasSize); y++)
+		{
+			for (unsigned int x = x0; x < std::min(x0 + tileSize, atlasSize); x++)
+			{
+				size_t texel = (size_t)y * atlasSize + x;
+				if (!covered[texel])
+					continue;
+
+				BakeRandom random((uint32_t)texel);
+				XMFLOAT3 position = positions[texel];
+				XMFLOAT3 normal = normals[texel];
+				XMFLOAT3 origin = Add(position, Scale(normal, scene.offset));
+
+				XMFLOAT3 indirect(0.0f, 0.0f, 0.0f);
+				for (unsigned int s = 0; s < settings.samplesPerTexel; s++)
+					indirect = Add(indirect, Radiance(scene, origin, SampleCosine(normal, random), random, rays, nullptr));
+
+				XMFLOAT3 total = Add(DirectLight(scene, position, normal, true, rays), Scale(indirect, sampleWeight));
+				texels[texel] = XMFLOAT4(total.x, total.y, total.z, 1.0f);
+			}
+		}
+		tileRays[job] = rays;
+
+		// Whoever finishes the tile that crosses each tenth reports it
+		unsigned int done = ++tilesDone;
+		if (done * 10 / tiles.size() != (done - 1) * 10 / tiles.size())
+			printf("Lightmap bake: %u%%\n", (unsigned int)(done * 100 / tiles.size()));
+	});
+
+	// Dilate, a ring of texels per pass
+	for (unsigned int pass = 0; pass < settings.dilation; pass++)
+	{
+		std::vector<XMFLOAT4> source = texels;
+		for (unsigned int y = 0; y < atlasSize; y++)
+		{
+			for (unsigned int x = 0; x < atlasSize; x++)
+			{
+				if (source[(size_t)y * atlasSize + x].w > 0.0f)
+					continue;
+
+				XMFLOAT4 sum(0.0f, 0.0f, 0.0f, 0.0f);
+				for (int dy = -1; dy <= 1; dy++)
+				{
+					for (int dx = -1; dx <= 1; dx++)
+					{
+						int nx = (int)x + dx, ny = (int)y + dy;
+						if (nx < 0 || ny < 0 || nx >= (int)atlasSize || ny >= (int)atlasSize)
+							continue;
+						const XMFLOAT4& neighbour = source[(size_t)ny * atlasSize + nx];
+						if (neighbour.w > 0.0f)
+							sum = XMFLOAT4(sum.x + neighbour.x, sum.y + neighbour.y, sum.z + neighbour.z, sum.w + 1.0f);
+					}
+				}
+				if (sum.w > 0.0f)
+					texels[(size_t)y * atlasSize + x] = XMFLOAT4(sum.x / sum.w, sum.y / sum.w, sum.z / sum.w, 1.0f);
+			}
+		}
+	}
+
+	unsigned long long rays = 0;
+	for (unsigned long long tileRayCount : tileRays)
+		rays += tileRayCount;
+	return rays;
+}
+
+// --------------------------------------------------------
+// Each probe projects the light arriving from evenly spread
+// random directions.  Probes that mostly see the backs of
+// surfaces are inside something, so they take the average
+// of their neighbours that aren't instead, or the sky's
+// light if none are.
+// --------------------------------------------------------
+unsigned long long LightmapBaker::BakeProbes(const std::vector<LightmapInstance>& instances, const std::vector<Light>& lights, const XMFLOAT3 skySH[SphericalHarmonics::CoefficientCount], const LightmapBakeSettings& settings, const ProbeGrid& grid, std::vector<XMFLOAT4>& coefficients)
+{
+	const unsigned int count = SphericalHarmonics::CoefficientCount;
+	unsigned int probeCount = grid.GetProbeCount();
+	coefficients.assign((size_t)probeCount * count, XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f));
+
+	BakeScene scene;
+	BuildScene(instances, lights, skySH, settings.bounces, scene);
+
+	std::vector<unsigned char> inside(probeCount, 0);
+	std::vector<unsigned long long> probeRays(probeCount, 0);
+	std::atomic<unsigned int> probesDone(0);
+	unsigned int samples = std::max(settings.probeSamples, 1u);
+	ThreadPool::GetInstance().ParallelFor(probeCount, [&](unsigned int probe)
+	{
+		unsigned int x = probe % grid.counts[0];
+		unsigned int y = (probe / grid.counts[0]) % grid.counts[1];
+		unsigned int z = probe / (grid.counts[0] * grid.counts[1]);
+		XMFLOAT3 origin(grid.origin.x + x * grid.spacing.x, grid.origin.y + y * grid.spacing.y, grid.origin.z + z * grid.spacing.z);
+
+		// Seeded apart from the lightmap's texels
+		BakeRandom random(probe ^ 0x9E3779B9u);
+		XMFLOAT3 sums[count];
+		std::fill(sums, sums + count, XMFLOAT3(0.0f, 0.0f, 0.0f));
+		unsigned int backfaces = 0;
+		unsigned long long rays = 0;
+		for (unsigned int s = 0; s < samples; s++)
+		{
+			XMFLOAT3 direction = SampleSphere(random);
+			bool backface = false;
+			XMFLOAT3 radiance = Radiance(scene, origin, direction, random, rays, &backface);
+			backfaces += backface ? 1 : 0;
+
+			float basis[count];
+			SphericalHarmonics::Basis(direction, basis);
+			for (unsigned int c = 0; c < count; c++)
+				sums[c] = Add(sums[c], Scale(radiance, basis[c]));
+		}
+
+		// Uniform samples each cover 4 pi / samples of the sphere
+		for (unsigned int c = 0; c < count; c++)
+			sums[c] = Scale(sums[c], 4.0f * Pi / samples);
+		SphericalHarmonics::ConvolveDiffuse(sums);
+		for (unsigned int c = 0; c < count; c++)
+			coefficients[(size_t)probe * count + c] = XMFLOAT4(sums[c].x, sums[c].y, sums[c].z, 0.0f);
+
+		inside[probe] = backfaces > samples * InsideBackfaceFraction ? 1 : 0;
+		probeRays[probe] = rays;
+
+		unsigned int done = ++probesDone;
+		if (done * 10 / probeCount != (done - 1) * 10 / probeCount)
+			printf("Probe bake: %u%%\n", done * 100 / probeCount);
+	});
+
+	// Fill probes inside geometry from outside in, a ring per pass
+	bool filling = true;
+	while (filling)
+	{
+		filling = false;
+		std::vector<unsigned char> wasInside = inside;
+		for (unsigned int probe = 0; probe < probeCount; probe++)
+		{
+			if (!wasInside[probe])
+				continue;
+
+			int cell[3] = { (int)(probe % grid.counts[0]), (int)((probe / grid.counts[0]) % grid.counts[1]), (int)(probe / (grid.counts[0] * grid.counts[1])) };
+			XMFLOAT3 sums[count];
+			std::fill(sums, sums + count, XMFLOAT3(0.0f, 0.0f, 0.0f));
+			unsigned int neighbours = 0;
+			for (unsigned int axis = 0; axis < 3; axis++)
+			{
+				for (int step = -1; step <= 1; step += 2)
+				{
+					int next[3] = { cell[0], cell[1], cell[2] };
+					next[axis] += step;
+					if (next[axis] < 0 || next[axis] >= (int)grid.counts[axis])
+						continue;
+
+					unsigned int neighbour = (next[2] * grid.counts[1] + next[1]) * grid.counts[0] + next[0];
+					if (wasInside[neighbour])
+						continue;
+
+					for (unsigned int c = 0; c < count; c++)
+					{
+						const XMFLOAT4& coefficient = coefficients[(size_t)neighbour * count + c];
+						sums[c] = Add(sums[c], XMFLOAT3(coefficient.x, coefficient.y, coefficient.z));
+					}
+					neighbours++;
+				}
+			}
+
+			if (neighbours == 0)
+				continue;
+			for (unsigned int c = 0; c < count; c++)
+				coefficients[(size_t)probe * count + c] = XMFLOAT4(sums[c].x / neighbours, sums[c].y / neighbours, sums[c].z / neighbours, 0.0f);
+			inside[probe] = 0;
+			filling = true;
+		}
+	}
+
+	// Every probe was inside something
+	XMFLOAT3 sky[count];
+	for (unsigned int c = 0; c < count; c++)
+		sky[c] = skySH[c];
+	SphericalHarmonics::ConvolveDiffuse(sky);
+	for (unsigned int probe = 0; probe < probeCount; probe++)
+	{
+		if (!inside[probe])
+			continue;
+		for (unsigned int c = 0; c < count; c++)
+			coefficients[(size_t)probe * count + c] = XMFLOAT4(sky[c].x, sky[c].y, sky[c].z, 0.0f);
+	}
+
+	unsigned long long rays = 0;
+	for (unsigned long long probeRayCount : probeRays)
+		rays += probeRayCount;
+	return rays;
+}
+
+bool LightmapBaker::BakeFiles(const std::vector<LightmapInstance>& instances, const std::vector<Light>& lights, const XMFLOAT3 skySH[SphericalHarmonics::CoefficientCount], const LightmapBakeSettings& settings, const ProbeGrid& grid, const std::string& lightmapPath, const std::string& probePath)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<XMFLOAT4> texels;
+	unsigned long long lightmapRays = BakeLightmap(instances, lights, skySH, settings, texels);
+	auto middle = std::chrono::high_resolution_clock::now();
+	std::vector<XMFLOAT4> probes;
+	unsigned long long probeRays = BakeProbes(instances, lights, skySH, settings, grid, probes);
+	auto end = std::chrono::high_resolution_clock::now();
+
+	double lightmapMs = std::chrono::duration<double, std::milli>(middle - start).count();
+	double probeMs = std::chrono::duration<double, std::milli>(end - middle).count();
+	printf("Lightmap bake, %u threads: lightmap %.1f ms (%.2f M rays/s), %u probes %.1f ms (%.2f M rays/s)\n",
+		ThreadPool::GetInstance().GetThreadCount(),
+		lightmapMs, lightmapRays / (lightmapMs * 1000.0),
+		grid.GetProbeCount(), probeMs, probeRays / (probeMs * 1000.0));
+
+	return DDSFile::WriteTexture(lightmapPath, settings.atlasSize, settings.atlasSize, texels) &&
+		DDSFile::WriteTexture(probePath, SphericalHarmonics::CoefficientCount, grid.GetProbeCount(), probes);
+}
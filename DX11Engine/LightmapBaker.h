@@ -0,0 +1,86 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+#include "Lights.h"
+#include "SphericalHarmonics.h"
+
+// How much work a bake does and how the results are laid out
+struct LightmapBakeSettings
+{
+	unsigned int atlasSize {512};			// The lightmap is atlasSize square
+	float texelsPerUnit {32.0f};			// Wanted density, lowered until every instance fits
+	unsigned int maxInstanceSize {256};		// Largest side of one instance's part of the atlas
+	unsigned int samplesPerTexel {64};		// Paths traced from each texel
+	unsigned int bounces {2};				// Surfaces a path may bounce off after the first it hits
+	unsigned int tileSize {16};				// Texels per side of the squares handed to threads
+	unsigned int dilation {2};				// How far empty texels are filled from their neighbours
+	float probeSpacing {1.0f};				// Wanted world units between irradiance probes
+	unsigned int maxProbesPerAxis {16};
+	unsigned int probeSamples {512};		// Rays traced from each probe
+};
+
+// One static entity's triangles, already in world space
+struct LightmapInstance
+{
+	std::vector<DirectX::XMFLOAT3> positions;
+	std::vector<DirectX::XMFLOAT3> normals;
+	std::vector<DirectX::XMFLOAT2> lightmapUVs;		// From LightmapUVs
+	std::vector<unsigned int> indices;
+	DirectX::XMFLOAT3 albedo;		// Its average diffuse color, for light bouncing off it
+	DirectX::XMFLOAT4 rect;			// Set by PackAtlas(): lightmap UV scale in xy, offset in zw
+};
+
+// A box of probes at the centers of equal cells, x fastest then y then z
+struct ProbeGrid
+{
+	DirectX::XMFLOAT3 origin;		// The first probe
+	DirectX::XMFLOAT3 spacing;
+	unsigned int counts[3];
+
+	unsigned int GetProbeCount() const { return counts[0] * counts[1] * counts[2]; }
+};
+
+// --------------------------------------------------------
+// Bakes the light on static geometry by path tracing on the
+// CPU, into a lightmap for the static instances and a grid
+// of irradiance probes for everything else.
+//
+// Each lightmap texel stores what a white diffuse surface
+// there reflects, in the pixel shader's units: the direct
+// light of lights marked Baked, plus light bouncing off the
+// scene and the sky.  Lights not marked Baked are still
+// drawn at runtime, so they only add their bounced light.
+// Paths see every light and sky misses use its radiance
+// spherical harmonics.  Each probe stores the light coming
+// in from around it as diffuse convolved harmonics (see
+// SphericalHarmonics::ConvolveDiffuse()).
+//
+// The atlas is split into tiles spread across the
+// ThreadPool, and every texel and probe seeds its own
+// random numbers, so bakes don't depend on thread count.
+// Spot lights fall off like in the pixel shader.  Tools/
+// BakeLightmaps bakes a test scene from the command line.
+// --------------------------------------------------------
+class LightmapBaker
+{
+public:
+	// Gives every instance a square of the atlas sized by its surface
+	// area, returning false if they can't fit even at the smallest size
+	// LightmapUVs pads its charts for
+	static bool PackAtlas(std::vector<LightmapInstance>& instances, const LightmapBakeSettings& settings);
+
+	// Probes spread over a world space box, at least two per axis
+	static ProbeGrid PlaceProbes(DirectX::XMFLOAT3 boundsMin, DirectX::XMFLOAT3 boundsMax, const LightmapBakeSettings& settings);
+
+	// Each returns how many rays it traced, for throughput.  Texels are
+	// atlasSize square, rows top first, with alpha 0 where nothing maps.
+	// Probes are nine coefficients each, in ProbeGrid order.
+	static unsigned long long BakeLightmap(const std::vector<LightmapInstance>& instances, const std::vector<Light>& lights, const DirectX::XMFLOAT3 skySH[SphericalHarmonics::CoefficientCount], const LightmapBakeSettings& settings, std::vector<DirectX::XMFLOAT4>& texels);
+	static unsigned long long BakeProbes(const std::vector<LightmapInstance>& instances, const std::vector<Light>& lights, const DirectX::XMFLOAT3 skySH[SphericalHarmonics::CoefficientCount], const LightmapBakeSettings& settings, const ProbeGrid& grid, std::vector<DirectX::XMFLOAT4>& coefficients);
+
+	// Bakes both and writes them as float DDS textures, the probes as
+	// nine texels per row and a row per probe, printing how long each took
+	static bool BakeFiles(const std::vector<LightmapInstance>& instances, const std::vector<Light>& lights, const DirectX::XMFLOAT3 skySH[SphericalHarmonics::CoefficientCount], const LightmapBakeSettings& settings, const ProbeGrid& grid, const std::string& lightmapPath, const std::string& probePath);
+};
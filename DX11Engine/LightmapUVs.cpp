@@ -0,0 +1,167 @@
+#include "LightmapUVs.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <map>
+#include <tuple>
+
+using namespace DirectX;
+
+struct Chart
+{
+	unsigned int axis;		// 0 to 5 for +X, -X, +Y, -Y, +Z, -Z
+	XMFLOAT2 min;
+	XMFLOAT2 max;
+	XMFLOAT2 offset;		// Where min ends up in the square, before scaling
+	std::vector<unsigned int> triangles;
+};
+
+static unsigned int FindRoot(std::vector<unsigned int>& parents, unsigned int i)
+{
+	while (parents[i] != i)
+	{
+		parents[i] = parents[parents[i]];
+		i = parents[i];
+	}
+	return i;
+}
+
+// The chart plane's coordinates of a position
+static XMFLOAT2 Project(const XMFLOAT3& p, unsigned int axis)
+{
+	switch (axis / 2)
+	{
+	case 0: return XMFLOAT2(p.z, p.y);
+	case 1: return XMFLOAT2(p.x, p.z);
+	default: return XMFLOAT2(p.x, p.y);
+	}
+}
+
+// --------------------------------------------------------
+// Packs chart boxes into rows across a square of the given
+// side, tallest first, returning false if they overflow
+// --------------------------------------------------------
+static bool ShelfPack(std::vector<Chart>& charts, const std::vector<unsigned int>& order, float side, float padding)
+{
+	float x = padding, y = padding, shelfHeight = 0.0f;
+	for (unsigned int c : order)
+	{
+		Chart& chart = charts[c];
+		float width = chart.max.x - chart.min.x;
+		float height = chart.max.y - chart.min.y;
+		if (x + width + padding > side)
+		{
+			x = padding;
+			y += shelfHeight + padding;
+			shelfHeight = 0.0f;
+		}
+		if (x + width + padding > side || y + height + padding > side)
+			return false;
+
+		chart.offset = XMFLOAT2(x, y);
+		x += width + padding;
+		shelfHeight = std::max(shelfHeight, height);
+	}
+	return true;
+}
+
+void LightmapUVs::Generate(const std::vector<XMFLOAT3>& positions, const std::vector<unsigned int>& indices, std::vector<XMFLOAT2>& lightmapUVs)
+{
+	lightmapUVs.assign(positions.size(), XMFLOAT2(0.0f, 0.0f));
+	unsigned int triangleCount = (unsigned int)(indices.size() / 3);
+	if (triangleCount == 0)
+		return;
+
+	// Which way each triangle faces most
+	std::vector<unsigned int> axes(triangleCount);
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		XMVECTOR p0 = XMLoadFloat3(&positions[indices[t * 3]]);
+		XMVECTOR p1 = XMLoadFloat3(&positions[indices[t * 3 + 1]]);
+		XMVECTOR p2 = XMLoadFloat3(&positions[indices[t * 3 + 2]]);
+		XMFLOAT3 n;
+		XMStoreFloat3(&n, XMVector3Cross(XMVectorSubtract(p1, p0), XMVectorSubtract(p2, p0)));
+		float ax = fabsf(n.x), ay = fabsf(n.y), az = fabsf(n.z);
+		axes[t] = ax >= ay && ax >= az ? (n.x < 0.0f ? 1 : 0) : (ay >= az ? (n.y < 0.0f ? 3 : 2) : (n.z < 0.0f ? 5 : 4));
+	}
+
+	// Join triangles that share a position and an axis
+	std::vector<unsigned int> parents(triangleCount);
+	for (unsigned int t = 0; t < triangleCount; t++)
+		parents[t] = t;
+
+	std::map<std::tuple<long long, long long, long long, unsigned int>, unsigned int> firstAtPosition;
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		for (unsigned int corner = 0; corner < 3; corner++)
+		{
+			const XMFLOAT3& p = positions[indices[t * 3 + corner]];
+			auto key = std::make_tuple(llroundf(p.x * 10000.0f), llroundf(p.y * 10000.0f), llroundf(p.z * 10000.0f), axes[t]);
+			auto found = firstAtPosition.find(key);
+			if (found == firstAtPosition.end())
+				firstAtPosition[key] = t;
+			else
+				parents[FindRoot(parents, t)] = FindRoot(parents, found->second);
+		}
+	}
+
+	std::vector<Chart> charts;
+	std::vector<int> chartOfRoot(triangleCount, -1);
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		unsigned int root = FindRoot(parents, t);
+		if (chartOfRoot[root] < 0)
+		{
+			chartOfRoot[root] = (int)charts.size();
+			Chart chart = {};
+			chart.axis = axes[t];
+			chart.min = XMFLOAT2(FLT_MAX, FLT_MAX);
+			chart.max = XMFLOAT2(-FLT_MAX, -FLT_MAX);
+			charts.push_back(chart);
+		}
+
+		Chart& chart = charts[chartOfRoot[root]];
+		chart.triangles.push_back(t);
+		for (unsigned int corner = 0; corner < 3; corner++)
+		{
+			XMFLOAT2 uv = Project(positions[indices[t * 3 + corner]], chart.axis);
+			chart.min = XMFLOAT2(std::min(chart.min.x, uv.x), std::min(chart.min.y, uv.y));
+			chart.max = XMFLOAT2(std::max(chart.max.x, uv.x), std::max(chart.max.y, uv.y));
+		}
+	}
+
+	// Tallest first, ties in chart order
+	std::vector<unsigned int> order(charts.size());
+	float area = 0.0f, widest = 0.0f;
+	for (unsigned int c = 0; c < charts.size(); c++)
+	{
+		order[c] = c;
+		area += (charts[c].max.x - charts[c].min.x) * (charts[c].max.y - charts[c].min.y);
+		widest = std::max(widest, std::max(charts[c].max.x - charts[c].min.x, charts[c].max.y - charts[c].min.y));
+	}
+	std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b)
+	{
+		return charts[a].max.y - charts[a].min.y > charts[b].max.y - charts[b].min.y;
+	});
+
+	// Grow the square until everything fits, padding scaling along with it
+	float paddingFraction = (float)PaddingTexels / ReferenceResolution;
+	float side = std::max(sqrtf(area) * 1.1f, widest / (1.0f - 2.0f * paddingFraction));
+	side = std::max(side, 1e-6f);
+	while (!ShelfPack(charts, order, side, side * paddingFraction))
+		side *= 1.1f;
+
+	for (const Chart& chart : charts)
+	{
+		for (unsigned int t : chart.triangles)
+		{
+			for (unsigned int corner = 0; corner < 3; corner++)
+			{
+				unsigned int index = indices[t * 3 + corner];
+				XMFLOAT2 uv = Project(positions[index], chart.axis);
+				lightmapUVs[index] = XMFLOAT2((uv.x - chart.min.x + chart.offset.x) / side, (uv.y - chart.min.y + chart.offset.y) / side);
+			}
+		}
+	}
+}
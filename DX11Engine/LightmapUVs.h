@@ -0,0 +1,31 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+
+// --------------------------------------------------------
+// Makes a second set of texture coordinates for lightmaps,
+// where no two triangles overlap.
+//
+// Triangles are grouped into charts - connected triangles
+// (by shared positions) facing the same way along the same
+// axis - and each chart is projected flat onto that axis'
+// plane, so it keeps its shape.  Charts are shelf packed
+// into the unit square with room between them for a few
+// texels at ReferenceResolution.
+//
+// A vertex shared by triangles in different charts keeps
+// the last one's coordinates, which only matters for
+// indexed meshes - the OBJ loader gives every triangle its
+// own vertices.  Run on the CPU copy Mesh keeps when it
+// loads, before the vertex buffer is made.
+// --------------------------------------------------------
+class LightmapUVs
+{
+public:
+	// The smallest a mesh's part of a lightmap is expected to be
+	static const unsigned int ReferenceResolution = 32;
+	static const unsigned int PaddingTexels = 2;
+
+	static void Generate(const std::vector<DirectX::XMFLOAT3>& positions, const std::vector<unsigned int>& indices, std::vector<DirectX::XMFLOAT2>& lightmapUVs);
+};
@@ -14,5 +14,7 @@ struct Light
 	float Intensity;				// All lights need an intensity 
 	DirectX::XMFLOAT3 Color;		// All lights need a color 
 	float SpotFalloff;				// Spot lights need a value to define their cone size 
-	DirectX::XMFLOAT3 Padding;		// Purposefully padding to hit the 16-byte boundary 
+	int ShadowView;					// Filled in by the renderer: the first of the light's shadow views
+	int ShadowViewCount;			// and how many there are, 0 if it isn't shadowed
+	int Baked;						// Lit by the lightmap instead on lightmapped surfaces
 };
\ No newline at end of file
@@ -1,13 +1,20 @@
 #include "Material.h"
+#include "RenderStats.h"
+#include "StateCache.h"
+#include <algorithm>
 
 using namespace DirectX;
 
+unsigned int Material::nextID = 0;
+
 Material::Material(DirectX::XMFLOAT4 p_color, float p_roughness, std::shared_ptr<SimpleVertexShader> p_vs, std::shared_ptr<SimplePixelShader> p_ps)
 {
 	color = p_color;
 	roughness = p_roughness;
 	vs = p_vs;
 	ps = p_ps;
+	id = nextID++;
+	bindingTableValid = false;
 }
 
 Material::~Material()
@@ -42,25 +49,118 @@ void Material::SetColor(DirectX::XMFLOAT4 newColor)
 void Material::SetVertexShader(std::shared_ptr<SimpleVertexShader> newVS)
 {
 	vs = newVS;
+	InvalidateBindingTable();
 }
 
 void Material::SetPixelShader(std::shared_ptr<SimplePixelShader> newPS)
 {
 	ps = newPS;
+	InvalidateBindingTable();
 }
 
 void Material::AddTextureSRV(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
 {
 	textureSRVs.insert({ name, srv });
+	InvalidateBindingTable();
 }
 
 void Material::AddSampler(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler)
 {
 	samplers.insert({ name, sampler });
+	InvalidateBindingTable();
+}
+
+bool Material::HasTextureSRV(std::string name)
+{
+	return textureSRVs.find(name) != textureSRVs.end();
 }
 
 void Material::PrepareMaterial()
 {
-	for (auto& t : textureSRVs) { ps->SetShaderResourceView(t.first.c_str(), t.second); }
-	for (auto& s : samplers) { ps->SetSamplerState(s.first.c_str(), s.second); }
+	PrepareMaterial(ps.get());
+}
+
+// --------------------------------------------------------
+// Binds the material for a variant of its pixel shader,
+// compiled from the same source.  Variants share its
+// registers, so the same binding table works for them.
+// --------------------------------------------------------
+void Material::PrepareMaterial(SimplePixelShader* variant)
+{
+	// Material values only need uploading when a different material is bound
+	variant->SetFloat4("colorTint", color);
+	variant->SetFloat("roughness", roughness);
+	variant->CopyBufferData("PerMaterial");
+
+	if (!bindingTableValid)
+		BuildBindingTable();
+
+	// Usually one run each, since material textures sit in consecutive registers
+	for (auto& run : srvRuns)
+		StateCache::GetInstance().SetShaderResources(ShaderStagePS, run.startSlot, (UINT)run.objects.size(), run.objects.data());
+	for (auto& run : samplerRuns)
+		StateCache::GetInstance().SetSamplers(ShaderStagePS, run.startSlot, (UINT)run.objects.size(), run.objects.data());
+
+	RenderStats::GetInstance().GetCurrentFrame().materialChanges++;
+}
+
+// --------------------------------------------------------
+// Forces the binding table to be rebuilt the next time
+// this material is bound, such as after its pixel shader
+// has been reloaded
+// --------------------------------------------------------
+void Material::InvalidateBindingTable()
+{
+	bindingTableValid = false;
+}
+
+// --------------------------------------------------------
+// Groups a list of (slot, object) pairs into runs of
+// consecutive slots
+// --------------------------------------------------------
+template <typename T>
+static void BuildRuns(std::vector<std::pair<UINT, T*>>& slots, std::vector<BindingRun<T>>& runs)
+{
+	std::sort(slots.begin(), slots.end(),
+		[](const std::pair<UINT, T*>& a, const std::pair<UINT, T*>& b) { return a.first < b.first; });
+
+	runs.clear();
+	for (auto& s : slots)
+	{
+		if (runs.empty() || runs.back().startSlot + runs.back().objects.size() != s.first)
+			runs.push_back({ s.first, {} });
+
+		runs.back().objects.push_back(s.second);
+	}
+}
+
+// --------------------------------------------------------
+// Looks up the pixel shader slot of every texture and
+// sampler once, so binding can skip the name lookups.
+// Names the shader doesn't use are left out.
+// --------------------------------------------------------
+void Material::BuildBindingTable()
+{
+	std::vector<std::pair<UINT, ID3D11ShaderResourceView*>> srvSlots;
+	for (auto& t : textureSRVs)
+	{
+		const SimpleSRV* info = ps->GetShaderResourceViewInfo(t.first);
+		if (info) srvSlots.push_back({ info->BindIndex, t.second.Get() });
+	}
+
+	std::vector<std::pair<UINT, ID3D11SamplerState*>> samplerSlots;
+	for (auto& s : samplers)
+	{
+		const SimpleSampler* info = ps->GetSamplerInfo(s.first);
+		if (info) samplerSlots.push_back({ info->BindIndex, s.second.Get() });
+	}
+
+	BuildRuns(srvSlots, srvRuns);
+	BuildRuns(samplerSlots, samplerRuns);
+	bindingTableValid = true;
+}
+
+unsigned int Material::GetID()
+{
+	return id;
 }
@@ -3,8 +3,20 @@
 #include <DirectXMath.h>
 #include <memory>			// Used for smart pointers
 #include <unordered_map>
+#include <vector>
 #include "SimpleShader.h"
 
+// --------------------------------------------------------
+// A run of consecutive pixel shader slots and the objects
+// bound to them, set with a single call
+// --------------------------------------------------------
+template <typename T>
+struct BindingRun
+{
+	UINT startSlot;
+	std::vector<T*> objects;
+};
+
 class Material
 {
 public:
@@ -19,16 +31,29 @@ public:
 	void SetPixelShader(std::shared_ptr<SimplePixelShader> newPS);
 	void AddTextureSRV(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
 	void AddSampler(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler);
+	bool HasTextureSRV(std::string name);
 	void PrepareMaterial();
+	void PrepareMaterial(SimplePixelShader* variant);
+	void InvalidateBindingTable();
+	unsigned int GetID();
 
 private:
 	DirectX::XMFLOAT4 color;					// Color tint
 	float roughness;							// Roughness that determines specularity
 	std::shared_ptr<SimpleVertexShader> vs;		// Shared pointer for Vertex Shader
 	std::shared_ptr<SimplePixelShader> ps;		// Shared pointer for Pixel Shader
+	unsigned int id;							// Unique per material, used for sorting draws
+	static unsigned int nextID;
 
 	// Hash Maps for SRVs and sampler states
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> textureSRVs;
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11SamplerState>> samplers;
+
+	// The maps above resolved to pixel shader slots, so binding doesn't
+	// need any lookups.  Rebuilt on the next bind after a change.
+	void BuildBindingTable();
+	bool bindingTableValid;
+	std::vector<BindingRun<ID3D11ShaderResourceView>> srvRuns;
+	std::vector<BindingRun<ID3D11SamplerState>> samplerRuns;
 };
 
@@ -1,12 +1,17 @@
 #include "Mesh.h"
+#include "StateCache.h"
+#include "LightmapUVs.h"
 #include <fstream>
 #include <vector>
 #include <DirectXMath.h>
 
 using namespace DirectX;
 
+unsigned int Mesh::nextID = 0;
+
 Mesh::Mesh(Vertex* vertices, int numVertices, unsigned int* indices, int p_numIndices, Microsoft::WRL::ComPtr<ID3D11Device> devicePtr, Microsoft::WRL::ComPtr<ID3D11DeviceContext> p_contextPtr)
 {
+	id = nextID++;
 	CalculateTangents(vertices, numVertices, indices, p_numIndices);
 	CreateBufferHelper(vertices, numVertices, indices, p_numIndices, devicePtr, p_contextPtr);
 }
@@ -15,6 +20,7 @@ Mesh::Mesh(const char* objFile, Microsoft::WRL::ComPtr<ID3D11Device> devicePtr,
 {
 	// Initializing numIndices variable
 	numIndices = 0;
+	id = nextID++;
 
 	// Author: Chris Cascioli
 	// Purpose: Basic .OBJ 3D model loading, supporting positions, uvs and normals
@@ -247,6 +253,24 @@ void Mesh::CreateBufferHelper(Vertex* vertices, int numVertices, unsigned int* i
 	numIndices = p_numIndices;
 	contextPtr = p_contextPtr;
 
+	// Bounds are kept on the CPU for culling
+	DirectX::BoundingBox::CreateFromPoints(localBox, numVertices, &vertices[0].Position, sizeof(Vertex));
+	DirectX::BoundingSphere::CreateFromPoints(localSphere, numVertices, &vertices[0].Position, sizeof(Vertex));
+
+	positions.resize(numVertices);
+	normals.resize(numVertices);
+	for (int i = 0; i < numVertices; i++)
+	{
+		positions[i] = vertices[i].Position;
+		normals[i] = vertices[i].Normal;
+	}
+	this->indices.assign(indices, indices + p_numIndices);
+
+	// Every mesh gets lightmap uvs, whether or not it's ever lightmapped
+	LightmapUVs::Generate(positions, this->indices, lightmapUVs);
+	for (int i = 0; i < numVertices; i++)
+		vertices[i].LightmapUV = lightmapUVs[i];
+
 	// Create the VERTEX BUFFER description -----------------------------------
 	// - The description is created on the stack because we only need
 	//    it to create the buffer.  The description is then useless.
@@ -304,6 +328,41 @@ int Mesh::GetIndexCount()
 	return numIndices;
 }
 
+unsigned int Mesh::GetID()
+{
+	return id;
+}
+
+const DirectX::BoundingBox& Mesh::GetLocalBox()
+{
+	return localBox;
+}
+
+const DirectX::BoundingSphere& Mesh::GetLocalSphere()
+{
+	return localSphere;
+}
+
+const std::vector<DirectX::XMFLOAT3>& Mesh::GetPositions()
+{
+	return positions;
+}
+
+const std::vector<DirectX::XMFLOAT3>& Mesh::GetNormals()
+{
+	return normals;
+}
+
+const std::vector<DirectX::XMFLOAT2>& Mesh::GetLightmapUVs()
+{
+	return lightmapUVs;
+}
+
+const std::vector<unsigned int>& Mesh::GetIndices()
+{
+	return indices;
+}
+
 void Mesh::Draw()
 {
 	// Set buffers in the input assembler
@@ -314,8 +373,9 @@ void Mesh::Draw()
 	//    in a larger application/game
 	UINT stride = sizeof(Vertex);
 	UINT offset = 0;
-	contextPtr->IASetVertexBuffers(0, 1, vertexBuffer.GetAddressOf(), &stride, &offset);
-	contextPtr->IASetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+	StateCache::GetInstance().IASetVertexBuffers(0, 1, vertexBuffer.GetAddressOf(), &stride, &offset);
+	StateCache::GetInstance().IASetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+	RenderStats::GetInstance().GetCurrentFrame().meshChanges++;
 
 
 	// Finally do the actual drawing
@@ -327,6 +387,51 @@ void Mesh::Draw()
 		numIndices,     // The number of indices to use (we could draw a subset if we wanted)
 		0,     // Offset to the first index we want to use
 		0);    // Offset to add to each index when looking up vertices
+
+	FrameCounters& stats = RenderStats::GetInstance().GetCurrentFrame();
+	stats.drawCalls++;
+	stats.instancesDrawn++;
+}
+
+// --------------------------------------------------------
+// Sets this mesh's buffers, plus an instance buffer, in the
+// input assembler.  Call once before any DrawInstanced()
+// calls, which can then be repeated without rebinding.
+//
+// instanceBuffer - per-instance data, bound to slot 1
+// instanceStride - size of one instance's data
+// --------------------------------------------------------
+void Mesh::BindInstanced(ID3D11Buffer* instanceBuffer, UINT instanceStride)
+{
+	// Mesh data goes in slot 0 and instance data in slot 1, which
+	// matches the _PER_INSTANCE input layout made by SimpleShader
+	ID3D11Buffer* buffers[2] = { vertexBuffer.Get(), instanceBuffer };
+	UINT strides[2] = { sizeof(Vertex), instanceStride };
+	UINT offsets[2] = { 0, 0 };
+	StateCache::GetInstance().IASetVertexBuffers(0, 2, buffers, strides, offsets);
+	StateCache::GetInstance().IASetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+	RenderStats::GetInstance().GetCurrentFrame().meshChanges++;
+}
+
+// --------------------------------------------------------
+// Draws several copies of this mesh with one draw call,
+// using the buffers set by BindInstanced()
+//
+// instanceCount  - how many copies to draw
+// startInstance  - first element of the instance buffer to use
+// --------------------------------------------------------
+void Mesh::DrawInstanced(UINT instanceCount, UINT startInstance)
+{
+	contextPtr->DrawIndexedInstanced(
+		numIndices,		// Indices per instance
+		instanceCount,	// Number of instances
+		0,				// Offset to the first index
+		0,				// Offset to add to each index
+		startInstance);	// Offset to the first instance
+
+	FrameCounters& stats = RenderStats::GetInstance().GetCurrentFrame();
+	stats.drawCalls++;
+	stats.instancesDrawn += instanceCount;
 }
 
 // --------------------------------------------------------
@@ -2,7 +2,10 @@
 
 #include <d3d11.h>
 #include <wrl/client.h>
+#include <DirectXCollision.h>
+#include <vector>
 #include "Vertex.h"
+#include "RenderStats.h"
 
 class Mesh
 {
@@ -16,6 +19,20 @@ private:
 	// Holds the number of indices in the index buffer
 	int numIndices;
 
+	// Unique per mesh, used for sorting draws
+	unsigned int id;
+	static unsigned int nextID;
+
+	// Bounds of the vertices in local space, found at load
+	DirectX::BoundingBox localBox;
+	DirectX::BoundingSphere localSphere;
+
+	// Copies of the geometry kept on the CPU for occlusion culling and baking
+	std::vector<DirectX::XMFLOAT3> positions;
+	std::vector<DirectX::XMFLOAT3> normals;
+	std::vector<DirectX::XMFLOAT2> lightmapUVs;
+	std::vector<unsigned int> indices;
+
 public:
 	
 	Mesh(Vertex* vertices, int numVertices, unsigned int* indices, int numIndices, Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext);
@@ -25,7 +42,16 @@ public:
 	Microsoft::WRL::ComPtr<ID3D11Buffer> GetVertexBuffer();
 	Microsoft::WRL::ComPtr<ID3D11Buffer> GetIndexBuffer();
 	int GetIndexCount();
+	unsigned int GetID();
+	const DirectX::BoundingBox& GetLocalBox();
+	const DirectX::BoundingSphere& GetLocalSphere();
+	const std::vector<DirectX::XMFLOAT3>& GetPositions();
+	const std::vector<DirectX::XMFLOAT3>& GetNormals();
+	const std::vector<DirectX::XMFLOAT2>& GetLightmapUVs();
+	const std::vector<unsigned int>& GetIndices();
 	void Draw();
+	void BindInstanced(ID3D11Buffer* instanceBuffer, UINT instanceStride);
+	void DrawInstanced(UINT instanceCount, UINT startInstance);
 	void CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices);
 };
 
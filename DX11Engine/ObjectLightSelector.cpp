@@ -0,0 +1,109 @@
+#include "ObjectLightSelector.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+// Objects per ThreadPool job
+static const unsigned int ObjectsPerJob = 64;
+
+void ObjectLightSelector::Select(const std::vector<Light>& lights, const std::vector<BoundingBox>& boxes, std::vector<ObjectLightList>& lists)
+{
+	lists.resize(boxes.size());
+
+	ConeCuller::PackBoxes(boxes, boxLanes);
+	spotHits.resize(std::min(lights.size(), (size_t)NoLight));
+	ThreadPool::GetInstance().ParallelFor((unsigned int)spotHits.size(), [&](unsigned int i)
+	{
+		if (lights[i].Type == LIGHT_TYPE_SPOT)
+			ConeCuller::CullBoxes(ConeCuller::FromLight(lights[i]), boxLanes, (unsigned int)boxes.size(), spotHits[i]);
+		else
+			spotHits[i].clear();
+	});
+
+	unsigned int jobs = (unsigned int)((boxes.size() + ObjectsPerJob - 1) / ObjectsPerJob);
+	ThreadPool::GetInstance().ParallelFor(jobs, [&](unsigned int job)
+	{
+		size_t end = std::min(boxes.size(), (size_t)(job + 1) * ObjectsPerJob);
+		for (size_t i = (size_t)job * ObjectsPerJob; i < end; i++)
+			SelectOne(lights, boxes[i], i, lists[i]);
+	});
+}
+
+float ObjectLightSelector::Contribution(const Light& light, const BoundingBox& box)
+{
+	if (light.Type == LIGHT_TYPE_SPOT && !ConeCuller::IntersectsBox(ConeCuller::FromLight(light), box))
+		return 0.0f;
+
+	return RangeContribution(light, box);
+}
+
+// --------------------------------------------------------
+// The light's brightness, times the shader's attenuation
+// at the point of the box nearest the light
+// --------------------------------------------------------
+float ObjectLightSelector::RangeContribution(const Light& light, const BoundingBox& box)
+{
+	float brightness = light.Intensity * (0.2126f * light.Color.x + 0.7152f * light.Color.y + 0.0722f * light.Color.z);
+	if (light.Type == LIGHT_TYPE_DIRECTIONAL)
+		return brightness;
+
+	float dx = std::max(0.0f, fabsf(light.Position.x - box.Center.x) - box.Extents.x);
+	float dy = std::max(0.0f, fabsf(light.Position.y - box.Center.y) - box.Extents.y);
+	float dz = std::max(0.0f, fabsf(light.Position.z - box.Center.z) - box.Extents.z);
+	float distanceSq = dx * dx + dy * dy + dz * dz;
+	float rangeSq = light.Range * light.Range;
+	if (distanceSq >= rangeSq)
+		return 0.0f;
+
+	float attenuation = 1.0f - distanceSq / rangeSq;
+	return brightness * attenuation * attenuation;
+}
+
+unsigned int ObjectLightSelector::GetLight(const ObjectLightList& list, unsigned int slot)
+{
+	return (list.packed[slot / 2] >> (16 * (slot % 2))) & 0xFFFF;
+}
+
+// --------------------------------------------------------
+// Keeps the brightest lights in a short sorted array, so an
+// object with many lights in reach never sorts them all.
+// Equal lights keep their order in the light list.
+// --------------------------------------------------------
+void ObjectLightSelector::SelectOne(const std::vector<Light>& lights, const BoundingBox& box, size_t boxIndex, ObjectLightList& list)
+{
+	float bestContribution[MaxLights];
+	unsigned int bestLight[MaxLights];
+	unsigned int count = 0;
+
+	for (unsigned int i = 0; i < lights.size() && i < NoLight; i++)
+	{
+		if (lights[i].Type == LIGHT_TYPE_SPOT && !spotHits[i][boxIndex])
+			continue;
+
+		float contribution = RangeContribution(lights[i], box);
+		if (contribution <= 0.0f)
+			continue;
+		if (count == MaxLights && contribution <= bestContribution[MaxLights - 1])
+			continue;
+
+		unsigned int slot = count < MaxLights ? count++ : MaxLights - 1;
+		while (slot > 0 && bestContribution[slot - 1] < contribution)
+		{
+			bestContribution[slot] = bestContribution[slot - 1];
+			bestLight[slot] = bestLight[slot - 1];
+			slot--;
+		}
+		bestContribution[slot] = contribution;
+		bestLight[slot] = i;
+	}
+
+	for (unsigned int p = 0; p < MaxLights / 2; p++)
+	{
+		unsigned int first = 2 * p < count ? bestLight[2 * p] : NoLight;
+		unsigned int second = 2 * p + 1 < count ? bestLight[2 * p + 1] : NoLight;
+		list.packed[p] = first | (second << 16);
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <vector>
+#include "Lights.h"
+#include "ConeCuller.h"
+
+// Up to ObjectLightSelector::MaxLights light indices, two 16 bit
+// indices to a uint, brightest first and ended by NoLight
+struct ObjectLightList
+{
+	unsigned int packed[4];
+};
+
+// --------------------------------------------------------
+// Picks the lights that shade each object - an alternative
+// to the light clusters that only needs a short index list
+// per object.  Directional lights always reach an object,
+// point lights only when their range reaches its world box,
+// and spot lights only when their cone does too.  An object
+// keeps its MaxLights brightest lights by an estimate of
+// how much each adds at its box.
+//
+// Every object is done in one call, spread across the
+// ThreadPool, with each spot light's cone tested against
+// every box first, four at a time.  Takes the lights and
+// boxes as plain data, so it runs before the frame's draws.
+// --------------------------------------------------------
+class ObjectLightSelector
+{
+public:
+	static const unsigned int MaxLights = 8;
+	static const unsigned int NoLight = 0xFFFF;
+
+	// lists ends up the same size as boxes
+	void Select(const std::vector<Light>& lights, const std::vector<DirectX::BoundingBox>& boxes, std::vector<ObjectLightList>& lists);
+
+	// Roughly how much of a light reaches a box, 0 if none of it does
+	static float Contribution(const Light& light, const DirectX::BoundingBox& box);
+
+	static unsigned int GetLight(const ObjectLightList& list, unsigned int slot);
+
+private:
+	static float RangeContribution(const Light& light, const DirectX::BoundingBox& box);
+	void SelectOne(const std::vector<Light>& lights, const DirectX::BoundingBox& box, size_t boxIndex, ObjectLightList& list);
+
+	// Per light, which boxes its cone touches - empty for all but spots
+	std::vector<BoxLanes> boxLanes;
+	std::vector<std::vector<unsigned char>> spotHits;
+};
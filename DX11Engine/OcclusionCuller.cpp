@@ -0,0 +1,323 @@
+#include "OcclusionCuller.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+using namespace DirectX;
+
+OcclusionCuller::OcclusionCuller(unsigned int p_width, unsigned int p_height)
+{
+	binsX = (p_width + BinWidth - 1) / BinWidth;
+	binsY = (p_height + BinHeight - 1) / BinHeight;
+	width = binsX * BinWidth;
+	height = binsY * BinHeight;
+	tilesX = width / TileSize;
+
+	binTriangles.resize(binsX * binsY);
+	depth.resize(width * height, 1.0f);
+	hiZ.resize(tilesX * (height / TileSize), 1.0f);
+	XMStoreFloat4x4(&viewProjection, XMMatrixIdentity());
+}
+
+// --------------------------------------------------------
+// Starts a new frame of occluders seen through the given
+// view-projection matrix
+// --------------------------------------------------------
+void OcclusionCuller::Begin(FXMMATRIX p_viewProjection)
+{
+	XMStoreFloat4x4(&viewProjection, p_viewProjection);
+	triangles.clear();
+	for (std::vector<unsigned int>& bin : binTriangles)
+		bin.clear();
+}
+
+// --------------------------------------------------------
+// Projects an occluder's triangles and sorts them into the
+// screen bins they overlap.  Nothing is drawn until
+// Rasterize().
+//
+// positions - the mesh's local space vertex positions
+// world     - the occluder's world matrix
+// --------------------------------------------------------
+void OcclusionCuller::AddOccluder(const XMFLOAT3* positions, const unsigned int* indices, unsigned int indexCount, FXMMATRIX world)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Every vertex is projected once, however many triangles share it
+	unsigned int vertexCount = 0;
+	for (unsigned int i = 0; i < indexCount; i++)
+		vertexCount = std::max(vertexCount, indices[i] + 1);
+
+	XMMATRIX worldViewProjection = world * XMLoadFloat4x4(&viewProjection);
+	clipPositions.resize(vertexCount);
+	XMVector3TransformStream(clipPositions.data(), sizeof(XMFLOAT4), positions, sizeof(XMFLOAT3), vertexCount, worldViewProjection);
+
+	for (unsigned int i = 0; i + 2 < indexCount; i += 3)
+	{
+		const XMFLOAT4* clip[3] = { &clipPositions[indices[i]], &clipPositions[indices[i + 1]], &clipPositions[indices[i + 2]] };
+
+		// Skip anything crossing the near plane
+		if (clip[0]->z < 0.0f || clip[1]->z < 0.0f || clip[2]->z < 0.0f)
+			continue;
+
+		float x[3], y[3], z[3];
+		for (int v = 0; v < 3; v++)
+		{
+			float invW = 1.0f / clip[v]->w;
+			x[v] = (clip[v]->x * invW * 0.5f + 0.5f) * width;
+			y[v] = (0.5f - clip[v]->y * invW * 0.5f) * height;
+			z[v] = clip[v]->z * invW;
+		}
+
+		Triangle t;
+		t.minX = std::max(0, (int)floorf(std::min(x[0], std::min(x[1], x[2]))));
+		t.minY = std::max(0, (int)floorf(std::min(y[0], std::min(y[1], y[2]))));
+		t.maxX = std::min((int)width - 1, (int)floorf(std::max(x[0], std::max(x[1], x[2]))));
+		t.maxY = std::min((int)height - 1, (int)floorf(std::max(y[0], std::max(y[1], y[2]))));
+		if (t.minX > t.maxX || t.minY > t.maxY)
+			continue;
+
+		// Edge e runs from vertex e to the next, and is zero along it
+		for (int e = 0; e < 3; e++)
+		{
+			int n = (e + 1) % 3;
+			t.edgeA[e] = y[e] - y[n];
+			t.edgeB[e] = x[n] - x[e];
+			t.edgeC[e] = x[e] * y[n] - y[e] * x[n];
+		}
+
+		// Twice the signed area, which is also each edge's value at the opposite vertex
+		float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+		if (area == 0.0f)
+			continue;
+
+		// Depth slopes are found from differences to the first vertex, since
+		// depths are all close to one and would lose precision otherwise
+		float invArea = 1.0f / area;
+		t.depthA = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) * invArea;
+		t.depthB = ((x[1] - x[0]) * (z[2] - z[0]) - (x[2] - x[0]) * (z[1] - z[0])) * invArea;
+		t.depthC = z[0] - t.depthA * x[0] - t.depthB * y[0];
+
+		// Either winding is drawn, so flip edges to be positive inside
+		if (area < 0.0f)
+		{
+			for (int e = 0; e < 3; e++)
+			{
+				t.edgeA[e] = -t.edgeA[e];
+				t.edgeB[e] = -t.edgeB[e];
+				t.edgeC[e] = -t.edgeC[e];
+			}
+		}
+
+		unsigned int index = (unsigned int)triangles.size();
+		triangles.push_back(t);
+
+		for (int by = t.minY / (int)BinHeight; by <= t.maxY / (int)BinHeight; by++)
+		{
+			for (int bx = t.minX / (int)BinWidth; bx <= t.maxX / (int)BinWidth; bx++)
+				binTriangles[by * binsX + bx].push_back(index);
+		}
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+	frameMilliseconds += std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+// --------------------------------------------------------
+// Draws all the occluders' triangles, one bin per job
+// --------------------------------------------------------
+void OcclusionCuller::Rasterize()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	ThreadPool::GetInstance().ParallelFor(binsX * binsY, [this](unsigned int bin) { RasterizeBin(bin); });
+
+	auto end = std::chrono::high_resolution_clock::now();
+	frameMilliseconds += std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+// --------------------------------------------------------
+// Clears a bin, draws its triangles four pixels at a time
+// keeping the nearest depth, then finds the farthest depth
+// in each of its tiles.  Bins don't share any pixels, so
+// they can be drawn on separate threads.
+// --------------------------------------------------------
+void OcclusionCuller::RasterizeBin(unsigned int bin)
+{
+	int binX = (int)(bin % binsX * BinWidth);
+	int binY = (int)(bin / binsX * BinHeight);
+
+	for (int y = binY; y < binY + (int)BinHeight; y++)
+		std::fill(&depth[y * width + binX], &depth[y * width + binX] + BinWidth, 1.0f);
+
+	const XMVECTOR pixelOffsets = XMVectorSet(0.5f, 1.5f, 2.5f, 3.5f);
+	const XMVECTOR zero = XMVectorZero();
+
+	for (unsigned int index : binTriangles[bin])
+	{
+		const Triangle& t = triangles[index];
+
+		// Columns start on a multiple of four - the extra pixels
+		// are outside the triangle so the edge tests reject them
+		int x0 = std::max(t.minX, binX) & ~3;
+		int x1 = std::min(t.maxX, binX + (int)BinWidth - 1);
+		int y0 = std::max(t.minY, binY);
+		int y1 = std::min(t.maxY, binY + (int)BinHeight - 1);
+
+		XMVECTOR a0 = XMVectorReplicate(t.edgeA[0]);
+		XMVECTOR a1 = XMVectorReplicate(t.edgeA[1]);
+		XMVECTOR a2 = XMVectorReplicate(t.edgeA[2]);
+		XMVECTOR aZ = XMVectorReplicate(t.depthA);
+
+		for (int y = y0; y <= y1; y++)
+		{
+			// The y terms are the same along the row
+			float py = (float)y + 0.5f;
+			XMVECTOR c0 = XMVectorReplicate(t.edgeB[0] * py + t.edgeC[0]);
+			XMVECTOR c1 = XMVectorReplicate(t.edgeB[1] * py + t.edgeC[1]);
+			XMVECTOR c2 = XMVectorReplicate(t.edgeB[2] * py + t.edgeC[2]);
+			XMVECTOR cZ = XMVectorReplicate(t.depthB * py + t.depthC);
+
+			float* row = &depth[y * width];
+			for (int x = x0; x <= x1; x += 4)
+			{
+				XMVECTOR px = XMVectorAdd(XMVectorReplicate((float)x), pixelOffsets);
+
+				XMVECTOR inside = XMVectorGreaterOrEqual(XMVectorAdd(XMVectorMultiply(a0, px), c0), zero);
+				inside = XMVectorAndInt(inside, XMVectorGreaterOrEqual(XMVectorAdd(XMVectorMultiply(a1, px), c1), zero));
+				inside = XMVectorAndInt(inside, XMVectorGreaterOrEqual(XMVectorAdd(XMVectorMultiply(a2, px), c2), zero));
+
+				XMVECTOR z = XMVectorAdd(XMVectorMultiply(aZ, px), cZ);
+				XMVECTOR old = XMLoadFloat4((const XMFLOAT4*)&row[x]);
+				XMStoreFloat4((XMFLOAT4*)&row[x], XMVectorSelect(old, XMVectorMin(old, z), inside));
+			}
+		}
+	}
+
+	// Farthest depth in each tile
+	for (int ty = binY; ty < binY + (int)BinHeight; ty += TileSize)
+	{
+		for (int tx = binX; tx < binX + (int)BinWidth; tx += TileSize)
+		{
+			XMVECTOR farthest = XMVectorZero();
+			for (int y = ty; y < ty + (int)TileSize; y++)
+			{
+				const float* row = &depth[y * width + tx];
+				farthest = XMVectorMax(farthest, XMLoadFloat4((const XMFLOAT4*)row));
+				farthest = XMVectorMax(farthest, XMLoadFloat4((const XMFLOAT4*)(row + 4)));
+			}
+
+			XMFLOAT4 f;
+			XMStoreFloat4(&f, farthest);
+			hiZ[(ty / TileSize) * tilesX + tx / TileSize] = std::max(std::max(f.x, f.y), std::max(f.z, f.w));
+		}
+	}
+}
+
+// --------------------------------------------------------
+// A box is hidden if its nearest depth is behind the depth
+// of every pixel its screen rectangle covers.  Tiles whose
+// farthest depth is nearer than the box settle a whole 8x8
+// block at once; the rest are checked pixel by pixel.
+// --------------------------------------------------------
+bool OcclusionCuller::IsVisible(const BoundingBox& worldBox)
+{
+	XMMATRIX vp = XMLoadFloat4x4(&viewProjection);
+	XMFLOAT3 corners[BoundingBox::CORNER_COUNT];
+	worldBox.GetCorners(corners);
+
+	float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+	float nearest = FLT_MAX;
+	for (size_t i = 0; i < BoundingBox::CORNER_COUNT; i++)
+	{
+		XMFLOAT4 clip;
+		XMStoreFloat4(&clip, XMVector3Transform(XMLoadFloat3(&corners[i]), vp));
+
+		// Boxes reaching the near plane are too close to judge
+		if (clip.z < 0.0f)
+			return true;
+
+		float invW = 1.0f / clip.w;
+		float x = (clip.x * invW * 0.5f + 0.5f) * width;
+		float y = (0.5f - clip.y * invW * 0.5f) * height;
+		minX = std::min(minX, x); maxX = std::max(maxX, x);
+		minY = std::min(minY, y); maxY = std::max(maxY, y);
+		nearest = std::min(nearest, clip.z * invW);
+	}
+
+	int x0 = std::max(0, (int)floorf(minX));
+	int y0 = std::max(0, (int)floorf(minY));
+	int x1 = std::min((int)width - 1, (int)floorf(maxX));
+	int y1 = std::min((int)height - 1, (int)floorf(maxY));
+	if (x0 > x1 || y0 > y1)
+		return true;
+
+	for (int ty = y0 / (int)TileSize; ty <= y1 / (int)TileSize; ty++)
+	{
+		for (int tx = x0 / (int)TileSize; tx <= x1 / (int)TileSize; tx++)
+		{
+			if (hiZ[ty * tilesX + tx] < nearest)
+				continue;
+
+			int px0 = std::max(x0, tx * (int)TileSize);
+			int px1 = std::min(x1, tx * (int)TileSize + (int)TileSize - 1);
+			int py0 = std::max(y0, ty * (int)TileSize);
+			int py1 = std::min(y1, ty * (int)TileSize + (int)TileSize - 1);
+			for (int y = py0; y <= py1; y++)
+			{
+				for (int x = px0; x <= px1; x++)
+				{
+					if (depth[y * width + x] >= nearest)
+						return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+// --------------------------------------------------------
+// Tests boxes in parallel, in chunks
+// --------------------------------------------------------
+void OcclusionCuller::Cull(const std::vector<BoundingBox>& boxes, std::vector<unsigned int>& visible)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	const unsigned int chunkSize = 64;
+	unsigned int count = (unsigned int)boxes.size();
+	boxVisible.resize(count);
+
+	ThreadPool::GetInstance().ParallelFor((count + chunkSize - 1) / chunkSize, [&](unsigned int chunk)
+		{
+			unsigned int end = std::min(count, (chunk + 1) * chunkSize);
+			for (unsigned int i = chunk * chunkSize; i < end; i++)
+				boxVisible[i] = IsVisible(boxes[i]);
+		});
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (boxVisible[i])
+			visible.push_back(i);
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+	frameMilliseconds += std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+// --------------------------------------------------------
+// Records the frame's time and adjusts the occluder limit
+// --------------------------------------------------------
+void OcclusionCuller::EndFrame()
+{
+	lastFrameMilliseconds = frameMilliseconds;
+	frameMilliseconds = 0.0f;
+
+	if (lastFrameMilliseconds > budgetMilliseconds)
+		occluderLimit = std::max(1u, occluderLimit * 3 / 4);
+	else if (lastFrameMilliseconds < budgetMilliseconds * 0.5f && occluderLimit < MaxOccluders)
+		occluderLimit++;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <vector>
+
+// --------------------------------------------------------
+// Software occlusion culling.  A few large occluders are
+// rasterized on the CPU into a small depth buffer, then
+// candidates' world boxes are tested against it, and any
+// box whose nearest point is behind everything already
+// drawn over its screen area is culled.
+//
+// The screen is split into bins which are rasterized in
+// parallel, four pixels at a time.  Each bin also records
+// the farthest depth of every 8x8 tile (a one level Hi-Z)
+// so most boxes are decided without reading single pixels.
+//
+// Triangles crossing the near plane are skipped rather than
+// clipped, which can only hide less, never too much.
+// --------------------------------------------------------
+class OcclusionCuller
+{
+public:
+	static const unsigned int TileSize = 8;		// Pixels per side of a Hi-Z tile
+	static const unsigned int BinWidth = 64;	// Pixels per rasterizer job
+	static const unsigned int BinHeight = 16;
+	static const unsigned int MaxOccluders = 256;
+
+	// Sizes are rounded up to whole bins
+	OcclusionCuller(unsigned int width = 320, unsigned int height = 192);
+
+	// Each frame: Begin(), AddOccluder() for the largest few
+	// objects, Rasterize(), then test boxes and EndFrame()
+	void Begin(DirectX::FXMMATRIX viewProjection);
+	void AddOccluder(const DirectX::XMFLOAT3* positions, const unsigned int* indices, unsigned int indexCount, DirectX::FXMMATRIX world);
+	void Rasterize();
+
+	bool IsVisible(const DirectX::BoundingBox& worldBox);
+
+	// Appends the index of every box that isn't hidden
+	void Cull(const std::vector<DirectX::BoundingBox>& boxes, std::vector<unsigned int>& visible);
+
+	// Time budget - the occluder limit shrinks while the
+	// work goes over budget and slowly grows back when under
+	void EndFrame();
+	void SetBudget(float milliseconds) { budgetMilliseconds = milliseconds; }
+	float GetBudget() { return budgetMilliseconds; }
+	float GetLastFrameMilliseconds() { return lastFrameMilliseconds; }
+	unsigned int GetOccluderLimit() { return occluderLimit; }
+
+	unsigned int GetWidth() { return width; }
+	unsigned int GetHeight() { return height; }
+	unsigned int GetTriangleCount() { return (unsigned int)triangles.size(); }
+	const float* GetDepth() { return depth.data(); }
+
+private:
+	// Edge functions and the depth plane, all in the form
+	// a * x + b * y + c over pixel positions
+	struct Triangle
+	{
+		float edgeA[3];
+		float edgeB[3];
+		float edgeC[3];
+		float depthA;
+		float depthB;
+		float depthC;
+		int minX, minY, maxX, maxY;		// Pixel bounds, clamped to the screen
+	};
+
+	void RasterizeBin(unsigned int bin);
+
+	unsigned int width;
+	unsigned int height;
+	unsigned int binsX;
+	unsigned int binsY;
+	unsigned int tilesX;
+
+	DirectX::XMFLOAT4X4 viewProjection;
+	std::vector<Triangle> triangles;
+	std::vector<std::vector<unsigned int>> binTriangles;
+	std::vector<DirectX::XMFLOAT4> clipPositions;	// Scratch for AddOccluder()
+	std::vector<float> depth;
+	std::vector<float> hiZ;
+	std::vector<unsigned char> boxVisible;			// Scratch for Cull()
+
+	float budgetMilliseconds = 0.5f;
+	float frameMilliseconds = 0.0f;
+	float lastFrameMilliseconds = 0.0f;
+	unsigned int occluderLimit = 32;
+};
@@ -1,27 +1,206 @@
 #include "ShaderInclude.hlsli"
 
+// Lighting variants define all four of DIRECTIONAL_LIGHTS, LOCAL_LIGHT_LIMIT,
+// SHADOWS and NORMAL_MAP (see ShaderPermutations.h).  Without them this is
+// the general shader, which shades any lights the clusters or object light
+// lists give it.
+#ifdef DIRECTIONAL_LIGHTS
+#define LIGHTING_VARIANT 1
+#else
+#define LIGHTING_VARIANT 0
+#define SHADOWS 1
+#define NORMAL_MAP 1
+#endif
+
 Texture2D Albedo			: register(t0);  // "t" registers for textures
 //Texture2D SpecularMap		: register(t1);
 Texture2D NormalMap			: register(t1);  
 Texture2D RoughnessMap		: register(t2);
 Texture2D MetalnessMap		: register(t3);
-Texture2D ShadowMap			: register(t4);
+Texture2D StaticShadowMap	: register(t4);  // Casters that don't move, rarely redrawn
+Texture2D DynamicShadowMap	: register(t5);  // Everything else
+Buffer<uint2> ClusterRanges		: register(t6);  // Each cluster's offset and count in ClusterLightIndices
+Buffer<uint> ClusterLightIndices	: register(t7);  // Directional lights first, then the clusters' lights
+StructuredBuffer<Light> Lights		: register(t8);  // Every light, only rewritten when one changes
+TextureCube SpecularIBL			: register(t9);  // The sky prefiltered for rising roughness down its mips
+Texture2D BRDFLookup			: register(t10); // Scale and bias to F0, by N dot V (u) and roughness (v)
+Texture2D Lightmap				: register(t11); // Baked diffuse light for lightmapped objects
+Texture2D ProbeSH				: register(t12); // Nine coefficients a row, a row per irradiance probe
 SamplerState BasicSampler	: register(s0); // "s" registers for samplers
 
 // Comparison sampler for shadow mapping
 SamplerComparisonState ShadowSampler	: register(s1);
+SamplerState ClampSampler				: register(s2);
+
+// Camera and light data, uploaded once per frame
+cbuffer PerFrame : register(b0)
+{
+	float3 cameraPosition;
+	int globalLightCount;			// Directional lights, at the front of ClusterLightIndices
+
+	// The sky's diffuse light as nine spherical harmonic coefficients (rgb)
+	float4 ambientSH[9];
+
+	// Tiles per pixel in xy, then the scale and bias from log view depth to slice
+	float4 clusterScale;
+
+	// Shade with each object's own light list instead of the clusters
+	int objectLightLists;
+	float specularIBLMips;
+
+	// The irradiance probe grid's first probe, spacing and size, used by
+	// objects without a lightmap if probesLoaded is set
+	float3 probeOrigin;
+	int probesLoaded;
+	float3 probeSpacing;
+	int3 probeCounts;
+
+	// Every shadowed light's views, found through the light's ShadowView.
+	// Each matrix goes from world space to the shadow atlas' texture
+	// coordinates, and each tile is the view's part of the atlas (min xy,
+	// max zw) less a texel all round, so filtering stays inside it.
+	matrix shadowMatrices[MAX_SHADOW_VIEWS];
+	float4 shadowTiles[MAX_SHADOW_VIEWS];
+}
 
-// Declaring constant buffer
-cbuffer ExternalData : register(b0)
+// Uploaded only when the bound material changes
+cbuffer PerMaterial : register(b1)
 {
 	float4 colorTint;
 	float roughness;
-	float3 cameraPosition;
-	float3 ambient;
-	float numLights;
+}
+
+// --------------------------------------------------------
+// Looks a position up in one shadow view's tile, returning
+// false if it's outside the tile.  The static and dynamic
+// layers share a layout, and a point is shadowed if either
+// layer shadows it.
+// --------------------------------------------------------
+bool SampleShadowView(int view, float3 worldPosition, out float shadow)
+{
+	shadow = 1.0f;
+
+	// Behind a perspective view
+	float4 shadowPos = mul(shadowMatrices[view], float4(worldPosition, 1.0f));
+	if (shadowPos.w <= 0.0f)
+		return false;
+
+	shadowPos.xyz /= shadowPos.w;
+	float4 tile = shadowTiles[view];
+	if (any(shadowPos.xy < tile.xy) || any(shadowPos.xy > tile.zw) || shadowPos.z > 1.0f)
+		return false;
 
-	// Instantiating array to some arbitrary large number, will only loop through 'numLights' amount of times
-	Light lightsArray[100];
+	shadow = min(
+		StaticShadowMap.SampleCmpLevelZero(ShadowSampler, shadowPos.xy, shadowPos.z),
+		DynamicShadowMap.SampleCmpLevelZero(ShadowSampler, shadowPos.xy, shadowPos.z));
+	return true;
+}
+
+// --------------------------------------------------------
+// How much of a light reaches a position, from 0 in full
+// shadow to 1.  Point lights use the cube face the position
+// is in, directional lights the nearest cascade covering it.
+// --------------------------------------------------------
+float SampleShadow(Light light, float3 worldPosition)
+{
+	float shadow = 1.0f;
+	if (light.ShadowViewCount == 0)
+		return shadow;
+
+	if (light.Type == LIGHT_TYPE_POINT)
+	{
+		// Faces are +X, -X, +Y, -Y, +Z, -Z
+		float3 toPosition = worldPosition - light.Position;
+		float3 size = abs(toPosition);
+		int face =
+			size.x >= size.y && size.x >= size.z ? (toPosition.x < 0.0f ? 1 : 0) :
+			size.y >= size.z ? (toPosition.y < 0.0f ? 3 : 2) :
+			(toPosition.z < 0.0f ? 5 : 4);
+		SampleShadowView(light.ShadowView + face, worldPosition, shadow);
+		return shadow;
+	}
+
+	// A spot light's only view, or cascades nearest first
+	for (int v = 0; v < light.ShadowViewCount; v++)
+	{
+		if (SampleShadowView(light.ShadowView + v, worldPosition, shadow))
+			return shadow;
+	}
+
+	// Past the last cascade
+	return 1.0f;
+}
+
+// Must match SphericalHarmonics::Basis()
+void SHBasis(float3 n, out float basis[9])
+{
+	basis[0] = 0.282095f;
+	basis[1] = 0.488603f * n.y;
+	basis[2] = 0.488603f * n.z;
+	basis[3] = 0.488603f * n.x;
+	basis[4] = 1.092548f * n.x * n.y;
+	basis[5] = 1.092548f * n.y * n.z;
+	basis[6] = 0.315392f * (3.0f * n.z * n.z - 1.0f);
+	basis[7] = 1.092548f * n.x * n.z;
+	basis[8] = 0.546274f * (n.x * n.x - n.y * n.y);
+}
+
+// --------------------------------------------------------
+// The sky's light reflected by a white diffuse surface
+// facing along the normal.  Must match
+// SphericalHarmonics::Evaluate().
+// --------------------------------------------------------
+float3 SkyAmbient(float3 n)
+{
+	float basis[9];
+	SHBasis(n, basis);
+
+	float3 result = 0.0f;
+	for (int c = 0; c < 9; c++)
+		result += ambientSH[c].rgb * basis[c];
+	return max(result, 0.0f);
+}
+
+// --------------------------------------------------------
+// The same for the baked light around a position, blended
+// from the eight irradiance probes around it.  Positions
+// outside the grid use the probes at its edge.
+// --------------------------------------------------------
+float3 ProbeAmbient(float3 worldPosition, float3 n)
+{
+	float basis[9];
+	SHBasis(n, basis);
+
+	float3 cell = clamp((worldPosition - probeOrigin) / probeSpacing, 0.0f, float3(probeCounts - 1));
+	int3 base = min((int3)cell, probeCounts - 2);
+	float3 t = cell - base;
+
+	float3 result = 0.0f;
+	for (int corner = 0; corner < 8; corner++)
+	{
+		int3 offset = int3(corner & 1, (corner >> 1) & 1, corner >> 2);
+		int3 probe = base + offset;
+		float3 weights = lerp(1.0f - t, t, (float3)offset);
+		float weight = weights.x * weights.y * weights.z;
+
+		int row = (probe.z * probeCounts.y + probe.y) * probeCounts.x + probe.x;
+		for (int c = 0; c < 9; c++)
+			result += ProbeSH.Load(int3(c, row, 0)).rgb * basis[c] * weight;
+	}
+	return max(result, 0.0f);
+}
+
+// --------------------------------------------------------
+// Finds the cluster a pixel is in from its screen position
+// and view depth (SV_POSITION's w), returning where its
+// lights are in ClusterLightIndices
+// --------------------------------------------------------
+uint2 FindClusterRange(float4 screenPosition)
+{
+	uint2 tile = min(uint2(screenPosition.xy * clusterScale.xy), uint2(CLUSTER_TILES_X - 1, CLUSTER_TILES_Y - 1));
+	uint slice = (uint)clamp(log(screenPosition.w) * clusterScale.z + clusterScale.w, 0.0f, CLUSTER_SLICES - 1.0f);
+	uint2 range = ClusterRanges[(slice * CLUSTER_TILES_Y + tile.y) * CLUSTER_TILES_X + tile.x];
+	return uint2(range.x + globalLightCount, range.y);
 }
 
 // --------------------------------------------------------
@@ -33,18 +212,8 @@ cbuffer ExternalData : register(b0)
 //    "put the output of this into the current render target"
 // - Named "main" because that's the default the shader compiler looks for
 // --------------------------------------------------------
-float4 main(VertexToPixelWithShadowPos input) : SV_TARGET
+float4 main(VertexToPixel input) : SV_TARGET
 {
-	// Shadow mapping
-	float2 shadowMapUV = input.shadowMapPos.xy / input.shadowMapPos.w * 0.5f + 0.5f;
-	shadowMapUV.y = 1.0f - shadowMapUV.y;
-
-	// Getting the distance from the light to this pixel
-	float depthFromLight = input.shadowMapPos.z / input.shadowMapPos.w;
-
-	// Use comparison sampler to determine whether pixel is in shadow and return an appropriate value
-	float shadowAmount = ShadowMap.SampleCmpLevelZero(ShadowSampler, shadowMapUV, depthFromLight);
-
 	// Sampling texture
 	float3 surfaceColor = pow(Albedo.Sample(BasicSampler, input.uv).rgb, 2.2f);
 	float3 tintedSurfaceColor = surfaceColor * colorTint;
@@ -52,8 +221,10 @@ float4 main(VertexToPixelWithShadowPos input) : SV_TARGET
 	// Sampling specular map
 	//float surfaceSpec = SpecularMap.Sample(BasicSampler, input.uv).r;
 
+#if NORMAL_MAP
 	// Sampling normal map
 	float3 unpackedNormal = NormalMap.Sample(BasicSampler, input.uv).rgb * 2 - 1;
+#endif
 	
 	// Sampling roughness map
 	float roughness = RoughnessMap.Sample(BasicSampler, input.uv).r;
@@ -67,6 +238,7 @@ float4 main(VertexToPixelWithShadowPos input) : SV_TARGET
 	// because of linear texture sampling, so lerp the specular color to match
 	float3 specularColor = lerp(F0_NON_METAL.rrr, surfaceColor.rgb, metalness);
 
+#if NORMAL_MAP
 	// Feel free to adjust/simplify this code to fit with your existing shader(s)
 	// Simplifications include not re-normalizing the same vector more than once!
 	float3 N = normalize(input.normal); // Must be normalized here or before
@@ -75,23 +247,99 @@ float4 main(VertexToPixelWithShadowPos input) : SV_TARGET
 	float3 B = cross(T, N);
 	float3x3 TBN = float3x3(T, B, N);
 	input.normal = mul(unpackedNormal, TBN);
+#else
+	input.normal = normalize(input.normal);
+#endif
 
 	// Calculating view vector
 	float3 V = normalize(cameraPosition - input.worldPosition);
 
-	float3 finalColor = ambient * surfaceColor.rgb;
+	// Diffuse ambient from the object's lightmap, which also holds the
+	// baked lights, or else the probes around it or the sky's spherical
+	// harmonics.  The split sum's prefiltered sky and BRDF lookup give
+	// specular ambient.
+	float3 ambientNormal = normalize(input.normal);
+	float3 diffuseAmbient =
+		input.lightmapped ? Lightmap.Sample(ClampSampler, input.lightmapUV).rgb :
+		probesLoaded ? ProbeAmbient(input.worldPosition, ambientNormal) :
+		SkyAmbient(ambientNormal);
+	float NdotV = saturate(dot(ambientNormal, V));
+	float3 prefiltered = SpecularIBL.SampleLevel(ClampSampler, reflect(-V, ambientNormal), roughness * (specularIBLMips - 1.0f)).rgb;
+	float2 brdf = BRDFLookup.SampleLevel(ClampSampler, float2(NdotV, roughness), 0).rg;
+	float3 finalColor =
+		diffuseAmbient * surfaceColor.rgb * (1.0f - metalness) +
+		prefiltered * (specularColor * brdf.x + brdf.y);
 
-	// Looping through all lights
-	for (int i = 0; i < numLights; i++)
+#if LIGHTING_VARIANT
+	// Exactly this variant's directional lights, unrolled with no need to
+	// check their type, then the cluster's lights up to the variant's limit
+	[unroll]
+	for (uint d = 0; d < DIRECTIONAL_LIGHTS; d++)
 	{
-		float3 result = HandleLightPBR(lightsArray[i], input.normal, V, roughness, metalness, specularColor, input.worldPosition, surfaceColor);
+		Light light = Lights[ClusterLightIndices[d]];
+		if (input.lightmapped && light.Baked)
+			continue;
+
+		float3 result = HandleDirectionalLightPBR(light, input.normal, V, roughness, metalness, specularColor, input.worldPosition, surfaceColor);
+#if SHADOWS
+		result *= SampleShadow(light, input.worldPosition);
+#endif
+		finalColor += result;
+	}
+
+#if LOCAL_LIGHT_LIMIT > 0
+	uint2 localRange = FindClusterRange(input.screenPosition);
+#if LOCAL_LIGHT_LIMIT <= 8
+	[unroll]
+#else
+	[loop]
+#endif
+	for (uint l = 0; l < LOCAL_LIGHT_LIMIT; l++)
+	{
+		if (l >= localRange.y)
+			break;
+
+		Light light = Lights[ClusterLightIndices[localRange.x + l]];
+		if (input.lightmapped && light.Baked)
+			continue;
+
+		float3 result = HandleLightPBR(light, input.normal, V, roughness, metalness, specularColor, input.worldPosition, surfaceColor);
+#if SHADOWS
+		result *= SampleShadow(light, input.worldPosition);
+#endif
+		finalColor += result;
+	}
+#endif
+#else
+	// Looping through the object's lights, or the directional lights then the lights reaching this pixel's cluster
+	uint2 range = FindClusterRange(input.screenPosition);
+	uint lightCount = objectLightLists ? MAX_OBJECT_LIGHTS : globalLightCount + range.y;
+	for (uint i = 0; i < lightCount; i++)
+	{
+		uint index;
+		if (objectLightLists)
+		{
+			index = (input.lights[i / 2] >> (16 * (i % 2))) & 0xFFFF;
+			if (index == NO_LIGHT)
+				break;
+		}
+		else
+		{
+			index = ClusterLightIndices[i < (uint)globalLightCount ? i : range.x + i - globalLightCount];
+		}
+
+		// Already in the lightmap
+		if (input.lightmapped && Lights[index].Baked)
+			continue;
+
+		float3 result = HandleLightPBR(Lights[index], input.normal, V, roughness, metalness, specularColor, input.worldPosition, surfaceColor);
 		
-		// Applying shadows for the first light
-		if (i == 0)
-			result *= shadowAmount;
+		// Applying each light's shadow, if it has one
+		result *= SampleShadow(Lights[index], input.worldPosition);
 		
 		finalColor += result;
 	}
+#endif
 
 	return float4(pow(finalColor, 1.0f / 2.2f), 1);
 }
\ No newline at end of file
@@ -0,0 +1,92 @@
+#include "RenderQueue.h"
+
+// --------------------------------------------------------
+// Packs the draw's state and depth into a sort key
+//
+// depth - 0 at the near plane to 1 at the far plane, clamped
+// --------------------------------------------------------
+unsigned long long RenderQueue::MakeKey(unsigned int pass, unsigned int shader, unsigned int material, unsigned int mesh, float depth)
+{
+	if (!(depth > 0.0f)) depth = 0.0f;	// Also catches NaN
+	if (depth > 1.0f) depth = 1.0f;
+	unsigned long long quantizedDepth = (unsigned long long)(depth * (float)((1u << DepthBits) - 1));
+
+	unsigned long long key = pass & ((1u << PassBits) - 1);
+	key = (key << ShaderBits) | (shader & ((1u << ShaderBits) - 1));
+	key = (key << MaterialBits) | (material & ((1u << MaterialBits) - 1));
+	key = (key << MeshBits) | (mesh & ((1u << MeshBits) - 1));
+	key = (key << DepthBits) | quantizedDepth;
+	return key;
+}
+
+// --------------------------------------------------------
+// Empties the queue, keeping its memory for the next frame
+// --------------------------------------------------------
+void RenderQueue::Clear()
+{
+	packets.clear();
+}
+
+// --------------------------------------------------------
+// Queues a draw
+// --------------------------------------------------------
+void RenderQueue::Add(unsigned long long key, unsigned int payload)
+{
+	packets.push_back({ key, payload });
+}
+
+// --------------------------------------------------------
+// Sorts the packets by key with an LSD radix sort, one byte
+// per pass.  Bytes that are the same in every key (common,
+// since most scenes use few passes and shaders) are skipped.
+// The sort is stable, so equal keys keep their queued order.
+// --------------------------------------------------------
+void RenderQueue::Sort()
+{
+	unsigned int count = (unsigned int)packets.size();
+	if (count < 2) return;
+	scratch.resize(count);
+
+	// Histogram every byte in a single read of the keys
+	unsigned int histograms[8][256] = {};
+	for (unsigned int i = 0; i < count; i++)
+	{
+		unsigned long long key = packets[i].key;
+		for (int b = 0; b < 8; b++)
+			histograms[b][(key >> (b * 8)) & 0xFF]++;
+	}
+
+	RenderPacket* src = packets.data();
+	RenderPacket* dst = scratch.data();
+	for (int b = 0; b < 8; b++)
+	{
+		unsigned int* histogram = histograms[b];
+
+		// Every key has the same value for this byte, so nothing would move
+		if (histogram[(src[0].key >> (b * 8)) & 0xFF] == count)
+			continue;
+
+		// Turn counts into starting offsets
+		unsigned int offset = 0;
+		for (int d = 0; d < 256; d++)
+		{
+			unsigned int c = histogram[d];
+			histogram[d] = offset;
+			offset += c;
+		}
+
+		for (unsigned int i = 0; i < count; i++)
+		{
+			unsigned int digit = (src[i].key >> (b * 8)) & 0xFF;
+			dst[histogram[digit]++] = src[i];
+		}
+
+		RenderPacket* temp = src;
+		src = dst;
+		dst = temp;
+	}
+
+	// An odd number of passes leaves the result in the scratch buffer
+	if (src != packets.data())
+		packets.swap(scratch);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+
+// Values for a sort key's pass field, in the order the passes are drawn
+enum RenderPass
+{
+	RenderPassShadow,
+	RenderPassOpaque
+};
+
+// --------------------------------------------------------
+// One queued draw: a sort key describing the state it needs,
+// plus an index the caller uses to find the actual object
+// --------------------------------------------------------
+struct RenderPacket
+{
+	unsigned long long key;
+	unsigned int payload;
+};
+
+// --------------------------------------------------------
+// A list of draws sorted by a 64-bit key, so draws needing
+// the same state end up next to each other.  Key layout,
+// from the most significant bit down:
+//
+//   pass     (4 bits)  - which render pass the draw belongs to
+//   shader   (10 bits) - shader ID
+//   material (14 bits) - material ID
+//   mesh     (12 bits) - mesh ID
+//   depth    (24 bits) - quantized 0-1 depth, nearest first
+//
+// IDs wider than their field are wrapped, which only costs
+// some sorting quality - callers still compare the objects
+// themselves before skipping a bind.
+// --------------------------------------------------------
+class RenderQueue
+{
+public:
+	static const unsigned int PassBits = 4;
+	static const unsigned int ShaderBits = 10;
+	static const unsigned int MaterialBits = 14;
+	static const unsigned int MeshBits = 12;
+	static const unsigned int DepthBits = 24;
+
+	static unsigned long long MakeKey(unsigned int pass, unsigned int shader, unsigned int material, unsigned int mesh, float depth);
+
+	// The key without its depth, which is the same for draws that share all state
+	static unsigned long long GetStateBits(unsigned long long key) { return key >> DepthBits; }
+
+	void Clear();
+	void Add(unsigned long long key, unsigned int payload);
+	void Sort();
+
+	const std::vector<RenderPacket>& GetPackets() { return packets; }
+	unsigned int GetCount() { return (unsigned int)packets.size(); }
+
+private:
+	std::vector<RenderPacket> packets;
+	std::vector<RenderPacket> scratch;
+};
@@ -0,0 +1,13 @@
+#include "RenderStats.h"
+
+// Singleton requirement
+RenderStats* RenderStats::instance;
+
+// --------------------------------------------------------
+// Keeps the finished frame's counters and starts a new frame
+// --------------------------------------------------------
+void RenderStats::EndOfFrame()
+{
+	lastFrame = currentFrame;
+	currentFrame = FrameCounters();
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+// --------------------------------------------------------
+// Counters for the work the renderer hands to the GPU.
+// Systems add to the current frame's counters as they go,
+// and EndOfFrame() keeps a copy of the finished frame so it
+// can be displayed (see DXCore::UpdateTitleBarStats)
+// --------------------------------------------------------
+struct FrameCounters
+{
+	unsigned int constantBufferUploads {0};		// UpdateSubresource calls on constant buffers
+	unsigned int constantBufferBytes {0};		// Bytes sent by those calls
+	unsigned int constantBufferSkips {0};		// Copies skipped because nothing changed
+	unsigned int constantBufferRingFallbacks {0};	// Copies that didn't fit in the upload ring
+	unsigned int drawCalls {0};					// Draw calls of any kind
+	unsigned int instancesDrawn {0};			// Objects drawn by those calls
+	unsigned int shaderChanges {0};				// SetShader() calls on any shader
+	unsigned int materialChanges {0};			// Material constants and textures rebound
+	unsigned int meshChanges {0};				// Vertex and index buffers rebound
+	unsigned int stateCallsIssued {0};			// Context state calls passed on by StateCache
+	unsigned int stateCallsFiltered {0};		// Context state calls dropped as redundant
+	unsigned int entitiesCulled {0};			// Entities outside the camera's view
+	unsigned int shadowCastersCulled {0};		// Entities outside a shadow view's volume, summed over views
+	unsigned int entitiesSkipped {0};			// Entities too small on screen or too far away
+	unsigned int shadowCastersSkipped {0};		// Entities too small in the shadow map or too far away
+	unsigned int shadowTilesRedrawn {0};		// Shadow map tiles drawn because something in them changed
+	unsigned int shadowTilesSkipped {0};		// Shadow map tiles kept from an earlier frame
+	unsigned int lightUploads {0};				// Light buffer range copies, only of lights that changed
+	unsigned int lightUploadBytes {0};			// Bytes sent by those copies
+	unsigned int lightUploadsSkipped {0};		// Frames the light buffer was already current
+	unsigned int lightsShaded {0};				// Lights the budget kept, fading ones included
+	unsigned int lightsCulled {0};				// Lights left out by the budget
+	unsigned int lightsRebinned {0};			// Lights binned into clusters again, all of them when the view moves
+	unsigned int entitiesOccluded {0};			// Entities hidden behind occluders
+	unsigned int occludersRasterized {0};		// Entities drawn into the occlusion depth buffer
+	unsigned int occlusionMicroseconds {0};		// CPU time spent on occlusion culling
+	unsigned int occlusionBudgetMicroseconds {0};	// Time it's allowed
+};
+
+class RenderStats
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static RenderStats& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new RenderStats();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	RenderStats(RenderStats const&) = delete;
+	void operator=(RenderStats const&) = delete;
+
+private:
+	static RenderStats* instance;
+	RenderStats() {};
+#pragma endregion
+
+public:
+	void EndOfFrame();
+
+	FrameCounters& GetCurrentFrame() { return currentFrame; }
+	const FrameCounters& GetLastFrame() { return lastFrame; }
+
+private:
+	FrameCounters currentFrame;
+	FrameCounters lastFrame;
+};
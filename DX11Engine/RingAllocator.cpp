@@ -0,0 +1,112 @@
+#include "RingAllocator.h"
+
+// --------------------------------------------------------
+// Creates an empty ring
+//
+// capacity - total size of the ring in bytes
+// alignment - every allocation starts on a multiple of this
+//             (must be a power of two)
+// --------------------------------------------------------
+RingAllocator::RingAllocator(unsigned int capacity, unsigned int alignment)
+	: capacity(capacity), alignment(alignment)
+{
+	Reset();
+}
+
+// --------------------------------------------------------
+// Reserves an aligned range of the ring
+//
+// size - bytes needed (rounded up to the alignment)
+// offset - receives the start of the range
+//
+// Returns false if the ring is full, in which case the
+// caller needs to wait for fences or use another buffer
+// --------------------------------------------------------
+bool RingAllocator::Allocate(unsigned int size, unsigned int& offset)
+{
+	unsigned int alignedSize = (size + alignment - 1) & ~(alignment - 1);
+	if (alignedSize == 0 || alignedSize > capacity || usedBytes == capacity)
+		return false;
+
+	// An empty ring can start over from the beginning
+	if (usedBytes == 0)
+		head = tail = 0;
+
+	unsigned int wasted = 0;
+	if (head >= tail)
+	{
+		// Free space is [head, capacity) followed by [0, tail)
+		if (capacity - head >= alignedSize)
+		{
+			offset = head;
+		}
+		else if (tail >= alignedSize)
+		{
+			// Skip the unused bit at the end and wrap around
+			wasted = capacity - head;
+			offset = 0;
+			wrapCount++;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	else
+	{
+		// Free space is [head, tail)
+		if (tail - head < alignedSize)
+			return false;
+
+		offset = head;
+	}
+
+	head = offset + alignedSize;
+	if (head == capacity)
+		head = 0;
+
+	usedBytes += wasted + alignedSize;
+	unfencedBytes += wasted + alignedSize;
+	return true;
+}
+
+// --------------------------------------------------------
+// Marks the end of everything allocated so far, usually
+// once per frame
+// --------------------------------------------------------
+void RingAllocator::Fence(unsigned long long fenceValue)
+{
+	if (unfencedBytes == 0)
+		return;
+
+	fences.push_back({ fenceValue, head, unfencedBytes });
+	unfencedBytes = 0;
+}
+
+// --------------------------------------------------------
+// Frees everything allocated before fences up to and
+// including the given value
+// --------------------------------------------------------
+void RingAllocator::Retire(unsigned long long completedFenceValue)
+{
+	while (!fences.empty() && fences.front().fenceValue <= completedFenceValue)
+	{
+		tail = fences.front().head;
+		usedBytes -= fences.front().bytes;
+		fences.pop_front();
+	}
+}
+
+// --------------------------------------------------------
+// Frees the entire ring, such as after the underlying
+// buffer has been discarded
+// --------------------------------------------------------
+void RingAllocator::Reset()
+{
+	head = 0;
+	tail = 0;
+	usedBytes = 0;
+	unfencedBytes = 0;
+	wrapCount = 0;
+	fences.clear();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <deque>
+
+// --------------------------------------------------------
+// Sub-allocates byte ranges from a fixed size ring, such as
+// a large upload buffer that is written once per draw.
+//
+// Ranges handed out during a frame stay reserved until that
+// frame's fence is retired (the GPU is done reading them).
+// This class only does the bookkeeping, so it has no
+// knowledge of Direct3D
+// --------------------------------------------------------
+class RingAllocator
+{
+public:
+	RingAllocator(unsigned int capacity, unsigned int alignment);
+
+	// Returns false if there isn't enough free space
+	bool Allocate(unsigned int size, unsigned int& offset);
+
+	// Fencing - everything allocated before a fence is freed
+	// once that fence has been retired
+	void Fence(unsigned long long fenceValue);
+	void Retire(unsigned long long completedFenceValue);
+	void Reset();
+
+	unsigned int GetCapacity() { return capacity; }
+	unsigned int GetUsedBytes() { return usedBytes; }
+	unsigned int GetWrapCount() { return wrapCount; }
+
+private:
+	// Where the ring's head was when a fence was placed, and
+	// how many bytes (including wasted tail space) it covers
+	struct FenceMarker
+	{
+		unsigned long long fenceValue;
+		unsigned int head;
+		unsigned int bytes;
+	};
+
+	unsigned int capacity;
+	unsigned int alignment;
+	unsigned int head;			// Next byte to hand out
+	unsigned int tail;			// Oldest byte still in use
+	unsigned int usedBytes;		// Bytes between tail and head
+	unsigned int unfencedBytes;	// Bytes allocated since the last fence
+	unsigned int wrapCount;
+	std::deque<FenceMarker> fences;
+};
@@ -0,0 +1,105 @@
+#include "ShaderBuffer.h"
+#include <cstring>
+
+ShaderBuffer::ShaderBuffer(Microsoft::WRL::ComPtr<ID3D11Device> p_device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> p_context, unsigned int p_stride, DXGI_FORMAT p_format, bool p_partialWrites)
+{
+	device = p_device;
+	context = p_context;
+	stride = p_stride;
+	format = p_format;
+	partialWrites = p_partialWrites;
+	capacity = 0;
+
+	// Always have a view to bind, even before the first write
+	Grow(1);
+}
+
+// --------------------------------------------------------
+// Copies the data to the GPU, discarding what was there
+//
+// data - array of count elements, each "stride" bytes
+// --------------------------------------------------------
+bool ShaderBuffer::Write(const void* data, unsigned int count)
+{
+	if (partialWrites) return WriteRange(data, 0, count);
+	if (count == 0) return true;
+	if (count > capacity && !Grow(count)) return false;
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return false;
+
+	memcpy(mapped.pData, data, (size_t)count * stride);
+	context->Unmap(buffer.Get(), 0);
+	return true;
+}
+
+// --------------------------------------------------------
+// Copies elements first to first + count - 1 to the GPU,
+// leaving the rest as they were
+// --------------------------------------------------------
+bool ShaderBuffer::WriteRange(const void* data, unsigned int first, unsigned int count)
+{
+	if (!partialWrites) return false;
+	if (count == 0) return true;
+	if (first + count > capacity && !Grow(first + count)) return false;
+
+	D3D11_BOX box = {};
+	box.left = first * stride;
+	box.right = (first + count) * stride;
+	box.bottom = 1;
+	box.back = 1;
+	context->UpdateSubresource(buffer.Get(), 0, &box, data, 0, 0);
+	return true;
+}
+
+// --------------------------------------------------------
+// Recreates the buffer and its view with room for at least
+// count elements, doubling like InstanceBuffer does.  With
+// partial writes the old contents are copied across.
+// --------------------------------------------------------
+bool ShaderBuffer::Grow(unsigned int count)
+{
+	unsigned int newCapacity = capacity > 0 ? capacity : 64;
+	while (newCapacity < count)
+		newCapacity *= 2;
+
+	D3D11_BUFFER_DESC desc = {};
+	desc.ByteWidth = newCapacity * stride;
+	desc.Usage = partialWrites ? D3D11_USAGE_DEFAULT : D3D11_USAGE_DYNAMIC;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.CPUAccessFlags = partialWrites ? 0 : D3D11_CPU_ACCESS_WRITE;
+	if (format == DXGI_FORMAT_UNKNOWN)
+	{
+		desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		desc.StructureByteStride = stride;
+	}
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer> newBuffer;
+	if (FAILED(device->CreateBuffer(&desc, 0, newBuffer.GetAddressOf())))
+		return false;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = format;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = newCapacity;
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> newSRV;
+	if (FAILED(device->CreateShaderResourceView(newBuffer.Get(), &srvDesc, newSRV.GetAddressOf())))
+		return false;
+
+	if (partialWrites && buffer)
+	{
+		D3D11_BOX box = {};
+		box.right = capacity * stride;
+		box.bottom = 1;
+		box.back = 1;
+		context->CopySubresourceRegion(newBuffer.Get(), 0, 0, 0, 0, buffer.Get(), 0, &box);
+	}
+
+	buffer = newBuffer;
+	srv = newSRV;
+	capacity = newCapacity;
+	return true;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+
+// --------------------------------------------------------
+// A dynamic buffer read by shaders through a shader resource
+// view, which is rewritten when its data changes and grows
+// as needed.  A format makes it a typed Buffer<>, while
+// DXGI_FORMAT_UNKNOWN makes it a StructuredBuffer<>.
+//
+// With partial writes the buffer lives in default usage
+// memory instead, so ranges of it can be updated while the
+// rest keeps what it held, including across growing.
+// --------------------------------------------------------
+class ShaderBuffer
+{
+public:
+	ShaderBuffer(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, unsigned int stride, DXGI_FORMAT format, bool partialWrites = false);
+
+	// Replaces the buffer's contents with count elements
+	bool Write(const void* data, unsigned int count);
+
+	// Replaces count elements starting at first, only with partial writes
+	bool WriteRange(const void* data, unsigned int first, unsigned int count);
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSRV() { return srv; }
+	unsigned int GetCapacity() { return capacity; }
+
+private:
+	bool Grow(unsigned int count);
+
+	unsigned int stride;
+	unsigned int capacity;
+	DXGI_FORMAT format;
+	bool partialWrites;
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+};
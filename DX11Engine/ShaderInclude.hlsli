@@ -7,6 +7,23 @@
 
 #define MAX_SPECULAR_EXPONENT		256.0f 
 
+// Must match ShadowViews::MaxViews
+#define MAX_SHADOW_VIEWS			32
+
+// Must match ClusterGrid's TilesX, TilesY and Slices
+#define CLUSTER_TILES_X				16
+#define CLUSTER_TILES_Y				9
+#define CLUSTER_SLICES				24
+
+// Must match ObjectLightSelector's MaxLights and NoLight
+#define MAX_OBJECT_LIGHTS			8
+#define NO_LIGHT					0xFFFF
+
+// Must match ShadowViews::SpotHalfAngle(): a spot's cone ends where
+// its falloff drops to the cutoff, or at 75 degrees (cos 75)
+#define SPOT_CUTOFF					0.01f
+#define SPOT_MAX_HALF_ANGLE_COS		0.258819f
+
 // The fresnel value for non-metals (dielectrics)
 // Page 9: "F0 of nonmetals is now a constant 0.04"
 // http://blog.selfshadow.com/publications/s2013-shading-course/karis/s2013_pbs_epic_notes_v2.pdf
@@ -28,7 +45,9 @@ struct Light
 	float Intensity;				// All lights need an intensity 
 	float3 Color;					// All lights need a color 
 	float SpotFalloff;				// Spot lights need a value to define their cone size 
-	float3 Padding;					// Purposefully padding to hit the 16-byte boundary 
+	int ShadowView;					// The first of the light's views in the shadow arrays
+	int ShadowViewCount;			// and how many there are, 0 if it isn't shadowed
+	int Baked;						// Lit by the lightmap instead on lightmapped surfaces
 };
 
 // Struct representing a single vertex worth of data
@@ -47,6 +66,7 @@ struct VertexShaderInput
 	float3 normal			: NORMAL;		// Normal vector
 	float3 tangent			: TANGENT;		// Tangent vector
 	float2 uv				: TEXCOORD;		// Texture coordinates
+	float2 lightmapUV		: TEXCOORD1;	// Charts packed into 0 to 1 (see LightmapUVs)
 };
 
 // Struct representing the data we're sending down the pipeline
@@ -66,17 +86,9 @@ struct VertexToPixel
 	float3 normal			: NORMAL;
 	float3 worldPosition	: POSITION;
 	float3 tangent			: TANGENT;
-};
-
-// Output struct that accomodates for shadow map information
-struct VertexToPixelWithShadowPos
-{
-	float4 screenPosition	: SV_POSITION;	// XYZW position (System Value Position)
-	float2 uv				: TEXCOORD;
-	float3 normal			: NORMAL;
-	float3 worldPosition	: POSITION;
-	float3 tangent			: TANGENT;
-	float4 shadowMapPos		: SHADOWPOS;
+	nointerpolation uint4 lights : LIGHTS;	// The object's light list, two 16 bit indices each
+	float2 lightmapUV		: LIGHTMAPUV;	// Already moved into the object's part of the lightmap
+	nointerpolation uint lightmapped : LIGHTMAPPED;
 };
 
 struct SkyVertexToPixel
@@ -216,6 +228,27 @@ float3 HandlePointLightPBR(Light light, float3 normal, float3 viewVector, float
 	return (balancedDiff * surfaceColor + spec) * Attenuate(light, pixelWorldPosition) * light.Intensity * light.Color;
 }
 
+// How much of a spot light reaches a pixel, eased to zero at the edge
+// of the cone the CPU culls it by.  A falloff of 0 has a hard edge.
+float SpotTerm(Light light, float3 toLight)
+{
+	float cosAngle = dot(-toLight, normalize(light.Direction));
+	float cosEdge = max(pow(SPOT_CUTOFF, 1.0f / light.SpotFalloff), SPOT_MAX_HALF_ANGLE_COS);
+	float edge = pow(cosEdge, light.SpotFalloff);
+	if (edge >= 1.0f)
+		return cosAngle >= cosEdge ? 1.0f : 0.0f;
+
+	float falloff = pow(saturate(cosAngle), light.SpotFalloff);
+	return saturate((falloff - edge) / (1.0f - edge));
+}
+
+// Handles PBR spot light
+float3 HandleSpotLightPBR(Light light, float3 normal, float3 viewVector, float roughness, float metalness, float3 specColor, float3 pixelWorldPosition, float3 surfaceColor)
+{
+	float3 toLight = normalize(light.Position - pixelWorldPosition);
+	return HandlePointLightPBR(light, normal, viewVector, roughness, metalness, specColor, pixelWorldPosition, surfaceColor) * SpotTerm(light, toLight);
+}
+
 // Handles PBR directional light
 float3 HandleDirectionalLightPBR(Light light, float3 normal, float3 viewVector, float roughness, float metalness, float3 specColor, float3 pixelWorldPosition, float3 surfaceColor)
 {
@@ -247,7 +280,7 @@ float3 HandleLightPBR(Light light, float3 normal, float3 viewVector, float rough
 		break;
 
 	case LIGHT_TYPE_SPOT:
-		return float3(0, 0, 0);
+		return HandleSpotLightPBR(light, normal, viewVector, roughness, metalness, specColor, pixelWorldPosition, surfaceColor);
 		break;
 
 	default:
@@ -0,0 +1,44 @@
+#include "ShaderPermutations.h"
+
+// Must match CompileShaderVariants.ps1
+const unsigned int ShaderPermutations::LocalLightBuckets[LocalLightBucketCount] = { 0, 8, 32 };
+
+unsigned int ShaderPermutations::MakeKey(const LightingPermutation& permutation)
+{
+	if (permutation.directionalLights > MaxDirectionalLights)
+		return NoVariant;
+
+	unsigned int bucket = 0;
+	while (bucket < LocalLightBucketCount && LocalLightBuckets[bucket] < permutation.localLights)
+		bucket++;
+	if (bucket == LocalLightBucketCount)
+		return NoVariant;
+
+	unsigned int key = permutation.directionalLights * LocalLightBucketCount + bucket;
+	key = key * 2 + (permutation.shadows ? 1 : 0);
+	return key * 2 + (permutation.normalMap ? 1 : 0);
+}
+
+LightingPermutation ShaderPermutations::GetPermutation(unsigned int key)
+{
+	LightingPermutation permutation = {};
+	if (key >= VariantCount)
+		return permutation;
+
+	permutation.normalMap = (key & 1) != 0;
+	permutation.shadows = (key & 2) != 0;
+	permutation.localLights = LocalLightBuckets[(key / 4) % LocalLightBucketCount];
+	permutation.directionalLights = key / 4 / LocalLightBucketCount;
+	return permutation;
+}
+
+std::wstring ShaderPermutations::GetFileName(const std::wstring& baseName, unsigned int key)
+{
+	LightingPermutation permutation = GetPermutation(key);
+	return baseName +
+		L"_d" + std::to_wstring(permutation.directionalLights) +
+		L"_l" + std::to_wstring(permutation.localLights) +
+		L"_s" + (permutation.shadows ? L"1" : L"0") +
+		L"_n" + (permutation.normalMap ? L"1" : L"0") +
+		L".cso";
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+
+// What a frame's lights and a material need from the pixel shader
+struct LightingPermutation
+{
+	unsigned int directionalLights;		// At the front of ClusterLightIndices
+	unsigned int localLights;			// Point and spot lights in the fullest cluster
+	bool shadows;						// Any shadow views this frame
+	bool normalMap;
+};
+
+// --------------------------------------------------------
+// Names the variants of PixelShader.hlsl compiled for
+// particular light setups, so the main pass can use one
+// with its loops unrolled and unused features compiled out
+// instead of the general shader.
+//
+// A variant shades exactly its number of directional
+// lights, then up to its bucket of local lights a cluster,
+// with or without shadows and a normal map.  Keys are dense
+// indices from 0 to VariantCount, so caches can be flat
+// arrays.  Setups with more lights than any variant covers
+// get NoVariant, meaning the general shader.
+//
+// The variants are compiled at build time by
+// CompileShaderVariants.ps1, which must enumerate the same
+// setups and file names, defining DIRECTIONAL_LIGHTS,
+// LOCAL_LIGHT_LIMIT, SHADOWS and NORMAL_MAP for each;
+// Tests/ShaderPermutationsTests reads the script to check.
+// --------------------------------------------------------
+class ShaderPermutations
+{
+public:
+	static const unsigned int MaxDirectionalLights = 2;
+	static const unsigned int LocalLightBucketCount = 3;
+	static const unsigned int LocalLightBuckets[LocalLightBucketCount];
+	static const unsigned int VariantCount = (MaxDirectionalLights + 1) * LocalLightBucketCount * 2 * 2;
+	static const unsigned int NoVariant = 0xFFFFFFFF;
+
+	// The smallest variant covering a setup
+	static unsigned int MakeKey(const LightingPermutation& permutation);
+
+	// The setup a variant was compiled for, with its local light bucket
+	static LightingPermutation GetPermutation(unsigned int key);
+
+	// Such as "PixelShader_d1_l8_s1_n1.cso" for the base name "PixelShader"
+	static std::wstring GetFileName(const std::wstring& baseName, unsigned int key);
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+// --------------------------------------------------------
+// The compiled variants of one shader, by key, each loaded
+// the first time it's asked for.  Keys are dense (see
+// ShaderPermutations), so the cache is a flat array.  A
+// variant that fails to load is remembered as missing and
+// never tried again, and callers fall back to the general
+// shader.
+//
+// Loading is left to the loader it's given, so the cache
+// itself knows nothing of the device or the shader type.
+// --------------------------------------------------------
+template <typename T>
+class ShaderVariantCache
+{
+public:
+	using Loader = std::function<std::shared_ptr<T>(unsigned int key)>;
+
+	ShaderVariantCache(unsigned int keyCount, Loader loader)
+		: entries(keyCount), loader(loader), loadedCount(0), missingCount(0)
+	{
+	}
+
+	// Null if the key is out of range or its variant couldn't be loaded
+	std::shared_ptr<T> Get(unsigned int key)
+	{
+		if (key >= entries.size())
+			return nullptr;
+
+		Entry& entry = entries[key];
+		if (!entry.tried)
+		{
+			entry.shader = loader(key);
+			entry.tried = true;
+			if (entry.shader)
+				loadedCount++;
+			else
+				missingCount++;
+		}
+		return entry.shader;
+	}
+
+	// Drops every variant, so each is loaded again when next asked for
+	void Clear()
+	{
+		for (Entry& entry : entries)
+			entry = Entry();
+		loadedCount = 0;
+		missingCount = 0;
+	}
+
+	unsigned int GetLoadedCount() const { return loadedCount; }
+	unsigned int GetMissingCount() const { return missingCount; }
+
+private:
+	struct Entry
+	{
+		std::shared_ptr<T> shader;
+		bool tried = false;
+	};
+
+	std::vector<Entry> entries;
+	Loader loader;
+	unsigned int loadedCount;
+	unsigned int missingCount;
+};
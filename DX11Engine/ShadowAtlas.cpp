@@ -0,0 +1,189 @@
+#include "ShadowAtlas.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+static bool IsPowerOfTwo(unsigned int value)
+{
+	return value != 0 && (value & (value - 1)) == 0;
+}
+
+void ShadowAtlas::Reset(unsigned int p_atlasSize, unsigned int p_minTileSize)
+{
+	atlasSize = p_atlasSize;
+	minTileSize = p_minTileSize;
+	Clear();
+}
+
+void ShadowAtlas::Clear()
+{
+	freeTiles.clear();
+	freeTiles.resize(LevelOf(minTileSize) + 1);
+	freeTiles[0].push_back({ 0, 0, atlasSize });
+}
+
+unsigned int ShadowAtlas::LevelOf(unsigned int size)
+{
+	unsigned int level = 0;
+	while ((atlasSize >> level) > size)
+		level++;
+	return level;
+}
+
+// --------------------------------------------------------
+// Takes a free tile of the right size if there is one,
+// otherwise splits the smallest larger tile down to size
+// --------------------------------------------------------
+bool ShadowAtlas::Allocate(unsigned int size, ShadowTile& tile)
+{
+	if (!IsPowerOfTwo(size) || size > atlasSize || size < minTileSize)
+		return false;
+
+	unsigned int level = LevelOf(size);
+	int source = (int)level;
+	while (source >= 0 && freeTiles[source].empty())
+		source--;
+	if (source < 0)
+		return false;
+
+	tile = freeTiles[source].back();
+	freeTiles[source].pop_back();
+
+	// Keep the top left quarter, the other three are free
+	for (unsigned int l = source; l < level; l++)
+	{
+		unsigned int half = tile.size / 2;
+		freeTiles[l + 1].push_back({ tile.x + half, tile.y + half, half });
+		freeTiles[l + 1].push_back({ tile.x, tile.y + half, half });
+		freeTiles[l + 1].push_back({ tile.x + half, tile.y, half });
+		tile.size = half;
+	}
+
+	return true;
+}
+
+void ShadowAtlas::Free(const ShadowTile& tile)
+{
+	unsigned int level = LevelOf(tile.size);
+	std::vector<ShadowTile>& list = freeTiles[level];
+	list.push_back(tile);
+	if (level == 0)
+		return;
+
+	// Merge with the three siblings if they're all free too
+	unsigned int parentSize = tile.size * 2;
+	unsigned int parentX = tile.x - tile.x % parentSize;
+	unsigned int parentY = tile.y - tile.y % parentSize;
+	size_t found[4];
+	unsigned int foundCount = 0;
+	for (size_t i = 0; i < list.size() && foundCount < 4; i++)
+	{
+		if (list[i].x - parentX < parentSize && list[i].y - parentY < parentSize)
+			found[foundCount++] = i;
+	}
+	if (foundCount < 4)
+		return;
+
+	// Erase from the back so the earlier indices stay valid
+	for (int i = 3; i >= 0; i--)
+	{
+		list[found[i]] = list.back();
+		list.pop_back();
+	}
+	Free({ parentX, parentY, parentSize });
+}
+
+unsigned long long ShadowAtlas::GetFreeArea()
+{
+	unsigned long long area = 0;
+	for (const std::vector<ShadowTile>& list : freeTiles)
+		for (const ShadowTile& tile : list)
+			area += (unsigned long long)tile.size * tile.size;
+	return area;
+}
+
+float ShadowAtlas::Importance(const Light& light, XMFLOAT3 eyePosition, float projectionScale, const XMFLOAT4 planes[6])
+{
+	if (light.Type == LIGHT_TYPE_DIRECTIONAL)
+		return 1.0f;
+
+	// Nothing in view is lit if the range is outside any plane
+	XMVECTOR center = XMLoadFloat3(&light.Position);
+	for (int p = 0; p < 6; p++)
+	{
+		float distance = XMVectorGetX(XMPlaneDotCoord(XMLoadFloat4(&planes[p]), center));
+		if (distance < -light.Range)
+			return 0.0f;
+	}
+
+	// The range's radius in half screen heights, as in ContributionCuller
+	float distanceSq = XMVectorGetX(XMVector3LengthSq(XMVectorSubtract(center, XMLoadFloat3(&eyePosition))));
+	float radiusSq = light.Range * light.Range;
+	if (distanceSq <= radiusSq)
+		return 1.0f;
+
+	return std::min(1.0f, light.Range * projectionScale / sqrtf(distanceSq - radiusSq));
+}
+
+void ShadowAtlas::ChooseSizes(
+	const std::vector<float>& importance,
+	const std::vector<unsigned int>& tileCounts,
+	unsigned int maxTileSize,
+	std::vector<unsigned int>& sizes)
+{
+	sizes.resize(importance.size(), 0);
+
+	unsigned long long totalArea = 0;
+	for (size_t i = 0; i < importance.size(); i++)
+	{
+		if (importance[i] <= 0.0f)
+		{
+			sizes[i] = 0;
+			continue;
+		}
+
+		// A size is chosen while the ideal is between it and double it
+		float ideal = importance[i] * maxTileSize;
+		unsigned int previous = sizes[i];
+		bool keep =
+			previous != 0 &&
+			(previous == minTileSize || ideal >= previous * (1.0f - hysteresis)) &&
+			(previous == maxTileSize || ideal < previous * 2.0f * (1.0f + hysteresis));
+
+		if (!keep)
+		{
+			sizes[i] = minTileSize;
+			while (sizes[i] * 2 <= maxTileSize && sizes[i] * 2 <= ideal)
+				sizes[i] *= 2;
+		}
+
+		totalArea += (unsigned long long)sizes[i] * sizes[i] * tileCounts[i];
+	}
+
+	// Shrink until it all fits, starting with the most generous tiles,
+	// and on a tie with the later light
+	unsigned long long atlasArea = (unsigned long long)atlasSize * atlasSize;
+	while (totalArea > atlasArea)
+	{
+		int shrink = -1;
+		float worst = 0.0f;
+		for (size_t i = 0; i < sizes.size(); i++)
+		{
+			if (sizes[i] == 0)
+				continue;
+
+			float generosity = sizes[i] / importance[i];
+			if (shrink < 0 || generosity >= worst)
+			{
+				shrink = (int)i;
+				worst = generosity;
+			}
+		}
+
+		unsigned long long before = (unsigned long long)sizes[shrink] * sizes[shrink] * tileCounts[shrink];
+		sizes[shrink] = sizes[shrink] > minTileSize ? sizes[shrink] / 2 : 0;
+		totalArea -= before - (unsigned long long)sizes[shrink] * sizes[shrink] * tileCounts[shrink];
+	}
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+#include "Lights.h"
+
+// A square region of the shadow atlas, in texels
+struct ShadowTile
+{
+	unsigned int x;
+	unsigned int y;
+	unsigned int size;
+};
+
+// --------------------------------------------------------
+// Hands out square, power of two tiles of one large shadow
+// map texture, and decides how big each light's tiles
+// should be.
+//
+// Tiles are packed as a quadtree: a free tile is split into
+// four to make smaller ones, and four free siblings are
+// merged back when the last is freed.  Allocating the
+// largest tiles first never fails while the total area
+// fits, so a full repack is always possible.
+//
+// Tiles are only coordinates; the caller owns the texture
+// and keeps the atlas and texture sizes in step.
+// --------------------------------------------------------
+class ShadowAtlas
+{
+public:
+	// Frees everything.  Both sizes must be powers of two.
+	void Reset(unsigned int atlasSize, unsigned int minTileSize);
+	void Clear();
+
+	// Returns false if no free space is left for the size
+	bool Allocate(unsigned int size, ShadowTile& tile);
+	void Free(const ShadowTile& tile);
+
+	unsigned int GetSize() { return atlasSize; }
+	unsigned int GetMinTileSize() { return minTileSize; }
+	unsigned long long GetFreeArea();
+
+	// How much a light's shadow matters on screen, 0 to 1.
+	// Directional lights are always 1, point and spot lights
+	// grow with the size of their range on screen and are 0
+	// when the range is outside the camera's planes.
+	// projectionScale - the camera projection matrix's y scale
+	static float Importance(const Light& light, DirectX::XMFLOAT3 eyePosition, float projectionScale, const DirectX::XMFLOAT4 planes[6]);
+
+	// Picks a tile size per light from its importance, then shrinks
+	// the tiles that are largest for their importance until every
+	// light's tiles (tileCounts of them) fit in the atlas.  Lights
+	// that still don't fit, or have no importance, get 0.
+	//
+	// sizes holds last frame's choices on the way in, and a light
+	// only changes size once its importance is past the new size's
+	// threshold by the hysteresis fraction, so tiles don't flip back
+	// and forth (and have to be redrawn) every frame.
+	void ChooseSizes(
+		const std::vector<float>& importance,
+		const std::vector<unsigned int>& tileCounts,
+		unsigned int maxTileSize,
+		std::vector<unsigned int>& sizes);
+
+	void SetHysteresis(float fraction) { hysteresis = fraction; }
+
+private:
+	unsigned int atlasSize = 0;
+	unsigned int minTileSize = 0;
+	float hysteresis = 0.1f;
+
+	// Free tiles for each level of the quadtree, level 0 being the whole atlas
+	std::vector<std::vector<ShadowTile>> freeTiles;
+
+	unsigned int LevelOf(unsigned int size);
+};
@@ -0,0 +1,46 @@
+#include "ShadowCache.h"
+
+#include <cstring>
+
+using namespace DirectX;
+
+void ShadowCache::Resize(unsigned int tileCount)
+{
+	tiles.clear();
+	tiles.resize(tileCount);
+}
+
+void ShadowCache::Invalidate(unsigned int tile)
+{
+	tiles[tile].valid = false;
+}
+
+void ShadowCache::InvalidateAll()
+{
+	for (Tile& tile : tiles)
+		tile.valid = false;
+}
+
+unsigned long long ShadowCache::CasterKey(unsigned int entity, unsigned int transformVersion)
+{
+	return ((unsigned long long)entity << 32) | transformVersion;
+}
+
+// --------------------------------------------------------
+// Matrices are compared exactly - cascades are snapped to
+// whole texels, so a still camera gives identical bits and
+// any real change is worth a redraw
+// --------------------------------------------------------
+bool ShadowCache::Update(unsigned int tile, const XMFLOAT4X4& viewProjection, const std::vector<unsigned long long>& casterKeys)
+{
+	Tile& t = tiles[tile];
+	if (t.valid &&
+		memcmp(&t.viewProjection, &viewProjection, sizeof(XMFLOAT4X4)) == 0 &&
+		t.casterKeys == casterKeys)
+		return false;
+
+	t.valid = true;
+	t.viewProjection = viewProjection;
+	t.casterKeys = casterKeys;
+	return true;
+}
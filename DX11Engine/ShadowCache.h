@@ -0,0 +1,56 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+
+// Shadow casters are drawn into one of two layers.  Static casters
+// are expected to stay put, so their layer is rarely redrawn, while
+// anything that moves goes in the dynamic layer.  Both are sampled
+// and combined when shading.
+enum ShadowLayer
+{
+	ShadowLayerStatic,
+	ShadowLayerDynamic,
+	ShadowLayerCount
+};
+
+// --------------------------------------------------------
+// Remembers what each shadow map tile was last drawn with,
+// so a tile is only redrawn when its contents would change.
+//
+// A tile's contents depend on the light's matrix and on the
+// casters drawn into it.  The caller describes the casters
+// with keys that change whenever one moves (see CasterKey),
+// and a tile is dirty when either differs from last time.
+// Anything else that affects the tiles, like recreating the
+// shadow map, should invalidate them.
+//
+// It only ever sees those matrices and keys, never the
+// shadow map, so drawing a dirty tile is up to the caller.
+// --------------------------------------------------------
+class ShadowCache
+{
+public:
+	void Resize(unsigned int tileCount);
+	void Invalidate(unsigned int tile);
+	void InvalidateAll();
+
+	// An entity index paired with its transform's version
+	static unsigned long long CasterKey(unsigned int entity, unsigned int transformVersion);
+
+	// Returns true if the tile has to be redrawn, and remembers the
+	// matrix and caster keys as what the tile now holds
+	bool Update(unsigned int tile, const DirectX::XMFLOAT4X4& viewProjection, const std::vector<unsigned long long>& casterKeys);
+
+	unsigned int GetTileCount() { return (unsigned int)tiles.size(); }
+
+private:
+	struct Tile
+	{
+		bool valid = false;
+		DirectX::XMFLOAT4X4 viewProjection;
+		std::vector<unsigned long long> casterKeys;
+	};
+
+	std::vector<Tile> tiles;
+};
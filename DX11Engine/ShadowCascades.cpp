@@ -0,0 +1,204 @@
+#include "ShadowCascades.h"
+
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// The "practical" split scheme: logarithmic splits match
+// how perspective shrinks things with distance, but leave
+// the first cascade tiny when the near clip is small, so
+// they're blended with even splits
+// --------------------------------------------------------
+void ShadowCascades::ComputeSplits(float nearClip, float farClip, unsigned int count, float lambda, float* splits)
+{
+	splits[0] = nearClip;
+	for (unsigned int i = 1; i < count; i++)
+	{
+		float fraction = (float)i / count;
+		float logSplit = nearClip * powf(farClip / nearClip, fraction);
+		float uniformSplit = nearClip + (farClip - nearClip) * fraction;
+		splits[i] = lambda * logSplit + (1.0f - lambda) * uniformSplit;
+	}
+	splits[count] = farClip;
+}
+
+void ShadowCascades::SliceCorners(FXMMATRIX cameraView, float xScale, float yScale, float nearDepth, float farDepth, XMFLOAT3 corners[8])
+{
+	XMVECTOR determinant;
+	XMMATRIX invView = XMMatrixInverse(&determinant, cameraView);
+
+	float depths[2] = { nearDepth, farDepth };
+	for (int d = 0; d < 2; d++)
+	{
+		// Half the view's width and height at this depth
+		float halfWidth = depths[d] / xScale;
+		float halfHeight = depths[d] / yScale;
+		for (int c = 0; c < 4; c++)
+		{
+			XMVECTOR viewCorner = XMVectorSet(
+				(c & 1) ? halfWidth : -halfWidth,
+				(c & 2) ? halfHeight : -halfHeight,
+				depths[d],
+				1.0f);
+			XMStoreFloat3(&corners[d * 4 + c], XMVector3TransformCoord(viewCorner, invView));
+		}
+	}
+}
+
+XMMATRIX ShadowCascades::LightView(XMFLOAT3 lightDirection)
+{
+	XMVECTOR direction = XMVector3Normalize(XMLoadFloat3(&lightDirection));
+
+	// Any up vector works as long as it isn't parallel to the light
+	XMVECTOR up = fabsf(XMVectorGetY(direction)) > 0.99f ? XMVectorSet(0, 0, 1, 0) : XMVectorSet(0, 1, 0, 0);
+	return XMMatrixLookToLH(XMVectorZero(), direction, up);
+}
+
+ShadowView ShadowCascades::Fit(const XMFLOAT3 corners[8], XMFLOAT3 lightDirection, unsigned int resolution, float casterDistance)
+{
+	// The slice is symmetric around the view direction, so the corners'
+	// average is on that axis and the farthest corner sets the radius
+	XMVECTOR center = XMVectorZero();
+	for (int i = 0; i < 8; i++)
+		center = XMVectorAdd(center, XMLoadFloat3(&corners[i]));
+	center = XMVectorScale(center, 1.0f / 8.0f);
+
+	float radius = 0.0f;
+	for (int i = 0; i < 8; i++)
+		radius = fmaxf(radius, XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&corners[i]), center))));
+
+	// Round the radius up so float noise can't change the texel size
+	radius = ceilf(radius * 16.0f) / 16.0f;
+
+	XMMATRIX view = LightView(lightDirection);
+	XMFLOAT3 lightCenter;
+	XMStoreFloat3(&lightCenter, XMVector3TransformCoord(center, view));
+
+	// Only move in whole texels, so a small camera move leaves the
+	// cascade exactly where it was (and any cached shadow still valid)
+	float texelSize = 2.0f * radius / resolution;
+	lightCenter.x = floorf(lightCenter.x / texelSize) * texelSize;
+	lightCenter.y = floorf(lightCenter.y / texelSize) * texelSize;
+	lightCenter.z = floorf(lightCenter.z / texelSize) * texelSize;
+
+	ShadowView cascade;
+	cascade.depthNear = lightCenter.z - radius - casterDistance;
+	cascade.depthFar = lightCenter.z + radius;
+	XMStoreFloat4x4(&cascade.view, view);
+	XMStoreFloat4x4(&cascade.projection, XMMatrixOrthographicOffCenterLH(
+		lightCenter.x - radius, lightCenter.x + radius,
+		lightCenter.y - radius, lightCenter.y + radius,
+		cascade.depthNear, cascade.depthFar));
+	return cascade;
+}
+
+// The light view space bounds of a world space box
+static void LightSpaceBounds(const XMFLOAT4X4& view, const BoundingBox& box, XMFLOAT3& boundsMin, XMFLOAT3& boundsMax)
+{
+	float center[3] = { box.Center.x, box.Center.y, box.Center.z };
+	float extents[3] = { box.Extents.x, box.Extents.y, box.Extents.z };
+	float outMin[3];
+	float outMax[3];
+	for (int j = 0; j < 3; j++)
+	{
+		float c = view.m[3][j];
+		float e = 0.0f;
+		for (int i = 0; i < 3; i++)
+		{
+			c += center[i] * view.m[i][j];
+			e += extents[i] * fabsf(view.m[i][j]);
+		}
+		outMin[j] = c - e;
+		outMax[j] = c + e;
+	}
+	boundsMin = XMFLOAT3(outMin[0], outMin[1], outMin[2]);
+	boundsMax = XMFLOAT3(outMax[0], outMax[1], outMax[2]);
+}
+
+ShadowView ShadowCascades::Tighten(
+	const ShadowView& cascade,
+	unsigned int resolution,
+	const std::vector<BoundingBox>& receivers,
+	const std::vector<BoundingBox>& casters)
+{
+	// Recover the fitted square from the projection, and the receivers'
+	// depth range, which is the fitted sphere without the caster reach
+	const XMFLOAT4X4& proj = cascade.projection;
+	float width = 2.0f / proj.m[0][0];
+	float left = -(proj.m[3][0] + 1.0f) / proj.m[0][0];
+	float bottom = -(proj.m[3][1] + 1.0f) / proj.m[1][1];
+	float receiverNear = cascade.depthFar - width;
+
+	// Union of the receivers inside the cascade, clipped to it
+	XMFLOAT3 usedMin(FLT_MAX, FLT_MAX, FLT_MAX);
+	XMFLOAT3 usedMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (const BoundingBox& box : receivers)
+	{
+		XMFLOAT3 boxMin, boxMax;
+		LightSpaceBounds(cascade.view, box, boxMin, boxMax);
+		if (boxMax.x < left || boxMin.x > left + width ||
+			boxMax.y < bottom || boxMin.y > bottom + width ||
+			boxMax.z < receiverNear || boxMin.z > cascade.depthFar)
+			continue;
+
+		usedMin.x = fminf(usedMin.x, fmaxf(boxMin.x, left));
+		usedMin.y = fminf(usedMin.y, fmaxf(boxMin.y, bottom));
+		usedMax.x = fmaxf(usedMax.x, fminf(boxMax.x, left + width));
+		usedMax.y = fmaxf(usedMax.y, fminf(boxMax.y, bottom + width));
+		usedMax.z = fmaxf(usedMax.z, fminf(boxMax.z, cascade.depthFar));
+	}
+	if (usedMax.z == -FLT_MAX)
+		return cascade;
+
+	// Halve while the receivers, plus a texel either side for the
+	// center's snapping, still fit
+	float extent = fmaxf(usedMax.x - usedMin.x, usedMax.y - usedMin.y);
+	float tightWidth = width;
+	for (unsigned int step = 0; step < MaxTightenSteps; step++)
+	{
+		float half = tightWidth * 0.5f;
+		if (extent + 2.0f * half / resolution > half)
+			break;
+		tightWidth = half;
+	}
+
+	float texelSize = tightWidth / resolution;
+	float centerX = floorf((usedMin.x + usedMax.x) * 0.5f / texelSize) * texelSize;
+	float centerY = floorf((usedMin.y + usedMax.y) * 0.5f / texelSize) * texelSize;
+	float tightLeft = centerX - tightWidth * 0.5f;
+	float tightBottom = centerY - tightWidth * 0.5f;
+
+	// Nearest caster that overlaps the new square and isn't behind everything
+	float casterNear = usedMax.z;
+	for (const BoundingBox& box : casters)
+	{
+		XMFLOAT3 boxMin, boxMax;
+		LightSpaceBounds(cascade.view, box, boxMin, boxMax);
+		if (boxMax.x < tightLeft || boxMin.x > tightLeft + tightWidth ||
+			boxMax.y < tightBottom || boxMin.y > tightBottom + tightWidth ||
+			boxMin.z > usedMax.z)
+			continue;
+
+		casterNear = fminf(casterNear, boxMin.z);
+	}
+
+	// Snap outwards so small moves don't change the matrices, keeping
+	// within the fitted range
+	float depthStep = width / DepthSteps;
+	float tightFar = fminf(ceilf(usedMax.z / depthStep) * depthStep, cascade.depthFar);
+	float tightNear = fmaxf(floorf(casterNear / depthStep) * depthStep, cascade.depthNear);
+	if (tightNear >= tightFar)
+		tightNear = tightFar - depthStep;
+
+	ShadowView tight;
+	tight.view = cascade.view;
+	tight.depthNear = tightNear;
+	tight.depthFar = tightFar;
+	XMStoreFloat4x4(&tight.projection, XMMatrixOrthographicOffCenterLH(
+		tightLeft, tightLeft + tightWidth,
+		tightBottom, tightBottom + tightWidth,
+		tightNear, tightFar));
+	return tight;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <vector>
+#include "ShadowViews.h"
+
+// --------------------------------------------------------
+// Math for cascaded shadow maps.  Each cascade is a view
+// with an orthographic projection covering one slice of the
+// camera's view, all sharing the light's rotation.  All
+// static, taking the camera's matrices and the scene's boxes
+// and returning the views to draw.
+//
+// Each cascade is fit around a sphere enclosing its slice
+// of the camera frustum.  The sphere's size depends only on
+// the slice, not the camera's orientation, and its center
+// is snapped to whole shadow map texels in light space, so
+// the shadow doesn't shimmer as the camera turns or moves.
+// --------------------------------------------------------
+class ShadowCascades
+{
+public:
+	static const unsigned int MaxCascades = 4;
+
+	// Fills count + 1 view depths from nearClip to farClip, blending
+	// logarithmic (lambda = 1) and uniform (lambda = 0) spacing
+	static void ComputeSplits(float nearClip, float farClip, unsigned int count, float lambda, float* splits);
+
+	// World space corners of the camera's view between two view depths
+	// xScale, yScale - the camera projection matrix's _11 and _22
+	static void SliceCorners(DirectX::FXMMATRIX cameraView, float xScale, float yScale, float nearDepth, float farDepth, DirectX::XMFLOAT3 corners[8]);
+
+	// Rotation only, looking along the light's direction
+	static DirectX::XMMATRIX LightView(DirectX::XMFLOAT3 lightDirection);
+
+	// Fits a cascade around a slice's corners
+	// resolution     - the cascade's size in shadow map texels
+	// casterDistance - how far towards the light the depth range reaches,
+	//                  so casters outside the slice still cast into it
+	static ShadowView Fit(const DirectX::XMFLOAT3 corners[8], DirectX::XMFLOAT3 lightDirection, unsigned int resolution, float casterDistance);
+
+	// Shrinks a fitted cascade to what's actually in it: the receivers
+	// (world boxes of what the camera sees) inside its volume, and the
+	// casters (world boxes) between them and the light.  Width only
+	// halves, up to MaxTightenSteps times, so texels keep a few fixed
+	// sizes and the center still snaps to whole texels.  Depths snap
+	// outwards to DepthSteps of the fitted width.  A cascade with no
+	// receivers is returned unchanged.
+	static ShadowView Tighten(
+		const ShadowView& cascade,
+		unsigned int resolution,
+		const std::vector<DirectX::BoundingBox>& receivers,
+		const std::vector<DirectX::BoundingBox>& casters);
+
+	static const unsigned int MaxTightenSteps = 3;
+	static const unsigned int DepthSteps = 16;
+};
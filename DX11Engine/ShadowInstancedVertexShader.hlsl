@@ -0,0 +1,34 @@
+#include "ShaderInclude.hlsli"
+
+// Light's view and projection, uploaded once per shadow pass
+cbuffer PerPass : register(b0)
+{
+	matrix view;
+	matrix projection;
+}
+
+// Only the world matrix is needed from the instance buffer, which
+// sits at the start of each InstanceData element
+struct ShadowInstancedVertexShaderInput
+{
+	float3 localPosition		: POSITION;
+	float3 normal				: NORMAL;
+	float3 tangent				: TANGENT;
+	float2 uv					: TEXCOORD;
+	matrix world				: WORLD_PER_INSTANCE;
+};
+
+struct ShadowVertexToPixel
+{
+	float4 screenPos : SV_POSITION;
+};
+
+ShadowVertexToPixel main(ShadowInstancedVertexShaderInput input)
+{
+	ShadowVertexToPixel output;
+
+	matrix wvp = mul(mul(projection, view), input.world);
+	output.screenPos = mul(wvp, float4(input.localPosition, 1.0f));
+
+	return output;
+}
@@ -1,13 +1,18 @@
 #include "ShaderInclude.hlsli"
 
-// Declaring constant buffer
-cbuffer ExternalData : register(b0)
+// Light's view and projection, uploaded once per shadow pass
+cbuffer PerPass : register(b0)
 {
-	matrix world;
 	matrix view;
 	matrix projection;
 }
 
+// Uploaded for every shadow caster
+cbuffer PerObject : register(b1)
+{
+	matrix world;
+}
+
 struct ShadowVertexToPixel
 {
 	float4 screenPos : SV_POSITION;
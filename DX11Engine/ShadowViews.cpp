@@ -0,0 +1,86 @@
+#include "ShadowViews.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Spot falloff is pow(cos(angle), spotFalloff), so this is
+// where that reaches 0.01.  Capped so one perspective view
+// can still cover it.
+// --------------------------------------------------------
+float ShadowViews::SpotHalfAngle(float spotFalloff)
+{
+	const float maxHalfAngle = XMConvertToRadians(75.0f);
+	if (spotFalloff <= 0.0f)
+		return maxHalfAngle;
+
+	return std::min(maxHalfAngle, acosf(powf(0.01f, 1.0f / spotFalloff)));
+}
+
+// Perspective projection whose edges are a texel outside the given half angle
+static XMMATRIX WidenedPerspective(float halfAngle, float nearClip, float range, unsigned int tileSize)
+{
+	float scale = 1.0f - 2.0f / tileSize;
+	float widened = atanf(tanf(halfAngle) / scale);
+	return XMMatrixPerspectiveFovLH(2.0f * widened, 1.0f, nearClip, range);
+}
+
+static ShadowView MakeView(FXMMATRIX view, CXMMATRIX projection, float nearClip, float range)
+{
+	ShadowView result;
+	XMStoreFloat4x4(&result.view, view);
+	XMStoreFloat4x4(&result.projection, projection);
+	result.depthNear = nearClip;
+	result.depthFar = range;
+	return result;
+}
+
+ShadowView ShadowViews::Spot(XMFLOAT3 position, XMFLOAT3 direction, float halfAngle, float nearClip, float range, unsigned int tileSize)
+{
+	XMVECTOR forward = XMVector3Normalize(XMLoadFloat3(&direction));
+	XMVECTOR up = fabsf(XMVectorGetY(forward)) > 0.99f ? XMVectorSet(0, 0, 1, 0) : XMVectorSet(0, 1, 0, 0);
+	XMMATRIX view = XMMatrixLookToLH(XMLoadFloat3(&position), forward, up);
+	return MakeView(view, WidenedPerspective(halfAngle, nearClip, range, tileSize), nearClip, range);
+}
+
+ShadowView ShadowViews::CubeFace(XMFLOAT3 position, unsigned int face, float nearClip, float range, unsigned int tileSize)
+{
+	static const XMFLOAT3 forwards[CubeFaces] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	static const XMFLOAT3 ups[CubeFaces] = { { 0, 1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 }, { 0, 1, 0 }, { 0, 1, 0 } };
+
+	XMMATRIX view = XMMatrixLookToLH(XMLoadFloat3(&position), XMLoadFloat3(&forwards[face]), XMLoadFloat3(&ups[face]));
+	return MakeView(view, WidenedPerspective(XM_PIDIV4, nearClip, range, tileSize), nearClip, range);
+}
+
+// --------------------------------------------------------
+// Clip space to the tile: y flips, -1 to 1 becomes the
+// tile's texture coordinates.  Offsets are in the w row so
+// they're divided by w along with x and y for perspective.
+// --------------------------------------------------------
+XMFLOAT4X4 ShadowViews::AtlasMatrix(const ShadowView& view, const ShadowTile& tile, unsigned int atlasSize)
+{
+	float halfScale = 0.5f * tile.size / atlasSize;
+	float centerX = (tile.x + 0.5f * tile.size) / atlasSize;
+	float centerY = (tile.y + 0.5f * tile.size) / atlasSize;
+	XMMATRIX toTile(
+		halfScale, 0.0f, 0.0f, 0.0f,
+		0.0f, -halfScale, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		centerX, centerY, 0.0f, 1.0f);
+
+	XMFLOAT4X4 result;
+	XMStoreFloat4x4(&result, XMLoadFloat4x4(&view.view) * XMLoadFloat4x4(&view.projection) * toTile);
+	return result;
+}
+
+XMFLOAT4 ShadowViews::AtlasBounds(const ShadowTile& tile, unsigned int atlasSize)
+{
+	float texel = 1.0f / atlasSize;
+	return XMFLOAT4(
+		(tile.x + 1) * texel,
+		(tile.y + 1) * texel,
+		(tile.x + tile.size - 1) * texel,
+		(tile.y + tile.size - 1) * texel);
+}
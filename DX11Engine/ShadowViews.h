@@ -0,0 +1,48 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include "ShadowAtlas.h"
+
+// --------------------------------------------------------
+// One view drawn into the shadow atlas: a directional
+// light's cascade, a spot light, or one face of a point
+// light's cube
+// --------------------------------------------------------
+struct ShadowView
+{
+	DirectX::XMFLOAT4X4 view;
+	DirectX::XMFLOAT4X4 projection;
+	float depthNear;					// View space depths the projection covers
+	float depthFar;
+};
+
+// --------------------------------------------------------
+// Builds the views of spot and point lights, and places any
+// view in its atlas tile.  The matrices it returns are what
+// the shader samples with, so they have to agree with
+// ShaderInclude.hlsli.
+//
+// Perspective views are widened by a texel on every side,
+// matching the texel the shader keeps clear of a tile's
+// edge, so a cube's faces still meet without gaps.
+// --------------------------------------------------------
+class ShadowViews
+{
+public:
+	static const unsigned int MaxViews = 32;	// Must match MAX_SHADOW_VIEWS in ShaderInclude.hlsli
+	static const unsigned int CubeFaces = 6;
+
+	// The cone's half angle, where the light's falloff drops to 1%
+	static float SpotHalfAngle(float spotFalloff);
+
+	static ShadowView Spot(DirectX::XMFLOAT3 position, DirectX::XMFLOAT3 direction, float halfAngle, float nearClip, float range, unsigned int tileSize);
+
+	// Faces are +X, -X, +Y, -Y, +Z, -Z, the order the shader expects
+	static ShadowView CubeFace(DirectX::XMFLOAT3 position, unsigned int face, float nearClip, float range, unsigned int tileSize);
+
+	// World space to atlas texture coordinates, through a view and its tile
+	static DirectX::XMFLOAT4X4 AtlasMatrix(const ShadowView& view, const ShadowTile& tile, unsigned int atlasSize);
+
+	// A tile's texture coordinates (min xy, max zw) inset by a texel
+	static DirectX::XMFLOAT4 AtlasBounds(const ShadowTile& tile, unsigned int atlasSize);
+};
@@ -1,9 +1,18 @@
 #include "SimpleShader.h"
+#include "RenderStats.h"
+#include "StateCache.h"
 
 // Default error reporting state
 bool ISimpleShader::ReportErrors = false;
 bool ISimpleShader::ReportWarnings = false;
 
+// Shared upload ring for constant buffers (null to give
+// each buffer its own resource, as usual)
+std::shared_ptr<ConstantBufferRing> ISimpleShader::UploadRing;
+
+// Next ID handed out to a shader
+unsigned int ISimpleShader::nextShaderID = 0;
+
 // To enable error reporting, use either or both 
 // of the following lines somewhere in your program, 
 // preferably before loading/using any shaders.
@@ -29,6 +38,7 @@ ISimpleShader::ISimpleShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Micros
 	this->constantBufferCount = 0;
 	this->constantBuffers = 0;
 	this->shaderValid = false;
+	this->shaderID = nextShaderID++;
 }
 
 // --------------------------------------------------------
@@ -203,6 +213,9 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		constantBuffers[b].LocalDataBuffer = new unsigned char[bufferDesc.Size];
 		ZeroMemory(constantBuffers[b].LocalDataBuffer, bufferDesc.Size);
 
+		// The GPU buffer starts out undefined, so the whole thing is dirty
+		constantBuffers[b].Tracker.Init(bufferDesc.Size);
+
 		// Loop through all variables in this buffer
 		for (unsigned int v = 0; v < bufferDesc.Variables; v++)
 		{
@@ -333,6 +346,7 @@ void ISimpleShader::SetShader()
 	// Set the shader and any relevant constant buffers, which
 	// is an overloaded method in a subclass
 	SetShaderAndCBs();
+	RenderStats::GetInstance().GetCurrentFrame().shaderChanges++;
 }
 
 // --------------------------------------------------------
@@ -345,13 +359,10 @@ void ISimpleShader::CopyAllBufferData()
 	// Ensure the shader is valid
 	if (!shaderValid) return;
 
-	// Loop through the constant buffers and copy all data
+	// Loop through the constant buffers and copy any that changed
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
-		// Copy the entire local data buffer
-		deviceContext->UpdateSubresource(
-			constantBuffers[i].ConstantBuffer.Get(), 0, 0,
-			constantBuffers[i].LocalDataBuffer, 0, 0);
+		UploadBuffer(&constantBuffers[i]);
 	}
 }
 
@@ -379,10 +390,8 @@ void ISimpleShader::CopyBufferData(unsigned int index)
 	SimpleConstantBuffer* cb = &this->constantBuffers[index];
 	if (!cb) return;
 
-	// Copy the data and get out
-	deviceContext->UpdateSubresource(
-		cb->ConstantBuffer.Get(), 0, 0, 
-		cb->LocalDataBuffer, 0, 0);
+	// Copy the data (if it changed) and get out
+	UploadBuffer(cb);
 }
 
 // --------------------------------------------------------
@@ -401,10 +410,119 @@ void ISimpleShader::CopyBufferData(std::string bufferName)
 	SimpleConstantBuffer* cb = this->FindConstantBuffer(bufferName);
 	if (!cb) return;
 
-	// Copy the data and get out
+	// Copy the data (if it changed) and get out
+	UploadBuffer(cb);
+}
+
+// --------------------------------------------------------
+// Uploads a constant buffer's local data if anything in it
+// changed, and records the upload (or skip) in the stats
+// --------------------------------------------------------
+void ISimpleShader::UploadBuffer(SimpleConstantBuffer* cb)
+{
+	if (UploadRing)
+	{
+		// Ring ranges can only be reused within the frame they were written
+		if (cb->RingFrame == UploadRing->GetFrameIndex() && !cb->Tracker.NeedsUpload(cb->LocalDataBuffer))
+		{
+			RenderStats::GetInstance().GetCurrentFrame().constantBufferSkips++;
+			return;
+		}
+
+		// The data now lives somewhere new: at a new offset in the
+		// ring or, if the ring is full, in the buffer's own resource
+		// (which is out of date and needs a full copy).  Uploading
+		// only writes data, so the slot is rebound here only if this
+		// shader is the one set; otherwise SetShader() binds it.
+		if (!WriteToRing(cb))
+			UploadOwnBuffer(cb);
+		if (IsShaderSet())
+			BindConstantBuffer(cb);
+		return;
+	}
+
+	if (!cb->Tracker.NeedsUpload(cb->LocalDataBuffer))
+	{
+		RenderStats::GetInstance().GetCurrentFrame().constantBufferSkips++;
+		return;
+	}
+
+	// Constant buffers can't be partially updated, so the
+	// whole local buffer is copied even for a small range
+	deviceContext->UpdateSubresource(
+		cb->ConstantBuffer.Get(), 0, 0,
+		cb->LocalDataBuffer, 0, 0);
+	FinishUpload(cb);
+}
+
+// --------------------------------------------------------
+// Copies the entire local buffer to the buffer's own
+// resource, regardless of what is dirty
+// --------------------------------------------------------
+void ISimpleShader::UploadOwnBuffer(SimpleConstantBuffer* cb)
+{
 	deviceContext->UpdateSubresource(
-		cb->ConstantBuffer.Get(), 0, 0, 
+		cb->ConstantBuffer.Get(), 0, 0,
 		cb->LocalDataBuffer, 0, 0);
+	cb->Tracker.MarkDirty(0, cb->Size);
+	FinishUpload(cb);
+}
+
+// --------------------------------------------------------
+// Copies a constant buffer into the upload ring.  Returns
+// false if the ring is full.
+// --------------------------------------------------------
+bool ISimpleShader::WriteToRing(SimpleConstantBuffer* cb)
+{
+	if (!UploadRing->Write(cb->LocalDataBuffer, cb->Size, cb->RingFirstConstant, cb->RingNumConstants))
+	{
+		cb->RingFrame = SimpleConstantBuffer::NotInRing;
+		RenderStats::GetInstance().GetCurrentFrame().constantBufferRingFallbacks++;
+		return false;
+	}
+
+	cb->RingFrame = UploadRing->GetFrameIndex();
+	FinishUpload(cb);
+	return true;
+}
+
+// --------------------------------------------------------
+// Determines if a buffer should be bound from the upload ring.
+// A buffer whose range is from an earlier frame may have been
+// overwritten since, so it is written again before binding.
+// --------------------------------------------------------
+bool ISimpleShader::RefreshRingRange(SimpleConstantBuffer* cb)
+{
+	if (!UploadRing || cb->RingFrame == SimpleConstantBuffer::NotInRing)
+		return false;
+
+	if (cb->RingFrame == UploadRing->GetFrameIndex())
+		return true;
+
+	if (WriteToRing(cb))
+		return true;
+
+	UploadOwnBuffer(cb);
+	return false;
+}
+
+// --------------------------------------------------------
+// Records that the GPU now holds the buffer's local data
+// --------------------------------------------------------
+void ISimpleShader::FinishUpload(SimpleConstantBuffer* cb)
+{
+	CountUpload(cb->Size);
+	cb->Tracker.FinishUpload(cb->LocalDataBuffer);
+}
+
+// --------------------------------------------------------
+// Adds a constant buffer upload to the frame's render stats
+// --------------------------------------------------------
+void ISimpleShader::CountUpload(unsigned int size)
+{
+	FrameCounters& frame = RenderStats::GetInstance().GetCurrentFrame();
+	frame.constantBufferUploads++;
+	frame.constantBufferBytes += size;
 }
 
 
@@ -446,15 +564,47 @@ bool ISimpleShader::SetData(std::string name, const void* data, unsigned int siz
 	}
 
 	// Set the data in the local data buffer
+	SimpleConstantBuffer* cb = &constantBuffers[var->ConstantBufferIndex];
 	memcpy(
-		constantBuffers[var->ConstantBufferIndex].LocalDataBuffer + var->ByteOffset,
+		cb->LocalDataBuffer + var->ByteOffset,
 		data,
 		size);
+	cb->Tracker.MarkDirty(var->ByteOffset, size);
 
 	// Success
 	return true;
 }
 
+// --------------------------------------------------------
+// Sets a whole constant buffer by name, such as to copy it
+// from another variant of the same shader
+//
+// bufferName - The name of the constant buffer
+// data - The data to set in the buffer
+// size - The size of the data (this must match the buffer's size)
+//
+// Returns true if data is copied, false if the buffer doesn't exist
+// --------------------------------------------------------
+bool ISimpleShader::SetBufferData(std::string bufferName, const void* data, unsigned int size)
+{
+	SimpleConstantBuffer* cb = this->FindConstantBuffer(bufferName);
+	if (!cb || size != cb->Size)
+	{
+		if (ReportWarnings)
+		{
+			LogWarning("SimpleShader::SetBufferData() - Constant buffer '");
+			Log(bufferName);
+			LogWarning("' not found or not the size of the data being set.\n");
+		}
+		return false;
+	}
+
+	memcpy(cb->LocalDataBuffer, data, size);
+	cb->Tracker.MarkDirty(0, size);
+	return true;
+}
+
+
 // --------------------------------------------------------
 // Sets INTEGER data
 // --------------------------------------------------------
@@ -869,24 +1019,54 @@ void SimpleVertexShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader and input layout
-	deviceContext->IASetInputLayout(inputLayout.Get());
-	deviceContext->VSSetShader(shader.Get(), 0, 0);
+	StateCache::GetInstance().IASetInputLayout(inputLayout.Get());
+	StateCache::GetInstance().SetShader(ShaderStageVS, shader.Get());
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
-	{
-		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
-			continue;
+		BindConstantBuffer(&constantBuffers[i]);
+}
 
-		// This is a real constant buffer, so set it
-		deviceContext->VSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
+// --------------------------------------------------------
+// Binds a single constant buffer to the vertex shader stage,
+// using its range in the upload ring if it was written there
+// --------------------------------------------------------
+void SimpleVertexShader::BindConstantBuffer(SimpleConstantBuffer* cb)
+{
+	// Skip "buffers" that aren't true constant buffers
+	if (cb->Type != D3D11_CT_CBUFFER)
+		return;
+
+	if (RefreshRingRange(cb))
+	{
+		ID3D11Buffer* ringBuffer = UploadRing->GetBuffer();
+		StateCache::GetInstance().SetConstantBuffers1(
+			ShaderStageVS,
+			cb->BindIndex,
+			1,
+			&ringBuffer,
+			&cb->RingFirstConstant,
+			&cb->RingNumConstants);
+	}
+	else
+	{
+		StateCache::GetInstance().SetConstantBuffers(
+			ShaderStageVS,
+			cb->BindIndex,
 			1,
-			constantBuffers[i].ConstantBuffer.GetAddressOf());
+			cb->ConstantBuffer.GetAddressOf());
 	}
 }
 
+// --------------------------------------------------------
+// Whether this is the vertex shader currently set, so its
+// constant buffers are the ones bound to the stage
+// --------------------------------------------------------
+bool SimpleVertexShader::IsShaderSet()
+{
+	return shaderValid && StateCache::GetInstance().IsShaderSet(ShaderStageVS, shader.Get());
+}
+
 // --------------------------------------------------------
 // Sets a shader resource view in the vertex shader stage
 //
@@ -911,7 +1091,7 @@ bool SimpleVertexShader::SetShaderResourceView(std::string name, Microsoft::WRL:
 	}
 
 	// Set the shader resource view
-	deviceContext->VSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	StateCache::GetInstance().SetShaderResources(ShaderStageVS, srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -941,7 +1121,7 @@ bool SimpleVertexShader::SetSamplerState(std::string name, Microsoft::WRL::ComPt
 	}
 
 	// Set the shader resource view
-	deviceContext->VSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	StateCache::GetInstance().SetSamplers(ShaderStageVS, sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -1012,23 +1192,53 @@ void SimplePixelShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 	
 	// Set the shader
-	deviceContext->PSSetShader(shader.Get(), 0, 0);
+	StateCache::GetInstance().SetShader(ShaderStagePS, shader.Get());
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
-	{
-		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
-			continue;
+		BindConstantBuffer(&constantBuffers[i]);
+}
+
+// --------------------------------------------------------
+// Binds a single constant buffer to the pixel shader stage,
+// using its range in the upload ring if it was written there
+// --------------------------------------------------------
+void SimplePixelShader::BindConstantBuffer(SimpleConstantBuffer* cb)
+{
+	// Skip "buffers" that aren't true constant buffers
+	if (cb->Type != D3D11_CT_CBUFFER)
+		return;
 
-		// This is a real constant buffer, so set it
-		deviceContext->PSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
+	if (RefreshRingRange(cb))
+	{
+		ID3D11Buffer* ringBuffer = UploadRing->GetBuffer();
+		StateCache::GetInstance().SetConstantBuffers1(
+			ShaderStagePS,
+			cb->BindIndex,
+			1,
+			&ringBuffer,
+			&cb->RingFirstConstant,
+			&cb->RingNumConstants);
+	}
+	else
+	{
+		StateCache::GetInstance().SetConstantBuffers(
+			ShaderStagePS,
+			cb->BindIndex,
 			1,
-			constantBuffers[i].ConstantBuffer.GetAddressOf());
+			cb->ConstantBuffer.GetAddressOf());
 	}
 }
 
+// --------------------------------------------------------
+// Whether this is the pixel shader currently set, so its
+// constant buffers are the ones bound to the stage
+// --------------------------------------------------------
+bool SimplePixelShader::IsShaderSet()
+{
+	return shaderValid && StateCache::GetInstance().IsShaderSet(ShaderStagePS, shader.Get());
+}
+
 // --------------------------------------------------------
 // Sets a shader resource view in the pixel shader stage
 //
@@ -1053,7 +1263,7 @@ bool SimplePixelShader::SetShaderResourceView(std::string name, Microsoft::WRL::
 	}
 
 	// Set the shader resource view
-	deviceContext->PSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	StateCache::GetInstance().SetShaderResources(ShaderStagePS, srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -1083,7 +1293,7 @@ bool SimplePixelShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr
 	}
 
 	// Set the shader resource view
-	deviceContext->PSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	StateCache::GetInstance().SetSamplers(ShaderStagePS, sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -1156,21 +1366,51 @@ void SimpleDomainShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->DSSetShader(shader.Get(), 0, 0);
+	StateCache::GetInstance().SetShader(ShaderStageDS, shader.Get());
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
-	{
-		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
-			continue;
+		BindConstantBuffer(&constantBuffers[i]);
+}
+
+// --------------------------------------------------------
+// Binds a single constant buffer to the domain shader stage,
+// using its range in the upload ring if it was written there
+// --------------------------------------------------------
+void SimpleDomainShader::BindConstantBuffer(SimpleConstantBuffer* cb)
+{
+	// Skip "buffers" that aren't true constant buffers
+	if (cb->Type != D3D11_CT_CBUFFER)
+		return;
 
-		// This is a real constant buffer, so set it
-		deviceContext->DSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
+	if (RefreshRingRange(cb))
+	{
+		ID3D11Buffer* ringBuffer = UploadRing->GetBuffer();
+		StateCache::GetInstance().SetConstantBuffers1(
+			ShaderStageDS,
+			cb->BindIndex,
 			1,
-			constantBuffers[i].ConstantBuffer.GetAddressOf());
+			&ringBuffer,
+			&cb->RingFirstConstant,
+			&cb->RingNumConstants);
 	}
+	else
+	{
+		StateCache::GetInstance().SetConstantBuffers(
+			ShaderStageDS,
+			cb->BindIndex,
+			1,
+			cb->ConstantBuffer.GetAddressOf());
+	}
+}
+
+// --------------------------------------------------------
+// Whether this is the domain shader currently set, so its
+// constant buffers are the ones bound to the stage
+// --------------------------------------------------------
+bool SimpleDomainShader::IsShaderSet()
+{
+	return shaderValid && StateCache::GetInstance().IsShaderSet(ShaderStageDS, shader.Get());
 }
 
 // --------------------------------------------------------
@@ -1197,7 +1437,7 @@ bool SimpleDomainShader::SetShaderResourceView(std::string name, Microsoft::WRL:
 	}
 
 	// Set the shader resource view
-	deviceContext->DSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	StateCache::GetInstance().SetShaderResources(ShaderStageDS, srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -1227,7 +1467,7 @@ bool SimpleDomainShader::SetSamplerState(std::string name, Microsoft::WRL::ComPt
 	}
 
 	// Set the shader resource view
-	deviceContext->DSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	StateCache::GetInstance().SetSamplers(ShaderStageDS, sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -1299,23 +1539,53 @@ void SimpleHullShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->HSSetShader(shader.Get(), 0, 0);
+	StateCache::GetInstance().SetShader(ShaderStageHS, shader.Get());
 
-	// Set the constant buffers?
+	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
-	{
-		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
-			continue;
+		BindConstantBuffer(&constantBuffers[i]);
+}
+
+// --------------------------------------------------------
+// Binds a single constant buffer to the hull shader stage,
+// using its range in the upload ring if it was written there
+// --------------------------------------------------------
+void SimpleHullShader::BindConstantBuffer(SimpleConstantBuffer* cb)
+{
+	// Skip "buffers" that aren't true constant buffers
+	if (cb->Type != D3D11_CT_CBUFFER)
+		return;
 
-		// This is a real constant buffer, so set it
-		deviceContext->HSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
+	if (RefreshRingRange(cb))
+	{
+		ID3D11Buffer* ringBuffer = UploadRing->GetBuffer();
+		StateCache::GetInstance().SetConstantBuffers1(
+			ShaderStageHS,
+			cb->BindIndex,
+			1,
+			&ringBuffer,
+			&cb->RingFirstConstant,
+			&cb->RingNumConstants);
+	}
+	else
+	{
+		StateCache::GetInstance().SetConstantBuffers(
+			ShaderStageHS,
+			cb->BindIndex,
 			1,
-			constantBuffers[i].ConstantBuffer.GetAddressOf());
+			cb->ConstantBuffer.GetAddressOf());
 	}
 }
 
+// --------------------------------------------------------
+// Whether this is the hull shader currently set, so its
+// constant buffers are the ones bound to the stage
+// --------------------------------------------------------
+bool SimpleHullShader::IsShaderSet()
+{
+	return shaderValid && StateCache::GetInstance().IsShaderSet(ShaderStageHS, shader.Get());
+}
+
 // --------------------------------------------------------
 // Sets a shader resource view in the hull shader stage
 //
@@ -1340,7 +1610,7 @@ bool SimpleHullShader::SetShaderResourceView(std::string name, Microsoft::WRL::C
 	}
 
 	// Set the shader resource view
-	deviceContext->HSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	StateCache::GetInstance().SetShaderResources(ShaderStageHS, srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -1370,7 +1640,7 @@ bool SimpleHullShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr<
 	}
 
 	// Set the shader resource view
-	deviceContext->HSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	StateCache::GetInstance().SetSamplers(ShaderStageHS, sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -1573,23 +1843,53 @@ void SimpleGeometryShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->GSSetShader(shader.Get(), 0, 0);
+	StateCache::GetInstance().SetShader(ShaderStageGS, shader.Get());
 
-	// Set the constant buffers?
+	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
-	{
-		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
-			continue;
+		BindConstantBuffer(&constantBuffers[i]);
+}
 
-		// This is a real constant buffer, so set it
-		deviceContext->GSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
+// --------------------------------------------------------
+// Binds a single constant buffer to the geometry shader stage,
+// using its range in the upload ring if it was written there
+// --------------------------------------------------------
+void SimpleGeometryShader::BindConstantBuffer(SimpleConstantBuffer* cb)
+{
+	// Skip "buffers" that aren't true constant buffers
+	if (cb->Type != D3D11_CT_CBUFFER)
+		return;
+
+	if (RefreshRingRange(cb))
+	{
+		ID3D11Buffer* ringBuffer = UploadRing->GetBuffer();
+		StateCache::GetInstance().SetConstantBuffers1(
+			ShaderStageGS,
+			cb->BindIndex,
+			1,
+			&ringBuffer,
+			&cb->RingFirstConstant,
+			&cb->RingNumConstants);
+	}
+	else
+	{
+		StateCache::GetInstance().SetConstantBuffers(
+			ShaderStageGS,
+			cb->BindIndex,
 			1,
-			constantBuffers[i].ConstantBuffer.GetAddressOf());
+			cb->ConstantBuffer.GetAddressOf());
 	}
 }
 
+// --------------------------------------------------------
+// Whether this is the geometry shader currently set, so its
+// constant buffers are the ones bound to the stage
+// --------------------------------------------------------
+bool SimpleGeometryShader::IsShaderSet()
+{
+	return shaderValid && StateCache::GetInstance().IsShaderSet(ShaderStageGS, shader.Get());
+}
+
 // --------------------------------------------------------
 // Sets a shader resource view in the Geometry shader stage
 //
@@ -1614,7 +1914,7 @@ bool SimpleGeometryShader::SetShaderResourceView(std::string name, Microsoft::WR
 	}
 
 	// Set the shader resource view
-	deviceContext->GSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	StateCache::GetInstance().SetShaderResources(ShaderStageGS, srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -1644,7 +1944,7 @@ bool SimpleGeometryShader::SetSamplerState(std::string name, Microsoft::WRL::Com
 	}
 
 	// Set the shader resource view
-	deviceContext->GSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	StateCache::GetInstance().SetSamplers(ShaderStageGS, sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -1783,23 +2083,53 @@ void SimpleComputeShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->CSSetShader(shader.Get(), 0, 0);
+	StateCache::GetInstance().SetShader(ShaderStageCS, shader.Get());
 
-	// Set the constant buffers?
+	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
-	{
-		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
-			continue;
+		BindConstantBuffer(&constantBuffers[i]);
+}
+
+// --------------------------------------------------------
+// Binds a single constant buffer to the compute shader stage,
+// using its range in the upload ring if it was written there
+// --------------------------------------------------------
+void SimpleComputeShader::BindConstantBuffer(SimpleConstantBuffer* cb)
+{
+	// Skip "buffers" that aren't true constant buffers
+	if (cb->Type != D3D11_CT_CBUFFER)
+		return;
 
-		// This is a real constant buffer, so set it
-		deviceContext->CSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
+	if (RefreshRingRange(cb))
+	{
+		ID3D11Buffer* ringBuffer = UploadRing->GetBuffer();
+		StateCache::GetInstance().SetConstantBuffers1(
+			ShaderStageCS,
+			cb->BindIndex,
+			1,
+			&ringBuffer,
+			&cb->RingFirstConstant,
+			&cb->RingNumConstants);
+	}
+	else
+	{
+		StateCache::GetInstance().SetConstantBuffers(
+			ShaderStageCS,
+			cb->BindIndex,
 			1,
-			constantBuffers[i].ConstantBuffer.GetAddressOf());
+			cb->ConstantBuffer.GetAddressOf());
 	}
 }
 
+// --------------------------------------------------------
+// Whether this is the compute shader currently set, so its
+// constant buffers are the ones bound to the stage
+// --------------------------------------------------------
+bool SimpleComputeShader::IsShaderSet()
+{
+	return shaderValid && StateCache::GetInstance().IsShaderSet(ShaderStageCS, shader.Get());
+}
+
 // --------------------------------------------------------
 // Dispatches the compute shader with the specified amount 
 // of groups, using the number of threads per group
@@ -1885,7 +2215,7 @@ bool SimpleComputeShader::SetShaderResourceView(std::string name, Microsoft::WRL
 	}
 
 	// Set the shader resource view
-	deviceContext->CSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	StateCache::GetInstance().SetShaderResources(ShaderStageCS, srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -1915,7 +2245,7 @@ bool SimpleComputeShader::SetSamplerState(std::string name, Microsoft::WRL::ComP
 	}
 
 	// Set the shader resource view
-	deviceContext->CSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	StateCache::GetInstance().SetSamplers(ShaderStageCS, sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
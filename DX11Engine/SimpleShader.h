@@ -10,6 +10,10 @@
 #include <unordered_map>
 #include <vector>
 #include <string>
+#include <memory>
+
+#include "ConstantBufferRing.h"
+#include "ConstantBufferTracker.h"
 
 
 // --------------------------------------------------------
@@ -37,6 +41,15 @@ struct SimpleConstantBuffer
 	Microsoft::WRL::ComPtr<ID3D11Buffer> ConstantBuffer = 0;
 	unsigned char* LocalDataBuffer = 0;
 	std::vector<SimpleShaderVariable> Variables;
+
+	// Which bytes have changed since the last upload
+	ConstantBufferTracker Tracker;
+
+	// Where this buffer's data lives in the upload ring (if used)
+	static const unsigned long long NotInRing = ~0ull;
+	unsigned long long RingFrame = NotInRing;
+	UINT RingFirstConstant = 0;
+	UINT RingNumConstants = 0;
 };
 
 // --------------------------------------------------------
@@ -68,6 +81,7 @@ public:
 
 	// Simple helpers
 	bool IsShaderValid() { return shaderValid; }
+	unsigned int GetShaderID() { return shaderID; }
 
 	// Activating the shader and copying data
 	void SetShader();
@@ -77,6 +91,7 @@ public:
 
 	// Sets arbitrary shader data
 	bool SetData(std::string name, const void* data, unsigned int size);
+	bool SetBufferData(std::string bufferName, const void* data, unsigned int size);
 
 	bool SetInt(std::string name, int data);
 	bool SetFloat(std::string name, float data);
@@ -122,9 +137,15 @@ public:
 	static bool ReportErrors;
 	static bool ReportWarnings;
 
+	// When set (and supported), constant buffers are written
+	// into this ring and bound by offset
+	static std::shared_ptr<ConstantBufferRing> UploadRing;
+
 protected:
 	
 	bool shaderValid;
+	unsigned int shaderID;	// Unique per shader object, used for sorting draws
+	static unsigned int nextShaderID;
 	Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob;
 	Microsoft::WRL::ComPtr<ID3D11Device> device;
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext;
@@ -147,6 +168,8 @@ protected:
 	// Pure virtual functions for dealing with shader types
 	virtual bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob) = 0;
 	virtual void SetShaderAndCBs() = 0;
+	virtual void BindConstantBuffer(SimpleConstantBuffer* cb) = 0;
+	virtual bool IsShaderSet() = 0;
 
 	virtual void CleanUp();
 
@@ -154,6 +177,18 @@ protected:
 	SimpleShaderVariable* FindVariable(std::string name, int size);
 	SimpleConstantBuffer* FindConstantBuffer(std::string name);
 
+	// Constant buffer uploads, skipped when the tracker finds nothing changed
+	void UploadBuffer(SimpleConstantBuffer* cb);
+	void UploadOwnBuffer(SimpleConstantBuffer* cb);
+	void FinishUpload(SimpleConstantBuffer* cb);
+
+	// Upload ring helpers
+	bool WriteToRing(SimpleConstantBuffer* cb);
+	bool RefreshRingRange(SimpleConstantBuffer* cb);
+
+	// Keeps track of how much data is sent to the GPU
+	void CountUpload(unsigned int size);
+
 	// Error logging
 	void Log(std::string message, WORD color);
 	void LogW(std::wstring message, WORD color);
@@ -187,6 +222,8 @@ protected:
 	 Microsoft::WRL::ComPtr<ID3D11VertexShader> shader;
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	void SetShaderAndCBs();
+	void BindConstantBuffer(SimpleConstantBuffer* cb);
+	bool IsShaderSet();
 	void CleanUp();
 };
 
@@ -208,6 +245,8 @@ protected:
 	Microsoft::WRL::ComPtr<ID3D11PixelShader> shader;
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	void SetShaderAndCBs();
+	void BindConstantBuffer(SimpleConstantBuffer* cb);
+	bool IsShaderSet();
 	void CleanUp();
 };
 
@@ -228,6 +267,8 @@ protected:
 	Microsoft::WRL::ComPtr<ID3D11DomainShader> shader;
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	void SetShaderAndCBs();
+	void BindConstantBuffer(SimpleConstantBuffer* cb);
+	bool IsShaderSet();
 	void CleanUp();
 };
 
@@ -248,6 +289,8 @@ protected:
 	Microsoft::WRL::ComPtr<ID3D11HullShader> shader;
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	void SetShaderAndCBs();
+	void BindConstantBuffer(SimpleConstantBuffer* cb);
+	bool IsShaderSet();
 	void CleanUp();
 };
 
@@ -280,6 +323,8 @@ protected:
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	bool CreateShaderWithStreamOut(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	void SetShaderAndCBs();
+	void BindConstantBuffer(SimpleConstantBuffer* cb);
+	bool IsShaderSet();
 	void CleanUp();
 
 	// Helpers
@@ -319,5 +364,7 @@ protected:
 
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	void SetShaderAndCBs();
+	void BindConstantBuffer(SimpleConstantBuffer* cb);
+	bool IsShaderSet();
 	void CleanUp();
 };
\ No newline at end of file
@@ -1,4 +1,6 @@
 #include "Sky.h"
+#include "StateCache.h"
+#include <cstring>
 
 using namespace DirectX;
 
@@ -29,8 +31,8 @@ Sky::Sky(std::shared_ptr<Mesh> p_mesh, Microsoft::WRL::ComPtr<ID3D11SamplerState
 void Sky::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext, std::shared_ptr<Camera> camera)
 {
 	// Setting render states
-	deviceContext->RSSetState(rasterizer.Get());
-	deviceContext->OMSetDepthStencilState(depthStencilState.Get(), 0);
+	StateCache::GetInstance().RSSetState(rasterizer.Get());
+	StateCache::GetInstance().OMSetDepthStencilState(depthStencilState.Get(), 0);
 
 	// Sending data to vertex shader constant  buffer
 	vs->SetMatrix4x4("view", camera->GetViewMatrix());
@@ -48,6 +50,92 @@ void Sky::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext, std::s
 	mesh->Draw();
 
 	// Resetting render states
-	deviceContext->RSSetState(nullptr);
-	deviceContext->OMSetDepthStencilState(nullptr, 0);
+	StateCache::GetInstance().RSSetState(nullptr);
+	StateCache::GetInstance().OMSetDepthStencilState(nullptr, 0);
 }
+
+// --------------------------------------------------------
+// Draws the sky from the center of the cube map into a
+// float render target once per face and copies each back,
+// so the result doesn't depend on the cube map's format.
+// Leaves no render target bound.
+// --------------------------------------------------------
+bool Sky::CaptureFaces(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext, unsigned int size, std::vector<XMFLOAT4> faces[6])
+{
+	D3D11_TEXTURE2D_DESC textureDesc = {};
+	textureDesc.Width = size;
+	textureDesc.Height = size;
+	textureDesc.MipLevels = 1;
+	textureDesc.ArraySize = 1;
+	textureDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT;
+	textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET;
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> target;
+	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> targetRTV;
+	if (FAILED(device->CreateTexture2D(&textureDesc, 0, target.GetAddressOf())) ||
+		FAILED(device->CreateRenderTargetView(target.Get(), 0, targetRTV.GetAddressOf())))
+		return false;
+
+	textureDesc.Usage = D3D11_USAGE_STAGING;
+	textureDesc.BindFlags = 0;
+	textureDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> staging;
+	if (FAILED(device->CreateTexture2D(&textureDesc, 0, staging.GetAddressOf())))
+		return false;
+
+	D3D11_VIEWPORT viewport = {};
+	viewport.Width = (float)size;
+	viewport.Height = (float)size;
+	viewport.MaxDepth = 1.0f;
+	deviceContext->RSSetViewports(1, &viewport);
+
+	StateCache::GetInstance().RSSetState(rasterizer.Get());
+	StateCache::GetInstance().OMSetDepthStencilState(depthStencilState.Get(), 0);
+	ps->SetShaderResourceView("SkyCubeMap", cubeMapSRV);
+	ps->SetSamplerState("SkySampler", sampler);
+
+	// Face order and orientation match D3D11's cube faces
+	static const XMFLOAT3 forwards[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	static const XMFLOAT3 ups[6] = { { 0, 1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 }, { 0, 1, 0 }, { 0, 1, 0 } };
+	XMFLOAT4X4 projection;
+	XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, 0.01f, 10.0f));
+
+	bool captured = true;
+	for (unsigned int face = 0; face < 6 && captured; face++)
+	{
+		XMFLOAT4X4 view;
+		XMStoreFloat4x4(&view, XMMatrixLookToLH(XMVectorZero(), XMLoadFloat3(&forwards[face]), XMLoadFloat3(&ups[face])));
+
+		const float black[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		deviceContext->ClearRenderTargetView(targetRTV.Get(), black);
+		StateCache::GetInstance().OMSetRenderTargets(1, targetRTV.GetAddressOf(), 0);
+
+		vs->SetMatrix4x4("view", view);
+		vs->SetMatrix4x4("projection", projection);
+		vs->CopyAllBufferData();
+		vs->SetShader();
+		ps->SetShader();
+		mesh->Draw();
+
+		deviceContext->CopyResource(staging.Get(), target.Get());
+		D3D11_MAPPED_SUBRESOURCE mapped = {};
+		if (FAILED(deviceContext->Map(staging.Get(), 0, D3D11_MAP_READ, 0, &mapped)))
+		{
+			captured = false;
+			break;
+		}
+
+		faces[face].resize((size_t)size * size);
+		for (unsigned int row = 0; row < size; row++)
+			memcpy(&faces[face][(size_t)row * size], (const char*)mapped.pData + (size_t)row * mapped.RowPitch, size * sizeof(XMFLOAT4));
+		deviceContext->Unmap(staging.Get(), 0);
+	}
+
+	// Resetting render states
+	StateCache::GetInstance().OMSetRenderTargets(0, 0, 0);
+	StateCache::GetInstance().RSSetState(nullptr);
+	StateCache::GetInstance().OMSetDepthStencilState(nullptr, 0);
+	return captured;
+}
\ No newline at end of file
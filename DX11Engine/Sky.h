@@ -3,6 +3,7 @@
 #include <wrl/client.h> 
 #include <WICTextureLoader.h>
 #include <memory>
+#include <vector>
 
 #include "Mesh.h"
 #include "SimpleShader.h"
@@ -19,6 +20,9 @@ public:
 		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cubeMapTextureSRV);
 	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext, std::shared_ptr<Camera> camera);
 
+	// Reads the sky back as six float faces (see SphericalHarmonics.h)
+	bool CaptureFaces(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext, unsigned int size, std::vector<DirectX::XMFLOAT4> faces[6]);
+
 private:
 
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler;
@@ -0,0 +1,201 @@
+#include "SphericalHarmonics.h"
+#include "ThreadPool.h"
+
+#include <cmath>
+
+using namespace DirectX;
+
+// Each face's center direction, then the directions u and v move along
+static const float FaceAxes[6][3][3] =
+{
+	{ {  1,  0,  0 }, {  0,  0, -1 }, {  0, -1,  0 } },		// +X
+	{ { -1,  0,  0 }, {  0,  0,  1 }, {  0, -1,  0 } },		// -X
+	{ {  0,  1,  0 }, {  1,  0,  0 }, {  0,  0,  1 } },		// +Y
+	{ {  0, -1,  0 }, {  1,  0,  0 }, {  0,  0, -1 } },		// -Y
+	{ {  0,  0,  1 }, {  1,  0,  0 }, {  0, -1,  0 } },		// +Z
+	{ {  0,  0, -1 }, { -1,  0,  0 }, {  0, -1,  0 } },		// -Z
+};
+
+// Basis function constants, see "An Efficient Representation for Irradiance Environment Maps"
+static const float Y0 = 0.282095f;
+static const float Y1 = 0.488603f;
+static const float Y2 = 1.092548f;
+static const float Y3 = 0.315392f;
+static const float Y4 = 0.546274f;
+
+// The same per-row sums ProjectCubeMap adds up, for one row
+struct RowSums
+{
+	float weight;
+	XMFLOAT3 coefficients[SphericalHarmonics::CoefficientCount];
+};
+
+XMFLOAT3 SphericalHarmonics::FaceDirection(unsigned int face, float u, float v)
+{
+	const float (*axes)[3] = FaceAxes[face];
+	float x = axes[0][0] + u * axes[1][0] + v * axes[2][0];
+	float y = axes[0][1] + u * axes[1][1] + v * axes[2][1];
+	float z = axes[0][2] + u * axes[1][2] + v * axes[2][2];
+	float invLength = 1.0f / sqrtf(x * x + y * y + z * z);
+	return XMFLOAT3(x * invLength, y * invLength, z * invLength);
+}
+
+// --------------------------------------------------------
+// Every row of every face is a job.  A texel at (u, v) on
+// a face one unit away covers a solid angle proportional
+// to (1 + u^2 + v^2)^(-3/2), and the weights are scaled to
+// total 4 pi at the end so the sphere is covered exactly.
+// --------------------------------------------------------
+void SphericalHarmonics::ProjectCubeMap(const std::vector<XMFLOAT4> faces[6], unsigned int size, XMFLOAT3 coefficients[CoefficientCount])
+{
+	std::vector<RowSums> rows(6 * size);
+	float texelSize = 2.0f / size;
+
+	ThreadPool::GetInstance().ParallelFor(6 * size, [&](unsigned int job)
+	{
+		unsigned int face = job / size;
+		unsigned int row = job % size;
+		const float (*axes)[3] = FaceAxes[face];
+		const XMFLOAT4* texels = &faces[face][(size_t)row * size];
+
+		float v = (row + 0.5f) * texelSize - 1.0f;
+		XMVECTOR vv = XMVectorReplicate(v);
+		XMVECTOR one = XMVectorReplicate(1.0f);
+
+		XMVECTOR weightSum = XMVectorZero();
+		XMVECTOR sums[CoefficientCount][3];
+		for (unsigned int c = 0; c < CoefficientCount; c++)
+			sums[c][0] = sums[c][1] = sums[c][2] = XMVectorZero();
+
+		for (unsigned int column = 0; column < size; column += 4)
+		{
+			// Four texels' coordinates and colors, padded lanes weigh nothing
+			XMFLOAT4 u, r, g, b, valid;
+			float* lanes[5] = { &u.x, &r.x, &g.x, &b.x, &valid.x };
+			for (unsigned int lane = 0; lane < 4; lane++)
+			{
+				unsigned int x = column + lane < size ? column + lane : size - 1;
+				lanes[0][lane] = (x + 0.5f) * texelSize - 1.0f;
+				lanes[1][lane] = texels[x].x;
+				lanes[2][lane] = texels[x].y;
+				lanes[3][lane] = texels[x].z;
+				lanes[4][lane] = column + lane < size ? 1.0f : 0.0f;
+			}
+			XMVECTOR uu = XMLoadFloat4(&u);
+
+			// Direction through each texel and its solid angle
+			XMVECTOR dx = XMVectorMultiplyAdd(uu, XMVectorReplicate(axes[1][0]), XMVectorReplicate(axes[0][0] + v * axes[2][0]));
+			XMVECTOR dy = XMVectorMultiplyAdd(uu, XMVectorReplicate(axes[1][1]), XMVectorReplicate(axes[0][1] + v * axes[2][1]));
+			XMVECTOR dz = XMVectorMultiplyAdd(uu, XMVectorReplicate(axes[1][2]), XMVectorReplicate(axes[0][2] + v * axes[2][2]));
+			XMVECTOR lengthSq = XMVectorAdd(one, XMVectorMultiplyAdd(uu, uu, XMVectorMultiply(vv, vv)));
+			XMVECTOR invLength = XMVectorDivide(one, XMVectorSqrt(lengthSq));
+			dx = XMVectorMultiply(dx, invLength);
+			dy = XMVectorMultiply(dy, invLength);
+			dz = XMVectorMultiply(dz, invLength);
+			XMVECTOR weight = XMVectorMultiply(XMLoadFloat4(&valid), XMVectorMultiply(invLength, XMVectorMultiply(invLength, invLength)));
+			weightSum = XMVectorAdd(weightSum, weight);
+
+			XMVECTOR basis[CoefficientCount] =
+			{
+				XMVectorReplicate(Y0),
+				XMVectorMultiply(XMVectorReplicate(Y1), dy),
+				XMVectorMultiply(XMVectorReplicate(Y1), dz),
+				XMVectorMultiply(XMVectorReplicate(Y1), dx),
+				XMVectorMultiply(XMVectorReplicate(Y2), XMVectorMultiply(dx, dy)),
+				XMVectorMultiply(XMVectorReplicate(Y2), XMVectorMultiply(dy, dz)),
+				XMVectorMultiply(XMVectorReplicate(Y3), XMVectorSubtract(XMVectorMultiply(XMVectorReplicate(3.0f), XMVectorMultiply(dz, dz)), one)),
+				XMVectorMultiply(XMVectorReplicate(Y2), XMVectorMultiply(dx, dz)),
+				XMVectorMultiply(XMVectorReplicate(Y4), XMVectorSubtract(XMVectorMultiply(dx, dx), XMVectorMultiply(dy, dy))),
+			};
+
+			XMVECTOR colors[3] =
+			{
+				XMVectorMultiply(XMLoadFloat4(&r), weight),
+				XMVectorMultiply(XMLoadFloat4(&g), weight),
+				XMVectorMultiply(XMLoadFloat4(&b), weight),
+			};
+			for (unsigned int c = 0; c < CoefficientCount; c++)
+			{
+				for (unsigned int channel = 0; channel < 3; channel++)
+					sums[c][channel] = XMVectorMultiplyAdd(basis[c], colors[channel], sums[c][channel]);
+			}
+		}
+
+		// Add the lanes together
+		RowSums& rowSums = rows[job];
+		XMFLOAT4 total;
+		XMStoreFloat4(&total, weightSum);
+		rowSums.weight = total.x + total.y + total.z + total.w;
+		for (unsigned int c = 0; c < CoefficientCount; c++)
+		{
+			float* channels = &rowSums.coefficients[c].x;
+			for (unsigned int channel = 0; channel < 3; channel++)
+			{
+				XMStoreFloat4(&total, sums[c][channel]);
+				channels[channel] = total.x + total.y + total.z + total.w;
+			}
+		}
+	});
+
+	// Rows in a fixed order, so the result doesn't depend on the threads
+	double weight = 0.0;
+	double totals[CoefficientCount][3] = {};
+	for (const RowSums& rowSums : rows)
+	{
+		weight += rowSums.weight;
+		for (unsigned int c = 0; c < CoefficientCount; c++)
+		{
+			totals[c][0] += rowSums.coefficients[c].x;
+			totals[c][1] += rowSums.coefficients[c].y;
+			totals[c][2] += rowSums.coefficients[c].z;
+		}
+	}
+
+	double scale = 4.0 * 3.14159265358979 / weight;
+	for (unsigned int c = 0; c < CoefficientCount; c++)
+		coefficients[c] = XMFLOAT3((float)(totals[c][0] * scale), (float)(totals[c][1] * scale), (float)(totals[c][2] * scale));
+}
+
+// --------------------------------------------------------
+// The cosine lobe's bands are pi, 2pi/3 and pi/4, and the
+// diffuse BRDF divides by pi
+// --------------------------------------------------------
+void SphericalHarmonics::ConvolveDiffuse(XMFLOAT3 coefficients[CoefficientCount])
+{
+	static const float bands[CoefficientCount] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+	for (unsigned int c = 0; c < CoefficientCount; c++)
+	{
+		coefficients[c].x *= bands[c];
+		coefficients[c].y *= bands[c];
+		coefficients[c].z *= bands[c];
+	}
+}
+
+// Must match SkyAmbient() in PixelShader.hlsl
+XMFLOAT3 SphericalHarmonics::Evaluate(const XMFLOAT3 coefficients[CoefficientCount], XMFLOAT3 d)
+{
+	float basis[CoefficientCount];
+	Basis(d, basis);
+
+	XMFLOAT3 result(0.0f, 0.0f, 0.0f);
+	for (unsigned int c = 0; c < CoefficientCount; c++)
+	{
+		result.x += coefficients[c].x * basis[c];
+		result.y += coefficients[c].y * basis[c];
+		result.z += coefficients[c].z * basis[c];
+	}
+	return result;
+}
+
+void SphericalHarmonics::Basis(XMFLOAT3 d, float basis[CoefficientCount])
+{
+	basis[0] = Y0;
+	basis[1] = Y1 * d.y;
+	basis[2] = Y1 * d.z;
+	basis[3] = Y1 * d.x;
+	basis[4] = Y2 * d.x * d.y;
+	basis[5] = Y2 * d.y * d.z;
+	basis[6] = Y3 * (3.0f * d.z * d.z - 1.0f);
+	basis[7] = Y2 * d.x * d.z;
+	basis[8] = Y4 * (d.x * d.x - d.y * d.y);
+}
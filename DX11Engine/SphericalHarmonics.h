@@ -0,0 +1,36 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+
+// --------------------------------------------------------
+// Order 2 (nine coefficient) spherical harmonics for a
+// cheap diffuse ambient from an environment.  A cube map is
+// projected once, each texel weighted by the solid angle it
+// covers, and the pixel shader rebuilds the light arriving
+// along a normal from the nine coefficients alone.
+//
+// Faces are in D3D11's order (+X, -X, +Y, -Y, +Z, -Z), each
+// size * size linear RGBA texels, rows top to bottom, read
+// back from the sky's cube map beforehand.
+// --------------------------------------------------------
+class SphericalHarmonics
+{
+public:
+	static const unsigned int CoefficientCount = 9;
+
+	// Projects the radiance in the faces, four texels at a time on the ThreadPool
+	static void ProjectCubeMap(const std::vector<DirectX::XMFLOAT4> faces[6], unsigned int size, DirectX::XMFLOAT3 coefficients[CoefficientCount]);
+
+	// Convolves radiance with the cosine lobe and divides by pi, so
+	// Evaluate() gives what a white diffuse surface reflects
+	static void ConvolveDiffuse(DirectX::XMFLOAT3 coefficients[CoefficientCount]);
+
+	static DirectX::XMFLOAT3 Evaluate(const DirectX::XMFLOAT3 coefficients[CoefficientCount], DirectX::XMFLOAT3 direction);
+
+	// Each basis function's value along a unit direction, for projecting samples
+	static void Basis(DirectX::XMFLOAT3 direction, float basis[CoefficientCount]);
+
+	// The unit direction through a face's texel coordinates (-1 to 1, v down)
+	static DirectX::XMFLOAT3 FaceDirection(unsigned int face, float u, float v);
+};
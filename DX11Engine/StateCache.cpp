@@ -0,0 +1,183 @@
+#include "StateCache.h"
+
+// Singleton requirement
+StateCache* StateCache::instance;
+
+// --------------------------------------------------------
+// Sets the context that calls are passed on to.  Nothing
+// is known about its state yet, so the cache starts empty.
+// --------------------------------------------------------
+void StateCache::Initialize(Microsoft::WRL::ComPtr<ID3D11DeviceContext> p_context)
+{
+	context = p_context;
+	context.As(&context1);
+	filter.Invalidate();
+}
+
+// --------------------------------------------------------
+// Forgets the cached state, so the next call to each
+// setter goes through to the context
+// --------------------------------------------------------
+void StateCache::Invalidate()
+{
+	filter.Invalidate();
+}
+
+// --------------------------------------------------------
+// Sets a shader on the given stage
+// --------------------------------------------------------
+void StateCache::SetShader(ShaderStage stage, ID3D11DeviceChild* shader)
+{
+	if (!filter.SetShader(stage, shader))
+		return;
+
+	switch (stage)
+	{
+	case ShaderStageVS: context->VSSetShader(static_cast<ID3D11VertexShader*>(shader), 0, 0); break;
+	case ShaderStageHS: context->HSSetShader(static_cast<ID3D11HullShader*>(shader), 0, 0); break;
+	case ShaderStageDS: context->DSSetShader(static_cast<ID3D11DomainShader*>(shader), 0, 0); break;
+	case ShaderStageGS: context->GSSetShader(static_cast<ID3D11GeometryShader*>(shader), 0, 0); break;
+	case ShaderStagePS: context->PSSetShader(static_cast<ID3D11PixelShader*>(shader), 0, 0); break;
+	case ShaderStageCS: context->CSSetShader(static_cast<ID3D11ComputeShader*>(shader), 0, 0); break;
+	}
+}
+
+// --------------------------------------------------------
+// Sets a range of shader resource views on the given stage
+// --------------------------------------------------------
+void StateCache::SetShaderResources(ShaderStage stage, UINT start, UINT count, ID3D11ShaderResourceView* const* views)
+{
+	UINT requestedStart = start;
+	if (!filter.SetShaderResources(stage, start, count, (const void* const*)views))
+		return;
+
+	// Only the changed part of the range is sent
+	views += start - requestedStart;
+	switch (stage)
+	{
+	case ShaderStageVS: context->VSSetShaderResources(start, count, views); break;
+	case ShaderStageHS: context->HSSetShaderResources(start, count, views); break;
+	case ShaderStageDS: context->DSSetShaderResources(start, count, views); break;
+	case ShaderStageGS: context->GSSetShaderResources(start, count, views); break;
+	case ShaderStagePS: context->PSSetShaderResources(start, count, views); break;
+	case ShaderStageCS: context->CSSetShaderResources(start, count, views); break;
+	}
+}
+
+// --------------------------------------------------------
+// Sets a range of samplers on the given stage
+// --------------------------------------------------------
+void StateCache::SetSamplers(ShaderStage stage, UINT start, UINT count, ID3D11SamplerState* const* samplers)
+{
+	UINT requestedStart = start;
+	if (!filter.SetSamplers(stage, start, count, (const void* const*)samplers))
+		return;
+
+	samplers += start - requestedStart;
+	switch (stage)
+	{
+	case ShaderStageVS: context->VSSetSamplers(start, count, samplers); break;
+	case ShaderStageHS: context->HSSetSamplers(start, count, samplers); break;
+	case ShaderStageDS: context->DSSetSamplers(start, count, samplers); break;
+	case ShaderStageGS: context->GSSetSamplers(start, count, samplers); break;
+	case ShaderStagePS: context->PSSetSamplers(start, count, samplers); break;
+	case ShaderStageCS: context->CSSetSamplers(start, count, samplers); break;
+	}
+}
+
+// --------------------------------------------------------
+// Binds whole constant buffers on the given stage
+// --------------------------------------------------------
+void StateCache::SetConstantBuffers(ShaderStage stage, UINT start, UINT count, ID3D11Buffer* const* buffers)
+{
+	UINT requestedStart = start;
+	if (!filter.SetConstantBuffers(stage, start, count, (const void* const*)buffers, 0, 0))
+		return;
+
+	buffers += start - requestedStart;
+	switch (stage)
+	{
+	case ShaderStageVS: context->VSSetConstantBuffers(start, count, buffers); break;
+	case ShaderStageHS: context->HSSetConstantBuffers(start, count, buffers); break;
+	case ShaderStageDS: context->DSSetConstantBuffers(start, count, buffers); break;
+	case ShaderStageGS: context->GSSetConstantBuffers(start, count, buffers); break;
+	case ShaderStagePS: context->PSSetConstantBuffers(start, count, buffers); break;
+	case ShaderStageCS: context->CSSetConstantBuffers(start, count, buffers); break;
+	}
+}
+
+// --------------------------------------------------------
+// Binds ranges of constant buffers on the given stage, which
+// requires Direct3D 11.1 (see ConstantBufferRing)
+// --------------------------------------------------------
+void StateCache::SetConstantBuffers1(ShaderStage stage, UINT start, UINT count, ID3D11Buffer* const* buffers, const UINT* firstConstants, const UINT* numConstants)
+{
+	UINT requestedStart = start;
+	if (!filter.SetConstantBuffers(stage, start, count, (const void* const*)buffers, firstConstants, numConstants))
+		return;
+
+	UINT skip = start - requestedStart;
+	buffers += skip;
+	firstConstants += skip;
+	numConstants += skip;
+	switch (stage)
+	{
+	case ShaderStageVS: context1->VSSetConstantBuffers1(start, count, buffers, firstConstants, numConstants); break;
+	case ShaderStageHS: context1->HSSetConstantBuffers1(start, count, buffers, firstConstants, numConstants); break;
+	case ShaderStageDS: context1->DSSetConstantBuffers1(start, count, buffers, firstConstants, numConstants); break;
+	case ShaderStageGS: context1->GSSetConstantBuffers1(start, count, buffers, firstConstants, numConstants); break;
+	case ShaderStagePS: context1->PSSetConstantBuffers1(start, count, buffers, firstConstants, numConstants); break;
+	case ShaderStageCS: context1->CSSetConstantBuffers1(start, count, buffers, firstConstants, numConstants); break;
+	}
+}
+
+void StateCache::IASetInputLayout(ID3D11InputLayout* layout)
+{
+	if (filter.SetInputLayout(layout))
+		context->IASetInputLayout(layout);
+}
+
+void StateCache::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	if (filter.SetPrimitiveTopology((unsigned int)topology))
+		context->IASetPrimitiveTopology(topology);
+}
+
+void StateCache::IASetVertexBuffers(UINT start, UINT count, ID3D11Buffer* const* buffers, const UINT* strides, const UINT* offsets)
+{
+	UINT requestedStart = start;
+	if (!filter.SetVertexBuffers(start, count, (const void* const*)buffers, strides, offsets))
+		return;
+
+	UINT skip = start - requestedStart;
+	context->IASetVertexBuffers(start, count, buffers + skip, strides + skip, offsets + skip);
+}
+
+void StateCache::IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset)
+{
+	if (filter.SetIndexBuffer(buffer, (unsigned int)format, offset))
+		context->IASetIndexBuffer(buffer, format, offset);
+}
+
+void StateCache::RSSetState(ID3D11RasterizerState* state)
+{
+	if (filter.SetRasterizerState(state))
+		context->RSSetState(state);
+}
+
+void StateCache::OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef)
+{
+	if (filter.SetDepthStencilState(state, stencilRef))
+		context->OMSetDepthStencilState(state, stencilRef);
+}
+
+// --------------------------------------------------------
+// Render targets aren't cached - they change rarely - but
+// Direct3D unbinds any shader resource that becomes a
+// target, so the cached resources can't be trusted after
+// --------------------------------------------------------
+void StateCache::OMSetRenderTargets(UINT count, ID3D11RenderTargetView* const* rtvs, ID3D11DepthStencilView* dsv)
+{
+	context->OMSetRenderTargets(count, rtvs, dsv);
+	filter.InvalidateShaderResources();
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <wrl/client.h>
+#include "StateFilter.h"
+
+// --------------------------------------------------------
+// Sits between the engine and the device context, dropping
+// calls that wouldn't change any state.  Engine code should
+// bind state through here rather than the context directly,
+// otherwise the cache falls out of date (call Invalidate()
+// after any direct use).
+// --------------------------------------------------------
+class StateCache
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static StateCache& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new StateCache();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	StateCache(StateCache const&) = delete;
+	void operator=(StateCache const&) = delete;
+
+private:
+	static StateCache* instance;
+	StateCache() {};
+#pragma endregion
+
+public:
+	void Initialize(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+	void Invalidate();
+
+	// Shader stages
+	void SetShader(ShaderStage stage, ID3D11DeviceChild* shader);
+	bool IsShaderSet(ShaderStage stage, ID3D11DeviceChild* shader) const { return filter.IsShaderSet(stage, shader); }
+	void SetShaderResources(ShaderStage stage, UINT start, UINT count, ID3D11ShaderResourceView* const* views);
+	void SetSamplers(ShaderStage stage, UINT start, UINT count, ID3D11SamplerState* const* samplers);
+	void SetConstantBuffers(ShaderStage stage, UINT start, UINT count, ID3D11Buffer* const* buffers);
+	void SetConstantBuffers1(ShaderStage stage, UINT start, UINT count, ID3D11Buffer* const* buffers, const UINT* firstConstants, const UINT* numConstants);
+
+	// Input assembler
+	void IASetInputLayout(ID3D11InputLayout* layout);
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+	void IASetVertexBuffers(UINT start, UINT count, ID3D11Buffer* const* buffers, const UINT* strides, const UINT* offsets);
+	void IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset);
+
+	// Rasterizer and output merger
+	void RSSetState(ID3D11RasterizerState* state);
+	void OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT stencilRef);
+	void OMSetRenderTargets(UINT count, ID3D11RenderTargetView* const* rtvs, ID3D11DepthStencilView* dsv);
+
+	StateFilter& GetFilter() { return filter; }
+
+private:
+	StateFilter filter;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> context1;	// Null before Direct3D 11.1
+};
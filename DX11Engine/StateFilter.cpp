@@ -0,0 +1,166 @@
+#include "StateFilter.h"
+#include "RenderStats.h"
+
+// Marks a slot as unknown.  No real object lives at this address, so
+// the first binding after an Invalidate() never looks redundant
+static const void* const UnknownObject = &UnknownObject;
+
+StateFilter::StateFilter()
+{
+	issuedCount = 0;
+	filteredCount = 0;
+	Invalidate();
+}
+
+// --------------------------------------------------------
+// Sets every slot to unknown
+// --------------------------------------------------------
+void StateFilter::Invalidate()
+{
+	Slot unknown = { UnknownObject, 0, 0 };
+
+	for (unsigned int s = 0; s < ShaderStageCount; s++)
+	{
+		shaders[s] = unknown;
+		for (unsigned int i = 0; i < MaxSamplers; i++) samplers[s][i] = unknown;
+		for (unsigned int i = 0; i < MaxConstantBuffers; i++) constantBuffers[s][i] = unknown;
+	}
+	InvalidateShaderResources();
+
+	inputLayout = unknown;
+	primitiveTopology = unknown;
+	for (unsigned int i = 0; i < MaxVertexBuffers; i++) vertexBuffers[i] = unknown;
+	indexBuffer = unknown;
+	rasterizerState = unknown;
+	depthStencilState = unknown;
+}
+
+// --------------------------------------------------------
+// Sets every shader resource slot to unknown
+// --------------------------------------------------------
+void StateFilter::InvalidateShaderResources()
+{
+	Slot unknown = { UnknownObject, 0, 0 };
+	for (unsigned int s = 0; s < ShaderStageCount; s++)
+		for (unsigned int i = 0; i < MaxShaderResources; i++)
+			shaderResources[s][i] = unknown;
+}
+
+bool StateFilter::SetShader(ShaderStage stage, const void* shader)
+{
+	return SetSingle(shaders[stage], shader, 0, 0);
+}
+
+bool StateFilter::SetShaderResources(ShaderStage stage, unsigned int& start, unsigned int& count, const void* const* views)
+{
+	return SetSlots(shaderResources[stage], MaxShaderResources, start, count, views, 0, 0);
+}
+
+bool StateFilter::SetSamplers(ShaderStage stage, unsigned int& start, unsigned int& count, const void* const* samplerStates)
+{
+	return SetSlots(samplers[stage], MaxSamplers, start, count, samplerStates, 0, 0);
+}
+
+bool StateFilter::SetConstantBuffers(ShaderStage stage, unsigned int& start, unsigned int& count, const void* const* buffers, const unsigned int* firstConstants, const unsigned int* numConstants)
+{
+	return SetSlots(constantBuffers[stage], MaxConstantBuffers, start, count, buffers, firstConstants, numConstants);
+}
+
+bool StateFilter::SetInputLayout(const void* layout)
+{
+	return SetSingle(inputLayout, layout, 0, 0);
+}
+
+bool StateFilter::SetPrimitiveTopology(unsigned int topology)
+{
+	// Topology isn't an object, so it lives in one of the numbers
+	return SetSingle(primitiveTopology, 0, topology, 0);
+}
+
+bool StateFilter::SetVertexBuffers(unsigned int& start, unsigned int& count, const void* const* buffers, const unsigned int* strides, const unsigned int* offsets)
+{
+	return SetSlots(vertexBuffers, MaxVertexBuffers, start, count, buffers, strides, offsets);
+}
+
+bool StateFilter::SetIndexBuffer(const void* buffer, unsigned int format, unsigned int offset)
+{
+	return SetSingle(indexBuffer, buffer, format, offset);
+}
+
+bool StateFilter::SetRasterizerState(const void* state)
+{
+	return SetSingle(rasterizerState, state, 0, 0);
+}
+
+bool StateFilter::SetDepthStencilState(const void* state, unsigned int stencilRef)
+{
+	return SetSingle(depthStencilState, state, stencilRef, 0);
+}
+
+// --------------------------------------------------------
+// Updates a range of slots, then narrows the range to the
+// first and last slots that actually changed.  Unchanged
+// slots in the middle are re-sent, which is harmless and
+// keeps it to a single call.
+//
+// a, b - optional per-slot numbers, treated as 0 when null
+// --------------------------------------------------------
+bool StateFilter::SetSlots(Slot* slots, unsigned int maxSlots, unsigned int& start, unsigned int& count, const void* const* objects, const unsigned int* a, const unsigned int* b)
+{
+	// Out of range calls are passed through untouched and Direct3D can report them
+	if (start >= maxSlots || count > maxSlots - start)
+		return Count(true);
+
+	unsigned int firstChanged = count;
+	unsigned int lastChanged = 0;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		Slot incoming = { objects ? objects[i] : 0, a ? a[i] : 0, b ? b[i] : 0 };
+		Slot& current = slots[start + i];
+		if (current.object != incoming.object || current.a != incoming.a || current.b != incoming.b)
+		{
+			if (firstChanged == count) firstChanged = i;
+			lastChanged = i;
+			current = incoming;
+		}
+	}
+
+	if (firstChanged == count)
+		return Count(false);
+
+	start += firstChanged;
+	count = lastChanged - firstChanged + 1;
+	return Count(true);
+}
+
+// --------------------------------------------------------
+// Updates a single slot
+// --------------------------------------------------------
+bool StateFilter::SetSingle(Slot& slot, const void* object, unsigned int a, unsigned int b)
+{
+	if (slot.object == object && slot.a == a && slot.b == b)
+		return Count(false);
+
+	slot = { object, a, b };
+	return Count(true);
+}
+
+// --------------------------------------------------------
+// Tallies a call as issued or filtered, and passes the
+// result back so setters can return it directly
+// --------------------------------------------------------
+bool StateFilter::Count(bool issued)
+{
+	FrameCounters& stats = RenderStats::GetInstance().GetCurrentFrame();
+	if (issued)
+	{
+		issuedCount++;
+		stats.stateCallsIssued++;
+	}
+	else
+	{
+		filteredCount++;
+		stats.stateCallsFiltered++;
+	}
+	return issued;
+}
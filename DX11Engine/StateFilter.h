@@ -0,0 +1,96 @@
+#pragma once
+
+// Shader stages, in the same order Direct3D numbers them
+enum ShaderStage
+{
+	ShaderStageVS,
+	ShaderStageHS,
+	ShaderStageDS,
+	ShaderStageGS,
+	ShaderStagePS,
+	ShaderStageCS,
+	ShaderStageCount
+};
+
+// --------------------------------------------------------
+// Remembers what is bound to each pipeline stage and slot,
+// and decides whether a new binding would change anything.
+//
+// Objects are compared by address only, so this class has
+// no knowledge of Direct3D (see StateCache for the part
+// that talks to the device context).  Every Set method
+// returns true when the call still needs to be issued.
+// Range setters also narrow start/count to just the slots
+// that changed.
+// --------------------------------------------------------
+class StateFilter
+{
+public:
+	// Slot counts match the Direct3D 11 limits
+	static const unsigned int MaxShaderResources = 128;
+	static const unsigned int MaxSamplers = 16;
+	static const unsigned int MaxConstantBuffers = 14;
+	static const unsigned int MaxVertexBuffers = 32;
+
+	StateFilter();
+
+	// Forgets all state, so the next call to each setter is
+	// issued.  Use after anything changes state behind our back.
+	void Invalidate();
+
+	// Forgets shader resources only, since binding a resource
+	// as an output silently unbinds it as an input
+	void InvalidateShaderResources();
+
+	bool SetShader(ShaderStage stage, const void* shader);
+
+	// Whether shader is known to be the one set on the stage
+	bool IsShaderSet(ShaderStage stage, const void* shader) const { return shaders[stage].object == shader; }
+
+	bool SetShaderResources(ShaderStage stage, unsigned int& start, unsigned int& count, const void* const* views);
+	bool SetSamplers(ShaderStage stage, unsigned int& start, unsigned int& count, const void* const* samplers);
+
+	// firstConstants and numConstants may be null for whole buffers
+	bool SetConstantBuffers(ShaderStage stage, unsigned int& start, unsigned int& count, const void* const* buffers, const unsigned int* firstConstants, const unsigned int* numConstants);
+
+	bool SetInputLayout(const void* layout);
+	bool SetPrimitiveTopology(unsigned int topology);
+	bool SetVertexBuffers(unsigned int& start, unsigned int& count, const void* const* buffers, const unsigned int* strides, const unsigned int* offsets);
+	bool SetIndexBuffer(const void* buffer, unsigned int format, unsigned int offset);
+	bool SetRasterizerState(const void* state);
+	bool SetDepthStencilState(const void* state, unsigned int stencilRef);
+
+	// Totals since construction - RenderStats has per-frame counts
+	unsigned long long GetIssuedCount() { return issuedCount; }
+	unsigned long long GetFilteredCount() { return filteredCount; }
+
+private:
+	// A slot holding an object plus up to two numbers (offsets, strides, etc.)
+	struct Slot
+	{
+		const void* object;
+		unsigned int a;
+		unsigned int b;
+	};
+
+	bool SetSlots(Slot* slots, unsigned int maxSlots, unsigned int& start, unsigned int& count, const void* const* objects, const unsigned int* a, const unsigned int* b);
+	bool SetSingle(Slot& slot, const void* object, unsigned int a, unsigned int b);
+	bool Count(bool issued);
+
+	// Per stage state
+	Slot shaders[ShaderStageCount];
+	Slot shaderResources[ShaderStageCount][MaxShaderResources];
+	Slot samplers[ShaderStageCount][MaxSamplers];
+	Slot constantBuffers[ShaderStageCount][MaxConstantBuffers];
+
+	// Fixed function state
+	Slot inputLayout;
+	Slot primitiveTopology;
+	Slot vertexBuffers[MaxVertexBuffers];
+	Slot indexBuffer;
+	Slot rasterizerState;
+	Slot depthStencilState;
+
+	unsigned long long issuedCount;
+	unsigned long long filteredCount;
+};
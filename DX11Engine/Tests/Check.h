@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdio>
+
+// --------------------------------------------------------
+// Just enough of a test harness for the headless tests.
+// CHECK reports a failed condition with its line and keeps
+// going, so one run shows every failure, and main() ends
+// with "return TestResult();" so ctest sees them.
+// --------------------------------------------------------
+inline int& TestFailures()
+{
+	static int failures = 0;
+	return failures;
+}
+
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			TestFailures()++; \
+		} \
+	} while (0)
+
+inline int TestResult()
+{
+	if (TestFailures() > 0)
+		printf("%d check(s) failed\n", TestFailures());
+	else
+		printf("All checks passed\n");
+	return TestFailures() > 0 ? 1 : 0;
+}
@@ -0,0 +1,259 @@
+#include "Check.h"
+#include "ClusterGrid.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+static const float XScale = 1.0f / (16.0f / 9.0f);
+static const float YScale = 1.0f;
+static const float NearClip = 0.1f;
+static const float FarClip = 200.0f;
+
+// A view space light somewhere in front of the camera, a spot in a
+// third of cases (some wider than 90 degrees), a point light otherwise
+static Cone RandomCone(std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> positive(0.0f, 1.0f);
+
+	float depth = powf(positive(rng), 2.0f) * 150.0f;
+	XMFLOAT3 apex(unit(rng) * depth / XScale, unit(rng) * depth / YScale, depth);
+	float range = 0.5f + positive(rng) * 12.0f;
+	if (positive(rng) < 0.67f)
+		return ConeCuller::MakeCone(apex, XMFLOAT3(0, 0, 1), XM_PI, range);
+
+	XMFLOAT3 direction;
+	XMStoreFloat3(&direction, XMVector3Normalize(XMVectorSet(unit(rng), unit(rng), unit(rng), 0)));
+	float halfAngle = 0.1f + positive(rng) * 1.9f;
+	return ConeCuller::MakeCone(apex, direction, halfAngle, range);
+}
+
+// How far into a box a sphere reaches, negative if it misses
+static float SphereBoxOverlap(const XMFLOAT4& sphere, const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax)
+{
+	float dx = std::max(0.0f, std::max(boundsMin.x - sphere.x, sphere.x - boundsMax.x));
+	float dy = std::max(0.0f, std::max(boundsMin.y - sphere.y, sphere.y - boundsMax.y));
+	float dz = std::max(0.0f, std::max(boundsMin.z - sphere.z, sphere.z - boundsMax.z));
+	return sphere.w - sqrtf(dx * dx + dy * dy + dz * dz);
+}
+
+// --------------------------------------------------------
+// Every cluster's list is checked against testing every
+// light against GetClusterBounds() one at a time: the range
+// sphere against the box, and for spot lights the cone too,
+// with ConeCuller's scalar test.  Lights within float noise
+// of a cluster's edge may go either way.
+// --------------------------------------------------------
+static unsigned int BruteForceMismatches(ClusterGrid& grid, const std::vector<Cone>& cones, const std::vector<unsigned int>& lightIndices, unsigned int& ambiguous)
+{
+	const std::vector<ClusterRange>& ranges = grid.GetRanges();
+	const std::vector<unsigned int>& indices = grid.GetLightIndices();
+	if (ranges.size() != ClusterGrid::ClusterCount)
+		return 1;
+
+	unsigned int mismatches = 0;
+	for (unsigned int slice = 0; slice < ClusterGrid::Slices; slice++)
+	{
+		for (unsigned int y = 0; y < ClusterGrid::TilesY; y++)
+		{
+			for (unsigned int x = 0; x < ClusterGrid::TilesX; x++)
+			{
+				XMFLOAT3 boundsMin, boundsMax;
+				grid.GetClusterBounds(x, y, slice, boundsMin, boundsMax);
+				BoundingBox box(
+					XMFLOAT3((boundsMin.x + boundsMax.x) * 0.5f, (boundsMin.y + boundsMax.y) * 0.5f, (boundsMin.z + boundsMax.z) * 0.5f),
+					XMFLOAT3((boundsMax.x - boundsMin.x) * 0.5f, (boundsMax.y - boundsMin.y) * 0.5f, (boundsMax.z - boundsMin.z) * 0.5f));
+
+				const ClusterRange& range = ranges[ClusterGrid::ClusterIndex(x, y, slice)];
+				std::vector<unsigned int> listed(indices.begin() + range.offset, indices.begin() + range.offset + range.count);
+
+				// Lists come out in the cones' order
+				mismatches += !std::is_sorted(listed.begin(), listed.end());
+
+				size_t next = 0;
+				for (unsigned int s = 0; s < cones.size(); s++)
+				{
+					bool found = next < listed.size() && listed[next] == lightIndices[s];
+					if (found)
+						next++;
+
+					float overlap = SphereBoxOverlap(cones[s].sphere, boundsMin, boundsMax);
+					if (fabsf(overlap) < 1e-4f * std::max(1.0f, boundsMax.z))
+					{
+						ambiguous++;
+						continue;
+					}
+
+					bool expected = overlap > 0.0f && (ConeCuller::IsSphere(cones[s]) || ConeCuller::IntersectsBox(cones[s], box));
+					mismatches += expected != found;
+				}
+				mismatches += next != listed.size();
+			}
+		}
+	}
+	return mismatches;
+}
+
+// Cluster bounds hold the view frustum's pieces, and slices tile the depth
+static void TestClusterBounds()
+{
+	ClusterGrid grid;
+	grid.SetProjection(XScale, YScale, NearClip, FarClip);
+	CHECK(fabsf(grid.GetSliceDepth(0) - NearClip) < 1e-6f);
+	CHECK(fabsf(grid.GetSliceDepth(ClusterGrid::Slices) - FarClip) < 1e-3f);
+
+	// Equal ratios between slices, so clusters stay roughly cube shaped
+	float ratio = grid.GetSliceDepth(1) / grid.GetSliceDepth(0);
+	for (unsigned int slice = 1; slice < ClusterGrid::Slices; slice++)
+		CHECK(fabsf(grid.GetSliceDepth(slice + 1) / grid.GetSliceDepth(slice) - ratio) < 1e-3f);
+
+	// Each cluster's frustum corners land inside its bounds
+	unsigned int outside = 0;
+	for (unsigned int slice = 0; slice < ClusterGrid::Slices; slice++)
+	{
+		for (unsigned int y = 0; y < ClusterGrid::TilesY; y++)
+		{
+			for (unsigned int x = 0; x < ClusterGrid::TilesX; x++)
+			{
+				XMFLOAT3 boundsMin, boundsMax;
+				grid.GetClusterBounds(x, y, slice, boundsMin, boundsMax);
+				for (unsigned int corner = 0; corner < 8; corner++)
+				{
+					float ndcX = 2.0f * (x + (corner & 1)) / ClusterGrid::TilesX - 1.0f;
+					float ndcY = 1.0f - 2.0f * (y + ((corner >> 1) & 1)) / ClusterGrid::TilesY;
+					float depth = grid.GetSliceDepth(slice + (corner >> 2));
+					float viewX = ndcX * depth / XScale, viewY = ndcY * depth / YScale;
+					outside +=
+						viewX < boundsMin.x - 1e-4f || viewX > boundsMax.x + 1e-4f ||
+						viewY < boundsMin.y - 1e-4f || viewY > boundsMax.y + 1e-4f ||
+						depth < boundsMin.z - 1e-4f || depth > boundsMax.z + 1e-4f;
+				}
+			}
+		}
+	}
+	CHECK(outside == 0);
+	CHECK(ClusterGrid::ClusterIndex(ClusterGrid::TilesX - 1, ClusterGrid::TilesY - 1, ClusterGrid::Slices - 1) == ClusterGrid::ClusterCount - 1);
+}
+
+// Build() matches brute force, for point and spot lights
+static void TestBuildAgainstBruteForce()
+{
+	std::mt19937 rng(41);
+	std::vector<Cone> cones;
+	std::vector<unsigned int> lightIndices;
+	for (unsigned int i = 0; i < 400; i++)
+	{
+		cones.push_back(RandomCone(rng));
+		lightIndices.push_back(i * 3 + 1);
+	}
+
+	ClusterGrid grid;
+	grid.SetProjection(XScale, YScale, NearClip, FarClip);
+	grid.Build(cones, lightIndices);
+
+	unsigned int ambiguous = 0;
+	CHECK(BruteForceMismatches(grid, cones, lightIndices, ambiguous) == 0);
+	CHECK(!grid.GetLightIndices().empty());
+
+	// Nothing at all
+	grid.Build(std::vector<Cone>(), std::vector<unsigned int>());
+	CHECK(grid.GetRanges().size() == ClusterGrid::ClusterCount);
+	CHECK(grid.GetLightIndices().empty());
+}
+
+// --------------------------------------------------------
+// Over many frames some lights move, some leave the list and
+// some come back.  After each Update() the ranges and index
+// list must be exactly what a fresh Build() makes, and only
+// the changed lights may have been binned.
+// --------------------------------------------------------
+static void TestUpdateMatchesBuild()
+{
+	const unsigned int lightCount = 1000;
+	std::mt19937 rng(410);
+	std::uniform_int_distribution<unsigned int> pick(0, lightCount - 1);
+
+	std::vector<Cone> allCones(lightCount);
+	std::vector<unsigned char> present(lightCount, 1);
+	for (Cone& cone : allCones)
+		cone = RandomCone(rng);
+
+	auto gather = [&](std::vector<Cone>& cones, std::vector<unsigned int>& lightIndices)
+	{
+		cones.clear();
+		lightIndices.clear();
+		for (unsigned int i = 0; i < lightCount; i++)
+		{
+			if (present[i])
+			{
+				cones.push_back(allCones[i]);
+				lightIndices.push_back(i);
+			}
+		}
+	};
+
+	std::vector<Cone> cones;
+	std::vector<unsigned int> lightIndices;
+	gather(cones, lightIndices);
+
+	ClusterGrid updated;
+	updated.SetProjection(XScale, YScale, NearClip, FarClip);
+	CHECK(updated.Update(cones, lightIndices, std::vector<unsigned int>()) == cones.size());
+
+	unsigned int differences = 0, overBinned = 0, mismatches = 0, ambiguous = 0;
+	for (unsigned int frame = 0; frame < 40; frame++)
+	{
+		std::vector<unsigned int> changed;
+		unsigned int changeCount = frame % 10 == 9 ? 0 : 1 + rng() % 40;
+		for (unsigned int c = 0; c < changeCount; c++)
+		{
+			unsigned int light = pick(rng);
+			switch (rng() % 4)
+			{
+			case 0: present[light] = !present[light]; break;
+			default: allCones[light] = RandomCone(rng); break;
+			}
+			changed.push_back(light);
+		}
+		std::sort(changed.begin(), changed.end());
+		changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+
+		gather(cones, lightIndices);
+		unsigned int binned = updated.Update(cones, lightIndices, changed);
+
+		unsigned int expectedBinned = 0;
+		for (unsigned int light : changed)
+			expectedBinned += present[light];
+		overBinned += binned != expectedBinned;
+
+		ClusterGrid fresh;
+		fresh.SetProjection(XScale, YScale, NearClip, FarClip);
+		fresh.Build(cones, lightIndices);
+
+		const std::vector<ClusterRange>& a = updated.GetRanges();
+		const std::vector<ClusterRange>& b = fresh.GetRanges();
+		for (unsigned int c = 0; c < ClusterGrid::ClusterCount; c++)
+			differences += a[c].offset != b[c].offset || a[c].count != b[c].count;
+		differences += updated.GetLightIndices() != fresh.GetLightIndices();
+
+		if (frame % 8 == 0)
+			mismatches += BruteForceMismatches(updated, cones, lightIndices, ambiguous);
+	}
+
+	CHECK(differences == 0);
+	CHECK(overBinned == 0);
+	CHECK(mismatches == 0);
+}
+
+int main()
+{
+	TestClusterBounds();
+	TestBuildAgainstBruteForce();
+	TestUpdateMatchesBuild();
+	return TestResult();
+}
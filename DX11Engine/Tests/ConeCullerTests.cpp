@@ -0,0 +1,326 @@
+#include "Check.h"
+#include "ConeCuller.h"
+#include "FrustumCuller.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+// Half angles from a sliver to past a hemisphere, and point lights
+static const float HalfAngles[] = { 0.05f, 0.3f, 0.785f, 1.2f, 1.5707964f, 1.9f, 2.6f, 3.1f, XM_PI };
+
+static XMFLOAT3 RandomDirection(std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	XMFLOAT3 direction;
+	XMStoreFloat3(&direction, XMVector3Normalize(XMVectorSet(unit(rng), unit(rng), unit(rng) + 0.001f, 0)));
+	return direction;
+}
+
+// --------------------------------------------------------
+// Boxes around a cone: anywhere near it, straddling its
+// apex, and behind it along its axis, where only cones
+// wider than 90 degrees reach
+// --------------------------------------------------------
+static std::vector<BoundingBox> BoxesAround(const Cone& cone, unsigned int count, std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> extent(0.05f, 2.0f);
+
+	std::vector<BoundingBox> boxes(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		XMFLOAT3 center;
+		switch (i % 3)
+		{
+		case 0:
+			center = XMFLOAT3(cone.apex.x + unit(rng) * cone.range * 1.5f, cone.apex.y + unit(rng) * cone.range * 1.5f, cone.apex.z + unit(rng) * cone.range * 1.5f);
+			break;
+		case 1:
+			center = XMFLOAT3(cone.apex.x + unit(rng), cone.apex.y + unit(rng), cone.apex.z + unit(rng));
+			break;
+		default:
+		{
+			float behind = (0.2f + 0.8f * fabsf(unit(rng))) * cone.range;
+			center = XMFLOAT3(cone.apex.x - cone.direction.x * behind + unit(rng), cone.apex.y - cone.direction.y * behind + unit(rng), cone.apex.z - cone.direction.z * behind + unit(rng));
+			break;
+		}
+		}
+		boxes[i] = BoundingBox(center, XMFLOAT3(extent(rng), extent(rng), extent(rng)));
+	}
+	return boxes;
+}
+
+// Whether the scalar test goes both ways for a slightly bigger and smaller box
+static bool AmbiguousBox(const Cone& cone, const BoundingBox& box)
+{
+	float grow = 1e-4f * std::max(1.0f, cone.range);
+	BoundingBox bigger(box.Center, XMFLOAT3(box.Extents.x + grow, box.Extents.y + grow, box.Extents.z + grow));
+	BoundingBox smaller(box.Center, XMFLOAT3(std::max(box.Extents.x - grow, 0.0f), std::max(box.Extents.y - grow, 0.0f), std::max(box.Extents.z - grow, 0.0f)));
+	return ConeCuller::IntersectsBox(cone, bigger) != ConeCuller::IntersectsBox(cone, smaller);
+}
+
+// --------------------------------------------------------
+// IntersectBoxes() and CullBoxes() give what IntersectsBox()
+// gives each box alone, for every width of cone.  Box
+// counts that aren't multiples of four leave padded lanes
+// (repeating the last box) that must not be stored.  Only
+// boxes within float noise of touching may differ.
+// --------------------------------------------------------
+static void TestBoxesMatchScalar()
+{
+	std::mt19937 rng(49);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	unsigned int mismatches = 0, ambiguous = 0, hits = 0, tested = 0;
+	unsigned int behindHits[2] = { 0, 0 };
+	for (unsigned int c = 0; c < 900; c++)
+	{
+		float halfAngle = HalfAngles[c % (sizeof(HalfAngles) / sizeof(HalfAngles[0]))];
+		Cone cone = ConeCuller::MakeCone(XMFLOAT3(unit(rng) * 50.0f, unit(rng) * 50.0f, unit(rng) * 50.0f), RandomDirection(rng), halfAngle, 1.0f + fabsf(unit(rng)) * 15.0f);
+		CHECK(ConeCuller::IsSphere(cone) == (halfAngle >= XM_PI));
+
+		unsigned int count = 1 + c % 11;
+		std::vector<BoundingBox> boxes = BoxesAround(cone, count, rng);
+		std::vector<BoxLanes> lanes;
+		ConeCuller::PackBoxes(boxes, lanes);
+		CHECK(lanes.size() == (count + 3) / 4);
+
+		// Stale values past the end must be overwritten or dropped
+		std::vector<unsigned char> culled(count + 5, 7);
+		ConeCuller::CullBoxes(cone, lanes, count, culled);
+		CHECK(culled.size() == count);
+
+		for (unsigned int i = 0; i < count; i++)
+		{
+			uint32_t mask[4];
+			XMStoreInt4(mask, ConeCuller::IntersectBoxes(cone, lanes[i / 4]));
+			bool expected = ConeCuller::IntersectsBox(cone, boxes[i]);
+			bool lane = mask[i % 4] != 0;
+			tested++;
+			hits += expected;
+			if (i % 3 == 2)
+				behindHits[halfAngle > XM_PIDIV2] += expected;
+
+			if (lane != expected || (culled[i] != 0) != expected || culled[i] > 1)
+			{
+				if (AmbiguousBox(cone, boxes[i]))
+					ambiguous++;
+				else
+					mismatches++;
+			}
+		}
+	}
+	CHECK(mismatches == 0);
+	CHECK(ambiguous < tested / 1000);
+	CHECK(hits > tested / 10 && hits < tested);
+
+	// Behind the apex only the wide cones reach
+	CHECK(behindHits[1] > 0);
+	CHECK(behindHits[0] < behindHits[1]);
+}
+
+// --------------------------------------------------------
+// Point lights are tested as their range's sphere exactly,
+// and a narrow cone misses what's straight behind it while
+// one wide enough to wrap around to it doesn't
+// --------------------------------------------------------
+static void TestShapes()
+{
+	Cone point = ConeCuller::MakeCone(XMFLOAT3(0, 0, 0), XMFLOAT3(0, 0, 1), XM_PI, 5.0f);
+	CHECK(ConeCuller::IsSphere(point));
+	CHECK(point.sphere.x == 0.0f && point.sphere.y == 0.0f && point.sphere.z == 0.0f && point.sphere.w == 5.0f);
+
+	std::mt19937 rng(490);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	unsigned int wrong = 0;
+	for (unsigned int i = 0; i < 5000; i++)
+	{
+		BoundingBox box(XMFLOAT3(unit(rng) * 8.0f, unit(rng) * 8.0f, unit(rng) * 8.0f), XMFLOAT3(fabsf(unit(rng)), fabsf(unit(rng)), fabsf(unit(rng))));
+		float dx = std::max(0.0f, fabsf(box.Center.x) - box.Extents.x);
+		float dy = std::max(0.0f, fabsf(box.Center.y) - box.Extents.y);
+		float dz = std::max(0.0f, fabsf(box.Center.z) - box.Extents.z);
+		float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+		if (fabsf(distance - 5.0f) < 1e-4f)
+			continue;
+		wrong += ConeCuller::IntersectsBox(point, box) != (distance <= 5.0f);
+	}
+	CHECK(wrong == 0);
+
+	BoundingBox behind(XMFLOAT3(0, 0, -3), XMFLOAT3(0.5f, 0.5f, 0.5f));
+	CHECK(!ConeCuller::IntersectsBox(ConeCuller::MakeCone(XMFLOAT3(0, 0, 0), XMFLOAT3(0, 0, 1), 0.5f, 10.0f), behind));
+	CHECK(!ConeCuller::IntersectsBox(ConeCuller::MakeCone(XMFLOAT3(0, 0, 0), XMFLOAT3(0, 0, 1), 1.5f, 10.0f), behind));
+	CHECK(!ConeCuller::IntersectsBox(ConeCuller::MakeCone(XMFLOAT3(0, 0, 0), XMFLOAT3(0, 0, 1), 2.0f, 10.0f), behind));
+	CHECK(ConeCuller::IntersectsBox(ConeCuller::MakeCone(XMFLOAT3(0, 0, 0), XMFLOAT3(0, 0, 1), 2.9f, 10.0f), behind));
+	CHECK(!ConeCuller::IntersectsBox(ConeCuller::MakeCone(XMFLOAT3(0, 0, 0), XMFLOAT3(0, 0, 1), 2.9f, 2.0f), behind));
+	CHECK(ConeCuller::IntersectsBox(point, behind));
+
+	// A box around the apex touches any cone
+	BoundingBox apex(XMFLOAT3(0.1f, 0, 0), XMFLOAT3(0.2f, 0.2f, 0.2f));
+	for (float halfAngle : HalfAngles)
+		CHECK(ConeCuller::IntersectsBox(ConeCuller::MakeCone(XMFLOAT3(0, 0, 0), XMFLOAT3(0, 1, 0), halfAngle, 4.0f), apex));
+}
+
+// Random planes, or a camera's, facing inwards
+static void RandomPlanes(std::mt19937& rng, unsigned int set, XMFLOAT4 planes[6])
+{
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	if (set % 2 == 0)
+	{
+		XMVECTOR eye = XMVectorSet(unit(rng) * 20.0f, unit(rng) * 20.0f, unit(rng) * 20.0f, 0);
+		XMFLOAT3 look = RandomDirection(rng);
+		XMMATRIX view = XMMatrixLookToLH(eye, XMLoadFloat3(&look), fabsf(look.y) > 0.9f ? XMVectorSet(1, 0, 0, 0) : XMVectorSet(0, 1, 0, 0));
+		XMMATRIX projection = XMMatrixPerspectiveFovLH(0.5f + fabsf(unit(rng)), 1.0f + fabsf(unit(rng)), 0.1f, 30.0f + fabsf(unit(rng)) * 100.0f);
+		FrustumCuller::ExtractPlanes(view * projection, planes);
+		return;
+	}
+
+	for (unsigned int p = 0; p < 6; p++)
+	{
+		XMFLOAT3 normal = RandomDirection(rng);
+		planes[p] = XMFLOAT4(normal.x, normal.y, normal.z, unit(rng) * 10.0f);
+	}
+}
+
+// Whether the scalar test goes both ways with the planes nudged in and out
+static bool AmbiguousFrustum(const Cone& cone, const XMFLOAT4 planes[6])
+{
+	XMFLOAT4 nearer[6], further[6];
+	float nudge = 1e-4f * std::max(1.0f, std::max(cone.range, sqrtf(cone.apex.x * cone.apex.x + cone.apex.y * cone.apex.y + cone.apex.z * cone.apex.z)));
+	for (unsigned int p = 0; p < 6; p++)
+	{
+		nearer[p] = XMFLOAT4(planes[p].x, planes[p].y, planes[p].z, planes[p].w + nudge);
+		further[p] = XMFLOAT4(planes[p].x, planes[p].y, planes[p].z, planes[p].w - nudge);
+	}
+	return ConeCuller::IntersectsFrustum(cone, nearer) != ConeCuller::IntersectsFrustum(cone, further);
+}
+
+// --------------------------------------------------------
+// OutsideFrustum() on one to four cones (the rest of the
+// lanes repeating the last) and CullCones() on lists of
+// every length against IntersectsFrustum() one at a time
+// --------------------------------------------------------
+static void TestFrustumMatchesScalar()
+{
+	std::mt19937 rng(4900);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	unsigned int mismatches = 0, ambiguous = 0, visibleCount = 0, tested = 0;
+	for (unsigned int set = 0; set < 600; set++)
+	{
+		XMFLOAT4 planes[6];
+		RandomPlanes(rng, set, planes);
+
+		unsigned int count = 1 + set % 13;
+		std::vector<Cone> cones(count);
+		for (unsigned int c = 0; c < count; c++)
+		{
+			float halfAngle = HalfAngles[(set + c) % (sizeof(HalfAngles) / sizeof(HalfAngles[0]))];
+			cones[c] = ConeCuller::MakeCone(XMFLOAT3(unit(rng) * 60.0f, unit(rng) * 60.0f, unit(rng) * 60.0f), RandomDirection(rng), halfAngle, 1.0f + fabsf(unit(rng)) * 20.0f);
+		}
+
+		std::vector<unsigned char> visible(count + 3, 9);
+		ConeCuller::CullCones(cones, planes, visible);
+		CHECK(visible.size() == count);
+
+		for (unsigned int c = 0; c < count; c++)
+		{
+			// The cone's group of up to four, as CullCones() passes them
+			unsigned int first = c - c % 4;
+			uint32_t mask[4];
+			XMStoreInt4(mask, ConeCuller::OutsideFrustum(&cones[first], std::min(4u, count - first), planes));
+
+			bool expected = ConeCuller::IntersectsFrustum(cones[c], planes);
+			tested++;
+			visibleCount += expected;
+			if ((mask[c % 4] == 0) != expected || (visible[c] != 0) != expected || visible[c] > 1)
+			{
+				if (AmbiguousFrustum(cones[c], planes))
+					ambiguous++;
+				else
+					mismatches++;
+			}
+		}
+
+		// A single cone fills all four lanes with itself
+		uint32_t mask[4];
+		XMStoreInt4(mask, ConeCuller::OutsideFrustum(&cones[0], 1, planes));
+		CHECK(mask[0] == mask[1] && mask[1] == mask[2] && mask[2] == mask[3]);
+	}
+	CHECK(mismatches == 0);
+	CHECK(ambiguous < tested / 1000 + 1);
+	CHECK(visibleCount > tested / 20 && visibleCount < tested);
+}
+
+// --------------------------------------------------------
+// Culling is conservative: no point inside a cone lies in
+// a box it was said to miss, or outside a view that was
+// said to be clear of it
+// --------------------------------------------------------
+static void TestConservative()
+{
+	std::mt19937 rng(49000);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> positive(0.0f, 1.0f);
+
+	unsigned int missedPoints = 0;
+	for (unsigned int c = 0; c < 300; c++)
+	{
+		float halfAngle = HalfAngles[c % (sizeof(HalfAngles) / sizeof(HalfAngles[0]))];
+		Cone cone = ConeCuller::MakeCone(XMFLOAT3(0, 0, 0), RandomDirection(rng), halfAngle, 2.0f + positive(rng) * 8.0f);
+		std::vector<BoundingBox> boxes = BoxesAround(cone, 30, rng);
+		std::vector<BoxLanes> lanes;
+		std::vector<unsigned char> hits;
+		ConeCuller::PackBoxes(boxes, lanes);
+		ConeCuller::CullBoxes(cone, lanes, (unsigned int)boxes.size(), hits);
+
+		XMFLOAT4 planes[6];
+		RandomPlanes(rng, c, planes);
+		std::vector<unsigned char> visible;
+		ConeCuller::CullCones(std::vector<Cone>(1, cone), planes, visible);
+
+		// Points inside the cone
+		for (unsigned int s = 0; s < 400; s++)
+		{
+			XMFLOAT3 direction = RandomDirection(rng);
+			float along = direction.x * cone.direction.x + direction.y * cone.direction.y + direction.z * cone.direction.z;
+			if (along < cone.cosHalfAngle)
+				continue;
+			float distance = cbrtf(positive(rng)) * cone.range * 0.999f;
+			XMFLOAT3 point(direction.x * distance, direction.y * distance, direction.z * distance);
+
+			for (unsigned int b = 0; b < boxes.size(); b++)
+			{
+				if (hits[b])
+					continue;
+				const BoundingBox& box = boxes[b];
+				missedPoints +=
+					fabsf(point.x - box.Center.x) < box.Extents.x * 0.999f &&
+					fabsf(point.y - box.Center.y) < box.Extents.y * 0.999f &&
+					fabsf(point.z - box.Center.z) < box.Extents.z * 0.999f;
+			}
+
+			if (!visible[0])
+			{
+				bool inside = true;
+				for (unsigned int p = 0; p < 6; p++)
+					inside = inside && planes[p].x * point.x + planes[p].y * point.y + planes[p].z * point.z + planes[p].w > 1e-3f;
+				missedPoints += inside;
+			}
+		}
+	}
+	CHECK(missedPoints == 0);
+}
+
+int main()
+{
+	TestBoxesMatchScalar();
+	TestShapes();
+	TestFrustumMatchesScalar();
+	TestConservative();
+	return TestResult();
+}
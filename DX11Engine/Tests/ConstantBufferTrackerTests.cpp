@@ -0,0 +1,196 @@
+#include "Check.h"
+#include "ConstantBufferTracker.h"
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Stands in for the device context, recording each buffer update
+struct RecordingContext
+{
+	std::vector<unsigned char> gpuData;
+	unsigned int updateCount = 0;
+
+	void UpdateSubresource(const unsigned char* data, unsigned int size)
+	{
+		gpuData.assign(data, data + size);
+		updateCount++;
+	}
+};
+
+// A constant buffer as SimpleShader keeps one, uploaded the same way
+struct TestBuffer
+{
+	std::vector<unsigned char> localData;
+	ConstantBufferTracker tracker;
+	RecordingContext context;
+
+	explicit TestBuffer(unsigned int size) : localData(size, 0)
+	{
+		tracker.Init(size);
+	}
+
+	void Set(unsigned int offset, const void* data, unsigned int size)
+	{
+		memcpy(localData.data() + offset, data, size);
+		tracker.MarkDirty(offset, size);
+	}
+
+	void SetFloat(unsigned int offset, float value)
+	{
+		Set(offset, &value, sizeof(value));
+	}
+
+	// Returns true if the context saw an update
+	bool Upload()
+	{
+		if (!tracker.NeedsUpload(localData.data()))
+			return false;
+
+		context.UpdateSubresource(localData.data(), (unsigned int)localData.size());
+		tracker.FinishUpload(localData.data());
+		return true;
+	}
+
+	bool GpuMatches()
+	{
+		return context.gpuData == localData;
+	}
+};
+
+// The GPU copy starts out undefined, so the first upload always happens
+static void TestFirstUpload()
+{
+	TestBuffer buffer(64);
+	CHECK(buffer.tracker.IsDirty());
+	CHECK(buffer.tracker.GetDirtyStart() == 0);
+	CHECK(buffer.tracker.GetDirtyEnd() == 64);
+
+	// Zeros match the zeroed mirror, but there's been no upload yet
+	CHECK(buffer.Upload());
+	CHECK(buffer.GpuMatches());
+	CHECK(buffer.tracker.HasUploaded());
+	CHECK(!buffer.tracker.IsDirty());
+
+	// Nothing set since
+	CHECK(!buffer.Upload());
+	CHECK(buffer.context.updateCount == 1);
+}
+
+// The dirty range covers every byte set, and nothing else
+static void TestDirtyRange()
+{
+	TestBuffer buffer(128);
+	buffer.Upload();
+
+	buffer.SetFloat(64, 1.0f);
+	buffer.SetFloat(16, 2.0f);
+	CHECK(buffer.tracker.GetDirtyStart() == 16);
+	CHECK(buffer.tracker.GetDirtyEnd() == 68);
+
+	// Empty sets don't dirty anything
+	buffer.tracker.MarkDirty(100, 0);
+	CHECK(buffer.tracker.GetDirtyEnd() == 68);
+
+	CHECK(buffer.Upload());
+	CHECK(buffer.GpuMatches());
+	CHECK(!buffer.tracker.IsDirty());
+}
+
+// Writing the values the GPU already has is skipped and cleans the range
+static void TestSameValuesSkipped()
+{
+	TestBuffer buffer(64);
+	buffer.SetFloat(0, 3.0f);
+	buffer.SetFloat(32, 4.0f);
+	CHECK(buffer.Upload());
+
+	buffer.SetFloat(0, 3.0f);
+	buffer.SetFloat(32, 4.0f);
+	CHECK(buffer.tracker.IsDirty());
+	CHECK(!buffer.Upload());
+	CHECK(!buffer.tracker.IsDirty());
+	CHECK(buffer.context.updateCount == 1);
+
+	buffer.SetFloat(32, 5.0f);
+	CHECK(buffer.Upload());
+	CHECK(buffer.GpuMatches());
+	CHECK(buffer.context.updateCount == 2);
+}
+
+// Buffers that always change stop comparing, then retry after a while
+static void TestCompareBudgetAndRetry()
+{
+	TestBuffer buffer(64);
+	buffer.Upload();
+
+	float value = 1.0f;
+	for (int i = 0; i < ConstantBufferTracker::CompareBudgetMax; i++)
+	{
+		CHECK(buffer.tracker.IsComparing());
+		buffer.SetFloat(0, value++);
+		CHECK(buffer.Upload());
+	}
+	CHECK(!buffer.tracker.IsComparing());
+
+	// Without comparing, rewriting the same value still uploads
+	unsigned int before = buffer.context.updateCount;
+	for (int i = 1; i < ConstantBufferTracker::CompareRetryInterval; i++)
+	{
+		buffer.SetFloat(0, value);
+		CHECK(buffer.Upload());
+	}
+	CHECK(buffer.context.updateCount == before + ConstantBufferTracker::CompareRetryInterval - 1);
+	CHECK(buffer.GpuMatches());
+
+	// After the interval it compares again, finds nothing changed and
+	// gets its whole budget back
+	buffer.SetFloat(0, value);
+	CHECK(!buffer.Upload());
+	CHECK(buffer.tracker.IsComparing());
+	buffer.SetFloat(0, value);
+	CHECK(!buffer.Upload());
+}
+
+// Whatever the mix of changed and unchanged writes, after each upload
+// the GPU holds exactly the local data
+static void TestRandomWrites()
+{
+	const unsigned int size = 256;
+	TestBuffer buffer(size);
+	std::mt19937 rng(27);
+	std::uniform_int_distribution<unsigned int> slot(0, size / 4 - 1);
+	std::uniform_int_distribution<unsigned int> writes(0, 6);
+	std::uniform_int_distribution<unsigned int> coin(0, 3);
+
+	unsigned int mismatches = 0, skips = 0;
+	for (unsigned int frame = 0; frame < 10000; frame++)
+	{
+		unsigned int count = writes(rng);
+		for (unsigned int w = 0; w < count; w++)
+		{
+			unsigned int offset = slot(rng) * 4;
+			float current;
+			memcpy(&current, buffer.localData.data() + offset, sizeof(float));
+
+			// Often the same value again, as per-frame Set*() calls do
+			buffer.SetFloat(offset, coin(rng) == 0 ? current + 1.0f : current);
+		}
+
+		skips += !buffer.Upload();
+		mismatches += !buffer.GpuMatches();
+	}
+
+	CHECK(mismatches == 0);
+	CHECK(skips > 0);
+}
+
+int main()
+{
+	TestFirstUpload();
+	TestDirtyRange();
+	TestSameValuesSkipped();
+	TestCompareBudgetAndRetry();
+	TestRandomWrites();
+	return TestResult();
+}
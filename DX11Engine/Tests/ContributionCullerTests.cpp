@@ -0,0 +1,188 @@
+#include "Check.h"
+#include "ContributionCuller.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Reference for the perspective size: looks straight at the
+// sphere through a real projection and measures the height
+// of its silhouette in pixels, found by projecting points on
+// the tangent cone's circle of contact
+// --------------------------------------------------------
+static float ReferencePixels(float fovY, float viewportHeight, float distance, float radius)
+{
+	XMMATRIX projection = XMMatrixPerspectiveFovLH(fovY, 1.0f, 0.01f, 1000.0f);
+
+	// The circle where sight lines graze the sphere
+	double sinAngle = radius / distance;
+	double contactDistance = distance * (1.0 - sinAngle * sinAngle);
+	double contactRadius = distance * sinAngle * sqrt(1.0 - sinAngle * sinAngle);
+
+	XMFLOAT4 top, bottom;
+	XMStoreFloat4(&top, XMVector3Transform(XMVectorSet(0, (float)contactRadius, (float)contactDistance, 1), projection));
+	XMStoreFloat4(&bottom, XMVector3Transform(XMVectorSet(0, -(float)contactRadius, (float)contactDistance, 1), projection));
+	return (top.y / top.w - bottom.y / bottom.w) * 0.5f * viewportHeight;
+}
+
+// Perspective sizes match the silhouette, whatever the direction
+static void TestProjectedSizePerspective()
+{
+	const float fovY = XM_PIDIV4;
+	const float viewportHeight = 1080.0f;
+	ContributionCuller culler;
+	culler.SetPerspective(1.0f / tanf(fovY * 0.5f), viewportHeight, 2.0f);
+
+	std::mt19937 rng(36);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> radius(0.05f, 5.0f);
+	std::uniform_real_distribution<float> distance(6.0f, 500.0f);
+
+	float worstError = 0.0f;
+	for (int i = 0; i < 1000; i++)
+	{
+		float r = radius(rng), d = distance(rng);
+		XMFLOAT3 eye(unit(rng) * 100.0f, unit(rng) * 100.0f, unit(rng) * 100.0f);
+		XMFLOAT3 direction;
+		XMStoreFloat3(&direction, XMVector3Normalize(XMVectorSet(unit(rng), unit(rng), unit(rng), 0)));
+
+		BoundingSphere sphere(XMFLOAT3(eye.x + direction.x * d, eye.y + direction.y * d, eye.z + direction.z * d), r);
+		float size = culler.ProjectedSize(eye, sphere);
+		float reference = ReferencePixels(fovY, viewportHeight, d, r);
+		worstError = std::max(worstError, fabsf(size - reference) / reference);
+	}
+	CHECK(worstError < 1e-3f);
+
+	// Twice as far is (nearly) half the size
+	BoundingSphere sphere(XMFLOAT3(0, 0, 100), 1.0f);
+	float nearSize = culler.ProjectedSize(XMFLOAT3(0, 0, 0), sphere);
+	float farSize = culler.ProjectedSize(XMFLOAT3(0, 0, -100), sphere);
+	CHECK(fabsf(nearSize / farSize - 2.0f) < 1e-3f);
+
+	// From inside, it covers everything
+	CHECK(culler.ProjectedSize(XMFLOAT3(0, 0, 99.5f), sphere) == FLT_MAX);
+}
+
+// Orthographic sizes are in texels and don't depend on distance
+static void TestProjectedSizeOrthographic()
+{
+	ContributionCuller culler;
+	culler.SetOrthographic(64.0f, 2048, 1.0f);
+
+	BoundingSphere sphere(XMFLOAT3(10, 20, 30), 0.5f);
+	CHECK(fabsf(culler.ProjectedSize(XMFLOAT3(0, 0, 0), sphere) - 32.0f) < 1e-4f);
+	CHECK(fabsf(culler.ProjectedSize(XMFLOAT3(0, 0, -1000), sphere) - 32.0f) < 1e-4f);
+}
+
+// Hidden things need the threshold plus the band to come back, shown
+// things stay until they pass the plain threshold
+static void TestKeepHysteresis()
+{
+	ContributionCuller culler;
+	culler.SetOrthographic(1.0f, 1, 10.0f);
+	culler.SetHysteresis(0.2f);
+
+	// Size threshold is 10 when shown, 12 when hidden
+	CHECK(culler.Keep(10.0f, 0.0f, 0.0f, true));
+	CHECK(!culler.Keep(9.9f, 0.0f, 0.0f, true));
+	CHECK(!culler.Keep(11.9f, 0.0f, 0.0f, false));
+	CHECK(culler.Keep(12.0f, 0.0f, 0.0f, false));
+
+	// Draw distance is 100 for hidden things and 120 for shown ones
+	CHECK(culler.Keep(50.0f, 119.0f, 100.0f, true));
+	CHECK(!culler.Keep(50.0f, 121.0f, 100.0f, true));
+	CHECK(!culler.Keep(50.0f, 101.0f, 100.0f, false));
+	CHECK(culler.Keep(50.0f, 100.0f, 100.0f, false));
+
+	// No draw distance means any distance
+	CHECK(culler.Keep(50.0f, 1e9f, 0.0f, false));
+
+	// Big enough doesn't help past the draw distance
+	CHECK(!culler.Keep(FLT_MAX, 200.0f, 100.0f, true));
+}
+
+// --------------------------------------------------------
+// An entity sitting on the size threshold, jittering by
+// less than the band, changes state once and then holds,
+// while one without hysteresis flickers
+// --------------------------------------------------------
+static void TestNoFlicker()
+{
+	const float minPixels = 4.0f;
+	std::vector<BoundingSphere> spheres(1);
+	std::vector<float> drawDistances(1, 0.0f);
+
+	unsigned int changes[2] = { 0, 0 };
+	for (int band = 0; band < 2; band++)
+	{
+		ContributionCuller culler;
+		culler.SetPerspective(1.0f, 100.0f, minPixels);
+		culler.SetHysteresis(band ? 0.1f : 0.0f);
+
+		// Distance where the sphere covers exactly minPixels
+		float radius = 1.0f;
+		float onThreshold = sqrtf(powf(2.0f * radius * 50.0f / minPixels, 2.0f) + radius * radius);
+
+		bool wasVisible = true;
+		for (int frame = 0; frame < 200; frame++)
+		{
+			float jitter = (frame % 2 ? 1.0f : -1.0f) * 0.02f * onThreshold;
+			spheres[0] = BoundingSphere(XMFLOAT3(0, 0, onThreshold + jitter), radius);
+
+			std::vector<unsigned int> entities(1, 0);
+			culler.Cull(XMFLOAT3(0, 0, 0), spheres, drawDistances, entities);
+			bool visible = !entities.empty();
+			changes[band] += visible != wasVisible;
+			wasVisible = visible;
+		}
+	}
+
+	CHECK(changes[0] > 100);
+	CHECK(changes[1] == 1);
+}
+
+// Cull() compacts the list, keeps order, and remembers per entity index
+static void TestCull()
+{
+	ContributionCuller culler;
+	culler.SetOrthographic(10.0f, 100, 5.0f);
+	culler.SetHysteresis(0.5f);
+
+	// Radii 0.1 to 0.6 cover 2 to 12 texels
+	std::vector<BoundingSphere> spheres;
+	for (int i = 0; i < 6; i++)
+		spheres.push_back(BoundingSphere(XMFLOAT3(0, 0, 0), 0.1f * (i + 1)));
+	std::vector<float> drawDistances(6, 0.0f);
+
+	std::vector<unsigned int> entities = { 10, 11, 12, 13, 14, 15 };
+	culler.Cull(XMFLOAT3(0, 0, -1), spheres, drawDistances, entities);
+	CHECK(entities == std::vector<unsigned int>({ 12, 13, 14, 15 }));
+
+	// Entity 12 (6 texels) was shown, so it stays, but 11 (4 texels)
+	// grown to 6 isn't past 5 plus half
+	spheres[1].Radius = 0.3f;
+	entities = { 10, 11, 12, 13, 14, 15 };
+	culler.Cull(XMFLOAT3(0, 0, -1), spheres, drawDistances, entities);
+	CHECK(entities == std::vector<unsigned int>({ 12, 13, 14, 15 }));
+
+	// After Reset() everything starts out shown again
+	culler.Reset();
+	entities = { 10, 11, 12, 13, 14, 15 };
+	culler.Cull(XMFLOAT3(0, 0, -1), spheres, drawDistances, entities);
+	CHECK(entities == std::vector<unsigned int>({ 11, 12, 13, 14, 15 }));
+}
+
+int main()
+{
+	TestProjectedSizePerspective();
+	TestProjectedSizeOrthographic();
+	TestKeepHysteresis();
+	TestNoFlicker();
+	TestCull();
+	return TestResult();
+}
@@ -0,0 +1,301 @@
+#include "Check.h"
+#include "DynamicBVH.h"
+#include "FrustumCuller.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+// How close to a plane or sphere (in world units) a box may be before
+// float rounding could reasonably go either way
+static const float Tolerance = 1e-3f;
+
+typedef std::vector<unsigned int> Results;
+
+static float MinCorner(const BoundingBox& box, int axis) { return (&box.Center.x)[axis] - (&box.Extents.x)[axis]; }
+static float MaxCorner(const BoundingBox& box, int axis) { return (&box.Center.x)[axis] + (&box.Extents.x)[axis]; }
+
+// --------------------------------------------------------
+// Brute force references.  Each returns how far the box is
+// from the edge of the query, positive if it overlaps, so
+// callers can skip boxes too close to call.
+// --------------------------------------------------------
+static float BoxOverlap(const BoundingBox& box, const BoundingBox& query)
+{
+	float overlap = FLT_MAX;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		overlap = std::min(overlap, MaxCorner(box, axis) - MinCorner(query, axis));
+		overlap = std::min(overlap, MaxCorner(query, axis) - MinCorner(box, axis));
+	}
+	return overlap;
+}
+
+static float SphereOverlap(const BoundingBox& box, const BoundingSphere& sphere)
+{
+	float distanceSq = 0.0f;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float center = (&sphere.Center.x)[axis];
+		float outside = std::max(std::max(MinCorner(box, axis) - center, 0.0f), center - MaxCorner(box, axis));
+		distanceSq += outside * outside;
+	}
+	return sphere.Radius - sqrtf(distanceSq);
+}
+
+static float FrustumOverlap(const BoundingBox& box, const XMFLOAT4 planes[6])
+{
+	float overlap = FLT_MAX;
+	for (int p = 0; p < 6; p++)
+	{
+		const XMFLOAT4& plane = planes[p];
+		float distance = plane.x * box.Center.x + plane.y * box.Center.y + plane.z * box.Center.z + plane.w;
+		float radius = fabsf(plane.x) * box.Extents.x + fabsf(plane.y) * box.Extents.y + fabsf(plane.z) * box.Extents.z;
+		overlap = std::min(overlap, distance + radius);
+	}
+	return overlap;
+}
+
+// Distance along the ray to where it enters the box, or -1 for a miss
+static float RayEntry(const BoundingBox& box, const XMFLOAT3& origin, const XMFLOAT3& direction)
+{
+	double tMin = 0.0, tMax = DBL_MAX;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		double o = (&origin.x)[axis], d = (&direction.x)[axis];
+		double lo = MinCorner(box, axis), hi = MaxCorner(box, axis);
+		if (fabs(d) < 1e-12)
+		{
+			if (o < lo || o > hi)
+				return -1.0f;
+			continue;
+		}
+
+		double t1 = (lo - o) / d, t2 = (hi - o) / d;
+		tMin = std::max(tMin, std::min(t1, t2));
+		tMax = std::min(tMax, std::max(t1, t2));
+	}
+	return tMin <= tMax ? (float)tMin : -1.0f;
+}
+
+// Counts boxes that were sure to be in the results but weren't, or
+// sure to be out but were.  Results must be sorted.
+template <typename Overlap>
+static unsigned int Mismatches(const std::vector<BoundingBox>& boxes, const std::vector<unsigned char>& alive, const Results& results, Overlap overlap)
+{
+	unsigned int mismatches = 0;
+	for (unsigned int i = 0; i < boxes.size(); i++)
+	{
+		bool found = std::binary_search(results.begin(), results.end(), i);
+		float distance = alive[i] ? overlap(boxes[i]) : -FLT_MAX;
+		mismatches += (distance > Tolerance && !found) || (distance < -Tolerance && found);
+	}
+
+	// Nothing twice
+	mismatches += (unsigned int)(std::adjacent_find(results.begin(), results.end()) != results.end());
+	return mismatches;
+}
+
+static BoundingBox RandomBox(std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> extent(0.1f, 4.0f);
+	return BoundingBox(XMFLOAT3(position(rng), position(rng), position(rng)), XMFLOAT3(extent(rng), extent(rng), extent(rng)));
+}
+
+// --------------------------------------------------------
+// 100k entities moving, some far enough to be reinserted,
+// some removed and inserted again.  Every query type must
+// agree with brute force over the live boxes every frame.
+// Also times the queries against brute force.
+// --------------------------------------------------------
+static void TestAgainstBruteForce()
+{
+	const unsigned int entityCount = 100000;
+	const unsigned int frameCount = 12;
+	std::mt19937 rng(34);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::uniform_int_distribution<unsigned int> pick(0, entityCount - 1);
+
+	std::vector<BoundingBox> boxes(entityCount);
+	std::vector<int> proxies(entityCount);
+	std::vector<unsigned char> alive(entityCount, 1);
+
+	DynamicBVH bvh;
+	auto buildStart = std::chrono::high_resolution_clock::now();
+	for (unsigned int i = 0; i < entityCount; i++)
+	{
+		boxes[i] = RandomBox(rng);
+		proxies[i] = bvh.Insert(boxes[i], i);
+	}
+	auto buildEnd = std::chrono::high_resolution_clock::now();
+	double insertMs = std::chrono::duration<double, std::milli>(buildEnd - buildStart).count();
+
+	double bvhMs = 0.0, bruteMs = 0.0;
+	unsigned int boxMisses = 0, sphereMisses = 0, frustumMisses = 0, rayMisses = 0, reinserted = 0;
+	for (unsigned int frame = 0; frame < frameCount; frame++)
+	{
+		// Most movers jitter inside their fat box, some jump
+		for (unsigned int m = 0; m < 5000; m++)
+		{
+			unsigned int i = pick(rng);
+			if (!alive[i])
+				continue;
+
+			float step = m % 8 == 0 ? 20.0f : 0.02f;
+			boxes[i].Center.x += unit(rng) * step;
+			boxes[i].Center.y += unit(rng) * step;
+			boxes[i].Center.z += unit(rng) * step;
+			reinserted += bvh.Move(proxies[i], boxes[i]);
+		}
+
+		// Churn - removed entities come back later as new proxies
+		for (unsigned int c = 0; c < 200; c++)
+		{
+			unsigned int i = pick(rng);
+			if (alive[i])
+			{
+				bvh.Remove(proxies[i]);
+				alive[i] = 0;
+			}
+			else
+			{
+				boxes[i] = RandomBox(rng);
+				proxies[i] = bvh.Insert(boxes[i], i);
+				alive[i] = 1;
+			}
+		}
+		bvh.Update();
+		CHECK(bvh.GetLeafCount() == (unsigned int)std::count(alive.begin(), alive.end(), 1));
+
+		BoundingBox queryBox(XMFLOAT3(unit(rng) * 400.0f, unit(rng) * 400.0f, unit(rng) * 400.0f), XMFLOAT3(60.0f, 30.0f, 45.0f));
+		BoundingSphere querySphere(XMFLOAT3(unit(rng) * 400.0f, unit(rng) * 400.0f, unit(rng) * 400.0f), 50.0f);
+
+		XMVECTOR eye = XMVectorSet(unit(rng) * 300.0f, unit(rng) * 300.0f, unit(rng) * 300.0f, 0);
+		XMVECTOR forward = XMVectorSet(unit(rng), unit(rng) * 0.5f, unit(rng), 0);
+		XMMATRIX viewProjection = XMMatrixLookToLH(eye, forward, XMVectorSet(0, 1, 0, 0)) * XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 300.0f);
+		XMFLOAT4 planes[6];
+		FrustumCuller::ExtractPlanes(viewProjection, planes);
+
+		// Rays from outside the scene, aimed through it
+		XMFLOAT3 rayOrigin(-600.0f, unit(rng) * 400.0f, unit(rng) * 400.0f);
+		XMFLOAT3 rayDirection;
+		XMStoreFloat3(&rayDirection, XMVector3Normalize(XMVectorSet(1.0f, unit(rng) * 0.1f, unit(rng) * 0.1f, 0)));
+
+		Results boxResults, sphereResults, frustumResults;
+		unsigned int hitUserData = 0;
+		float hitDistance = 0.0f;
+		auto start = std::chrono::high_resolution_clock::now();
+		bvh.QueryBox(queryBox, boxResults);
+		bvh.QuerySphere(querySphere, sphereResults);
+		bvh.QueryFrustum(planes, frustumResults);
+		bool hit = bvh.RayCast(rayOrigin, rayDirection, 2000.0f, hitUserData, hitDistance);
+		auto middle = std::chrono::high_resolution_clock::now();
+
+		float nearest = FLT_MAX;
+		unsigned int bruteHits = 0;
+		for (unsigned int i = 0; i < entityCount; i++)
+		{
+			if (!alive[i])
+				continue;
+			bruteHits += BoxOverlap(boxes[i], queryBox) > 0.0f;
+			bruteHits += SphereOverlap(boxes[i], querySphere) > 0.0f;
+			bruteHits += FrustumOverlap(boxes[i], planes) > 0.0f;
+			float entry = RayEntry(boxes[i], rayOrigin, rayDirection);
+			if (entry >= 0.0f)
+				nearest = std::min(nearest, entry);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		bvhMs += std::chrono::duration<double, std::milli>(middle - start).count();
+		bruteMs += std::chrono::duration<double, std::milli>(end - middle).count();
+		CHECK(bruteHits > 0);
+
+		std::sort(boxResults.begin(), boxResults.end());
+		std::sort(sphereResults.begin(), sphereResults.end());
+		std::sort(frustumResults.begin(), frustumResults.end());
+		boxMisses += Mismatches(boxes, alive, boxResults, [&](const BoundingBox& b) { return BoxOverlap(b, queryBox); });
+		sphereMisses += Mismatches(boxes, alive, sphereResults, [&](const BoundingBox& b) { return SphereOverlap(b, querySphere); });
+		frustumMisses += Mismatches(boxes, alive, frustumResults, [&](const BoundingBox& b) { return FrustumOverlap(b, planes); });
+
+		// The hit must be a live box, entered where the ray says, and as close as any
+		if (hit != (nearest < FLT_MAX))
+			rayMisses++;
+		else if (hit)
+			rayMisses += hitUserData >= entityCount || !alive[hitUserData] ||
+				fabsf(hitDistance - nearest) > Tolerance ||
+				fabsf(RayEntry(boxes[hitUserData], rayOrigin, rayDirection) - hitDistance) > Tolerance;
+	}
+
+	printf("BVH over %u entities: insert %.1f ms, queries %.3f ms vs brute force %.3f ms per frame, height %d, %u reinserted\n",
+		entityCount, insertMs, bvhMs / frameCount, bruteMs / frameCount, bvh.GetHeight(), reinserted);
+
+	CHECK(boxMisses == 0);
+	CHECK(sphereMisses == 0);
+	CHECK(frustumMisses == 0);
+	CHECK(rayMisses == 0);
+	CHECK(reinserted > 0);
+
+	// Balanced, roughly log2 of the leaf count rather than anywhere near it
+	CHECK(bvh.GetHeight() < 40);
+}
+
+// Small moves stay inside the fat box, big ones reinsert
+static void TestFatMargin()
+{
+	DynamicBVH bvh(0.5f);
+	BoundingBox box(XMFLOAT3(0, 0, 0), XMFLOAT3(1, 1, 1));
+	int proxy = bvh.Insert(box, 7);
+	CHECK(bvh.GetUserData(proxy) == 7);
+
+	box.Center.x = 0.4f;
+	CHECK(!bvh.Move(proxy, box));
+
+	// Queries still see the real box, not the fat one
+	Results results;
+	bvh.QueryBox(BoundingBox(XMFLOAT3(-1.7f, 0, 0), XMFLOAT3(0.2f, 0.2f, 0.2f)), results);
+	CHECK(results.empty());
+	bvh.QueryBox(BoundingBox(XMFLOAT3(1.3f, 0, 0), XMFLOAT3(0.2f, 0.2f, 0.2f)), results);
+	CHECK(results == Results({ 7 }));
+
+	box.Center.x = 0.6f;
+	CHECK(bvh.Move(proxy, box));
+}
+
+// Removing everything leaves an empty tree that still answers queries
+static void TestEmpty()
+{
+	DynamicBVH bvh;
+	std::vector<int> proxies;
+	for (unsigned int i = 0; i < 50; i++)
+		proxies.push_back(bvh.Insert(BoundingBox(XMFLOAT3((float)i, 0, 0), XMFLOAT3(0.4f, 0.4f, 0.4f)), i));
+	for (int proxy : proxies)
+		bvh.Remove(proxy);
+
+	CHECK(bvh.GetLeafCount() == 0);
+	CHECK(bvh.GetHeight() == 0);
+
+	Results results;
+	bvh.QuerySphere(BoundingSphere(XMFLOAT3(0, 0, 0), 1000.0f), results);
+	CHECK(results.empty());
+
+	unsigned int hitUserData;
+	float hitDistance;
+	CHECK(!bvh.RayCast(XMFLOAT3(-10, 0, 0), XMFLOAT3(1, 0, 0), 100.0f, hitUserData, hitDistance));
+
+	// Freed nodes get reused
+	bvh.Insert(BoundingBox(XMFLOAT3(0, 0, 0), XMFLOAT3(1, 1, 1)), 3);
+	bvh.QuerySphere(BoundingSphere(XMFLOAT3(0, 0, 0), 1.0f), results);
+	CHECK(results == Results({ 3 }));
+}
+
+int main()
+{
+	TestAgainstBruteForce();
+	TestFatMargin();
+	TestEmpty();
+	return TestResult();
+}
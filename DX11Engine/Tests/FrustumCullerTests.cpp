@@ -0,0 +1,221 @@
+#include "Check.h"
+#include "FrustumCuller.h"
+
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+// How far from a plane (in clip space, relative to w) a box's nearest
+// corner must be for the brute force answer to count as certain
+static const double Ambiguity = 1e-5;
+
+enum Reference
+{
+	ReferenceInside,
+	ReferenceOutside,
+	ReferenceAmbiguous
+};
+
+// --------------------------------------------------------
+// Brute force reference: transforms all eight corners to
+// clip space in double precision, and calls the box outside
+// when every corner fails the same clip inequality
+// --------------------------------------------------------
+static Reference ReferenceTest(const BoundingBox& box, const XMFLOAT4X4& viewProjection)
+{
+	XMFLOAT3 corners[BoundingBox::CORNER_COUNT];
+	box.GetCorners(corners);
+
+	double clip[BoundingBox::CORNER_COUNT][4];
+	for (size_t c = 0; c < BoundingBox::CORNER_COUNT; c++)
+	{
+		double position[4] = { corners[c].x, corners[c].y, corners[c].z, 1.0 };
+		for (int j = 0; j < 4; j++)
+		{
+			clip[c][j] = 0.0;
+			for (int i = 0; i < 4; i++)
+				clip[c][j] += position[i] * viewProjection.m[i][j];
+		}
+	}
+
+	bool ambiguous = false;
+	for (int plane = 0; plane < 6; plane++)
+	{
+		double best = -DBL_MAX, scale = 1.0;
+		for (size_t c = 0; c < BoundingBox::CORNER_COUNT; c++)
+		{
+			const double* v = clip[c];
+			double inside = 0.0;
+			switch (plane)
+			{
+			case 0: inside = v[3] + v[0]; break;
+			case 1: inside = v[3] - v[0]; break;
+			case 2: inside = v[3] + v[1]; break;
+			case 3: inside = v[3] - v[1]; break;
+			case 4: inside = v[2]; break;
+			case 5: inside = v[3] - v[2]; break;
+			}
+			best = std::max(best, inside);
+			scale = std::max(scale, fabs(v[3]));
+		}
+
+		if (best < -Ambiguity * scale)
+			return ReferenceOutside;
+		if (best < Ambiguity * scale)
+			ambiguous = true;
+	}
+	return ambiguous ? ReferenceAmbiguous : ReferenceInside;
+}
+
+static std::vector<BoundingBox> RandomBoxes(unsigned int count, std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+	std::uniform_real_distribution<float> extent(0.1f, 8.0f);
+
+	std::vector<BoundingBox> boxes(count);
+	for (BoundingBox& box : boxes)
+		box = BoundingBox(XMFLOAT3(position(rng), position(rng), position(rng)), XMFLOAT3(extent(rng), extent(rng), extent(rng)));
+	return boxes;
+}
+
+static XMMATRIX CameraViewProjection(std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> position(-300.0f, 300.0f);
+	std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+
+	XMVECTOR eye = XMVectorSet(position(rng), position(rng), position(rng), 0);
+	XMVECTOR forward = XMVectorSet(direction(rng), direction(rng) * 0.5f, direction(rng), 0);
+	XMMATRIX view = XMMatrixLookToLH(eye, forward, XMVectorSet(0, 1, 0, 0));
+	XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 400.0f);
+	return view * projection;
+}
+
+// A directional light's shadow volume, as ShadowCascades builds them
+static XMMATRIX LightViewProjection(std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+
+	XMVECTOR forward = XMVectorSet(direction(rng), -1.0f, direction(rng), 0);
+	XMMATRIX view = XMMatrixLookToLH(XMVectorScale(XMVector3Normalize(forward), -300.0f), forward, XMVectorSet(0, 0, 1, 0));
+	XMMATRIX projection = XMMatrixOrthographicOffCenterLH(-120.0f, 80.0f, -60.0f, 150.0f, 1.0f, 700.0f);
+	return view * projection;
+}
+
+// --------------------------------------------------------
+// Every box the reference is sure about gets the same
+// answer, for camera frustums and orthographic volumes.
+// Also times the SIMD cull against the brute force one at
+// 100k boxes.
+// --------------------------------------------------------
+static void TestAgainstBruteForce()
+{
+	const unsigned int boxCount = 100000;
+	const unsigned int viewCount = 8;
+	std::mt19937 rng(33);
+	std::vector<BoundingBox> boxes = RandomBoxes(boxCount, rng);
+
+	FrustumCuller culler;
+	for (const BoundingBox& box : boxes)
+		culler.Add(box);
+	CHECK(culler.GetCount() == boxCount);
+
+	double simdMs = 0.0, bruteMs = 0.0;
+	unsigned int falseCulls = 0, falseKeeps = 0, ambiguous = 0, visibleTotal = 0;
+	for (unsigned int v = 0; v < viewCount * 2; v++)
+	{
+		XMMATRIX viewProjection = v < viewCount ? CameraViewProjection(rng) : LightViewProjection(rng);
+		XMFLOAT4X4 matrix;
+		XMStoreFloat4x4(&matrix, viewProjection);
+
+		std::vector<unsigned int> visible;
+		auto start = std::chrono::high_resolution_clock::now();
+		culler.Cull(viewProjection, visible);
+		auto middle = std::chrono::high_resolution_clock::now();
+
+		std::vector<Reference> reference(boxCount);
+		for (unsigned int i = 0; i < boxCount; i++)
+			reference[i] = ReferenceTest(boxes[i], matrix);
+		auto end = std::chrono::high_resolution_clock::now();
+		simdMs += std::chrono::duration<double, std::milli>(middle - start).count();
+		bruteMs += std::chrono::duration<double, std::milli>(end - middle).count();
+
+		// Indices come out in Add() order
+		std::vector<unsigned char> kept(boxCount, 0);
+		long long previous = -1;
+		for (unsigned int index : visible)
+		{
+			CHECK(index < boxCount && (long long)index > previous);
+			previous = index;
+			if (index < boxCount)
+				kept[index] = 1;
+		}
+
+		for (unsigned int i = 0; i < boxCount; i++)
+		{
+			falseCulls += reference[i] == ReferenceInside && !kept[i];
+			falseKeeps += reference[i] == ReferenceOutside && kept[i];
+			ambiguous += reference[i] == ReferenceAmbiguous;
+		}
+		visibleTotal += (unsigned int)visible.size();
+	}
+
+	printf("Frustum culling %u boxes: SIMD %.3f ms, brute force %.3f ms per view, %.1f visible, %u ambiguous\n",
+		boxCount, simdMs / (viewCount * 2), bruteMs / (viewCount * 2), (double)visibleTotal / (viewCount * 2), ambiguous);
+
+	CHECK(falseCulls == 0);
+	CHECK(falseKeeps == 0);
+	CHECK(visibleTotal > 0 && visibleTotal < boxCount * viewCount * 2);
+}
+
+// Padded lanes never show up, whatever the count
+static void TestPadding()
+{
+	for (unsigned int count = 0; count < 9; count++)
+	{
+		FrustumCuller culler;
+		for (unsigned int i = 0; i < count; i++)
+			culler.Add(BoundingBox(XMFLOAT3(0, 0, 10), XMFLOAT3(1, 1, 1)));
+
+		XMMATRIX viewProjection = XMMatrixPerspectiveFovLH(XM_PIDIV4, 1.0f, 0.1f, 100.0f);
+		std::vector<unsigned int> visible;
+		culler.Cull(viewProjection, visible);
+		CHECK(visible.size() == count);
+
+		// Adding after a cull (which pads the arrays) keeps the count right
+		culler.Add(BoundingBox(XMFLOAT3(0, 0, -10), XMFLOAT3(1, 1, 1)));
+		visible.clear();
+		culler.Cull(viewProjection, visible);
+		CHECK(visible.size() == count);
+		CHECK(culler.GetCount() == count + 1);
+	}
+}
+
+// Planes are unit length, face inward, and pass through the volume's corners
+static void TestExtractPlanes()
+{
+	XMMATRIX viewProjection = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 1.0f, 50.0f);
+	XMFLOAT4 planes[6];
+	FrustumCuller::ExtractPlanes(viewProjection, planes);
+
+	for (const XMFLOAT4& plane : planes)
+		CHECK(fabsf(sqrtf(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z) - 1.0f) < 1e-4f);
+
+	// A point down the middle is inside every plane
+	for (const XMFLOAT4& plane : planes)
+		CHECK(plane.z * 10.0f + plane.w > 0.0f);
+
+	// The near and far planes sit at their depths
+	CHECK(fabsf(planes[4].z * 1.0f + planes[4].w) < 1e-4f);
+	CHECK(fabsf(planes[5].z * 50.0f + planes[5].w) < 1e-3f);
+}
+
+int main()
+{
+	TestAgainstBruteForce();
+	TestPadding();
+	TestExtractPlanes();
+	return TestResult();
+}
@@ -0,0 +1,216 @@
+#include "Check.h"
+#include "IBLBaker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+using namespace DirectX;
+
+// Small enough to bake in a blink
+static IBLBakeSettings SmallSettings()
+{
+	IBLBakeSettings settings;
+	settings.specularSize = 16;
+	settings.specularMips = 5;
+	settings.specularSamples = 64;
+	settings.brdfSize = 32;
+	settings.brdfSamples = 128;
+	settings.skyGamma = 1.0f;
+	return settings;
+}
+
+static CubeFaces RandomSky(unsigned int size, unsigned int seed)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> radiance(0.0f, 4.0f);
+
+	CubeFaces sky;
+	sky.size = size;
+	for (std::vector<XMFLOAT4>& face : sky.faces)
+	{
+		face.resize(size * size);
+		for (XMFLOAT4& texel : face)
+			texel = XMFLOAT4(radiance(rng), radiance(rng), radiance(rng), 1.0f);
+	}
+	return sky;
+}
+
+// Largest difference between two cube maps' colors, or infinity if their sizes differ
+static float CubeDifference(const CubeFaces& a, const CubeFaces& b)
+{
+	if (a.size != b.size)
+		return INFINITY;
+
+	float worst = 0.0f;
+	for (unsigned int face = 0; face < 6; face++)
+	{
+		for (size_t t = 0; t < a.faces[face].size(); t++)
+		{
+			const XMFLOAT4& x = a.faces[face][t];
+			const XMFLOAT4& y = b.faces[face][t];
+			worst = std::max(worst, std::max(fabsf(x.x - y.x), std::max(fabsf(x.y - y.y), fabsf(x.z - y.z))));
+		}
+	}
+	return worst;
+}
+
+// A constant sky stays constant at every roughness, as every lobe averages the same light
+static void TestConstantSky()
+{
+	IBLBakeSettings settings = SmallSettings();
+	CubeFaces sky;
+	sky.size = 32;
+	for (std::vector<XMFLOAT4>& face : sky.faces)
+		face.assign(sky.size * sky.size, XMFLOAT4(0.25f, 1.0f, 3.0f, 1.0f));
+
+	std::vector<CubeFaces> mips;
+	unsigned long long samples = IBLBaker::PrefilterSpecular(sky, settings, mips);
+	CHECK(mips.size() == settings.specularMips);
+
+	unsigned long long texels = 0;
+	for (unsigned int mip = 0; mip < mips.size(); mip++)
+	{
+		CHECK(mips[mip].size == std::max(settings.specularSize >> mip, 1u));
+		CubeFaces expected = mips[mip];
+		for (std::vector<XMFLOAT4>& face : expected.faces)
+			std::fill(face.begin(), face.end(), XMFLOAT4(0.25f, 1.0f, 3.0f, 1.0f));
+		CHECK(CubeDifference(mips[mip], expected) < 1e-4f);
+		texels += 6ull * mips[mip].size * mips[mip].size;
+	}
+	CHECK(samples == texels * settings.specularSamples);
+}
+
+// --------------------------------------------------------
+// At roughness 0 the lobe is a mirror, so the top mip, at
+// the sky's own size, is the sky: every sample lands on the
+// texel's center
+// --------------------------------------------------------
+static void TestMirrorMip()
+{
+	IBLBakeSettings settings = SmallSettings();
+	CubeFaces sky = RandomSky(settings.specularSize, 45);
+
+	std::vector<CubeFaces> mips;
+	IBLBaker::PrefilterSpecular(sky, settings, mips);
+	CHECK(CubeDifference(mips[0], sky) < 1e-4f);
+
+	// Rougher mips blur more, so the colors spread less each mip down
+	float previousSpread = INFINITY;
+	for (const CubeFaces& mip : mips)
+	{
+		float low = INFINITY, high = -INFINITY;
+		for (const std::vector<XMFLOAT4>& face : mip.faces)
+		{
+			for (const XMFLOAT4& texel : face)
+			{
+				low = std::min(low, texel.x);
+				high = std::max(high, texel.x);
+			}
+		}
+		CHECK(high - low < previousSpread);
+		previousSpread = high - low;
+	}
+}
+
+// --------------------------------------------------------
+// The split sum's BRDF half: scale and bias to F0 never add
+// up to more than the light that comes in, and a smooth
+// surface seen head on reflects all of it with F0 alone
+// --------------------------------------------------------
+static void TestBRDF()
+{
+	IBLBakeSettings settings = SmallSettings();
+	std::vector<XMFLOAT2> lookup;
+	unsigned long long samples = IBLBaker::IntegrateBRDF(settings, lookup);
+	CHECK(lookup.size() == settings.brdfSize * settings.brdfSize);
+	CHECK(samples == (unsigned long long)settings.brdfSize * settings.brdfSize * settings.brdfSamples);
+
+	unsigned int outOfRange = 0;
+	for (const XMFLOAT2& texel : lookup)
+		outOfRange += !(texel.x >= 0.0f && texel.y >= 0.0f && texel.x + texel.y <= 1.0001f);
+	CHECK(outOfRange == 0);
+
+	// Rows go from smooth to rough, columns from grazing to head on
+	unsigned int size = settings.brdfSize;
+	const XMFLOAT2& smoothHeadOn = lookup[size - 1];
+	const XMFLOAT2& smoothGrazing = lookup[0];
+	const XMFLOAT2& roughHeadOn = lookup[(size - 1) * size + size - 1];
+	CHECK(smoothHeadOn.x > 0.99f && smoothHeadOn.y < 0.01f);
+
+	// Fresnel brings in the bias at grazing angles, and roughness loses light
+	CHECK(smoothGrazing.y > smoothHeadOn.y);
+	CHECK(roughHeadOn.x + roughHeadOn.y < smoothHeadOn.x + smoothHeadOn.y);
+}
+
+// Texels are independent and sampled in a fixed order, so bakes repeat exactly
+static void TestDeterminism()
+{
+	IBLBakeSettings settings = SmallSettings();
+	CubeFaces sky = RandomSky(32, 450);
+
+	std::vector<CubeFaces> first, second;
+	IBLBaker::PrefilterSpecular(sky, settings, first);
+	IBLBaker::PrefilterSpecular(sky, settings, second);
+	unsigned int differences = 0;
+	for (unsigned int mip = 0; mip < first.size(); mip++)
+	{
+		for (unsigned int face = 0; face < 6; face++)
+			differences += memcmp(first[mip].faces[face].data(), second[mip].faces[face].data(), first[mip].faces[face].size() * sizeof(XMFLOAT4)) != 0;
+	}
+	CHECK(differences == 0);
+
+	std::vector<XMFLOAT2> lookupA, lookupB;
+	IBLBaker::IntegrateBRDF(settings, lookupA);
+	IBLBaker::IntegrateBRDF(settings, lookupB);
+	CHECK(memcmp(lookupA.data(), lookupB.data(), lookupA.size() * sizeof(XMFLOAT2)) == 0);
+}
+
+// --------------------------------------------------------
+// BakeFiles() from a sky on disk, as BakeIBL runs it: the
+// specular file's top mip is what PrefilterSpecular() makes
+// of the linearized sky.  A missing sky fails cleanly.
+// --------------------------------------------------------
+static void TestBakeFiles()
+{
+	const char* skyPath = "IBLBakerTests_Sky.dds";
+	const char* specularPath = "IBLBakerTests_Specular.dds";
+	const char* brdfPath = "IBLBakerTests_BRDF.dds";
+
+	IBLBakeSettings settings = SmallSettings();
+	settings.skyGamma = 2.2f;
+	CubeFaces sky = RandomSky(32, 4500);
+	CHECK(DDSFile::WriteCubeMap(skyPath, std::vector<CubeFaces>(1, sky)));
+	CHECK(IBLBaker::BakeFiles(skyPath, specularPath, brdfPath, settings));
+
+	CubeFaces linearSky = sky;
+	for (std::vector<XMFLOAT4>& face : linearSky.faces)
+	{
+		for (XMFLOAT4& texel : face)
+			texel = XMFLOAT4(powf(texel.x, 2.2f), powf(texel.y, 2.2f), powf(texel.z, 2.2f), 1.0f);
+	}
+	std::vector<CubeFaces> mips;
+	IBLBaker::PrefilterSpecular(linearSky, settings, mips);
+
+	CubeFaces written;
+	CHECK(DDSFile::ReadCubeMap(specularPath, written));
+	CHECK(CubeDifference(written, mips[0]) == 0.0f);
+
+	CHECK(!IBLBaker::BakeFiles("IBLBakerTests_Missing.dds", specularPath, brdfPath, settings));
+
+	remove(skyPath);
+	remove(specularPath);
+	remove(brdfPath);
+}
+
+int main()
+{
+	TestConstantSky();
+	TestMirrorMip();
+	TestBRDF();
+	TestDeterminism();
+	TestBakeFiles();
+	return TestResult();
+}
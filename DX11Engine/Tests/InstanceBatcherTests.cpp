@@ -0,0 +1,147 @@
+#include "Check.h"
+#include "InstanceBatcher.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+// The batcher only compares addresses, so these never need to be real
+class Mesh {};
+class Material {};
+
+struct TestEntity
+{
+	unsigned int mesh;
+	unsigned int material;
+	float depth;
+};
+
+// Mixed mesh and material keys, added in random order, come out as one
+// batch per pair, in key order, with each batch front to back
+static void TestGrouping()
+{
+	const unsigned int meshCount = 3, materialCount = 4;
+	Mesh meshes[meshCount];
+	Material materials[materialCount];
+
+	std::mt19937 rng(29);
+	std::uniform_int_distribution<unsigned int> mesh(0, meshCount - 1);
+	std::uniform_int_distribution<unsigned int> material(0, materialCount - 1);
+	std::uniform_real_distribution<float> depth(0.0f, 1.0f);
+
+	std::vector<TestEntity> entities(500);
+	for (TestEntity& entity : entities)
+		entity = { mesh(rng), material(rng), depth(rng) };
+
+	InstanceBatcher batcher;
+	batcher.Begin();
+	for (unsigned int i = 0; i < entities.size(); i++)
+	{
+		const TestEntity& entity = entities[i];
+		unsigned long long key = RenderQueue::MakeKey(RenderPassOpaque, 0, entity.material, entity.mesh, entity.depth);
+		batcher.Add(key, &meshes[entity.mesh], &materials[entity.material], i);
+	}
+	batcher.Build();
+
+	const std::vector<InstanceBatch>& batches = batcher.GetBatches();
+	const std::vector<unsigned int>& order = batcher.GetInstanceOrder();
+	CHECK(order.size() == entities.size());
+
+	// Every entity shows up exactly once
+	std::vector<unsigned int> seen(entities.size(), 0);
+	for (unsigned int index : order)
+		if (index < seen.size())
+			seen[index]++;
+	CHECK(std::count(seen.begin(), seen.end(), 1u) == (long)entities.size());
+
+	std::vector<unsigned int> batchesPerPair(meshCount * materialCount, 0);
+	unsigned int nextInstance = 0;
+	unsigned long long lastState = 0;
+	for (const InstanceBatch& batch : batches)
+	{
+		unsigned int meshIndex = (unsigned int)(batch.mesh - meshes);
+		unsigned int materialIndex = (unsigned int)(batch.material - materials);
+		CHECK(meshIndex < meshCount && materialIndex < materialCount);
+		batchesPerPair[materialIndex * meshCount + meshIndex]++;
+
+		// Batches cover the instance order without gaps, in key order
+		CHECK(batch.firstInstance == nextInstance);
+		CHECK(batch.instanceCount > 0);
+		nextInstance += batch.instanceCount;
+
+		unsigned long long state = RenderQueue::GetStateBits(RenderQueue::MakeKey(RenderPassOpaque, 0, materialIndex, meshIndex, 0.0f));
+		CHECK(state >= lastState);
+		lastState = state;
+
+		float lastDepth = -1.0f;
+		for (unsigned int i = batch.firstInstance; i < batch.firstInstance + batch.instanceCount; i++)
+		{
+			const TestEntity& entity = entities[order[i]];
+			CHECK(entity.mesh == meshIndex);
+			CHECK(entity.material == materialIndex);
+			CHECK(entity.depth >= lastDepth);
+			lastDepth = entity.depth;
+		}
+	}
+	CHECK(nextInstance == entities.size());
+
+	// Each pair in use got exactly one batch
+	for (unsigned int count : batchesPerPair)
+		CHECK(count == 1);
+}
+
+// Pairs whose keys collide are still never drawn as one batch
+static void TestKeyCollisions()
+{
+	Mesh meshes[2];
+	Material material;
+
+	// Same key for both meshes, so they sort together but alternate
+	unsigned long long key = RenderQueue::MakeKey(RenderPassOpaque, 0, 0, 0, 0.5f);
+	InstanceBatcher batcher;
+	batcher.Begin();
+	for (unsigned int i = 0; i < 6; i++)
+		batcher.Add(key, &meshes[i % 2], &material, i);
+	batcher.Build();
+
+	const std::vector<InstanceBatch>& batches = batcher.GetBatches();
+	const std::vector<unsigned int>& order = batcher.GetInstanceOrder();
+	unsigned int total = 0;
+	for (const InstanceBatch& batch : batches)
+	{
+		for (unsigned int i = batch.firstInstance; i < batch.firstInstance + batch.instanceCount; i++)
+			CHECK(&meshes[order[i] % 2] == batch.mesh);
+		total += batch.instanceCount;
+	}
+	CHECK(total == 6);
+}
+
+// Begin() forgets the last frame
+static void TestBegin()
+{
+	Mesh mesh;
+	Material material;
+
+	InstanceBatcher batcher;
+	batcher.Begin();
+	batcher.Add(RenderQueue::MakeKey(RenderPassOpaque, 0, 0, 0, 0.1f), &mesh, &material, 7);
+	batcher.Build();
+	CHECK(batcher.GetBatches().size() == 1);
+
+	batcher.Begin();
+	CHECK(batcher.GetBatches().empty());
+	CHECK(batcher.GetInstanceOrder().empty());
+
+	batcher.Add(RenderQueue::MakeKey(RenderPassOpaque, 0, 0, 0, 0.2f), &mesh, &material, 3);
+	batcher.Build();
+	CHECK(batcher.GetBatches().size() == 1);
+	CHECK(batcher.GetInstanceOrder().size() == 1 && batcher.GetInstanceOrder()[0] == 3);
+}
+
+int main()
+{
+	TestGrouping();
+	TestKeyCollisions();
+	TestBegin();
+	return TestResult();
+}
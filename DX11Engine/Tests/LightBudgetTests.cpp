@@ -0,0 +1,344 @@
+#include "Check.h"
+#include "FrustumCuller.h"
+#include "LightBudget.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+static const float ProjectionScale = 1.0f / 0.41421356f;
+
+// A camera at the origin looking down +Z
+static void CameraPlanes(XMFLOAT4 planes[6])
+{
+	XMMATRIX view = XMMatrixLookToLH(XMVectorSet(0, 0, 0, 0), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0));
+	XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 200.0f);
+	FrustumCuller::ExtractPlanes(view * projection, planes);
+}
+
+static Light PointLight(XMFLOAT3 position, float range, float intensity)
+{
+	Light light = {};
+	light.Type = LIGHT_TYPE_POINT;
+	light.Position = position;
+	light.Range = range;
+	light.Intensity = intensity;
+	light.Color = XMFLOAT3(1, 1, 1);
+	return light;
+}
+
+// Points, spots of every width (some past 90 degrees) and the odd directional
+static std::vector<Light> RandomLights(unsigned int count, std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> positive(0.0f, 1.0f);
+
+	std::vector<Light> lights(count);
+	for (Light& light : lights)
+	{
+		light = PointLight(XMFLOAT3(unit(rng) * 120.0f, unit(rng) * 60.0f, unit(rng) * 150.0f), 0.5f + positive(rng) * 20.0f, positive(rng) * 3.0f);
+		light.Color = XMFLOAT3(positive(rng), positive(rng), positive(rng));
+
+		float kind = positive(rng);
+		if (kind < 0.4f)
+		{
+			light.Type = LIGHT_TYPE_SPOT;
+			XMStoreFloat3(&light.Direction, XMVector3Normalize(XMVectorSet(unit(rng), unit(rng), unit(rng), 0)));
+			light.SpotFalloff = 0.5f + positive(rng) * 60.0f;
+		}
+		else if (kind < 0.42f)
+		{
+			light.Type = LIGHT_TYPE_DIRECTIONAL;
+			light.Direction = XMFLOAT3(0, -1, 0);
+		}
+		else if (kind < 0.45f)
+		{
+			// Around the camera, so it's inside the range
+			light.Position = XMFLOAT3(unit(rng), unit(rng), unit(rng));
+		}
+	}
+	return lights;
+}
+
+// --------------------------------------------------------
+// Update() scores four lights at a time; every score must
+// be what Score() gives that light alone.  Counts that
+// leave 1, 2 and 3 lights in the last vector, and that
+// split across the ThreadPool's blocks, test the padding.
+// --------------------------------------------------------
+static void TestVectorScoresMatchScalar()
+{
+	XMFLOAT4 planes[6];
+	CameraPlanes(planes);
+	XMFLOAT3 eye(0, 0, 0);
+
+	std::mt19937 rng(47);
+	unsigned int counts[] = { 1, 2, 3, 5, 1023, 1025, 10000, 10001, 10002, 10003 };
+	for (unsigned int count : counts)
+	{
+		std::vector<Light> lights = RandomLights(count, rng);
+		LightBudget budget;
+		budget.Update(lights, eye, ProjectionScale, planes, 0.016f);
+
+		unsigned int mismatches = 0, culled = 0, directional = 0;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			float expected = LightBudget::Score(lights[i], eye, ProjectionScale, planes);
+			float actual = budget.GetScore(i);
+			mismatches += fabsf(actual - expected) > 1e-6f * std::max(expected, 1.0f);
+			culled += expected == 0.0f;
+			directional += expected == FLT_MAX;
+		}
+		CHECK(mismatches == 0);
+
+		// Nothing past the last light gets a score
+		CHECK(budget.GetScore(count) == 0.0f);
+
+		// Both culled and directional lights came up
+		if (count >= 1000)
+			CHECK(culled > 0 && directional > 0 && culled < count);
+	}
+}
+
+// Bigger on screen or brighter scores higher; directional lights always win
+static void TestScoreOrder()
+{
+	XMFLOAT4 planes[6];
+	CameraPlanes(planes);
+	XMFLOAT3 eye(0, 0, 0);
+
+	float nearScore = LightBudget::Score(PointLight(XMFLOAT3(0, 0, 20), 2.0f, 1.0f), eye, ProjectionScale, planes);
+	float farScore = LightBudget::Score(PointLight(XMFLOAT3(0, 0, 40), 2.0f, 1.0f), eye, ProjectionScale, planes);
+	float brightScore = LightBudget::Score(PointLight(XMFLOAT3(0, 0, 40), 2.0f, 2.0f), eye, ProjectionScale, planes);
+	CHECK(nearScore > farScore && farScore > 0.0f);
+	CHECK(fabsf(brightScore - 2.0f * farScore) < 1e-6f);
+
+	// Behind the camera, or standing inside the light
+	CHECK(LightBudget::Score(PointLight(XMFLOAT3(0, 0, -20), 2.0f, 1.0f), eye, ProjectionScale, planes) == 0.0f);
+	CHECK(fabsf(LightBudget::Score(PointLight(XMFLOAT3(0, 0, 1), 2.0f, 1.0f), eye, ProjectionScale, planes) - 1.0f) < 1e-6f);
+
+	Light sun = {};
+	sun.Type = LIGHT_TYPE_DIRECTIONAL;
+	CHECK(LightBudget::Score(sun, eye, ProjectionScale, planes) == FLT_MAX);
+}
+
+// --------------------------------------------------------
+// Two lights a budget of one, their scores within a percent
+// and trading the lead every frame.  With hysteresis the
+// first pick keeps the slot; without it the pick flips
+// every frame.
+// --------------------------------------------------------
+static void TestHysteresisHoldsCloseLights()
+{
+	XMFLOAT4 planes[6];
+	CameraPlanes(planes);
+	XMFLOAT3 eye(0, 0, 0);
+
+	unsigned int swaps[2] = { 0, 0 };
+	for (unsigned int withHysteresis = 0; withHysteresis < 2; withHysteresis++)
+	{
+		LightBudget budget;
+		budget.SetBudget(1, 0.0001f);
+		budget.SetHysteresis(withHysteresis ? 0.2f : 0.0f);
+
+		std::vector<Light> lights = { PointLight(XMFLOAT3(-3, 0, 30), 2.0f, 1.0f), PointLight(XMFLOAT3(3, 0, 30), 2.0f, 1.0f) };
+		unsigned int previous = 2;
+		for (unsigned int frame = 0; frame < 100; frame++)
+		{
+			lights[frame % 2].Intensity = 1.01f;
+			lights[1 - frame % 2].Intensity = 1.0f;
+			budget.Update(lights, eye, ProjectionScale, planes, 0.016f);
+
+			CHECK(budget.GetSelectedCount() == 1);
+			unsigned int pick = budget.IsSelected(0) ? 0 : 1;
+			swaps[withHysteresis] += frame > 0 && pick != previous;
+			previous = pick;
+		}
+	}
+	CHECK(swaps[0] == 99);
+	CHECK(swaps[1] == 0);
+
+	// A clear winner still takes over past the bonus
+	LightBudget budget;
+	budget.SetBudget(1, 0.0001f);
+	budget.SetHysteresis(0.2f);
+	std::vector<Light> lights = { PointLight(XMFLOAT3(-3, 0, 30), 2.0f, 1.0f), PointLight(XMFLOAT3(3, 0, 30), 2.0f, 1.0f) };
+	budget.Update(lights, eye, ProjectionScale, planes, 0.016f);
+	CHECK(budget.IsSelected(0));
+	lights[1].Intensity = 1.19f;
+	budget.Update(lights, eye, ProjectionScale, planes, 0.016f);
+	CHECK(budget.IsSelected(0));
+	lights[1].Intensity = 1.21f;
+	budget.Update(lights, eye, ProjectionScale, planes, 0.016f);
+	CHECK(budget.IsSelected(1) && !budget.IsSelected(0));
+}
+
+// --------------------------------------------------------
+// Fades move by deltaTime / fadeTime each update, stopping
+// at 0 and 1, and lights seen for the first time start
+// where they belong
+// --------------------------------------------------------
+static void TestFadeSteps()
+{
+	XMFLOAT4 planes[6];
+	CameraPlanes(planes);
+	XMFLOAT3 eye(0, 0, 0);
+
+	LightBudget budget;
+	budget.SetBudget(1, 0.0001f);
+	budget.SetFadeTime(0.5f);
+	budget.SetHysteresis(0.0f);
+
+	// Light 1 is brighter, so it's picked and starts fully in
+	std::vector<Light> lights = { PointLight(XMFLOAT3(-3, 0, 30), 2.0f, 1.0f), PointLight(XMFLOAT3(3, 0, 30), 2.0f, 2.0f) };
+	CHECK(budget.Update(lights, eye, ProjectionScale, planes, 0.1f));
+	CHECK(budget.GetFade(0) == 0.0f && budget.GetFade(1) == 1.0f);
+	CHECK(budget.GetActiveLights() == std::vector<unsigned int>({ 1 }));
+
+	// Nothing moves, nothing changes
+	CHECK(!budget.Update(lights, eye, ProjectionScale, planes, 0.1f));
+	CHECK(budget.GetFadeChanges().empty());
+
+	// Light 0 takes over: it fades in and light 1 out, a fifth a step
+	lights[0].Intensity = 3.0f;
+	float deltas[] = { 0.1f, 0.1f, 0.15f, 0.1f, 0.1f, 0.1f };
+	float expected = 0.0f;
+	for (float deltaTime : deltas)
+	{
+		bool moving = expected < 1.0f;
+		CHECK(budget.Update(lights, eye, ProjectionScale, planes, deltaTime) == moving);
+		CHECK(budget.GetFadeChanges() == (moving ? std::vector<unsigned int>({ 0, 1 }) : std::vector<unsigned int>()));
+
+		expected = std::min(expected + deltaTime / 0.5f, 1.0f);
+		CHECK(fabsf(budget.GetFade(0) - expected) < 1e-6f);
+		CHECK(fabsf(budget.GetFade(1) - (1.0f - expected)) < 1e-6f);
+
+		// Both are shaded while light 1 fades out
+		CHECK(budget.GetActiveLights() == (expected < 1.0f ? std::vector<unsigned int>({ 0, 1 }) : std::vector<unsigned int>({ 0 })));
+	}
+	CHECK(budget.GetFade(0) == 1.0f && budget.GetFade(1) == 0.0f);
+
+	// A light added later starts fully out, as it didn't make the cut
+	lights.push_back(PointLight(XMFLOAT3(0, 0, 30), 2.0f, 0.5f));
+	CHECK(budget.Update(lights, eye, ProjectionScale, planes, 0.1f));
+	CHECK(budget.GetFade(2) == 0.0f);
+
+	// No fade time switches at once
+	budget.SetFadeTime(0.0f);
+	lights[2].Intensity = 10.0f;
+	budget.Update(lights, eye, ProjectionScale, planes, 0.016f);
+	CHECK(budget.GetFade(2) == 1.0f && budget.GetFade(0) == 0.0f);
+
+	// After a reset everything starts where it belongs again
+	budget.SetFadeTime(0.5f);
+	budget.Reset();
+	lights[1].Intensity = 20.0f;
+	budget.Update(lights, eye, ProjectionScale, planes, 0.016f);
+	CHECK(budget.GetFade(1) == 1.0f && budget.GetFade(2) == 0.0f);
+}
+
+// The budget caps the selection, and scores under the minimum never make it
+static void TestBudgetLimits()
+{
+	XMFLOAT4 planes[6];
+	CameraPlanes(planes);
+	XMFLOAT3 eye(0, 0, 0);
+
+	std::mt19937 rng(470);
+	std::vector<Light> lights = RandomLights(5000, rng);
+	LightBudget budget;
+	budget.SetBudget(64, 0.001f);
+	budget.Update(lights, eye, ProjectionScale, planes, 0.016f);
+	CHECK(budget.GetSelectedCount() == 64);
+
+	// Every selected light scores at least as high as every one left out
+	float lowestSelected = FLT_MAX, highestDropped = 0.0f;
+	unsigned int selectedCount = 0;
+	for (unsigned int i = 0; i < lights.size(); i++)
+	{
+		if (budget.IsSelected(i))
+		{
+			lowestSelected = std::min(lowestSelected, budget.GetScore(i));
+			selectedCount++;
+		}
+		else
+		{
+			highestDropped = std::max(highestDropped, budget.GetScore(i));
+		}
+	}
+	CHECK(selectedCount == 64);
+	CHECK(lowestSelected >= highestDropped);
+	CHECK(lowestSelected >= 0.001f);
+
+	// Raising the minimum past every point and spot light leaves the directional ones
+	budget.SetBudget(64, 1e30f);
+	budget.Update(lights, eye, ProjectionScale, planes, 0.016f);
+	unsigned int directional = 0;
+	for (const Light& light : lights)
+		directional += light.Type == LIGHT_TYPE_DIRECTIONAL;
+	CHECK(budget.GetSelectedCount() == std::min(directional, 64u));
+}
+
+// --------------------------------------------------------
+// Times Update() on 1k and 10k lights against scoring each
+// light alone with Score(), which is all the sorting and
+// fading has to beat.  Each frame's scores must still match.
+// --------------------------------------------------------
+static void TestTiming()
+{
+	XMFLOAT4 planes[6];
+	CameraPlanes(planes);
+	XMFLOAT3 eye(0, 0, 0);
+	const unsigned int frameCount = 20;
+
+	std::mt19937 rng(4700);
+	unsigned int counts[] = { 1000, 10000 };
+	for (unsigned int count : counts)
+	{
+		std::vector<Light> lights = RandomLights(count, rng);
+		std::vector<float> scalar(count);
+		LightBudget budget;
+
+		double updateMs = 0.0, scalarMs = 0.0;
+		unsigned int mismatches = 0;
+		for (unsigned int f = 0; f < frameCount; f++)
+		{
+			// The lights drift a little each frame
+			for (Light& light : lights)
+				light.Position.x += 0.01f;
+
+			auto start = std::chrono::high_resolution_clock::now();
+			budget.Update(lights, eye, ProjectionScale, planes, 0.016f);
+			auto middle = std::chrono::high_resolution_clock::now();
+			for (unsigned int i = 0; i < count; i++)
+				scalar[i] = LightBudget::Score(lights[i], eye, ProjectionScale, planes);
+			auto end = std::chrono::high_resolution_clock::now();
+			updateMs += std::chrono::duration<double, std::milli>(middle - start).count();
+			scalarMs += std::chrono::duration<double, std::milli>(end - middle).count();
+
+			for (unsigned int i = 0; i < count; i++)
+				mismatches += fabsf(budget.GetScore(i) - scalar[i]) > 1e-6f * std::max(scalar[i], 1.0f);
+		}
+
+		printf("Light budget over %u lights: Update %.3f ms vs scalar scores %.3f ms per frame, %u selected\n",
+			count, updateMs / frameCount, scalarMs / frameCount, budget.GetSelectedCount());
+		CHECK(mismatches == 0);
+	}
+}
+
+int main()
+{
+	TestVectorScoresMatchScalar();
+	TestScoreOrder();
+	TestHysteresisHoldsCloseLights();
+	TestFadeSteps();
+	TestBudgetLimits();
+	TestTiming();
+	return TestResult();
+}
@@ -0,0 +1,347 @@
+#include "Check.h"
+#include "LightUploadQueue.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <vector>
+
+typedef std::vector<LightRange> Ranges;
+
+static bool operator==(const LightRange& a, const LightRange& b)
+{
+	return a.first == b.first && a.count == b.count;
+}
+
+static Light PointLight(float x, float intensity)
+{
+	Light light = {};
+	light.Type = LIGHT_TYPE_POINT;
+	light.Position = DirectX::XMFLOAT3(x, 0, 0);
+	light.Range = 5.0f;
+	light.Intensity = intensity;
+	light.Color = DirectX::XMFLOAT3(1, 1, 1);
+	return light;
+}
+
+// Flushes, recording what was written
+static Ranges FlushAll(LightUploadQueue& queue)
+{
+	Ranges written;
+	queue.Flush([&](const LightRange& range)
+	{
+		written.push_back(range);
+		return true;
+	});
+	return written;
+}
+
+// Queueing the manager's changes since a version, as Game does each frame
+static unsigned int QueueChanges(const LightManager& manager, unsigned int sinceVersion, LightUploadQueue& queue)
+{
+	Ranges changed;
+	manager.GetChangedRanges(sinceVersion, 0, changed);
+	for (const LightRange& range : changed)
+		queue.Queue(range);
+	return manager.GetVersion();
+}
+
+// Hand picked changes, and the ranges they should make
+static void TestScriptedFrames()
+{
+	LightManager manager;
+	std::vector<LightHandle> handles;
+	for (unsigned int i = 0; i < 32; i++)
+		handles.push_back(manager.Add(PointLight((float)i, 1.0f)));
+
+	LightUploadQueue queue(4);
+	CHECK(queue.GetMaxGap() == 4);
+
+	// The first frame uploads everything in one go
+	unsigned int seen = QueueChanges(manager, 0, queue);
+	CHECK(FlushAll(queue) == Ranges({ { 0, 32 } }));
+	CHECK(queue.IsEmpty());
+
+	// Nothing changed, nothing to write
+	seen = QueueChanges(manager, seen, queue);
+	CHECK(queue.IsEmpty());
+	CHECK(FlushAll(queue).empty());
+
+	// Setting a light to what it already is isn't a change
+	manager.Set(handles[5], PointLight(5.0f, 1.0f));
+	seen = QueueChanges(manager, seen, queue);
+	CHECK(queue.IsEmpty());
+
+	// Three unchanged lights between 3 and 7 are taken along, five
+	// between 8 and 14 are more than the four allowed
+	manager.Set(handles[3], PointLight(3.0f, 2.0f));
+	manager.Set(handles[7], PointLight(7.0f, 2.0f));
+	manager.Set(handles[8], PointLight(8.0f, 2.0f));
+	manager.Set(handles[14], PointLight(14.0f, 2.0f));
+	seen = QueueChanges(manager, seen, queue);
+	CHECK(FlushAll(queue) == Ranges({ { 3, 6 }, { 14, 1 } }));
+
+	// Single lights queued out of order and twice, like fade changes
+	// landing on lights the manager also reports, come out merged
+	manager.Set(handles[20], PointLight(20.0f, 3.0f));
+	seen = QueueChanges(manager, seen, queue);
+	queue.Queue(31);
+	queue.Queue(20);
+	queue.Queue(21);
+	queue.Queue(0);
+	CHECK(FlushAll(queue) == Ranges({ { 0, 1 }, { 20, 2 }, { 31, 1 } }));
+
+	// A removed light's slot is uploaded (as an unlit light), and the
+	// light added next reuses the slot
+	manager.Remove(handles[10]);
+	seen = QueueChanges(manager, seen, queue);
+	CHECK(FlushAll(queue) == Ranges({ { 10, 1 } }));
+	handles[10] = manager.Add(PointLight(10.0f, 4.0f));
+	CHECK(handles[10].index == 10);
+	handles.push_back(manager.Add(PointLight(32.0f, 1.0f)));
+	seen = QueueChanges(manager, seen, queue);
+	CHECK(FlushAll(queue) == Ranges({ { 10, 1 }, { 32, 1 } }));
+}
+
+// --------------------------------------------------------
+// maxGap counts the unchanged lights a join may take in:
+// with 0 only neighbours join, with 1 one light between, and
+// with maxGap exactly maxGap but not one more.  The manager
+// and MergeRanges() must agree.
+// --------------------------------------------------------
+static void TestGapSizes()
+{
+	const unsigned int maxGap = LightUploadQueue::DefaultMaxGap;
+
+	LightManager manager;
+	std::vector<LightHandle> handles;
+	for (unsigned int i = 0; i < 40; i++)
+		handles.push_back(manager.Add(PointLight((float)i, 1.0f)));
+	unsigned int seen = manager.GetVersion();
+
+	// Neighbours at 2 and 3, one light between 10 and 12, maxGap lights
+	// between 20 and the next, and one more than that before the last.
+	// The other gaps are wider than maxGap.
+	unsigned int afterGap = 21 + maxGap;
+	unsigned int last = afterGap + maxGap + 2;
+	std::vector<unsigned int> changes = { 2, 3, 10, 12, 20, afterGap, last };
+	for (unsigned int i : changes)
+		manager.Set(handles[i], PointLight((float)i, 2.0f));
+
+	Ranges ranges;
+	manager.GetChangedRanges(seen, 0, ranges);
+	CHECK(ranges == Ranges({ { 2, 2 }, { 10, 1 }, { 12, 1 }, { 20, 1 }, { afterGap, 1 }, { last, 1 } }));
+	manager.GetChangedRanges(seen, 1, ranges);
+	CHECK(ranges == Ranges({ { 2, 2 }, { 10, 3 }, { 20, 1 }, { afterGap, 1 }, { last, 1 } }));
+	manager.GetChangedRanges(seen, maxGap, ranges);
+	CHECK(ranges == Ranges({ { 2, 2 }, { 10, 3 }, { 20, maxGap + 2 }, { last, 1 } }));
+
+	// Merging the single lights, shuffled, gives the same
+	for (unsigned int gap : { 0u, 1u, maxGap })
+	{
+		Ranges merged, expected;
+		for (unsigned int i = (unsigned int)changes.size(); i-- > 0;)
+			merged.push_back({ changes[i], 1 });
+		LightManager::MergeRanges(merged, gap);
+		manager.GetChangedRanges(seen, gap, expected);
+		CHECK(merged == expected);
+	}
+
+	// Touching and overlapping ranges join even with no gap allowed
+	Ranges touching = { { 5, 3 }, { 0, 5 }, { 6, 4 }, { 11, 1 } };
+	LightManager::MergeRanges(touching, 0);
+	CHECK(touching == Ranges({ { 0, 10 }, { 11, 1 } }));
+
+	// The queue joins the same way
+	LightUploadQueue queue(1);
+	queue.Queue(4);
+	queue.Queue(5);
+	queue.Queue(7);
+	queue.Queue(10);
+	CHECK(FlushAll(queue) == Ranges({ { 4, 4 }, { 10, 1 } }));
+}
+
+// Ranges that fail to write stay queued, and go out with the next flush
+static void TestFailedWritesRetry()
+{
+	LightUploadQueue queue(2);
+	queue.Queue(1);
+	queue.Queue(10);
+	queue.Queue(20);
+
+	unsigned int written = queue.Flush([](const LightRange& range) { return range.first != 10; });
+	CHECK(written == 2);
+	CHECK(queue.GetQueued() == Ranges({ { 10, 1 } }));
+
+	// Nothing written at all
+	CHECK(queue.Flush([](const LightRange&) { return false; }) == 0);
+	CHECK(queue.GetQueued() == Ranges({ { 10, 1 } }));
+
+	// The leftover merges with a neighbour queued since
+	queue.Queue(11);
+	queue.Queue(30);
+	CHECK(FlushAll(queue) == Ranges({ { 10, 2 }, { 30, 1 } }));
+	CHECK(queue.IsEmpty());
+}
+
+// --------------------------------------------------------
+// The ranges a flush should write for a set of dirty lights:
+// each starts and ends on a dirty light, and two dirty runs
+// are joined when at most maxGap clean lights separate them
+// --------------------------------------------------------
+static Ranges ExpectedRanges(const std::vector<unsigned char>& dirty, unsigned int maxGap)
+{
+	Ranges ranges;
+	for (unsigned int i = 0; i < dirty.size(); i++)
+	{
+		if (!dirty[i])
+			continue;
+
+		if (!ranges.empty() && i - (ranges.back().first + ranges.back().count) <= maxGap)
+			ranges.back().count = i + 1 - ranges.back().first;
+		else
+			ranges.push_back({ i, 1 });
+	}
+	return ranges;
+}
+
+// --------------------------------------------------------
+// Lights are added, removed, moved and faded at random over
+// many frames, as Game drives them: the manager's changes
+// and the fade changes are queued and flushed once a frame
+// into a mirror of the light buffer.  Every flush must write
+// exactly the expected ranges, the mirror must then match,
+// and a frame with a failed write must catch up on the next.
+// --------------------------------------------------------
+static void TestRandomFrames()
+{
+	const unsigned int maxGap = LightUploadQueue::DefaultMaxGap;
+	std::mt19937 rng(43);
+	std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+
+	LightManager manager;
+	std::vector<LightHandle> handles;
+	for (unsigned int i = 0; i < 2000; i++)
+		handles.push_back(manager.Add(PointLight(position(rng), 1.0f)));
+
+	// What the shaders see: the manager's lights scaled by a fade
+	std::vector<float> fades;
+	std::vector<Light> shaded, gpu;
+	auto shade = [&](unsigned int i)
+	{
+		shaded[i] = manager.GetLight(i);
+		shaded[i].Intensity *= fades[i];
+	};
+
+	LightUploadQueue queue(maxGap);
+	unsigned int seen = 0;
+	unsigned int wrongRanges = 0, wrongBytes = 0, stale = 0, totalRanges = 0, totalDirty = 0;
+	bool failNextWrite = false;
+	std::vector<unsigned char> dirty;
+	for (unsigned int frame = 0; frame < 200; frame++)
+	{
+		// Some lights change, a few go, a few come
+		unsigned int changes = frame % 10 == 5 ? 0 : rng() % 60;
+		for (unsigned int c = 0; c < changes; c++)
+		{
+			unsigned int h = rng() % handles.size();
+			switch (rng() % 8)
+			{
+			case 0: manager.Remove(handles[h]); break;
+			case 1: handles.push_back(manager.Add(PointLight(position(rng), 1.0f))); break;
+			default: manager.Set(handles[h], PointLight(position(rng), 1.0f)); break;
+			}
+		}
+
+		unsigned int slots = manager.GetSlotCount();
+		fades.resize(slots, 1.0f);
+		shaded.resize(slots);
+		gpu.resize(slots);
+		dirty.resize(slots, 0);
+
+		Ranges changed;
+		manager.GetChangedRanges(seen, 0, changed);
+		for (const LightRange& range : changed)
+		{
+			for (unsigned int i = range.first; i < range.first + range.count; i++)
+			{
+				shade(i);
+				dirty[i] = 1;
+			}
+			queue.Queue(range);
+		}
+		seen = manager.GetVersion();
+
+		// Fades move on for a handful of lights
+		unsigned int fadeChanges = rng() % 8;
+		for (unsigned int f = 0; f < fadeChanges; f++)
+		{
+			unsigned int i = rng() % slots;
+			fades[i] = (rng() % 100) / 100.0f;
+			shade(i);
+			dirty[i] = 1;
+			queue.Queue(i);
+		}
+
+		totalDirty += (unsigned int)std::count(dirty.begin(), dirty.end(), 1);
+
+		// Every so often the first range fails to write
+		Ranges expected = ExpectedRanges(dirty, maxGap);
+		unsigned int expectedBytes = 0;
+		for (const LightRange& range : expected)
+			expectedBytes += (unsigned int)(sizeof(Light) * range.count);
+
+		Ranges written;
+		unsigned int bytes = 0;
+		bool failing = failNextWrite;
+		queue.Flush([&](const LightRange& range)
+		{
+			written.push_back(range);
+			if (failing)
+			{
+				failing = false;
+				return false;
+			}
+			memcpy(&gpu[range.first], &shaded[range.first], sizeof(Light) * range.count);
+			bytes += (unsigned int)(sizeof(Light) * range.count);
+			return true;
+		});
+
+		wrongRanges += written != expected;
+		totalRanges += (unsigned int)written.size();
+		if (failNextWrite && !expected.empty())
+		{
+			// Only the failed range is left dirty
+			const LightRange& failed = expected.front();
+			wrongBytes += bytes != expectedBytes - sizeof(Light) * failed.count;
+			std::fill(dirty.begin(), dirty.end(), 0);
+			for (unsigned int i = failed.first; i < failed.first + failed.count; i++)
+				dirty[i] = 1;
+			wrongRanges += queue.GetQueued() != Ranges({ failed });
+		}
+		else
+		{
+			wrongBytes += bytes != expectedBytes;
+			std::fill(dirty.begin(), dirty.end(), 0);
+			wrongRanges += !queue.IsEmpty();
+			stale += memcmp(gpu.data(), shaded.data(), sizeof(Light) * slots) != 0;
+		}
+		failNextWrite = frame % 17 == 3;
+	}
+
+	CHECK(wrongRanges == 0);
+	CHECK(wrongBytes == 0);
+	CHECK(stale == 0);
+
+	// Fewer copies than changed lights
+	CHECK(totalRanges > 0 && totalRanges < totalDirty);
+}
+
+int main()
+{
+	TestScriptedFrames();
+	TestGapSizes();
+	TestFailedWritesRetry();
+	TestRandomFrames();
+	return TestResult();
+}
@@ -0,0 +1,199 @@
+#include "Check.h"
+#include "ObjectLightSelector.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+static Light MakeLight(int type, XMFLOAT3 position, XMFLOAT3 direction, float range, float intensity)
+{
+	Light light = {};
+	light.Type = type;
+	light.Position = position;
+	XMStoreFloat3(&light.Direction, XMVector3Normalize(XMLoadFloat3(&direction)));
+	light.Range = range;
+	light.Intensity = intensity;
+	light.Color = XMFLOAT3(1, 1, 1);
+	light.SpotFalloff = 8.0f;
+	return light;
+}
+
+// The lights in a list up to its end marker
+static std::vector<unsigned int> Unpack(const ObjectLightList& list)
+{
+	std::vector<unsigned int> indices;
+	for (unsigned int slot = 0; slot < ObjectLightSelector::MaxLights; slot++)
+	{
+		unsigned int light = ObjectLightSelector::GetLight(list, slot);
+		if (light == ObjectLightSelector::NoLight)
+			break;
+		indices.push_back(light);
+	}
+	return indices;
+}
+
+// --------------------------------------------------------
+// Reference selection: every light that reaches the box,
+// stably sorted brightest first, cut to MaxLights
+// --------------------------------------------------------
+static std::vector<unsigned int> BruteForce(const std::vector<Light>& lights, const BoundingBox& box)
+{
+	std::vector<unsigned int> reaching;
+	std::vector<float> contributions(lights.size(), 0.0f);
+	for (unsigned int i = 0; i < lights.size(); i++)
+	{
+		contributions[i] = ObjectLightSelector::Contribution(lights[i], box);
+		if (contributions[i] > 0.0f)
+			reaching.push_back(i);
+	}
+	std::stable_sort(reaching.begin(), reaching.end(), [&](unsigned int a, unsigned int b) { return contributions[a] > contributions[b]; });
+	if (reaching.size() > ObjectLightSelector::MaxLights)
+		reaching.resize(ObjectLightSelector::MaxLights);
+	return reaching;
+}
+
+// --------------------------------------------------------
+// Random scenes of every kind of light, with some lights
+// repeated so equal contributions must keep their order,
+// against the brute force reference for each box
+// --------------------------------------------------------
+static void TestMatchesBruteForce()
+{
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> positive(0.0f, 1.0f);
+
+	unsigned int wrongLists = 0, fullLists = 0, shortLists = 0, emptyLists = 0;
+	for (unsigned int scene = 0; scene < 20; scene++)
+	{
+		std::vector<Light> lights;
+		unsigned int lightCount = 1 + scene * 5;
+		for (unsigned int i = 0; i < lightCount; i++)
+		{
+			// One light in five copies the one before it
+			if (i > 0 && rng() % 5 == 0)
+			{
+				lights.push_back(lights.back());
+				continue;
+			}
+
+			int type = rng() % 12 == 0 ? LIGHT_TYPE_DIRECTIONAL : (rng() % 2 ? LIGHT_TYPE_POINT : LIGHT_TYPE_SPOT);
+			lights.push_back(MakeLight(type,
+				XMFLOAT3(unit(rng) * 40.0f, unit(rng) * 10.0f, unit(rng) * 40.0f),
+				XMFLOAT3(unit(rng), unit(rng) - 0.5f, unit(rng)),
+				2.0f + positive(rng) * 18.0f, 0.1f + positive(rng) * 3.0f));
+		}
+
+		std::vector<BoundingBox> boxes;
+		unsigned int boxCount = 1 + (scene * 37) % 300;
+		for (unsigned int b = 0; b < boxCount; b++)
+			boxes.push_back(BoundingBox(XMFLOAT3(unit(rng) * 45.0f, unit(rng) * 10.0f, unit(rng) * 45.0f), XMFLOAT3(0.2f + positive(rng) * 2.0f, 0.2f + positive(rng) * 2.0f, 0.2f + positive(rng) * 2.0f)));
+
+		// Stale lists from a bigger selection must be cut down
+		ObjectLightSelector selector;
+		std::vector<ObjectLightList> lists(boxCount + 10);
+		selector.Select(lights, boxes, lists);
+		CHECK(lists.size() == boxCount);
+
+		for (unsigned int b = 0; b < boxCount; b++)
+		{
+			std::vector<unsigned int> selected = Unpack(lists[b]);
+			wrongLists += selected != BruteForce(lights, boxes[b]);
+
+			// Every slot after the end marker is empty too
+			for (unsigned int slot = (unsigned int)selected.size(); slot < ObjectLightSelector::MaxLights; slot++)
+				wrongLists += ObjectLightSelector::GetLight(lists[b], slot) != ObjectLightSelector::NoLight;
+
+			fullLists += selected.size() == ObjectLightSelector::MaxLights;
+			shortLists += !selected.empty() && selected.size() < ObjectLightSelector::MaxLights;
+			emptyLists += selected.empty();
+		}
+	}
+	CHECK(wrongLists == 0);
+
+	// The scenes covered capped, partial and empty lists
+	CHECK(fullLists > 0 && shortLists > 0 && emptyLists > 0);
+}
+
+// --------------------------------------------------------
+// Hand placed lights: directional lights reach every box,
+// point and spot lights only boxes within their range (and
+// cone), and more than MaxLights in reach keep the brightest
+// --------------------------------------------------------
+static void TestReach()
+{
+	BoundingBox box(XMFLOAT3(0, 0, 0), XMFLOAT3(1, 1, 1));
+	std::vector<Light> lights;
+	lights.push_back(MakeLight(LIGHT_TYPE_POINT, XMFLOAT3(5, 0, 0), XMFLOAT3(0, -1, 0), 3.0f, 10.0f));		// 0: 4 away, range 3
+	lights.push_back(MakeLight(LIGHT_TYPE_SPOT, XMFLOAT3(0, 5, 0), XMFLOAT3(0, 1, 0), 20.0f, 10.0f));		// 1: pointing away
+	lights.push_back(MakeLight(LIGHT_TYPE_SPOT, XMFLOAT3(0, 10, 0), XMFLOAT3(0, -1, 0), 5.0f, 10.0f));		// 2: aimed at it, 9 away, range 5
+	lights.push_back(MakeLight(LIGHT_TYPE_DIRECTIONAL, XMFLOAT3(500, 500, 500), XMFLOAT3(0, -1, 0), 0.0f, 0.01f));	// 3: dim, but always in
+	lights.push_back(MakeLight(LIGHT_TYPE_POINT, XMFLOAT3(2, 0, 0), XMFLOAT3(0, -1, 0), 3.0f, 1.0f));		// 4: in reach
+	lights.push_back(MakeLight(LIGHT_TYPE_SPOT, XMFLOAT3(0, 4, 0), XMFLOAT3(0, -1, 0), 10.0f, 1.0f));		// 5: aimed at it and in reach
+
+	for (const Light& light : lights)
+		CHECK((ObjectLightSelector::Contribution(light, box) > 0.0f) == (&light == &lights[3] || &light == &lights[4] || &light == &lights[5]));
+
+	ObjectLightSelector selector;
+	std::vector<ObjectLightList> lists;
+	selector.Select(lights, std::vector<BoundingBox>(1, box), lists);
+	std::vector<unsigned int> selected = Unpack(lists[0]);
+	std::sort(selected.begin(), selected.end());
+	CHECK(selected == std::vector<unsigned int>({ 3, 4, 5 }));
+
+	// A box far from everything still gets the directional light
+	selector.Select(lights, std::vector<BoundingBox>(1, BoundingBox(XMFLOAT3(-300, 0, 0), XMFLOAT3(1, 1, 1))), lists);
+	CHECK(Unpack(lists[0]) == std::vector<unsigned int>({ 3 }));
+
+	// Twelve point lights in reach, brighter the later they come,
+	// leave the directional light and the seven brightest
+	for (unsigned int i = 0; i < 12; i++)
+		lights.push_back(MakeLight(LIGHT_TYPE_POINT, XMFLOAT3(0, 0, 2), XMFLOAT3(0, -1, 0), 5.0f, 100.0f + i));
+	lights[3].Intensity = 1000.0f;
+	selector.Select(lights, std::vector<BoundingBox>(1, box), lists);
+	CHECK(Unpack(lists[0]) == std::vector<unsigned int>({ 3, 17, 16, 15, 14, 13, 12, 11 }));
+
+	// No boxes, no lists
+	selector.Select(lights, std::vector<BoundingBox>(), lists);
+	CHECK(lists.empty());
+}
+
+// --------------------------------------------------------
+// Two 16 bit indices to a uint, the first in the low half,
+// as the shaders unpack them.  Lights past the last index
+// a list can hold are never picked.
+// --------------------------------------------------------
+static void TestPacking()
+{
+	BoundingBox box(XMFLOAT3(0, 0, 0), XMFLOAT3(1, 1, 1));
+	std::vector<Light> lights(ObjectLightSelector::NoLight + 3, MakeLight(LIGHT_TYPE_POINT, XMFLOAT3(100, 0, 0), XMFLOAT3(0, -1, 0), 1.0f, 1.0f));
+
+	// In reach: 2 and 0x1234, brighter first, then 0xFFFE, the last index
+	// a list holds, and two past it that are brighter still
+	lights[2] = MakeLight(LIGHT_TYPE_POINT, XMFLOAT3(0, 0, 0), XMFLOAT3(0, -1, 0), 5.0f, 1.0f);
+	lights[0x1234] = MakeLight(LIGHT_TYPE_POINT, XMFLOAT3(0, 0, 0), XMFLOAT3(0, -1, 0), 5.0f, 3.0f);
+	lights[0xFFFE] = MakeLight(LIGHT_TYPE_POINT, XMFLOAT3(0, 0, 0), XMFLOAT3(0, -1, 0), 5.0f, 0.5f);
+	lights[0xFFFF] = MakeLight(LIGHT_TYPE_POINT, XMFLOAT3(0, 0, 0), XMFLOAT3(0, -1, 0), 5.0f, 9.0f);
+	lights[0x10001] = MakeLight(LIGHT_TYPE_POINT, XMFLOAT3(0, 0, 0), XMFLOAT3(0, -1, 0), 5.0f, 9.0f);
+
+	ObjectLightSelector selector;
+	std::vector<ObjectLightList> lists;
+	selector.Select(lights, std::vector<BoundingBox>(1, box), lists);
+	CHECK(lists[0].packed[0] == (0x1234u | (2u << 16)));
+	CHECK(lists[0].packed[1] == (0xFFFEu | (0xFFFFu << 16)));
+	CHECK(lists[0].packed[2] == 0xFFFFFFFFu && lists[0].packed[3] == 0xFFFFFFFFu);
+	CHECK(Unpack(lists[0]) == std::vector<unsigned int>({ 0x1234, 2, 0xFFFE }));
+
+	ObjectLightList list = { { 0x00010000u, 0x00030002u, 0xFFFF0004u, 0xFFFFFFFFu } };
+	CHECK(Unpack(list) == std::vector<unsigned int>({ 0, 1, 2, 3, 4 }));
+}
+
+int main()
+{
+	TestMatchesBruteForce();
+	TestReach();
+	TestPacking();
+	return TestResult();
+}
@@ -0,0 +1,270 @@
+#include "Check.h"
+#include "OcclusionCuller.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+// Depths closer than this are float rounding, not occlusion
+static const float DepthTolerance = 1e-5f;
+
+// Unit cube, as an occluder mesh and for rasterizing boxes
+static const std::vector<XMFLOAT3> Cube =
+{
+	XMFLOAT3(-0.5f, -0.5f, -0.5f), XMFLOAT3(0.5f, -0.5f, -0.5f), XMFLOAT3(0.5f, 0.5f, -0.5f), XMFLOAT3(-0.5f, 0.5f, -0.5f),
+	XMFLOAT3(-0.5f, -0.5f, 0.5f), XMFLOAT3(0.5f, -0.5f, 0.5f), XMFLOAT3(0.5f, 0.5f, 0.5f), XMFLOAT3(-0.5f, 0.5f, 0.5f)
+};
+static const std::vector<unsigned int> CubeIndices =
+{
+	0, 2, 1, 0, 3, 2,	4, 5, 6, 4, 6, 7,	0, 1, 5, 0, 5, 4,
+	3, 7, 6, 3, 6, 2,	0, 4, 7, 0, 7, 3,	1, 2, 6, 1, 6, 5
+};
+
+// --------------------------------------------------------
+// Straightforward version of the culler's rasterizer: every
+// pixel under a triangle's bounds is tested against it using
+// barycentric weights in double precision.  Calls visit()
+// with each covered pixel and its depth.  Returns false if a
+// triangle crossed the near plane and was skipped.
+// --------------------------------------------------------
+template <typename Visit>
+static bool ReferenceRasterize(int width, int height, FXMMATRIX worldViewProjection, Visit visit)
+{
+	bool complete = true;
+	for (size_t i = 0; i + 2 < CubeIndices.size(); i += 3)
+	{
+		double x[3], y[3], z[3];
+		bool crossesNear = false;
+		for (int v = 0; v < 3; v++)
+		{
+			XMFLOAT4 clip;
+			XMStoreFloat4(&clip, XMVector3Transform(XMLoadFloat3(&Cube[CubeIndices[i + v]]), worldViewProjection));
+			crossesNear |= clip.z < 0.0f;
+			x[v] = (clip.x / clip.w * 0.5 + 0.5) * width;
+			y[v] = (0.5 - clip.y / clip.w * 0.5) * height;
+			z[v] = clip.z / clip.w;
+		}
+
+		double area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+		if (crossesNear)
+			complete = false;
+		if (crossesNear || area == 0.0)
+			continue;
+
+		int x0 = std::max(0, (int)floor(std::min(std::min(x[0], x[1]), x[2])));
+		int x1 = std::min(width - 1, (int)ceil(std::max(std::max(x[0], x[1]), x[2])));
+		int y0 = std::max(0, (int)floor(std::min(std::min(y[0], y[1]), y[2])));
+		int y1 = std::min(height - 1, (int)ceil(std::max(std::max(y[0], y[1]), y[2])));
+		for (int py = y0; py <= y1; py++)
+		{
+			for (int px = x0; px <= x1; px++)
+			{
+				double cx = px + 0.5, cy = py + 0.5;
+				double w0 = ((x[2] - x[1]) * (cy - y[1]) - (cx - x[1]) * (y[2] - y[1])) / area;
+				double w1 = ((x[0] - x[2]) * (cy - y[2]) - (cx - x[2]) * (y[0] - y[2])) / area;
+				double w2 = 1.0 - w0 - w1;
+				if (w0 >= 0.0 && w1 >= 0.0 && w2 >= 0.0)
+					visit(py * width + px, (float)(w0 * z[0] + w1 * z[1] + w2 * z[2]));
+			}
+		}
+	}
+	return complete;
+}
+
+// A street of building-like boxes, as occluder world matrices
+static std::vector<XMMATRIX> Buildings(std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<XMMATRIX> buildings;
+	for (int x = -6; x <= 6; x++)
+	{
+		for (int z = 0; z < 12; z++)
+		{
+			buildings.push_back(
+				XMMatrixScaling(2.0f + unit(rng) * 1.5f, 2.0f + unit(rng) * 6.0f, 2.0f + unit(rng) * 1.5f) *
+				XMMatrixTranslation(x * 4.0f, 0.0f, z * 4.0f));
+		}
+	}
+	return buildings;
+}
+
+// Box world matrix for rasterizing it as a cube
+static XMMATRIX BoxWorld(const BoundingBox& box)
+{
+	return
+		XMMatrixScaling(box.Extents.x * 2.0f, box.Extents.y * 2.0f, box.Extents.z * 2.0f) *
+		XMMatrixTranslation(box.Center.x, box.Center.y, box.Center.z);
+}
+
+// --------------------------------------------------------
+// From several street level viewpoints, the culler's depth
+// buffer must match the reference, and no box may be culled
+// that the reference shows in front of the occluders - by
+// rasterizing the box itself, so the culler's screen space
+// rectangle test is checked too, not just assumed.
+// --------------------------------------------------------
+static void TestAgainstReference()
+{
+	const unsigned int boxCount = 5000;
+	const unsigned int viewCount = 4;
+	std::mt19937 rng(35);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	std::vector<XMMATRIX> buildings = Buildings(rng);
+	std::vector<BoundingBox> boxes(boxCount);
+	for (BoundingBox& box : boxes)
+	{
+		float size = 0.1f + unit(rng) * 0.6f;
+		box = BoundingBox(XMFLOAT3((unit(rng) - 0.5f) * 60.0f, unit(rng) * 3.0f, unit(rng) * 60.0f), XMFLOAT3(size, size, size));
+	}
+
+	OcclusionCuller culler;
+	int width = (int)culler.GetWidth();
+	int height = (int)culler.GetHeight();
+
+	unsigned int coverageDiffers = 0, tooNear = 0, violations = 0, rectangleViolations = 0, culled = 0;
+	for (unsigned int v = 0; v < viewCount; v++)
+	{
+		XMVECTOR eye = XMVectorSet((unit(rng) - 0.5f) * 20.0f, 1.0f + unit(rng) * 2.0f, -10.0f + unit(rng) * 20.0f, 0);
+		XMVECTOR focus = XMVectorAdd(eye, XMVectorSet(unit(rng) - 0.5f, 0.0f, 1.0f, 0));
+		XMMATRIX viewProjection =
+			XMMatrixLookAtLH(eye, focus, XMVectorSet(0, 1, 0, 0)) *
+			XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 200.0f);
+
+		culler.Begin(viewProjection);
+		for (const XMMATRIX& world : buildings)
+			culler.AddOccluder(Cube.data(), CubeIndices.data(), (unsigned int)CubeIndices.size(), world);
+		culler.Rasterize();
+
+		std::vector<unsigned int> visible;
+		culler.Cull(boxes, visible);
+		culler.EndFrame();
+
+		std::vector<float> reference(width * height, 1.0f);
+		for (const XMMATRIX& world : buildings)
+		{
+			ReferenceRasterize(width, height, world * viewProjection,
+				[&reference](int pixel, float d) { reference[pixel] = std::min(reference[pixel], d); });
+		}
+
+		// Same pixels covered, and never nearer than the reference, which
+		// would hide things that should show
+		const float* depth = culler.GetDepth();
+		for (int i = 0; i < width * height; i++)
+		{
+			coverageDiffers += (depth[i] < 1.0f) != (reference[i] < 1.0f);
+			tooNear += depth[i] < reference[i] - DepthTolerance;
+		}
+
+		std::vector<unsigned char> kept(boxCount, 0);
+		for (unsigned int index : visible)
+			kept[index] = 1;
+
+		for (unsigned int i = 0; i < boxCount; i++)
+		{
+			if (kept[i])
+				continue;
+			culled++;
+
+			// Is any of the box really in front of the occluders?
+			bool showing = false;
+			bool complete = ReferenceRasterize(width, height, BoxWorld(boxes[i]) * viewProjection,
+				[&](int pixel, float d) { showing |= d < reference[pixel] - DepthTolerance; });
+			violations += showing || !complete;
+
+			// And the rectangle test the benchmark used to check with
+			XMFLOAT3 corners[BoundingBox::CORNER_COUNT];
+			boxes[i].GetCorners(corners);
+			float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, nearest = FLT_MAX;
+			bool rectangleVisible = false;
+			for (size_t c = 0; c < BoundingBox::CORNER_COUNT; c++)
+			{
+				XMFLOAT4 clip;
+				XMStoreFloat4(&clip, XMVector3Transform(XMLoadFloat3(&corners[c]), viewProjection));
+				rectangleVisible |= clip.z < 0.0f;
+				minX = std::min(minX, (clip.x / clip.w * 0.5f + 0.5f) * width);
+				maxX = std::max(maxX, (clip.x / clip.w * 0.5f + 0.5f) * width);
+				minY = std::min(minY, (0.5f - clip.y / clip.w * 0.5f) * height);
+				maxY = std::max(maxY, (0.5f - clip.y / clip.w * 0.5f) * height);
+				nearest = std::min(nearest, clip.z / clip.w);
+			}
+
+			int x0 = std::max(0, (int)floorf(minX)), x1 = std::min(width - 1, (int)floorf(maxX));
+			int y0 = std::max(0, (int)floorf(minY)), y1 = std::min(height - 1, (int)floorf(maxY));
+			rectangleVisible |= x0 > x1 || y0 > y1;
+			for (int y = y0; y <= y1 && !rectangleVisible; y++)
+			{
+				for (int x = x0; x <= x1 && !rectangleVisible; x++)
+					rectangleVisible = reference[y * width + x] >= nearest + DepthTolerance;
+			}
+			rectangleViolations += rectangleVisible;
+		}
+	}
+
+	printf("Occlusion culling %u boxes over %u views: %u culled, %u coverage differences, %u violations\n",
+		boxCount, viewCount, culled, coverageDiffers, violations);
+
+	CHECK(coverageDiffers == 0);
+	CHECK(tooNear == 0);
+	CHECK(violations == 0);
+	CHECK(rectangleViolations == 0);
+
+	// It has to actually cull something to mean anything
+	CHECK(culled > 0);
+}
+
+// Boxes in front of the occluders, reaching the near plane, or off
+// screen are always kept; boxes straight behind a wall never are
+static void TestSimpleCases()
+{
+	XMMATRIX viewProjection = XMMatrixPerspectiveFovLH(XM_PIDIV4, 1.0f, 0.1f, 100.0f);
+	OcclusionCuller culler;
+	culler.Begin(viewProjection);
+
+	// A wall filling the view at z = 10
+	XMMATRIX wall = XMMatrixScaling(40.0f, 40.0f, 1.0f) * XMMatrixTranslation(0.0f, 0.0f, 10.0f);
+	culler.AddOccluder(Cube.data(), CubeIndices.data(), (unsigned int)CubeIndices.size(), wall);
+	culler.Rasterize();
+	CHECK(culler.GetTriangleCount() > 0);
+
+	CHECK(!culler.IsVisible(BoundingBox(XMFLOAT3(0, 0, 20), XMFLOAT3(1, 1, 1))));
+	CHECK(!culler.IsVisible(BoundingBox(XMFLOAT3(3, -2, 50), XMFLOAT3(2, 2, 2))));
+	CHECK(culler.IsVisible(BoundingBox(XMFLOAT3(0, 0, 5), XMFLOAT3(1, 1, 1))));
+	CHECK(culler.IsVisible(BoundingBox(XMFLOAT3(0, 0, 0), XMFLOAT3(1, 1, 1))));
+
+	// Poking through the wall
+	CHECK(culler.IsVisible(BoundingBox(XMFLOAT3(0, 0, 10), XMFLOAT3(1, 1, 1))));
+
+	// Entirely off to the side, so nothing to test against
+	CHECK(culler.IsVisible(BoundingBox(XMFLOAT3(0, 0, -20), XMFLOAT3(1, 1, 1))));
+}
+
+// Nothing rasterized hides nothing
+static void TestNoOccluders()
+{
+	std::mt19937 rng(350);
+	std::uniform_real_distribution<float> position(-20.0f, 20.0f);
+	std::vector<BoundingBox> boxes(500);
+	for (BoundingBox& box : boxes)
+		box = BoundingBox(XMFLOAT3(position(rng), position(rng), position(rng) + 30.0f), XMFLOAT3(0.5f, 0.5f, 0.5f));
+
+	OcclusionCuller culler;
+	culler.Begin(XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 100.0f));
+	culler.Rasterize();
+
+	std::vector<unsigned int> visible;
+	culler.Cull(boxes, visible);
+	CHECK(visible.size() == boxes.size());
+}
+
+int main()
+{
+	TestAgainstReference();
+	TestSimpleCases();
+	TestNoOccluders();
+	return TestResult();
+}
@@ -0,0 +1,207 @@
+#include "Check.h"
+#include "RingAllocator.h"
+
+#include <random>
+#include <vector>
+
+// The alignment ConstantBufferRing uses, 16 constants of 16 bytes
+static const unsigned int ConstantAlignment = 256;
+
+// Every allocation is aligned, and in constants lands on a multiple of 16
+static void TestAlignment()
+{
+	RingAllocator ring(4096, ConstantAlignment);
+	unsigned int offset = 0;
+
+	CHECK(ring.Allocate(1, offset));
+	CHECK(offset == 0);
+	CHECK(ring.GetUsedBytes() == 256);
+
+	CHECK(ring.Allocate(257, offset));
+	CHECK(offset == 256);
+	CHECK(ring.GetUsedBytes() == 768);
+
+	CHECK(ring.Allocate(64, offset));
+	CHECK(offset == 768);
+	CHECK(offset % ConstantAlignment == 0);
+	CHECK((offset / 16) % 16 == 0);
+
+	// Nothing, or more than the whole ring, can't be had
+	CHECK(!ring.Allocate(0, offset));
+	CHECK(!ring.Allocate(4097, offset));
+	CHECK(ring.GetUsedBytes() == 1024);
+}
+
+// Filling the ring, then wrapping past the unused end once the front frees up
+static void TestFillAndWrap()
+{
+	RingAllocator ring(1024, ConstantAlignment);
+	unsigned int offset = 0;
+
+	for (unsigned int i = 0; i < 4; i++)
+	{
+		CHECK(ring.Allocate(256, offset));
+		CHECK(offset == i * 256);
+	}
+	CHECK(ring.GetUsedBytes() == 1024);
+	CHECK(!ring.Allocate(16, offset));
+	ring.Fence(1);
+	ring.Retire(1);
+	CHECK(ring.GetUsedBytes() == 0);
+
+	// An empty ring starts over at the front
+	CHECK(ring.Allocate(512, offset));
+	CHECK(offset == 0);
+	ring.Fence(2);
+	CHECK(ring.Allocate(256, offset));
+	CHECK(offset == 512);
+	ring.Fence(3);
+	ring.Retire(2);
+	CHECK(ring.GetUsedBytes() == 256);
+
+	// 256 bytes are left at the end, too few, so they're skipped
+	CHECK(ring.Allocate(512, offset));
+	CHECK(offset == 0);
+	CHECK(ring.GetWrapCount() == 1);
+	CHECK(ring.GetUsedBytes() == 1024);
+	CHECK(!ring.Allocate(16, offset));
+	ring.Fence(4);
+
+	// The skipped end belongs to fence 4, so retiring 3 only frees [512, 768)
+	ring.Retire(3);
+	CHECK(ring.GetUsedBytes() == 768);
+	CHECK(ring.Allocate(256, offset));
+	CHECK(offset == 512);
+	CHECK(!ring.Allocate(16, offset));
+	ring.Fence(5);
+
+	ring.Retire(4);
+	CHECK(ring.GetUsedBytes() == 256);
+	ring.Retire(5);
+	CHECK(ring.GetUsedBytes() == 0);
+}
+
+// Nothing is handed out again until the fence covering it is retired
+static void TestInFlightTail()
+{
+	RingAllocator ring(1024, ConstantAlignment);
+	unsigned int offset = 0;
+
+	CHECK(ring.Allocate(1024, offset));
+	ring.Fence(10);
+	CHECK(!ring.Allocate(256, offset));
+
+	// Older values leave it in flight
+	ring.Retire(9);
+	CHECK(ring.GetUsedBytes() == 1024);
+	CHECK(!ring.Allocate(256, offset));
+
+	ring.Retire(10);
+	CHECK(ring.GetUsedBytes() == 0);
+	CHECK(ring.Allocate(256, offset));
+
+	// Unfenced bytes are never freed by Retire
+	ring.Retire(100);
+	CHECK(ring.GetUsedBytes() == 256);
+}
+
+// Several frames in flight with random sizes - each allocation must stay
+// clear of every range whose fence hasn't been retired
+static void TestRetireFreesRightSpan()
+{
+	struct Range
+	{
+		unsigned int offset;
+		unsigned int size;
+		unsigned long long fence;
+	};
+
+	const unsigned int capacity = 64 * 1024;
+	const unsigned long long framesInFlight = 2;
+	RingAllocator ring(capacity, ConstantAlignment);
+	std::mt19937 rng(28);
+	std::uniform_int_distribution<unsigned int> size(1, 2048);
+	std::uniform_int_distribution<unsigned int> perFrame(1, 24);
+	std::vector<Range> live;
+	unsigned int overlaps = 0, failures = 0, misaligned = 0;
+
+	for (unsigned long long frame = 1; frame <= 2000; frame++)
+	{
+		if (frame > framesInFlight)
+		{
+			unsigned long long completed = frame - framesInFlight;
+			ring.Retire(completed);
+			std::vector<Range> kept;
+			for (const Range& range : live)
+				if (range.fence > completed)
+					kept.push_back(range);
+			live.swap(kept);
+		}
+
+		unsigned int allocations = perFrame(rng);
+		for (unsigned int a = 0; a < allocations; a++)
+		{
+			unsigned int bytes = size(rng);
+			unsigned int offset = 0;
+			if (!ring.Allocate(bytes, offset))
+			{
+				failures++;
+				continue;
+			}
+
+			unsigned int aligned = (bytes + ConstantAlignment - 1) & ~(ConstantAlignment - 1);
+			misaligned += offset % ConstantAlignment != 0 || offset + aligned > capacity;
+			for (const Range& range : live)
+				overlaps += offset < range.offset + range.size && range.offset < offset + aligned;
+			live.push_back({ offset, aligned, frame });
+		}
+		ring.Fence(frame);
+
+		// Used bytes never fall below what's really live
+		unsigned int liveBytes = 0;
+		for (const Range& range : live)
+			liveBytes += range.size;
+		CHECK(ring.GetUsedBytes() >= liveBytes);
+	}
+
+	CHECK(overlaps == 0);
+	CHECK(misaligned == 0);
+	CHECK(failures == 0);
+	CHECK(ring.GetWrapCount() > 0);
+}
+
+// Reset frees everything and forgets the fences
+static void TestReset()
+{
+	RingAllocator ring(1024, ConstantAlignment);
+	unsigned int offset = 0;
+
+	CHECK(ring.Allocate(512, offset));
+	ring.Fence(1);
+	CHECK(ring.Allocate(256, offset));
+	ring.Fence(2);
+	ring.Retire(1);
+	CHECK(ring.Allocate(512, offset));
+	CHECK(ring.GetWrapCount() == 1);
+
+	ring.Reset();
+	CHECK(ring.GetUsedBytes() == 0);
+	CHECK(ring.GetWrapCount() == 0);
+
+	// Retiring fences from before the reset changes nothing
+	ring.Retire(2);
+	CHECK(ring.GetUsedBytes() == 0);
+
+	CHECK(ring.Allocate(1024, offset));
+	CHECK(offset == 0);
+}
+
+int main()
+{
+	TestAlignment();
+	TestFillAndWrap();
+	TestInFlightTail();
+	TestRetireFreesRightSpan();
+	TestReset();
+	return TestResult();
+}
@@ -0,0 +1,198 @@
+#include "Check.h"
+#include "ShaderPermutations.h"
+#include "ShaderVariantCache.h"
+
+#include <fstream>
+#include <regex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------
+// The setups CompileShaderVariants.ps1 compiles, read from
+// the script itself: its directional light count and local
+// light buckets, walked in its loop order
+// --------------------------------------------------------
+static bool ReadScriptSetups(const std::string& path, unsigned int& maxDirectionalLights, std::vector<unsigned int>& buckets, std::string& fileNamePattern)
+{
+	std::ifstream file(path);
+	if (!file)
+		return false;
+	std::stringstream text;
+	text << file.rdbuf();
+	std::string script = text.str();
+
+	std::smatch match;
+	if (!std::regex_search(script, match, std::regex(R"(\$maxDirectionalLights = (\d+))")))
+		return false;
+	maxDirectionalLights = (unsigned int)std::stoul(match[1]);
+
+	if (!std::regex_search(script, match, std::regex(R"(\$localLightBuckets = @\(([\d, ]+)\))")))
+		return false;
+	std::string list = match[1];
+	std::regex digits(R"(\d+)");
+	for (std::sregex_iterator number(list.begin(), list.end(), digits), end; number != end; ++number)
+		buckets.push_back((unsigned int)std::stoul(number->str()));
+
+	if (!std::regex_search(script, match, std::regex(R"pattern("(PixelShader_[^"]+\.cso)")pattern")))
+		return false;
+	fileNamePattern = match[1];
+	return true;
+}
+
+static std::wstring Widen(const std::string& text)
+{
+	return std::wstring(text.begin(), text.end());
+}
+
+// --------------------------------------------------------
+// Every variant the script compiles has a key, the key
+// names the file the script wrote, and the key gives the
+// setup back.  Together the keys are 0 to VariantCount.
+// --------------------------------------------------------
+static void TestScriptVariants(const std::string& scriptPath)
+{
+	unsigned int maxDirectionalLights = 0;
+	std::vector<unsigned int> buckets;
+	std::string pattern;
+	CHECK(ReadScriptSetups(scriptPath, maxDirectionalLights, buckets, pattern));
+
+	CHECK(maxDirectionalLights == ShaderPermutations::MaxDirectionalLights);
+	CHECK(buckets == std::vector<unsigned int>(ShaderPermutations::LocalLightBuckets, ShaderPermutations::LocalLightBuckets + ShaderPermutations::LocalLightBucketCount));
+	CHECK(pattern == "PixelShader_d${d}_l${l}_s${s}_n${n}.cso");
+
+	std::set<unsigned int> keys;
+	unsigned int variants = 0;
+	for (unsigned int d = 0; d <= maxDirectionalLights; d++)
+	{
+		for (unsigned int l : buckets)
+		{
+			for (unsigned int s = 0; s <= 1; s++)
+			{
+				for (unsigned int n = 0; n <= 1; n++)
+				{
+					LightingPermutation permutation = { d, l, s != 0, n != 0 };
+					unsigned int key = ShaderPermutations::MakeKey(permutation);
+					CHECK(key < ShaderPermutations::VariantCount);
+					keys.insert(key);
+					variants++;
+
+					std::string name = "PixelShader_d" + std::to_string(d) + "_l" + std::to_string(l) + "_s" + std::to_string(s) + "_n" + std::to_string(n) + ".cso";
+					CHECK(ShaderPermutations::GetFileName(L"PixelShader", key) == Widen(name));
+
+					LightingPermutation back = ShaderPermutations::GetPermutation(key);
+					CHECK(back.directionalLights == d && back.localLights == l && back.shadows == (s != 0) && back.normalMap == (n != 0));
+				}
+			}
+		}
+	}
+
+	CHECK(variants == 36);
+	CHECK(ShaderPermutations::VariantCount == 36);
+	CHECK(keys.size() == variants);
+	CHECK(!keys.empty() && *keys.begin() == 0 && *keys.rbegin() == ShaderPermutations::VariantCount - 1);
+}
+
+// --------------------------------------------------------
+// For any setup, the variant picked shades exactly its
+// directional lights and at least its local lights, with
+// the smallest bucket that does, and setups past the
+// largest get the general shader
+// --------------------------------------------------------
+static void TestBucketRounding()
+{
+	const unsigned int largestBucket = ShaderPermutations::LocalLightBuckets[ShaderPermutations::LocalLightBucketCount - 1];
+	unsigned int wrong = 0;
+	for (unsigned int d = 0; d <= ShaderPermutations::MaxDirectionalLights + 2; d++)
+	{
+		for (unsigned int l = 0; l <= largestBucket + 10; l++)
+		{
+			for (unsigned int flags = 0; flags < 4; flags++)
+			{
+				LightingPermutation permutation = { d, l, (flags & 2) != 0, (flags & 1) != 0 };
+				unsigned int key = ShaderPermutations::MakeKey(permutation);
+				if (d > ShaderPermutations::MaxDirectionalLights || l > largestBucket)
+				{
+					wrong += key != ShaderPermutations::NoVariant;
+					continue;
+				}
+
+				LightingPermutation variant = ShaderPermutations::GetPermutation(key);
+				wrong += variant.directionalLights != d;
+				wrong += variant.localLights < l;
+				wrong += variant.shadows != permutation.shadows || variant.normalMap != permutation.normalMap;
+
+				// No smaller bucket would have done
+				for (unsigned int b = 0; b < ShaderPermutations::LocalLightBucketCount; b++)
+				{
+					unsigned int bucket = ShaderPermutations::LocalLightBuckets[b];
+					wrong += bucket >= l && bucket < variant.localLights;
+				}
+			}
+		}
+	}
+	CHECK(wrong == 0);
+
+	// Out of range keys give an empty setup
+	LightingPermutation none = ShaderPermutations::GetPermutation(ShaderPermutations::NoVariant);
+	CHECK(none.directionalLights == 0 && none.localLights == 0 && !none.shadows && !none.normalMap);
+}
+
+// --------------------------------------------------------
+// Each key is loaded once, on first use; a failed load is
+// remembered and not retried; Clear() forgets everything
+// --------------------------------------------------------
+static void TestVariantCache()
+{
+	std::vector<unsigned int> loads(ShaderPermutations::VariantCount, 0);
+	ShaderVariantCache<unsigned int> cache(ShaderPermutations::VariantCount, [&](unsigned int key)
+	{
+		loads[key]++;
+
+		// Odd keys are missing, as if their files weren't compiled
+		return key % 2 ? nullptr : std::make_shared<unsigned int>(key * 10);
+	});
+	CHECK(cache.GetLoadedCount() == 0 && cache.GetMissingCount() == 0);
+
+	for (unsigned int pass = 0; pass < 3; pass++)
+	{
+		for (unsigned int key = 0; key < ShaderPermutations::VariantCount; key++)
+		{
+			std::shared_ptr<unsigned int> shader = cache.Get(key);
+			CHECK(key % 2 ? !shader : shader && *shader == key * 10);
+		}
+	}
+
+	unsigned int extraLoads = 0;
+	for (unsigned int count : loads)
+		extraLoads += count != 1;
+	CHECK(extraLoads == 0);
+	CHECK(cache.GetLoadedCount() == ShaderPermutations::VariantCount / 2);
+	CHECK(cache.GetMissingCount() == ShaderPermutations::VariantCount / 2);
+
+	// No variant, or past the end, is null without trying to load
+	CHECK(!cache.Get(ShaderPermutations::NoVariant));
+	CHECK(!cache.Get(ShaderPermutations::VariantCount));
+
+	// The same shader comes back each time
+	CHECK(cache.Get(4) == cache.Get(4));
+
+	cache.Clear();
+	CHECK(cache.GetLoadedCount() == 0 && cache.GetMissingCount() == 0);
+	cache.Get(4);
+	cache.Get(5);
+	CHECK(loads[4] == 2 && loads[5] == 2 && loads[6] == 1);
+	CHECK(cache.GetLoadedCount() == 1 && cache.GetMissingCount() == 1);
+}
+
+int main(int argc, char* argv[])
+{
+	// CMake passes the script's path
+	CHECK(argc > 1);
+	if (argc > 1)
+		TestScriptVariants(argv[1]);
+	TestBucketRounding();
+	TestVariantCache();
+	return TestResult();
+}
@@ -0,0 +1,385 @@
+#include "Check.h"
+#include "FrustumCuller.h"
+#include "ShadowAtlas.h"
+#include "ShadowViews.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+static bool Overlap(const ShadowTile& a, const ShadowTile& b)
+{
+	return a.x < b.x + b.size && b.x < a.x + a.size && a.y < b.y + b.size && b.y < a.y + a.size;
+}
+
+// Checks a set of live tiles: inside the atlas, aligned to their own size
+// (so they sit on the quadtree), and never overlapping.  Returns the problems.
+static unsigned int Problems(const std::vector<ShadowTile>& tiles, unsigned int atlasSize)
+{
+	unsigned int problems = 0;
+	for (size_t i = 0; i < tiles.size(); i++)
+	{
+		const ShadowTile& tile = tiles[i];
+		problems += tile.x + tile.size > atlasSize || tile.y + tile.size > atlasSize;
+		problems += tile.x % tile.size != 0 || tile.y % tile.size != 0;
+		for (size_t j = i + 1; j < tiles.size(); j++)
+			problems += Overlap(tile, tiles[j]);
+	}
+	return problems;
+}
+
+// Sizes that aren't powers of two or are out of range are refused
+static void TestAllocateSizes()
+{
+	ShadowAtlas atlas;
+	atlas.Reset(1024, 64);
+	ShadowTile tile;
+
+	CHECK(!atlas.Allocate(0, tile));
+	CHECK(!atlas.Allocate(96, tile));
+	CHECK(!atlas.Allocate(32, tile));
+	CHECK(!atlas.Allocate(2048, tile));
+	CHECK(atlas.GetFreeArea() == 1024ull * 1024);
+
+	CHECK(atlas.Allocate(1024, tile));
+	CHECK(tile.x == 0 && tile.y == 0 && tile.size == 1024);
+	CHECK(!atlas.Allocate(64, tile));
+	CHECK(atlas.GetFreeArea() == 0);
+}
+
+// --------------------------------------------------------
+// Random allocations and frees never hand out overlapping
+// or misaligned tiles, free area adds up, and once all is
+// freed the siblings have merged back into the whole atlas
+// --------------------------------------------------------
+static void TestRandomAllocations()
+{
+	const unsigned int atlasSize = 4096, minTileSize = 64;
+	ShadowAtlas atlas;
+	atlas.Reset(atlasSize, minTileSize);
+
+	std::mt19937 rng(39);
+	std::uniform_int_distribution<unsigned int> level(0, 6);
+	std::uniform_int_distribution<unsigned int> coin(0, 2);
+
+	std::vector<ShadowTile> live;
+	unsigned int problems = 0, areaMismatches = 0, allocated = 0;
+	for (int step = 0; step < 5000; step++)
+	{
+		if (coin(rng) != 0 || live.empty())
+		{
+			ShadowTile tile;
+			if (atlas.Allocate(minTileSize << level(rng), tile))
+			{
+				live.push_back(tile);
+				allocated++;
+			}
+		}
+		else
+		{
+			size_t index = rng() % live.size();
+			atlas.Free(live[index]);
+			live[index] = live.back();
+			live.pop_back();
+		}
+
+		unsigned long long used = 0;
+		for (const ShadowTile& tile : live)
+			used += (unsigned long long)tile.size * tile.size;
+		areaMismatches += used + atlas.GetFreeArea() != (unsigned long long)atlasSize * atlasSize;
+
+		if (step % 250 == 0)
+			problems += Problems(live, atlasSize);
+	}
+	problems += Problems(live, atlasSize);
+	CHECK(problems == 0);
+	CHECK(areaMismatches == 0);
+	CHECK(allocated > 1000);
+
+	for (const ShadowTile& tile : live)
+		atlas.Free(tile);
+	ShadowTile whole;
+	CHECK(atlas.Allocate(atlasSize, whole));
+}
+
+// Largest first, anything whose total area fits is placed in full
+static void TestLargestFirstFits()
+{
+	const unsigned int atlasSize = 2048, minTileSize = 32;
+	std::mt19937 rng(390);
+	std::uniform_int_distribution<unsigned int> level(0, 5);
+
+	unsigned int failures = 0;
+	for (int round = 0; round < 200; round++)
+	{
+		std::vector<unsigned int> sizes;
+		unsigned long long area = 0;
+		while (true)
+		{
+			unsigned int size = minTileSize << level(rng);
+			if (area + (unsigned long long)size * size > (unsigned long long)atlasSize * atlasSize)
+				break;
+			sizes.push_back(size);
+			area += (unsigned long long)size * size;
+		}
+		std::sort(sizes.begin(), sizes.end(), std::greater<unsigned int>());
+
+		ShadowAtlas atlas;
+		atlas.Reset(atlasSize, minTileSize);
+		std::vector<ShadowTile> tiles;
+		for (unsigned int size : sizes)
+		{
+			ShadowTile tile;
+			if (atlas.Allocate(size, tile))
+				tiles.push_back(tile);
+			else
+				failures++;
+		}
+		failures += Problems(tiles, atlasSize);
+	}
+	CHECK(failures == 0);
+}
+
+// Chosen sizes are powers of two in range, fit the atlas, and favour
+// the important lights
+static void TestChooseSizesFit()
+{
+	const unsigned int atlasSize = 4096, minTileSize = 64, maxTileSize = 1024;
+	ShadowAtlas atlas;
+	atlas.Reset(atlasSize, minTileSize);
+
+	std::mt19937 rng(391);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	unsigned int problems = 0;
+	for (int round = 0; round < 200; round++)
+	{
+		unsigned int lightCount = 1 + rng() % 60;
+		std::vector<float> importance(lightCount);
+		std::vector<unsigned int> tileCounts(lightCount);
+		for (unsigned int i = 0; i < lightCount; i++)
+		{
+			importance[i] = unit(rng) < 0.1f ? 0.0f : unit(rng);
+			tileCounts[i] = unit(rng) < 0.3f ? ShadowViews::CubeFaces : 1;
+		}
+
+		std::vector<unsigned int> sizes;
+		atlas.ChooseSizes(importance, tileCounts, maxTileSize, sizes);
+		CHECK(sizes.size() == lightCount);
+
+		unsigned long long area = 0;
+		for (unsigned int i = 0; i < lightCount; i++)
+		{
+			if (sizes[i] == 0)
+				continue;
+			problems += importance[i] <= 0.0f;
+			problems += sizes[i] < minTileSize || sizes[i] > maxTileSize || (sizes[i] & (sizes[i] - 1)) != 0;
+			area += (unsigned long long)sizes[i] * sizes[i] * tileCounts[i];
+		}
+		problems += area > (unsigned long long)atlasSize * atlasSize;
+
+		// And they really do pack, largest first
+		std::vector<unsigned int> all;
+		for (unsigned int i = 0; i < lightCount; i++)
+			for (unsigned int t = 0; t < tileCounts[i] && sizes[i] > 0; t++)
+				all.push_back(sizes[i]);
+		std::sort(all.begin(), all.end(), std::greater<unsigned int>());
+		atlas.Clear();
+		for (unsigned int size : all)
+		{
+			ShadowTile tile;
+			problems += !atlas.Allocate(size, tile);
+		}
+	}
+	CHECK(problems == 0);
+
+	// With room to spare, twice the importance is never a smaller tile
+	std::vector<float> importance = { 0.1f, 0.2f, 0.4f, 0.8f };
+	std::vector<unsigned int> tileCounts(4, 1);
+	std::vector<unsigned int> sizes;
+	atlas.ChooseSizes(importance, tileCounts, maxTileSize, sizes);
+	CHECK(sizes == std::vector<unsigned int>({ 64, 128, 256, 512 }));
+
+	// Out of room, the most generous for its importance shrinks first
+	ShadowAtlas small;
+	small.Reset(1024, 64);
+	importance = { 1.0f, 1.0f, 0.6f };
+	sizes.clear();
+	small.ChooseSizes(importance, tileCounts, 1024, sizes);
+	CHECK(sizes == std::vector<unsigned int>({ 512, 512, 512 }));
+}
+
+// --------------------------------------------------------
+// A light whose importance wobbles around a size boundary
+// keeps its size, where without hysteresis it would flip
+// every frame.  A real change still gets through.
+// --------------------------------------------------------
+static void TestChooseSizesHysteresis()
+{
+	const unsigned int maxTileSize = 1024;
+	std::vector<unsigned int> tileCounts(1, 1);
+
+	unsigned int changes[2] = { 0, 0 };
+	for (int band = 0; band < 2; band++)
+	{
+		ShadowAtlas atlas;
+		atlas.Reset(4096, 64);
+		atlas.SetHysteresis(band ? 0.1f : 0.0f);
+
+		// 256 / 1024 is the boundary between 128 and 256 tiles
+		std::vector<unsigned int> sizes;
+		unsigned int last = 0;
+		for (int frame = 0; frame < 100; frame++)
+		{
+			std::vector<float> importance = { 0.25f + (frame % 2 ? 0.01f : -0.01f) };
+			atlas.ChooseSizes(importance, tileCounts, maxTileSize, sizes);
+			changes[band] += frame > 0 && sizes[0] != last;
+			last = sizes[0];
+		}
+	}
+	CHECK(changes[0] == 99);
+	CHECK(changes[1] == 0);
+
+	ShadowAtlas atlas;
+	atlas.Reset(4096, 64);
+	std::vector<unsigned int> sizes = { 256 };
+
+	// Past the band on either side it moves
+	atlas.ChooseSizes({ 0.22f }, tileCounts, maxTileSize, sizes);
+	CHECK(sizes[0] == 128);
+	atlas.ChooseSizes({ 0.26f }, tileCounts, maxTileSize, sizes);
+	CHECK(sizes[0] == 128);
+	atlas.ChooseSizes({ 0.6f }, tileCounts, maxTileSize, sizes);
+	CHECK(sizes[0] == 512);
+
+	// Losing all importance drops it at once
+	atlas.ChooseSizes({ 0.0f }, tileCounts, maxTileSize, sizes);
+	CHECK(sizes[0] == 0);
+}
+
+static void TestImportance()
+{
+	XMMATRIX viewProjection = XMMatrixPerspectiveFovLH(XM_PIDIV4, 1.0f, 0.1f, 100.0f);
+	XMFLOAT4 planes[6];
+	FrustumCuller::ExtractPlanes(viewProjection, planes);
+	float projectionScale = 1.0f / tanf(XM_PIDIV4 * 0.5f);
+	XMFLOAT3 eye(0, 0, 0);
+
+	Light light = {};
+	light.Type = LIGHT_TYPE_DIRECTIONAL;
+	CHECK(ShadowAtlas::Importance(light, eye, projectionScale, planes) == 1.0f);
+
+	light.Type = LIGHT_TYPE_POINT;
+	light.Range = 2.0f;
+	light.Position = XMFLOAT3(0, 0, 1);
+	CHECK(ShadowAtlas::Importance(light, eye, projectionScale, planes) == 1.0f);
+
+	// Shrinks with distance
+	float last = 1.0f;
+	for (float z = 10.0f; z < 100.0f; z += 10.0f)
+	{
+		light.Position = XMFLOAT3(0, 0, z);
+		float importance = ShadowAtlas::Importance(light, eye, projectionScale, planes);
+		CHECK(importance > 0.0f && importance < last);
+		last = importance;
+	}
+
+	// Behind the camera, or past the far plane by more than its range
+	light.Position = XMFLOAT3(0, 0, -5);
+	CHECK(ShadowAtlas::Importance(light, eye, projectionScale, planes) == 0.0f);
+	light.Position = XMFLOAT3(0, 0, 103);
+	CHECK(ShadowAtlas::Importance(light, eye, projectionScale, planes) == 0.0f);
+
+	// Just behind, but its range reaches into view
+	light.Position = XMFLOAT3(0, 0, -1);
+	CHECK(ShadowAtlas::Importance(light, eye, projectionScale, planes) > 0.0f);
+}
+
+// Spot falloff at the half angle is 1%, up to the cap
+static void TestSpotHalfAngle()
+{
+	for (float falloff : { 8.0f, 25.0f, 100.0f })
+	{
+		float angle = ShadowViews::SpotHalfAngle(falloff);
+		CHECK(fabsf(powf(cosf(angle), falloff) - 0.01f) < 1e-4f);
+	}
+	CHECK(fabsf(ShadowViews::SpotHalfAngle(1.0f) - XMConvertToRadians(75.0f)) < 1e-5f);
+	CHECK(fabsf(ShadowViews::SpotHalfAngle(0.0f) - XMConvertToRadians(75.0f)) < 1e-5f);
+}
+
+// --------------------------------------------------------
+// Spot cones and cube faces land a texel inside their tile,
+// where AtlasBounds stops the shader, and every direction
+// around a point light is inside some face's bounds
+// --------------------------------------------------------
+static void TestViewsInTiles()
+{
+	const unsigned int atlasSize = 2048;
+	const float texel = 1.0f / atlasSize;
+	ShadowTile tile = { 512, 1024, 256 };
+	XMFLOAT4 bounds = ShadowViews::AtlasBounds(tile, atlasSize);
+	CHECK(fabsf(bounds.x - 513 * texel) < 1e-7f && fabsf(bounds.y - 1025 * texel) < 1e-7f);
+	CHECK(fabsf(bounds.z - 767 * texel) < 1e-7f && fabsf(bounds.w - 1279 * texel) < 1e-7f);
+
+	auto toAtlas = [atlasSize, &tile](const ShadowView& view, XMFLOAT3 point)
+	{
+		XMFLOAT4X4 matrix = ShadowViews::AtlasMatrix(view, tile, atlasSize);
+		XMFLOAT3 uvz;
+		XMStoreFloat3(&uvz, XMVector3TransformCoord(XMLoadFloat3(&point), XMLoadFloat4x4(&matrix)));
+		return uvz;
+	};
+
+	// A point on the spot's cone edge, at the middle of each side
+	XMFLOAT3 position(3, 4, 5);
+	float halfAngle = XMConvertToRadians(40.0f);
+	ShadowView spot = ShadowViews::Spot(position, XMFLOAT3(0, 0, 1), halfAngle, 0.1f, 20.0f, tile.size);
+	float edge = tanf(halfAngle) * 10.0f;
+	XMFLOAT3 right = toAtlas(spot, XMFLOAT3(position.x + edge, position.y, position.z + 10.0f));
+	XMFLOAT3 top = toAtlas(spot, XMFLOAT3(position.x, position.y + edge, position.z + 10.0f));
+	CHECK(fabsf(right.x - bounds.z) < 1e-5f);
+	CHECK(fabsf(top.y - bounds.y) < 1e-5f);
+	CHECK(right.z > 0.0f && right.z < 1.0f);
+
+	// Random directions around a point light hit some face inside its bounds
+	ShadowView faces[ShadowViews::CubeFaces];
+	for (unsigned int f = 0; f < ShadowViews::CubeFaces; f++)
+		faces[f] = ShadowViews::CubeFace(position, f, 0.1f, 20.0f, tile.size);
+
+	std::mt19937 rng(392);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	unsigned int uncovered = 0;
+	for (int i = 0; i < 10000; i++)
+	{
+		XMFLOAT3 direction;
+		XMStoreFloat3(&direction, XMVectorScale(XMVector3Normalize(XMVectorSet(unit(rng), unit(rng), unit(rng), 0)), 5.0f));
+		XMFLOAT3 point(position.x + direction.x, position.y + direction.y, position.z + direction.z);
+
+		bool covered = false;
+		for (unsigned int f = 0; f < ShadowViews::CubeFaces && !covered; f++)
+		{
+			XMFLOAT3 uvz = toAtlas(faces[f], point);
+			XMFLOAT4 clip;
+			XMStoreFloat4(&clip, XMVector3Transform(XMVector3Transform(XMLoadFloat3(&point), XMLoadFloat4x4(&faces[f].view)), XMLoadFloat4x4(&faces[f].projection)));
+			covered = clip.w > 0.0f &&
+				uvz.x >= bounds.x && uvz.x <= bounds.z && uvz.y >= bounds.y && uvz.y <= bounds.w &&
+				uvz.z >= 0.0f && uvz.z <= 1.0f;
+		}
+		uncovered += !covered;
+	}
+	CHECK(uncovered == 0);
+}
+
+int main()
+{
+	TestAllocateSizes();
+	TestRandomAllocations();
+	TestLargestFirstFits();
+	TestChooseSizesFit();
+	TestChooseSizesHysteresis();
+	TestImportance();
+	TestSpotHalfAngle();
+	TestViewsInTiles();
+	return TestResult();
+}
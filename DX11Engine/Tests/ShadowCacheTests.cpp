@@ -0,0 +1,156 @@
+#include "Check.h"
+#include "ShadowCache.h"
+#include "ShadowCascades.h"
+
+#include <vector>
+
+using namespace DirectX;
+
+typedef std::vector<unsigned long long> Keys;
+
+static XMFLOAT4X4 Matrix(float scale)
+{
+	XMFLOAT4X4 matrix;
+	XMStoreFloat4x4(&matrix, XMMatrixScaling(scale, scale, scale));
+	return matrix;
+}
+
+// A tile is redrawn the first time, and whenever its matrix or any
+// caster key differs from what it last held
+static void TestRedrawRules()
+{
+	ShadowCache cache;
+	cache.Resize(2);
+	CHECK(cache.GetTileCount() == 2);
+
+	XMFLOAT4X4 matrix = Matrix(1.0f);
+	Keys keys = { ShadowCache::CasterKey(1, 0), ShadowCache::CasterKey(5, 3) };
+	CHECK(cache.Update(0, matrix, keys));
+	CHECK(!cache.Update(0, matrix, keys));
+
+	// A caster moved, so its transform's version went up
+	keys[1] = ShadowCache::CasterKey(5, 4);
+	CHECK(cache.Update(0, matrix, keys));
+	CHECK(!cache.Update(0, matrix, keys));
+
+	// A caster came into the view, then left it
+	keys.push_back(ShadowCache::CasterKey(9, 0));
+	CHECK(cache.Update(0, matrix, keys));
+	keys.pop_back();
+	CHECK(cache.Update(0, matrix, keys));
+
+	// No casters at all is still something to draw (a cleared tile)
+	CHECK(cache.Update(0, matrix, Keys()));
+	CHECK(!cache.Update(0, matrix, Keys()));
+
+	// Any change to the matrix, however small
+	XMFLOAT4X4 moved = matrix;
+	moved.m[3][0] = 1e-7f;
+	CHECK(cache.Update(0, moved, Keys()));
+
+	// The other tile has its own state
+	CHECK(cache.Update(1, moved, Keys()));
+	CHECK(!cache.Update(1, moved, Keys()));
+}
+
+// Keys tell apart entities and versions that a plain sum would mix up
+static void TestCasterKeys()
+{
+	CHECK(ShadowCache::CasterKey(1, 0) != ShadowCache::CasterKey(0, 1));
+	CHECK(ShadowCache::CasterKey(1, 2) != ShadowCache::CasterKey(2, 1));
+	CHECK(ShadowCache::CasterKey(0xFFFFFFFFu, 0) != ShadowCache::CasterKey(0, 0xFFFFFFFFu));
+}
+
+// Invalidating forces a redraw of that tile only, and resizing forgets all
+static void TestInvalidation()
+{
+	const unsigned int tileCount = 8;
+	ShadowCache cache;
+	cache.Resize(tileCount);
+
+	XMFLOAT4X4 matrix = Matrix(2.0f);
+	Keys keys = { ShadowCache::CasterKey(3, 1) };
+	for (unsigned int t = 0; t < tileCount; t++)
+		cache.Update(t, matrix, keys);
+
+	cache.Invalidate(3);
+	for (unsigned int t = 0; t < tileCount; t++)
+		CHECK(cache.Update(t, matrix, keys) == (t == 3));
+
+	cache.InvalidateAll();
+	for (unsigned int t = 0; t < tileCount; t++)
+		CHECK(cache.Update(t, matrix, keys));
+	for (unsigned int t = 0; t < tileCount; t++)
+		CHECK(!cache.Update(t, matrix, keys));
+
+	cache.Resize(tileCount);
+	for (unsigned int t = 0; t < tileCount; t++)
+		CHECK(cache.Update(t, matrix, keys));
+}
+
+// --------------------------------------------------------
+// A cascade's static and dynamic layers over a run of
+// frames, as Game drives them: while the camera drifts by
+// less than a texel and only a dynamic caster moves, the
+// static tile is drawn once and the dynamic one only on
+// frames its caster moved.  A real camera move redraws both.
+// --------------------------------------------------------
+static void TestCascadeLayers()
+{
+	const unsigned int resolution = 1024;
+	auto cascadeMatrix = [resolution](float eyeX)
+	{
+		XMMATRIX view = XMMatrixLookToLH(XMVectorSet(eyeX, 2, 0, 0), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0));
+		XMFLOAT3 corners[8];
+		ShadowCascades::SliceCorners(view, 1.0f, 1.78f, 0.5f, 25.0f, corners);
+		ShadowView cascade = ShadowCascades::Fit(corners, XMFLOAT3(0.3f, -1.0f, 0.2f), resolution, 40.0f);
+
+		XMFLOAT4X4 viewProjection;
+		XMStoreFloat4x4(&viewProjection, XMLoadFloat4x4(&cascade.view) * XMLoadFloat4x4(&cascade.projection));
+		return viewProjection;
+	};
+
+	ShadowCache cache;
+	cache.Resize(ShadowLayerCount);
+
+	Keys staticKeys;
+	for (unsigned int i = 0; i < 20; i++)
+		staticKeys.push_back(ShadowCache::CasterKey(i, 0));
+
+	unsigned int dynamicVersion = 0, dynamicMoves = 0;
+	unsigned int redraws[ShadowLayerCount] = { 0, 0 };
+	for (unsigned int frame = 0; frame < 100; frame++)
+	{
+		XMFLOAT4X4 matrix = cascadeMatrix(frame * 1e-6f);
+
+		// The dynamic caster moves every third frame
+		if (frame % 3 == 0)
+		{
+			dynamicVersion++;
+			dynamicMoves++;
+		}
+		Keys dynamicKeys = { ShadowCache::CasterKey(20, dynamicVersion) };
+
+		redraws[ShadowLayerStatic] += cache.Update(ShadowLayerStatic, matrix, staticKeys);
+		redraws[ShadowLayerDynamic] += cache.Update(ShadowLayerDynamic, matrix, dynamicKeys);
+	}
+	CHECK(redraws[ShadowLayerStatic] == 1);
+	CHECK(redraws[ShadowLayerDynamic] == dynamicMoves);
+
+	// Several texels over, and both layers are redrawn once
+	XMFLOAT4X4 moved = cascadeMatrix(5.0f);
+	Keys dynamicKeys = { ShadowCache::CasterKey(20, dynamicVersion) };
+	CHECK(cache.Update(ShadowLayerStatic, moved, staticKeys));
+	CHECK(cache.Update(ShadowLayerDynamic, moved, dynamicKeys));
+	CHECK(!cache.Update(ShadowLayerStatic, moved, staticKeys));
+	CHECK(!cache.Update(ShadowLayerDynamic, moved, dynamicKeys));
+}
+
+int main()
+{
+	TestRedrawRules();
+	TestCasterKeys();
+	TestInvalidation();
+	TestCascadeLayers();
+	return TestResult();
+}
@@ -0,0 +1,341 @@
+#include "Check.h"
+#include "ShadowCascades.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+static const unsigned int Resolution = 1024;
+
+// The fitted square's width and left and bottom edges, in light view space
+static void SquareEdges(const ShadowView& cascade, float& width, float& left, float& bottom)
+{
+	const XMFLOAT4X4& proj = cascade.projection;
+	width = 2.0f / proj.m[0][0];
+	left = -(proj.m[3][0] + 1.0f) / proj.m[0][0];
+	bottom = -(proj.m[3][1] + 1.0f) / proj.m[1][1];
+}
+
+static bool SameMatrices(const ShadowView& a, const ShadowView& b)
+{
+	return
+		memcmp(&a.view, &b.view, sizeof(a.view)) == 0 &&
+		memcmp(&a.projection, &b.projection, sizeof(a.projection)) == 0;
+}
+
+static float DistanceFromWhole(float value)
+{
+	return fabsf(value - roundf(value));
+}
+
+// Splits run from near to far, uniform at lambda 0 and geometric at 1
+static void TestSplits()
+{
+	float splits[ShadowCascades::MaxCascades + 1];
+
+	ShadowCascades::ComputeSplits(1.0f, 101.0f, 4, 0.0f, splits);
+	for (unsigned int i = 0; i <= 4; i++)
+		CHECK(fabsf(splits[i] - (1.0f + 25.0f * i)) < 1e-4f);
+
+	ShadowCascades::ComputeSplits(0.1f, 1000.0f, 4, 1.0f, splits);
+	for (unsigned int i = 0; i <= 4; i++)
+		CHECK(fabsf(splits[i] / (0.1f * powf(10.0f, (float)i)) - 1.0f) < 1e-4f);
+
+	// Blends land in between, strictly increasing, with exact ends
+	for (float lambda : { 0.25f, 0.5f, 0.75f })
+	{
+		for (unsigned int count = 1; count <= ShadowCascades::MaxCascades; count++)
+		{
+			ShadowCascades::ComputeSplits(0.5f, 300.0f, count, lambda, splits);
+			CHECK(splits[0] == 0.5f);
+			CHECK(splits[count] == 300.0f);
+			for (unsigned int i = 1; i <= count; i++)
+				CHECK(splits[i] > splits[i - 1]);
+
+			float uniform[ShadowCascades::MaxCascades + 1], logarithmic[ShadowCascades::MaxCascades + 1];
+			ShadowCascades::ComputeSplits(0.5f, 300.0f, count, 0.0f, uniform);
+			ShadowCascades::ComputeSplits(0.5f, 300.0f, count, 1.0f, logarithmic);
+			for (unsigned int i = 1; i < count; i++)
+				CHECK(splits[i] <= uniform[i] && splits[i] >= logarithmic[i]);
+		}
+	}
+}
+
+// A slice's corners are where the camera's projection puts its corners
+static void TestSliceCorners()
+{
+	float xScale = 1.2f, yScale = 2.1f;
+	XMMATRIX view = XMMatrixLookToLH(XMVectorSet(3, 4, 5, 0), XMVectorSet(1, -0.3f, 0.5f, 0), XMVectorSet(0, 1, 0, 0));
+	XMMATRIX projection = XMMatrixPerspectiveFovLH(2.0f * atanf(1.0f / yScale), yScale / xScale, 0.1f, 100.0f);
+	XMMATRIX viewProjection = view * projection;
+
+	XMFLOAT3 corners[8];
+	ShadowCascades::SliceCorners(view, xScale, yScale, 2.0f, 30.0f, corners);
+	for (int c = 0; c < 8; c++)
+	{
+		XMFLOAT4 clip;
+		XMStoreFloat4(&clip, XMVector3Transform(XMLoadFloat3(&corners[c]), viewProjection));
+		CHECK(fabsf(fabsf(clip.x / clip.w) - 1.0f) < 1e-4f);
+		CHECK(fabsf(fabsf(clip.y / clip.w) - 1.0f) < 1e-4f);
+		CHECK(fabsf(clip.w - (c < 4 ? 2.0f : 30.0f)) < 1e-3f);
+	}
+}
+
+// The fitted cascade holds the whole slice, and reaches toward the light
+static void TestFitCoversSlice()
+{
+	std::mt19937 rng(37);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	unsigned int outside = 0;
+	for (int i = 0; i < 200; i++)
+	{
+		XMMATRIX view = XMMatrixLookToLH(
+			XMVectorSet(unit(rng) * 100.0f, unit(rng) * 100.0f, unit(rng) * 100.0f, 0),
+			XMVectorSet(unit(rng), unit(rng) * 0.5f, unit(rng), 0),
+			XMVectorSet(0, 1, 0, 0));
+		XMFLOAT3 lightDirection(unit(rng), -1.0f, unit(rng));
+
+		XMFLOAT3 corners[8];
+		ShadowCascades::SliceCorners(view, 1.0f, 1.78f, 5.0f, 40.0f, corners);
+		ShadowView cascade = ShadowCascades::Fit(corners, lightDirection, Resolution, 50.0f);
+		XMMATRIX viewProjection = XMLoadFloat4x4(&cascade.view) * XMLoadFloat4x4(&cascade.projection);
+
+		for (const XMFLOAT3& corner : corners)
+		{
+			XMFLOAT3 ndc;
+			XMStoreFloat3(&ndc, XMVector3TransformCoord(XMLoadFloat3(&corner), viewProjection));
+			outside += fabsf(ndc.x) > 1.0f || fabsf(ndc.y) > 1.0f || ndc.z < 0.0f || ndc.z > 1.0f;
+		}
+
+		// The caster reach is in front of the slice's sphere
+		float width, left, bottom;
+		SquareEdges(cascade, width, left, bottom);
+		CHECK(fabsf(cascade.depthFar - cascade.depthNear - (width + 50.0f)) < 1e-3f);
+	}
+	CHECK(outside == 0);
+}
+
+// --------------------------------------------------------
+// Texel snapping: however the camera moves or turns, the
+// cascade keeps its size, and its edges only ever move by
+// whole texels, so each world position stays at the same
+// place within its texel and the shadow doesn't shimmer.
+// Moves smaller than a texel leave it exactly unchanged.
+// --------------------------------------------------------
+static void TestTexelSnapping()
+{
+	XMFLOAT3 lightDirection(0.4f, -1.0f, 0.3f);
+	auto fitAt = [&lightDirection](XMFLOAT3 eye, XMFLOAT3 forward)
+	{
+		XMMATRIX view = XMMatrixLookToLH(XMLoadFloat3(&eye), XMLoadFloat3(&forward), XMVectorSet(0, 1, 0, 0));
+		XMFLOAT3 corners[8];
+		ShadowCascades::SliceCorners(view, 1.0f, 1.78f, 0.5f, 25.0f, corners);
+		return ShadowCascades::Fit(corners, lightDirection, Resolution, 40.0f);
+	};
+
+	ShadowView first = fitAt(XMFLOAT3(0, 2, 0), XMFLOAT3(0, 0, 1));
+	float firstWidth, firstLeft, firstBottom;
+	SquareEdges(first, firstWidth, firstLeft, firstBottom);
+	float texelSize = firstWidth / Resolution;
+
+	// The edges sit on the texel grid to begin with
+	CHECK(DistanceFromWhole(firstLeft / texelSize) < 1e-3f);
+	CHECK(DistanceFromWhole(firstBottom / texelSize) < 1e-3f);
+
+	std::mt19937 rng(370);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	unsigned int sizeChanges = 0, offGrid = 0, moves = 0;
+	XMFLOAT3 eye(0, 2, 0);
+	for (int frame = 0; frame < 500; frame++)
+	{
+		// Walk and turn
+		eye.x += unit(rng) * 0.3f;
+		eye.z += unit(rng) * 0.3f;
+		XMFLOAT3 forward(unit(rng), unit(rng) * 0.3f, unit(rng));
+
+		ShadowView cascade = fitAt(eye, forward);
+		float width, left, bottom;
+		SquareEdges(cascade, width, left, bottom);
+		sizeChanges += width != firstWidth;
+
+		float stepX = (left - firstLeft) / texelSize;
+		float stepY = (bottom - firstBottom) / texelSize;
+		offGrid += DistanceFromWhole(stepX) > 1e-2f || DistanceFromWhole(stepY) > 1e-2f;
+		moves += fabsf(stepX) >= 0.5f || fabsf(stepY) >= 0.5f;
+	}
+	CHECK(sizeChanges == 0);
+	CHECK(offGrid == 0);
+	CHECK(moves > 0);
+
+	// Tiny moves don't change a single bit
+	unsigned int changed = 0;
+	for (int i = 1; i <= 100; i++)
+		changed += !SameMatrices(first, fitAt(XMFLOAT3(i * 1e-5f, 2.0f, i * 1e-5f), XMFLOAT3(0, 0, 1)));
+	CHECK(changed == 0);
+}
+
+// The light view space bounds of a box, from its corners
+static void LightBounds(const ShadowView& cascade, const BoundingBox& box, XMFLOAT3& boundsMin, XMFLOAT3& boundsMax)
+{
+	XMFLOAT3 corners[BoundingBox::CORNER_COUNT];
+	box.GetCorners(corners);
+	XMMATRIX view = XMLoadFloat4x4(&cascade.view);
+
+	boundsMin = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+	boundsMax = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (const XMFLOAT3& corner : corners)
+	{
+		XMFLOAT3 p;
+		XMStoreFloat3(&p, XMVector3TransformCoord(XMLoadFloat3(&corner), view));
+		boundsMin = XMFLOAT3(std::min(boundsMin.x, p.x), std::min(boundsMin.y, p.y), std::min(boundsMin.z, p.z));
+		boundsMax = XMFLOAT3(std::max(boundsMax.x, p.x), std::max(boundsMax.y, p.y), std::max(boundsMax.z, p.z));
+	}
+}
+
+// --------------------------------------------------------
+// Tighten never cuts anything off.  Whatever part of each
+// receiver the fitted cascade held is still inside the
+// tightened one, and every caster over that square, between
+// the receivers and the light, is inside its depth range
+// (unless the fitted cascade's caster reach already cut it).
+// --------------------------------------------------------
+static void TestTightenKeepsEverything()
+{
+	const float slack = 1e-3f;
+	std::mt19937 rng(40);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> positive(0.0f, 1.0f);
+
+	unsigned int receiversCut = 0, castersCut = 0, shrunk = 0, unchanged = 0;
+	for (int round = 0; round < 300; round++)
+	{
+		XMFLOAT3 eye(unit(rng) * 50.0f, 2.0f + positive(rng) * 5.0f, unit(rng) * 50.0f);
+		XMMATRIX view = XMMatrixLookToLH(XMLoadFloat3(&eye), XMVectorSet(unit(rng), -0.2f, unit(rng), 0), XMVectorSet(0, 1, 0, 0));
+		XMFLOAT3 lightDirection(unit(rng), -1.0f, unit(rng));
+		XMFLOAT3 corners[8];
+		ShadowCascades::SliceCorners(view, 1.0f, 1.78f, 1.0f, 30.0f, corners);
+		ShadowView cascade = ShadowCascades::Fit(corners, lightDirection, Resolution, 40.0f);
+
+		// A cluster of receivers (sometimes tiny, so it shrinks a lot),
+		// some far off, and casters around and above them
+		float spread = positive(rng) < 0.5f ? 1.0f : 12.0f;
+		XMFLOAT3 middle = corners[0];
+		std::vector<BoundingBox> receivers, casters;
+		int receiverCount = round % 10 == 0 ? 0 : 1 + (int)(positive(rng) * 20.0f);
+		for (int i = 0; i < receiverCount; i++)
+		{
+			XMFLOAT3 center(middle.x + unit(rng) * spread, middle.y + unit(rng) * spread, middle.z + unit(rng) * spread);
+			XMFLOAT3 extents(0.1f + positive(rng) * spread * 0.3f, 0.1f + positive(rng), 0.1f + positive(rng) * spread * 0.3f);
+			receivers.push_back(BoundingBox(center, extents));
+		}
+		receivers.push_back(BoundingBox(XMFLOAT3(eye.x + 500.0f, 0, eye.z), XMFLOAT3(1, 1, 1)));
+		casters = receivers;
+		for (int i = 0; i < 20; i++)
+		{
+			XMFLOAT3 center(middle.x + unit(rng) * spread * 2.0f, middle.y + positive(rng) * 60.0f, middle.z + unit(rng) * spread * 2.0f);
+			casters.push_back(BoundingBox(center, XMFLOAT3(0.5f, 0.5f, 0.5f)));
+		}
+
+		ShadowView tight = ShadowCascades::Tighten(cascade, Resolution, receivers, casters);
+
+		float width, left, bottom, tightWidth, tightLeft, tightBottom;
+		SquareEdges(cascade, width, left, bottom);
+		SquareEdges(tight, tightWidth, tightLeft, tightBottom);
+		float receiverNear = cascade.depthFar - width;
+
+		if (SameMatrices(tight, cascade) && tight.depthNear == cascade.depthNear && tight.depthFar == cascade.depthFar)
+			unchanged++;
+		shrunk += tightWidth < width;
+
+		// The receivers' clipped parts, and how far from the light they reach
+		float receiverFar = -FLT_MAX;
+		for (const BoundingBox& box : receivers)
+		{
+			XMFLOAT3 boxMin, boxMax;
+			LightBounds(cascade, box, boxMin, boxMax);
+			XMFLOAT3 clipMin(std::max(boxMin.x, left), std::max(boxMin.y, bottom), std::max(boxMin.z, receiverNear));
+			XMFLOAT3 clipMax(std::min(boxMax.x, left + width), std::min(boxMax.y, bottom + width), std::min(boxMax.z, cascade.depthFar));
+			if (clipMin.x > clipMax.x || clipMin.y > clipMax.y || clipMin.z > clipMax.z)
+				continue;
+
+			receiverFar = std::max(receiverFar, clipMax.z);
+			receiversCut +=
+				clipMin.x < tightLeft - slack || clipMax.x > tightLeft + tightWidth + slack ||
+				clipMin.y < tightBottom - slack || clipMax.y > tightBottom + tightWidth + slack ||
+				clipMax.z > tight.depthFar + slack;
+		}
+
+		for (const BoundingBox& box : casters)
+		{
+			XMFLOAT3 boxMin, boxMax;
+			LightBounds(cascade, box, boxMin, boxMax);
+			bool overSquare =
+				boxMax.x > tightLeft && boxMin.x < tightLeft + tightWidth &&
+				boxMax.y > tightBottom && boxMin.y < tightBottom + tightWidth;
+			if (!overSquare || boxMin.z > receiverFar)
+				continue;
+
+			castersCut += std::max(boxMin.z, cascade.depthNear) < tight.depthNear - slack;
+		}
+
+		// Still a valid range inside the fitted one
+		CHECK(tight.depthNear < tight.depthFar);
+		CHECK(tight.depthNear >= cascade.depthNear && tight.depthFar <= cascade.depthFar);
+	}
+
+	CHECK(receiversCut == 0);
+	CHECK(castersCut == 0);
+	CHECK(shrunk > 0);
+	CHECK(unchanged >= 30);
+}
+
+// Tightened cascades are as stable under small camera moves as fitted ones
+static void TestTightenStable()
+{
+	std::vector<BoundingBox> receivers = { BoundingBox(XMFLOAT3(0, -2, 5), XMFLOAT3(4, 0.1f, 4)), BoundingBox(XMFLOAT3(1, 0, 6), XMFLOAT3(0.5f, 1, 0.5f)) };
+	std::vector<BoundingBox> casters = receivers;
+	casters.push_back(BoundingBox(XMFLOAT3(0, 10, -5), XMFLOAT3(0.5f, 0.5f, 0.5f)));
+
+	auto tightAt = [&](float eyeX)
+	{
+		XMMATRIX view = XMMatrixLookToLH(XMVectorSet(eyeX, 0, 0, 0), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0));
+		XMFLOAT3 corners[8];
+		ShadowCascades::SliceCorners(view, 1.0f, 1.5f, 0.1f, 20.0f, corners);
+		ShadowView fitted = ShadowCascades::Fit(corners, XMFLOAT3(0, -1, 1), Resolution, 50.0f);
+		return ShadowCascades::Tighten(fitted, Resolution, receivers, casters);
+	};
+
+	ShadowView first = tightAt(0.0f);
+	float width, left, bottom, fittedWidth;
+	SquareEdges(first, width, left, bottom);
+	{
+		XMMATRIX view = XMMatrixLookToLH(XMVectorSet(0, 0, 0, 0), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0));
+		XMFLOAT3 corners[8];
+		ShadowCascades::SliceCorners(view, 1.0f, 1.5f, 0.1f, 20.0f, corners);
+		float fittedLeft, fittedBottom;
+		SquareEdges(ShadowCascades::Fit(corners, XMFLOAT3(0, -1, 1), Resolution, 50.0f), fittedWidth, fittedLeft, fittedBottom);
+	}
+	CHECK(width < fittedWidth);
+
+	unsigned int changed = 0;
+	for (int i = 1; i <= 100; i++)
+		changed += !SameMatrices(first, tightAt(i * 1e-4f));
+	CHECK(changed == 0);
+}
+
+int main()
+{
+	TestSplits();
+	TestSliceCorners();
+	TestFitCoversSlice();
+	TestTexelSnapping();
+	TestTightenKeepsEverything();
+	TestTightenStable();
+	return TestResult();
+}
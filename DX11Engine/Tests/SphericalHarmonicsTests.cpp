@@ -0,0 +1,226 @@
+#include "Check.h"
+#include "SphericalHarmonics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <vector>
+
+using namespace DirectX;
+
+typedef XMFLOAT3 Coefficients[SphericalHarmonics::CoefficientCount];
+
+static const double Pi = 3.14159265358979;
+
+// A cube map of the radiance an environment sends along each texel's center
+static void MakeFaces(const std::function<XMFLOAT3(XMFLOAT3)>& environment, unsigned int size, std::vector<XMFLOAT4> faces[6])
+{
+	for (unsigned int face = 0; face < 6; face++)
+	{
+		faces[face].resize(size * size);
+		for (unsigned int y = 0; y < size; y++)
+		{
+			for (unsigned int x = 0; x < size; x++)
+			{
+				XMFLOAT3 direction = SphericalHarmonics::FaceDirection(face, (x + 0.5f) * 2.0f / size - 1.0f, (y + 0.5f) * 2.0f / size - 1.0f);
+				XMFLOAT3 radiance = environment(direction);
+				faces[face][y * size + x] = XMFLOAT4(radiance.x, radiance.y, radiance.z, 1.0f);
+			}
+		}
+	}
+}
+
+// The largest difference from the expected coefficients, per channel
+static float WorstError(const Coefficients actual, const Coefficients expected)
+{
+	float worst = 0.0f;
+	for (unsigned int c = 0; c < SphericalHarmonics::CoefficientCount; c++)
+	{
+		worst = std::max(worst, fabsf(actual[c].x - expected[c].x));
+		worst = std::max(worst, fabsf(actual[c].y - expected[c].y));
+		worst = std::max(worst, fabsf(actual[c].z - expected[c].z));
+	}
+	return worst;
+}
+
+// Directions spread over the sphere, for checking Evaluate()
+static std::vector<XMFLOAT3> SphereDirections()
+{
+	std::vector<XMFLOAT3> directions;
+	for (int i = 0; i < 200; i++)
+	{
+		// A Fibonacci spiral
+		float z = 1.0f - (i + 0.5f) * 2.0f / 200;
+		float r = sqrtf(1.0f - z * z);
+		float angle = i * 2.39996323f;
+		directions.push_back(XMFLOAT3(r * cosf(angle), r * sinf(angle), z));
+	}
+	return directions;
+}
+
+// --------------------------------------------------------
+// A constant environment L only has the first coefficient,
+// L times the integral of Y0 over the sphere (4 pi Y0, or
+// 2 sqrt(pi)), and a white diffuse surface facing any way
+// reflects exactly L.  Odd sizes leave a part-filled group
+// of four texels at the end of each row.
+// --------------------------------------------------------
+static void TestConstant()
+{
+	const XMFLOAT3 radiance(0.5f, 1.0f, 2.0f);
+	const float c0 = (float)(2.0 * sqrt(Pi));
+
+	Coefficients expected = {};
+	expected[0] = XMFLOAT3(radiance.x * c0, radiance.y * c0, radiance.z * c0);
+
+	unsigned int sizes[] = { 1, 7, 32 };
+	for (unsigned int size : sizes)
+	{
+		std::vector<XMFLOAT4> faces[6];
+		MakeFaces([&](XMFLOAT3) { return radiance; }, size, faces);
+
+		Coefficients coefficients;
+		SphericalHarmonics::ProjectCubeMap(faces, size, coefficients);
+		CHECK(WorstError(coefficients, expected) < 1e-4f);
+
+		SphericalHarmonics::ConvolveDiffuse(coefficients);
+		float worst = 0.0f;
+		for (const XMFLOAT3& normal : SphereDirections())
+		{
+			XMFLOAT3 reflected = SphericalHarmonics::Evaluate(coefficients, normal);
+			worst = std::max(worst, fabsf(reflected.x - radiance.x) + fabsf(reflected.y - radiance.y) + fabsf(reflected.z - radiance.z));
+		}
+		CHECK(worst < 1e-4f);
+	}
+}
+
+// --------------------------------------------------------
+// A linear gradient a + b d.y puts b times the integral of
+// Y1 d.y, which is sqrt(4 pi / 3), in the y coefficient
+// only.  Each channel runs along a different axis.  The
+// cosine lobe keeps two thirds of the first band, so the
+// reflected light is a + 2/3 b n.y exactly.
+// --------------------------------------------------------
+static void TestLinearGradient()
+{
+	const float a = 1.0f, b = 0.75f;
+	const unsigned int size = 32;
+
+	std::vector<XMFLOAT4> faces[6];
+	MakeFaces([&](XMFLOAT3 d) { return XMFLOAT3(a + b * d.y, a + b * d.z, a + b * d.x); }, size, faces);
+
+	Coefficients coefficients;
+	SphericalHarmonics::ProjectCubeMap(faces, size, coefficients);
+
+	// Basis order is 1, y, z, x, ...
+	const float c0 = (float)(2.0 * sqrt(Pi)) * a;
+	const float c1 = (float)sqrt(4.0 * Pi / 3.0) * b;
+	Coefficients expected = {};
+	expected[0] = XMFLOAT3(c0, c0, c0);
+	expected[1] = XMFLOAT3(c1, 0, 0);
+	expected[2] = XMFLOAT3(0, c1, 0);
+	expected[3] = XMFLOAT3(0, 0, c1);
+	CHECK(WorstError(coefficients, expected) < 2e-3f);
+
+	SphericalHarmonics::ConvolveDiffuse(coefficients);
+	float worst = 0.0f;
+	for (const XMFLOAT3& n : SphereDirections())
+	{
+		XMFLOAT3 reflected = SphericalHarmonics::Evaluate(coefficients, n);
+		worst = std::max(worst, fabsf(reflected.x - (a + 2.0f / 3.0f * b * n.y)));
+		worst = std::max(worst, fabsf(reflected.y - (a + 2.0f / 3.0f * b * n.z)));
+		worst = std::max(worst, fabsf(reflected.z - (a + 2.0f / 3.0f * b * n.x)));
+	}
+	CHECK(worst < 2e-3f);
+}
+
+// The exact solid angle of the part of a face from its center out to (u, v)
+static double CornerSolidAngle(double u, double v)
+{
+	return atan2(u * v, sqrt(u * u + v * v + 1.0));
+}
+
+static double TexelSolidAngle(unsigned int x, unsigned int y, unsigned int size)
+{
+	double u0 = x * 2.0 / size - 1.0, u1 = (x + 1) * 2.0 / size - 1.0;
+	double v0 = y * 2.0 / size - 1.0, v1 = (y + 1) * 2.0 / size - 1.0;
+	return CornerSolidAngle(u1, v1) - CornerSolidAngle(u0, v1) - CornerSolidAngle(u1, v0) + CornerSolidAngle(u0, v0);
+}
+
+// --------------------------------------------------------
+// A single lit texel is light from one direction: each
+// coefficient is the light's power (radiance times the
+// texel's solid angle) times the basis function along that
+// direction.  Tried on every face, and away from the
+// centers so every basis function is nonzero somewhere.
+// --------------------------------------------------------
+static void TestSingleDirection()
+{
+	const unsigned int size = 64;
+	const float radiance = 100.0f;
+	const unsigned int texels[][2] = { { 10, 50 }, { 32, 5 }, { 60, 33 } };
+
+	float worstRatio = 0.0f, worstPower = 0.0f;
+	for (unsigned int face = 0; face < 6; face++)
+	{
+		for (const auto& texel : texels)
+		{
+			std::vector<XMFLOAT4> faces[6];
+			for (unsigned int f = 0; f < 6; f++)
+				faces[f].assign(size * size, XMFLOAT4(0, 0, 0, 1));
+			faces[face][texel[1] * size + texel[0]] = XMFLOAT4(radiance, 0, 0, 1);
+
+			Coefficients coefficients;
+			SphericalHarmonics::ProjectCubeMap(faces, size, coefficients);
+
+			XMFLOAT3 direction = SphericalHarmonics::FaceDirection(face, (texel[0] + 0.5f) * 2.0f / size - 1.0f, (texel[1] + 0.5f) * 2.0f / size - 1.0f);
+			float basis[SphericalHarmonics::CoefficientCount];
+			SphericalHarmonics::Basis(direction, basis);
+
+			float power = (float)(radiance * TexelSolidAngle(texel[0], texel[1], size));
+			for (unsigned int c = 0; c < SphericalHarmonics::CoefficientCount; c++)
+			{
+				// Against the first coefficient the texel's weight cancels out
+				worstRatio = std::max(worstRatio, fabsf(coefficients[c].x / coefficients[0].x - basis[c] / basis[0]));
+				CHECK(coefficients[c].y == 0.0f && coefficients[c].z == 0.0f);
+			}
+			worstPower = std::max(worstPower, fabsf(coefficients[0].x / (power * basis[0]) - 1.0f));
+		}
+	}
+	CHECK(worstRatio < 1e-4f);
+
+	// The weights approximate each texel's solid angle closely
+	CHECK(worstPower < 1e-3f);
+}
+
+// The basis is orthonormal: projecting each basis function gives back 1 for itself
+static void TestOrthonormalBasis()
+{
+	const unsigned int size = 64;
+	for (unsigned int b = 0; b < SphericalHarmonics::CoefficientCount; b++)
+	{
+		std::vector<XMFLOAT4> faces[6];
+		MakeFaces([b](XMFLOAT3 d)
+		{
+			float basis[SphericalHarmonics::CoefficientCount];
+			SphericalHarmonics::Basis(d, basis);
+			return XMFLOAT3(basis[b], 0, 0);
+		}, size, faces);
+
+		Coefficients coefficients;
+		SphericalHarmonics::ProjectCubeMap(faces, size, coefficients);
+
+		Coefficients expected = {};
+		expected[b].x = 1.0f;
+		CHECK(WorstError(coefficients, expected) < 2e-3f);
+	}
+}
+
+int main()
+{
+	TestConstant();
+	TestLinearGradient();
+	TestSingleDirection();
+	TestOrthonormalBasis();
+	return TestResult();
+}
@@ -0,0 +1,246 @@
+#include "Check.h"
+#include "StateFilter.h"
+
+#include <string>
+#include <vector>
+
+// Stands in for the device context, recording each call that reaches it
+struct RecordingContext
+{
+	std::vector<std::string> calls;
+
+	void Record(const std::string& call) { calls.push_back(call); }
+
+	// The calls since the last Take()
+	std::vector<std::string> Take()
+	{
+		std::vector<std::string> taken;
+		taken.swap(calls);
+		return taken;
+	}
+};
+
+static std::string Range(const char* name, unsigned int start, unsigned int count)
+{
+	return std::string(name) + "(" + std::to_string(start) + "," + std::to_string(count) + ")";
+}
+
+// Forwards binds through a StateFilter the way StateCache does, so only
+// the calls (and slot ranges) it lets through reach the context
+struct FilteredContext
+{
+	StateFilter filter;
+	RecordingContext context;
+
+	void PSSetShader(const void* shader)
+	{
+		if (filter.SetShader(ShaderStagePS, shader))
+			context.Record("PSSetShader");
+	}
+
+	void PSSetShaderResources(unsigned int start, unsigned int count, const void* const* views)
+	{
+		if (filter.SetShaderResources(ShaderStagePS, start, count, views))
+			context.Record(Range("PSSetShaderResources", start, count));
+	}
+
+	void VSSetConstantBuffers(unsigned int start, unsigned int count, const void* const* buffers)
+	{
+		if (filter.SetConstantBuffers(ShaderStageVS, start, count, buffers, 0, 0))
+			context.Record(Range("VSSetConstantBuffers", start, count));
+	}
+
+	void VSSetConstantBuffers1(unsigned int start, unsigned int count, const void* const* buffers, const unsigned int* firstConstants, const unsigned int* numConstants)
+	{
+		if (filter.SetConstantBuffers(ShaderStageVS, start, count, buffers, firstConstants, numConstants))
+			context.Record(Range("VSSetConstantBuffers1", start, count));
+	}
+
+	void IASetPrimitiveTopology(unsigned int topology)
+	{
+		if (filter.SetPrimitiveTopology(topology))
+			context.Record("IASetPrimitiveTopology");
+	}
+
+	void IASetVertexBuffers(unsigned int start, unsigned int count, const void* const* buffers, const unsigned int* strides, const unsigned int* offsets)
+	{
+		if (filter.SetVertexBuffers(start, count, buffers, strides, offsets))
+			context.Record(Range("IASetVertexBuffers", start, count));
+	}
+
+	void OMSetDepthStencilState(const void* state, unsigned int stencilRef)
+	{
+		if (filter.SetDepthStencilState(state, stencilRef))
+			context.Record("OMSetDepthStencilState");
+	}
+};
+
+typedef std::vector<std::string> Calls;
+
+// Repeating a bind reaches the context once, a different one always does
+static void TestSingleSlots()
+{
+	FilteredContext cache;
+	int shaderA, shaderB, depthState;
+
+	cache.PSSetShader(&shaderA);
+	cache.PSSetShader(&shaderA);
+	cache.PSSetShader(&shaderB);
+	cache.PSSetShader(nullptr);
+	cache.PSSetShader(nullptr);
+	CHECK(cache.context.Take() == Calls({ "PSSetShader", "PSSetShader", "PSSetShader" }));
+
+	cache.IASetPrimitiveTopology(4);
+	cache.IASetPrimitiveTopology(4);
+	cache.OMSetDepthStencilState(&depthState, 0);
+	cache.OMSetDepthStencilState(&depthState, 0);
+	cache.OMSetDepthStencilState(&depthState, 1);
+	CHECK(cache.context.Take() == Calls({ "IASetPrimitiveTopology", "OMSetDepthStencilState", "OMSetDepthStencilState" }));
+}
+
+// Range binds are narrowed to the slots that changed
+static void TestRangeNarrowing()
+{
+	FilteredContext cache;
+	int a, b, c, d;
+	const void* views[4] = { &a, &b, nullptr, nullptr };
+
+	cache.PSSetShaderResources(0, 4, views);
+	cache.PSSetShaderResources(0, 4, views);
+	views[2] = &c;
+	cache.PSSetShaderResources(0, 4, views);
+
+	// Unchanged slots between two changed ones are sent again
+	views[0] = &d;
+	views[3] = &d;
+	cache.PSSetShaderResources(0, 4, views);
+	CHECK(cache.context.Take() == Calls({
+		"PSSetShaderResources(0,4)",
+		"PSSetShaderResources(2,1)",
+		"PSSetShaderResources(0,4)" }));
+
+	const void* buffers[2] = { &a, &b };
+	unsigned int strides[2] = { 32, 32 };
+	unsigned int offsets[2] = { 0, 0 };
+	cache.IASetVertexBuffers(0, 2, buffers, strides, offsets);
+	cache.IASetVertexBuffers(0, 2, buffers, strides, offsets);
+	offsets[1] = 64;
+	cache.IASetVertexBuffers(0, 2, buffers, strides, offsets);
+	CHECK(cache.context.Take() == Calls({ "IASetVertexBuffers(0,2)", "IASetVertexBuffers(1,1)" }));
+}
+
+// The same ring buffer bound at a new offset is a new binding
+static void TestConstantBufferOffsets()
+{
+	FilteredContext cache;
+	int ring, perObject;
+	const void* buffers[2] = { &ring, &ring };
+	unsigned int firstConstants[2] = { 0, 16 };
+	unsigned int numConstants[2] = { 16, 16 };
+
+	cache.VSSetConstantBuffers1(0, 2, buffers, firstConstants, numConstants);
+	cache.VSSetConstantBuffers1(0, 2, buffers, firstConstants, numConstants);
+
+	// Only the second slot moved within the ring
+	firstConstants[1] = 32;
+	cache.VSSetConstantBuffers1(0, 2, buffers, firstConstants, numConstants);
+
+	// A size change is a change too
+	numConstants[0] = 32;
+	cache.VSSetConstantBuffers1(0, 2, buffers, firstConstants, numConstants);
+	cache.VSSetConstantBuffers1(0, 2, buffers, firstConstants, numConstants);
+	CHECK(cache.context.Take() == Calls({
+		"VSSetConstantBuffers1(0,2)",
+		"VSSetConstantBuffers1(1,1)",
+		"VSSetConstantBuffers1(0,1)" }));
+
+	// A whole buffer bind replaces a ring range even for the same
+	// buffer, since it counts as 0 constants and no ring range does
+	const void* whole[1] = { &ring };
+	cache.VSSetConstantBuffers(0, 1, whole);
+	cache.VSSetConstantBuffers(0, 1, whole);
+	const void* own[1] = { &perObject };
+	cache.VSSetConstantBuffers(1, 1, own);
+	CHECK(cache.context.Take() == Calls({ "VSSetConstantBuffers(0,1)", "VSSetConstantBuffers(1,1)" }));
+}
+
+// After an Invalidate() the next bind of each kind always goes through
+static void TestInvalidate()
+{
+	FilteredContext cache;
+	int shader, view;
+	const void* views[1] = { &view };
+
+	cache.PSSetShader(&shader);
+	cache.PSSetShaderResources(3, 1, views);
+	cache.IASetPrimitiveTopology(4);
+	cache.context.Take();
+
+	cache.filter.InvalidateShaderResources();
+	cache.PSSetShader(&shader);
+	cache.PSSetShaderResources(3, 1, views);
+	CHECK(cache.context.Take() == Calls({ "PSSetShaderResources(3,1)" }));
+
+	cache.filter.Invalidate();
+	cache.PSSetShader(&shader);
+	cache.PSSetShaderResources(3, 1, views);
+	cache.IASetPrimitiveTopology(4);
+	cache.PSSetShader(&shader);
+	CHECK(cache.context.Take() == Calls({ "PSSetShader", "PSSetShaderResources(3,1)", "IASetPrimitiveTopology" }));
+
+	// Null is a valid binding and is just as unknown after invalidating
+	cache.filter.Invalidate();
+	cache.PSSetShader(nullptr);
+	CHECK(cache.context.Take() == Calls({ "PSSetShader" }));
+}
+
+// --------------------------------------------------------
+// IsShaderSet() knows only the shader last set on each stage,
+// and nothing after an Invalidate(), so SimpleShader rebinds
+// an uploaded buffer only for the shader the stage really has
+// --------------------------------------------------------
+static void TestIsShaderSet()
+{
+	FilteredContext cache;
+	int shaderA, shaderB;
+
+	CHECK(!cache.filter.IsShaderSet(ShaderStagePS, &shaderA));
+	cache.PSSetShader(&shaderA);
+	CHECK(cache.filter.IsShaderSet(ShaderStagePS, &shaderA));
+	CHECK(!cache.filter.IsShaderSet(ShaderStagePS, &shaderB));
+	CHECK(!cache.filter.IsShaderSet(ShaderStageVS, &shaderA));
+
+	cache.PSSetShader(&shaderB);
+	CHECK(!cache.filter.IsShaderSet(ShaderStagePS, &shaderA));
+	CHECK(cache.filter.IsShaderSet(ShaderStagePS, &shaderB));
+
+	cache.filter.Invalidate();
+	CHECK(!cache.filter.IsShaderSet(ShaderStagePS, &shaderB));
+}
+
+// Out of range calls go through untouched for Direct3D to report
+static void TestOutOfRange()
+{
+	FilteredContext cache;
+	int view;
+	const void* views[2] = { &view, &view };
+
+	cache.PSSetShaderResources(StateFilter::MaxShaderResources - 1, 2, views);
+	cache.PSSetShaderResources(StateFilter::MaxShaderResources - 1, 2, views);
+	CHECK(cache.context.Take() == Calls({ "PSSetShaderResources(127,2)", "PSSetShaderResources(127,2)" }));
+
+	// Both counted as issued
+	CHECK(cache.filter.GetIssuedCount() == 2);
+	CHECK(cache.filter.GetFilteredCount() == 0);
+}
+
+int main()
+{
+	TestSingleSlots();
+	TestRangeNarrowing();
+	TestConstantBufferOffsets();
+	TestInvalidate();
+	TestIsShaderSet();
+	TestOutOfRange();
+	return TestResult();
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+// --------------------------------------------------------
+// Stand-in for DirectXCollision's bounding volumes, with
+// just the members the engine's device-free code uses
+// --------------------------------------------------------
+
+#include "DirectXMath.h"
+
+namespace DirectX
+{
+	struct BoundingSphere
+	{
+		XMFLOAT3 Center;
+		float Radius;
+
+		BoundingSphere() : Center(0, 0, 0), Radius(1.0f) {}
+		BoundingSphere(const XMFLOAT3& center, float radius) : Center(center), Radius(radius) {}
+	};
+
+	struct BoundingBox
+	{
+		static const size_t CORNER_COUNT = 8;
+
+		XMFLOAT3 Center;
+		XMFLOAT3 Extents;
+
+		BoundingBox() : Center(0, 0, 0), Extents(1, 1, 1) {}
+		BoundingBox(const XMFLOAT3& center, const XMFLOAT3& extents) : Center(center), Extents(extents) {}
+
+		// In DirectXCollision's order
+		void GetCorners(XMFLOAT3* corners) const
+		{
+			static const float offsets[CORNER_COUNT][3] =
+			{
+				{ -1, -1,  1 }, {  1, -1,  1 }, {  1,  1,  1 }, { -1,  1,  1 },
+				{ -1, -1, -1 }, {  1, -1, -1 }, {  1,  1, -1 }, { -1,  1, -1 },
+			};
+			for (size_t i = 0; i < CORNER_COUNT; i++)
+			{
+				corners[i] = XMFLOAT3(
+					Center.x + offsets[i][0] * Extents.x,
+					Center.y + offsets[i][1] * Extents.y,
+					Center.z + offsets[i][2] * Extents.z);
+			}
+		}
+	};
+}
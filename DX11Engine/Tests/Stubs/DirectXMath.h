@@ -0,0 +1,381 @@
+#pragma once
+
+// --------------------------------------------------------
+// Stand-in for DirectXMath on platforms without it, so the
+// headless tests can build the engine's device-free code.
+// Only what that code and the tests use is here, on SSE2,
+// with the same names, types and lane semantics as the real
+// header.  The Windows build never sees this directory.
+// --------------------------------------------------------
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace DirectX
+{
+	const float XM_PI = 3.141592654f;
+	const float XM_2PI = 6.283185307f;
+	const float XM_PIDIV2 = 1.570796327f;
+	const float XM_PIDIV4 = 0.785398163f;
+	const float XM_1DIVSQRT2 = 0.707106781f;
+
+	typedef __m128 XMVECTOR;
+	typedef const XMVECTOR FXMVECTOR;
+
+	struct XMFLOAT2
+	{
+		float x, y;
+		XMFLOAT2() = default;
+		XMFLOAT2(float p_x, float p_y) : x(p_x), y(p_y) {}
+	};
+
+	struct XMFLOAT3
+	{
+		float x, y, z;
+		XMFLOAT3() = default;
+		XMFLOAT3(float p_x, float p_y, float p_z) : x(p_x), y(p_y), z(p_z) {}
+	};
+
+	struct XMFLOAT4
+	{
+		float x, y, z, w;
+		XMFLOAT4() = default;
+		XMFLOAT4(float p_x, float p_y, float p_z, float p_w) : x(p_x), y(p_y), z(p_z), w(p_w) {}
+	};
+
+	struct XMFLOAT4X4
+	{
+		float m[4][4];
+	};
+
+	// Rows, as in DirectXMath
+	struct XMMATRIX
+	{
+		XMVECTOR r[4];
+		XMMATRIX() = default;
+		XMMATRIX(
+			float m00, float m01, float m02, float m03,
+			float m10, float m11, float m12, float m13,
+			float m20, float m21, float m22, float m23,
+			float m30, float m31, float m32, float m33)
+		{
+			r[0] = _mm_set_ps(m03, m02, m01, m00);
+			r[1] = _mm_set_ps(m13, m12, m11, m10);
+			r[2] = _mm_set_ps(m23, m22, m21, m20);
+			r[3] = _mm_set_ps(m33, m32, m31, m30);
+		}
+	};
+	typedef const XMMATRIX& FXMMATRIX;
+	typedef const XMMATRIX& CXMMATRIX;
+
+	inline float XMConvertToRadians(float degrees) { return degrees * (XM_PI / 180.0f); }
+
+	// ---- Loads and stores ----
+
+	inline XMVECTOR XMVectorSet(float x, float y, float z, float w) { return _mm_set_ps(w, z, y, x); }
+	inline XMVECTOR XMVectorZero() { return _mm_setzero_ps(); }
+	inline XMVECTOR XMVectorReplicate(float value) { return _mm_set1_ps(value); }
+	inline XMVECTOR XMVectorTrueInt() { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+	inline XMVECTOR XMVectorFalseInt() { return _mm_setzero_ps(); }
+
+	inline XMVECTOR XMLoadFloat3(const XMFLOAT3* source) { return _mm_set_ps(0.0f, source->z, source->y, source->x); }
+	inline XMVECTOR XMLoadFloat4(const XMFLOAT4* source) { return _mm_loadu_ps(&source->x); }
+	inline XMVECTOR XMLoadInt4(const uint32_t* source) { return _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)source)); }
+
+	inline void XMStoreFloat4(XMFLOAT4* destination, FXMVECTOR v) { _mm_storeu_ps(&destination->x, v); }
+	inline void XMStoreInt4(uint32_t* destination, FXMVECTOR v) { _mm_storeu_si128((__m128i*)destination, _mm_castps_si128(v)); }
+	inline void XMStoreFloat3(XMFLOAT3* destination, FXMVECTOR v)
+	{
+		float lanes[4];
+		_mm_storeu_ps(lanes, v);
+		destination->x = lanes[0];
+		destination->y = lanes[1];
+		destination->z = lanes[2];
+	}
+
+	inline float XMVectorGetX(FXMVECTOR v) { return _mm_cvtss_f32(v); }
+	inline float XMVectorGetY(FXMVECTOR v) { return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))); }
+	inline float XMVectorGetZ(FXMVECTOR v) { return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))); }
+	inline float XMVectorGetW(FXMVECTOR v) { return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3))); }
+	inline XMVECTOR XMVectorSetW(FXMVECTOR v, float w)
+	{
+		float lanes[4];
+		_mm_storeu_ps(lanes, v);
+		lanes[3] = w;
+		return _mm_loadu_ps(lanes);
+	}
+
+	// ---- Per-lane arithmetic ----
+
+	inline XMVECTOR XMVectorAdd(FXMVECTOR a, FXMVECTOR b) { return _mm_add_ps(a, b); }
+	inline XMVECTOR XMVectorSubtract(FXMVECTOR a, FXMVECTOR b) { return _mm_sub_ps(a, b); }
+	inline XMVECTOR XMVectorMultiply(FXMVECTOR a, FXMVECTOR b) { return _mm_mul_ps(a, b); }
+	inline XMVECTOR XMVectorDivide(FXMVECTOR a, FXMVECTOR b) { return _mm_div_ps(a, b); }
+	inline XMVECTOR XMVectorMultiplyAdd(FXMVECTOR a, FXMVECTOR b, FXMVECTOR c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+	inline XMVECTOR XMVectorScale(FXMVECTOR v, float scale) { return _mm_mul_ps(v, _mm_set1_ps(scale)); }
+	inline XMVECTOR XMVectorNegate(FXMVECTOR v) { return _mm_sub_ps(_mm_setzero_ps(), v); }
+	inline XMVECTOR XMVectorAbs(FXMVECTOR v) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), v); }
+	inline XMVECTOR XMVectorSqrt(FXMVECTOR v) { return _mm_sqrt_ps(v); }
+	inline XMVECTOR XMVectorMin(FXMVECTOR a, FXMVECTOR b) { return _mm_min_ps(a, b); }
+	inline XMVECTOR XMVectorMax(FXMVECTOR a, FXMVECTOR b) { return _mm_max_ps(a, b); }
+	inline XMVECTOR XMVectorLerp(FXMVECTOR a, FXMVECTOR b, float t) { return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_set1_ps(t))); }
+
+	// ---- Comparisons and masks ----
+
+	inline XMVECTOR XMVectorLess(FXMVECTOR a, FXMVECTOR b) { return _mm_cmplt_ps(a, b); }
+	inline XMVECTOR XMVectorLessOrEqual(FXMVECTOR a, FXMVECTOR b) { return _mm_cmple_ps(a, b); }
+	inline XMVECTOR XMVectorGreater(FXMVECTOR a, FXMVECTOR b) { return _mm_cmpgt_ps(a, b); }
+	inline XMVECTOR XMVectorGreaterOrEqual(FXMVECTOR a, FXMVECTOR b) { return _mm_cmpge_ps(a, b); }
+	inline XMVECTOR XMVectorAndInt(FXMVECTOR a, FXMVECTOR b) { return _mm_and_ps(a, b); }
+	inline XMVECTOR XMVectorAndCInt(FXMVECTOR a, FXMVECTOR b) { return _mm_andnot_ps(b, a); }
+	inline XMVECTOR XMVectorOrInt(FXMVECTOR a, FXMVECTOR b) { return _mm_or_ps(a, b); }
+
+	// Lanes of b where control is set, of a elsewhere
+	inline XMVECTOR XMVectorSelect(FXMVECTOR a, FXMVECTOR b, FXMVECTOR control)
+	{
+		return _mm_or_ps(_mm_andnot_ps(control, a), _mm_and_ps(b, control));
+	}
+
+	inline bool XMVector4EqualInt(FXMVECTOR a, FXMVECTOR b)
+	{
+		__m128i equal = _mm_cmpeq_epi32(_mm_castps_si128(a), _mm_castps_si128(b));
+		return _mm_movemask_ps(_mm_castsi128_ps(equal)) == 0xF;
+	}
+
+	// ---- 3D vectors and planes ----
+
+	namespace Internal
+	{
+		inline float Dot3(FXMVECTOR a, FXMVECTOR b)
+		{
+			float x[4], y[4];
+			_mm_storeu_ps(x, a);
+			_mm_storeu_ps(y, b);
+			return x[0] * y[0] + x[1] * y[1] + x[2] * y[2];
+		}
+	}
+
+	inline XMVECTOR XMVector3Dot(FXMVECTOR a, FXMVECTOR b) { return _mm_set1_ps(Internal::Dot3(a, b)); }
+	inline XMVECTOR XMVector3LengthSq(FXMVECTOR v) { return XMVector3Dot(v, v); }
+	inline XMVECTOR XMVector3Length(FXMVECTOR v) { return _mm_sqrt_ps(XMVector3Dot(v, v)); }
+	inline XMVECTOR XMVector3Normalize(FXMVECTOR v) { return _mm_div_ps(v, XMVector3Length(v)); }
+
+	inline XMVECTOR XMVector3Cross(FXMVECTOR a, FXMVECTOR b)
+	{
+		float x[4], y[4];
+		_mm_storeu_ps(x, a);
+		_mm_storeu_ps(y, b);
+		return XMVectorSet(x[1] * y[2] - x[2] * y[1], x[2] * y[0] - x[0] * y[2], x[0] * y[1] - x[1] * y[0], 0.0f);
+	}
+
+	inline XMVECTOR XMPlaneDotCoord(FXMVECTOR plane, FXMVECTOR point)
+	{
+		return _mm_set1_ps(Internal::Dot3(plane, point) + XMVectorGetW(plane));
+	}
+
+	// Scales the whole plane so its normal is unit length
+	inline XMVECTOR XMPlaneNormalize(FXMVECTOR plane)
+	{
+		float length = sqrtf(Internal::Dot3(plane, plane));
+		return length > 0.0f ? _mm_div_ps(plane, _mm_set1_ps(length)) : plane;
+	}
+
+	// ---- Matrices ----
+
+	inline XMMATRIX XMLoadFloat4x4(const XMFLOAT4X4* source)
+	{
+		XMMATRIX m;
+		for (int i = 0; i < 4; i++)
+			m.r[i] = _mm_loadu_ps(source->m[i]);
+		return m;
+	}
+
+	inline void XMStoreFloat4x4(XMFLOAT4X4* destination, FXMMATRIX m)
+	{
+		for (int i = 0; i < 4; i++)
+			_mm_storeu_ps(destination->m[i], m.r[i]);
+	}
+
+	inline XMMATRIX XMMatrixIdentity()
+	{
+		return XMMATRIX(
+			1, 0, 0, 0,
+			0, 1, 0, 0,
+			0, 0, 1, 0,
+			0, 0, 0, 1);
+	}
+
+	inline XMMATRIX XMMatrixTranspose(FXMMATRIX m)
+	{
+		XMMATRIX t = m;
+		_MM_TRANSPOSE4_PS(t.r[0], t.r[1], t.r[2], t.r[3]);
+		return t;
+	}
+
+	inline XMMATRIX XMMatrixScaling(float x, float y, float z)
+	{
+		return XMMATRIX(
+			x, 0, 0, 0,
+			0, y, 0, 0,
+			0, 0, z, 0,
+			0, 0, 0, 1);
+	}
+
+	inline XMMATRIX XMMatrixTranslation(float x, float y, float z)
+	{
+		return XMMATRIX(
+			1, 0, 0, 0,
+			0, 1, 0, 0,
+			0, 0, 1, 0,
+			x, y, z, 1);
+	}
+
+	// Row vector times matrix, as in DirectXMath
+	inline XMVECTOR XMVector4Transform(FXMVECTOR v, FXMMATRIX m)
+	{
+		float lanes[4];
+		_mm_storeu_ps(lanes, v);
+		return _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(_mm_set1_ps(lanes[0]), m.r[0]), _mm_mul_ps(_mm_set1_ps(lanes[1]), m.r[1])),
+			_mm_add_ps(_mm_mul_ps(_mm_set1_ps(lanes[2]), m.r[2]), _mm_mul_ps(_mm_set1_ps(lanes[3]), m.r[3])));
+	}
+
+	// Treats w as 1
+	inline XMVECTOR XMVector3Transform(FXMVECTOR v, FXMMATRIX m)
+	{
+		return XMVector4Transform(XMVectorSetW(v, 1.0f), m);
+	}
+
+	// Treats w as 0
+	inline XMVECTOR XMVector3TransformNormal(FXMVECTOR v, FXMMATRIX m)
+	{
+		return XMVector4Transform(XMVectorSetW(v, 0.0f), m);
+	}
+
+	// Treats w as 1, then divides by the result's w
+	inline XMVECTOR XMVector3TransformCoord(FXMVECTOR v, FXMMATRIX m)
+	{
+		XMVECTOR result = XMVector3Transform(v, m);
+		return XMVectorSetW(_mm_div_ps(result, _mm_set1_ps(XMVectorGetW(result))), 1.0f);
+	}
+
+	inline XMFLOAT4* XMVector3TransformStream(XMFLOAT4* output, size_t outputStride, const XMFLOAT3* input, size_t inputStride, size_t count, FXMMATRIX m)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			const XMFLOAT3* in = (const XMFLOAT3*)((const char*)input + i * inputStride);
+			XMFLOAT4* out = (XMFLOAT4*)((char*)output + i * outputStride);
+			XMStoreFloat4(out, XMVector3Transform(XMLoadFloat3(in), m));
+		}
+		return output;
+	}
+
+	inline XMMATRIX XMMatrixMultiply(FXMMATRIX a, CXMMATRIX b)
+	{
+		XMMATRIX result;
+		for (int i = 0; i < 4; i++)
+			result.r[i] = XMVector4Transform(a.r[i], b);
+		return result;
+	}
+
+	inline XMMATRIX operator*(FXMMATRIX a, CXMMATRIX b) { return XMMatrixMultiply(a, b); }
+
+	// Gauss-Jordan in double precision, with partial pivoting
+	inline XMMATRIX XMMatrixInverse(XMVECTOR* determinant, FXMMATRIX m)
+	{
+		double a[4][8];
+		float row[4];
+		for (int i = 0; i < 4; i++)
+		{
+			_mm_storeu_ps(row, m.r[i]);
+			for (int j = 0; j < 4; j++)
+			{
+				a[i][j] = row[j];
+				a[i][j + 4] = i == j ? 1.0 : 0.0;
+			}
+		}
+
+		double det = 1.0;
+		for (int c = 0; c < 4; c++)
+		{
+			int pivot = c;
+			for (int r = c + 1; r < 4; r++)
+				if (fabs(a[r][c]) > fabs(a[pivot][c]))
+					pivot = r;
+			if (pivot != c)
+			{
+				for (int j = 0; j < 8; j++)
+					std::swap(a[c][j], a[pivot][j]);
+				det = -det;
+			}
+
+			double diagonal = a[c][c];
+			det *= diagonal;
+			for (int j = 0; j < 8; j++)
+				a[c][j] /= diagonal;
+			for (int r = 0; r < 4; r++)
+			{
+				if (r == c) continue;
+				double factor = a[r][c];
+				for (int j = 0; j < 8; j++)
+					a[r][j] -= factor * a[c][j];
+			}
+		}
+
+		if (determinant)
+			*determinant = _mm_set1_ps((float)det);
+
+		XMMATRIX inverse;
+		for (int i = 0; i < 4; i++)
+			inverse.r[i] = _mm_set_ps((float)a[i][7], (float)a[i][6], (float)a[i][5], (float)a[i][4]);
+		return inverse;
+	}
+
+	inline XMMATRIX XMMatrixLookToLH(FXMVECTOR eye, FXMVECTOR direction, FXMVECTOR up)
+	{
+		XMVECTOR zAxis = XMVector3Normalize(direction);
+		XMVECTOR xAxis = XMVector3Normalize(XMVector3Cross(up, zAxis));
+		XMVECTOR yAxis = XMVector3Cross(zAxis, xAxis);
+		return XMMATRIX(
+			XMVectorGetX(xAxis), XMVectorGetX(yAxis), XMVectorGetX(zAxis), 0,
+			XMVectorGetY(xAxis), XMVectorGetY(yAxis), XMVectorGetY(zAxis), 0,
+			XMVectorGetZ(xAxis), XMVectorGetZ(yAxis), XMVectorGetZ(zAxis), 0,
+			-Internal::Dot3(xAxis, eye), -Internal::Dot3(yAxis, eye), -Internal::Dot3(zAxis, eye), 1);
+	}
+
+	inline XMMATRIX XMMatrixLookAtLH(FXMVECTOR eye, FXMVECTOR focus, FXMVECTOR up)
+	{
+		return XMMatrixLookToLH(eye, XMVectorSubtract(focus, eye), up);
+	}
+
+	inline XMMATRIX XMMatrixPerspectiveFovLH(float fovY, float aspect, float nearZ, float farZ)
+	{
+		float height = 1.0f / tanf(fovY * 0.5f);
+		float width = height / aspect;
+		float range = farZ / (farZ - nearZ);
+		return XMMATRIX(
+			width, 0, 0, 0,
+			0, height, 0, 0,
+			0, 0, range, 1,
+			0, 0, -range * nearZ, 0);
+	}
+
+	inline XMMATRIX XMMatrixOrthographicOffCenterLH(float left, float right, float bottom, float top, float nearZ, float farZ)
+	{
+		float width = 1.0f / (right - left);
+		float height = 1.0f / (top - bottom);
+		float range = 1.0f / (farZ - nearZ);
+		return XMMATRIX(
+			2 * width, 0, 0, 0,
+			0, 2 * height, 0, 0,
+			0, 0, range, 0,
+			-(left + right) * width, -(top + bottom) * height, -nearZ * range, 1);
+	}
+}
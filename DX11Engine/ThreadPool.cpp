@@ -0,0 +1,98 @@
+#include "ThreadPool.h"
+
+// Singleton requirement
+ThreadPool* ThreadPool::instance;
+
+ThreadPool::ThreadPool()
+{
+	unsigned int hardwareThreads = std::thread::hardware_concurrency();
+	unsigned int workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+
+	for (unsigned int i = 0; i < workerCount; i++)
+		workers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	workReady.notify_all();
+
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+// --------------------------------------------------------
+// Runs the jobs across the workers and this thread, and
+// waits for all of them to finish
+// --------------------------------------------------------
+void ThreadPool::ParallelFor(unsigned int p_jobCount, const std::function<void(unsigned int)>& job)
+{
+	if (p_jobCount == 0)
+		return;
+
+	// Not worth waking anyone for a single job
+	if (p_jobCount == 1 || workers.empty())
+	{
+		for (unsigned int i = 0; i < p_jobCount; i++)
+			job(i);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		currentJob = &job;
+		jobCount = p_jobCount;
+		nextJob = 0;
+		busyWorkers = (unsigned int)workers.size();
+		generation++;
+	}
+	workReady.notify_all();
+
+	RunJobs();
+
+	// Workers may still be finishing the last few jobs
+	std::unique_lock<std::mutex> lock(mutex);
+	workDone.wait(lock, [this]() { return busyWorkers == 0; });
+	currentJob = nullptr;
+}
+
+// --------------------------------------------------------
+// Takes job indices until there are none left
+// --------------------------------------------------------
+void ThreadPool::RunJobs()
+{
+	while (true)
+	{
+		unsigned int i = nextJob.fetch_add(1);
+		if (i >= jobCount)
+			break;
+
+		(*currentJob)(i);
+	}
+}
+
+void ThreadPool::WorkerLoop()
+{
+	unsigned int seenGeneration = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			workReady.wait(lock, [this, seenGeneration]() { return quit || generation != seenGeneration; });
+			if (quit)
+				return;
+			seenGeneration = generation;
+		}
+
+		RunJobs();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			busyWorkers--;
+		}
+		workDone.notify_one();
+	}
+}
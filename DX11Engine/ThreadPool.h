@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------------
+// A fixed set of worker threads (one fewer than the CPU's
+// hardware threads) for splitting CPU work across cores.
+//
+// ParallelFor() hands out job indices one at a time, so
+// jobs of uneven cost still spread evenly, and the calling
+// thread works on them too.  It returns once every job is
+// done.  Jobs must not call ParallelFor() themselves.
+// --------------------------------------------------------
+class ThreadPool
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static ThreadPool& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new ThreadPool();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	ThreadPool(ThreadPool const&) = delete;
+	void operator=(ThreadPool const&) = delete;
+
+private:
+	static ThreadPool* instance;
+	ThreadPool();
+#pragma endregion
+
+public:
+	~ThreadPool();
+
+	// Calls job(i) for every i in [0, jobCount)
+	void ParallelFor(unsigned int jobCount, const std::function<void(unsigned int)>& job);
+
+	// Workers plus the calling thread
+	unsigned int GetThreadCount() { return (unsigned int)workers.size() + 1; }
+
+private:
+	void WorkerLoop();
+	void RunJobs();
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable workReady;
+	std::condition_variable workDone;
+
+	const std::function<void(unsigned int)>* currentJob = nullptr;
+	unsigned int jobCount = 0;
+	std::atomic<unsigned int> nextJob { 0 };
+	unsigned int busyWorkers = 0;
+	unsigned int generation = 0;	// Bumped for each ParallelFor() so workers know there's work
+	bool quit = false;
+};
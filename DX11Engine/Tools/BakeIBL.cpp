@@ -0,0 +1,68 @@
+#include "IBLBaker.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// --------------------------------------------------------
+// Bakes a sky's image based lighting from the command line,
+// the same as Game does when the files are missing:
+//
+//   BakeIBL <sky.dds> <specular.dds> <brdf.dds> [options]
+//
+// The sky must be an uncompressed cube map.  Options change
+// IBLBakeSettings, for trying quality against bake time.
+// --------------------------------------------------------
+static void PrintUsage()
+{
+	IBLBakeSettings defaults;
+	printf("Usage: BakeIBL <sky.dds> <specular.dds> <brdf.dds> [options]\n");
+	printf("  --size N          Top mip of the specular cube map (%u)\n", defaults.specularSize);
+	printf("  --mips N          Specular mips, one per roughness step (%u)\n", defaults.specularMips);
+	printf("  --samples N       GGX samples per specular texel (%u)\n", defaults.specularSamples);
+	printf("  --brdf-size N     BRDF lookup table size (%u)\n", defaults.brdfSize);
+	printf("  --brdf-samples N  Samples per BRDF texel (%u)\n", defaults.brdfSamples);
+	printf("  --gamma G         The sky's gamma, 1 if it's already linear (%.1f)\n", defaults.skyGamma);
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 4)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	IBLBakeSettings settings;
+	for (int a = 4; a < argc; a++)
+	{
+		if (a + 1 >= argc)
+		{
+			printf("%s needs a value\n", argv[a]);
+			return 1;
+		}
+
+		const char* value = argv[++a];
+		if (strcmp(argv[a - 1], "--size") == 0) settings.specularSize = (unsigned int)atoi(value);
+		else if (strcmp(argv[a - 1], "--mips") == 0) settings.specularMips = (unsigned int)atoi(value);
+		else if (strcmp(argv[a - 1], "--samples") == 0) settings.specularSamples = (unsigned int)atoi(value);
+		else if (strcmp(argv[a - 1], "--brdf-size") == 0) settings.brdfSize = (unsigned int)atoi(value);
+		else if (strcmp(argv[a - 1], "--brdf-samples") == 0) settings.brdfSamples = (unsigned int)atoi(value);
+		else if (strcmp(argv[a - 1], "--gamma") == 0) settings.skyGamma = (float)atof(value);
+		else
+		{
+			printf("Unknown option %s\n", argv[a - 1]);
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	if (settings.specularSize == 0 || settings.specularMips == 0 || settings.specularSamples == 0 ||
+		settings.brdfSize == 0 || settings.brdfSamples == 0)
+	{
+		printf("Sizes, mips and sample counts must be at least 1\n");
+		return 1;
+	}
+
+	return IBLBaker::BakeFiles(argv[1], argv[2], argv[3], settings) ? 0 : 1;
+}
@@ -0,0 +1,214 @@
+#include "LightmapBaker.h"
+#include "LightmapUVs.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Bakes a lightmap and irradiance probes for a fixed test
+// scene without a window or device, for timing the baker
+// and checking its output:
+//
+//   BakeLightmaps <lightmap.dds> <probes.dds> [options]
+//
+// LightmapBaker prints its progress and rays per second.
+// With --check-determinism the scene is baked a second time
+// and the files must match byte for byte.
+// --------------------------------------------------------
+static void PrintUsage()
+{
+	LightmapBakeSettings defaults;
+	printf("Usage: BakeLightmaps <lightmap.dds> <probes.dds> [options]\n");
+	printf("  --atlas N             Lightmap size (%u)\n", defaults.atlasSize);
+	printf("  --samples N           Paths per texel (%u)\n", defaults.samplesPerTexel);
+	printf("  --bounces N           Bounces per path (%u)\n", defaults.bounces);
+	printf("  --probe-samples N     Rays per probe (%u)\n", defaults.probeSamples);
+	printf("  --check-determinism   Bake twice and compare the files\n");
+}
+
+// A box's six faces as its own triangles, the way the OBJ loader gives them
+static LightmapInstance MakeBox(XMFLOAT3 center, XMFLOAT3 extents, XMFLOAT3 albedo)
+{
+	static const float axes[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	static const unsigned int corners[6] = { 0, 1, 2, 0, 2, 3 };
+
+	LightmapInstance box;
+	for (unsigned int face = 0; face < 6; face++)
+	{
+		XMVECTOR normal = XMVectorSet(axes[face][0], axes[face][1], axes[face][2], 0);
+		XMVECTOR u = fabsf(axes[face][1]) > 0.5f ? XMVectorSet(1, 0, 0, 0) : XMVectorSet(0, 1, 0, 0);
+		XMVECTOR v = XMVector3Cross(normal, u);
+		XMVECTOR scale = XMLoadFloat3(&extents);
+		XMVECTOR faceCenter = XMVectorAdd(XMLoadFloat3(&center), XMVectorMultiply(normal, scale));
+
+		XMFLOAT3 quad[4];
+		float signs[4][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+		for (unsigned int q = 0; q < 4; q++)
+		{
+			XMVECTOR offset = XMVectorAdd(XMVectorScale(u, signs[q][0]), XMVectorScale(v, signs[q][1]));
+			XMStoreFloat3(&quad[q], XMVectorAdd(faceCenter, XMVectorMultiply(offset, scale)));
+		}
+
+		XMFLOAT3 faceNormal(axes[face][0], axes[face][1], axes[face][2]);
+		for (unsigned int c : corners)
+		{
+			box.indices.push_back((unsigned int)box.positions.size());
+			box.positions.push_back(quad[c]);
+			box.normals.push_back(faceNormal);
+		}
+	}
+
+	LightmapUVs::Generate(box.positions, box.indices, box.lightmapUVs);
+	box.albedo = albedo;
+	box.rect = XMFLOAT4(0, 0, 0, 0);
+	return box;
+}
+
+// A floor, two walls and a few blocks, lit by a baked point light,
+// a real time sun that only bounces, and a blue sky
+static void MakeScene(std::vector<LightmapInstance>& instances, std::vector<Light>& lights, XMFLOAT3 skySH[SphericalHarmonics::CoefficientCount], XMFLOAT3& boundsMin, XMFLOAT3& boundsMax)
+{
+	instances.push_back(MakeBox(XMFLOAT3(0, -0.5f, 0), XMFLOAT3(8, 0.5f, 8), XMFLOAT3(0.5f, 0.5f, 0.5f)));
+	instances.push_back(MakeBox(XMFLOAT3(-8.5f, 3, 0), XMFLOAT3(0.5f, 3, 8), XMFLOAT3(0.6f, 0.2f, 0.2f)));
+	instances.push_back(MakeBox(XMFLOAT3(0, 3, 8.5f), XMFLOAT3(8, 3, 0.5f), XMFLOAT3(0.2f, 0.6f, 0.2f)));
+	instances.push_back(MakeBox(XMFLOAT3(-3, 1, 2), XMFLOAT3(1, 1, 1), XMFLOAT3(0.7f, 0.7f, 0.7f)));
+	instances.push_back(MakeBox(XMFLOAT3(2, 2, -1), XMFLOAT3(1, 2, 1), XMFLOAT3(0.4f, 0.4f, 0.6f)));
+	instances.push_back(MakeBox(XMFLOAT3(4, 0.5f, 4), XMFLOAT3(1.5f, 0.5f, 0.5f), XMFLOAT3(0.8f, 0.6f, 0.3f)));
+	boundsMin = XMFLOAT3(-9, -1, -8);
+	boundsMax = XMFLOAT3(8, 6, 9);
+
+	Light point = {};
+	point.Type = LIGHT_TYPE_POINT;
+	point.Position = XMFLOAT3(-1, 3, 3);
+	point.Range = 10.0f;
+	point.Intensity = 2.0f;
+	point.Color = XMFLOAT3(1.0f, 0.9f, 0.7f);
+	point.Baked = 1;
+	lights.push_back(point);
+
+	Light sun = {};
+	sun.Type = LIGHT_TYPE_DIRECTIONAL;
+	sun.Direction = XMFLOAT3(0.4f, -1.0f, 0.3f);
+	sun.Intensity = 1.0f;
+	sun.Color = XMFLOAT3(1, 1, 1);
+	lights.push_back(sun);
+
+	// Brighter overhead than at the horizon
+	for (unsigned int c = 0; c < SphericalHarmonics::CoefficientCount; c++)
+		skySH[c] = XMFLOAT3(0, 0, 0);
+	skySH[0] = XMFLOAT3(0.4f, 0.6f, 1.0f);
+	skySH[1] = XMFLOAT3(0.2f, 0.3f, 0.5f);
+}
+
+static bool ReadFile(const std::string& path, std::vector<char>& bytes)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+	bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return true;
+}
+
+// Prints where two files first differ, returning true if they don't
+static bool SameFiles(const std::string& a, const std::string& b)
+{
+	std::vector<char> first, second;
+	if (!ReadFile(a, first) || !ReadFile(b, second))
+	{
+		printf("Couldn't read %s or %s back\n", a.c_str(), b.c_str());
+		return false;
+	}
+
+	size_t length = first.size() < second.size() ? first.size() : second.size();
+	for (size_t i = 0; i < length; i++)
+	{
+		if (first[i] != second[i])
+		{
+			printf("%s and %s differ at byte %zu\n", a.c_str(), b.c_str(), i);
+			return false;
+		}
+	}
+	if (first.size() != second.size())
+	{
+		printf("%s and %s differ in size\n", a.c_str(), b.c_str());
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	LightmapBakeSettings settings;
+	bool checkDeterminism = false;
+	for (int a = 3; a < argc; a++)
+	{
+		if (strcmp(argv[a], "--check-determinism") == 0)
+		{
+			checkDeterminism = true;
+			continue;
+		}
+		if (a + 1 >= argc)
+		{
+			printf("%s needs a value\n", argv[a]);
+			return 1;
+		}
+
+		const char* value = argv[++a];
+		if (strcmp(argv[a - 1], "--atlas") == 0) settings.atlasSize = (unsigned int)atoi(value);
+		else if (strcmp(argv[a - 1], "--samples") == 0) settings.samplesPerTexel = (unsigned int)atoi(value);
+		else if (strcmp(argv[a - 1], "--bounces") == 0) settings.bounces = (unsigned int)atoi(value);
+		else if (strcmp(argv[a - 1], "--probe-samples") == 0) settings.probeSamples = (unsigned int)atoi(value);
+		else
+		{
+			printf("Unknown option %s\n", argv[a - 1]);
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	std::vector<LightmapInstance> instances;
+	std::vector<Light> lights;
+	XMFLOAT3 skySH[SphericalHarmonics::CoefficientCount];
+	XMFLOAT3 boundsMin, boundsMax;
+	MakeScene(instances, lights, skySH, boundsMin, boundsMax);
+
+	if (settings.atlasSize == 0 || !LightmapBaker::PackAtlas(instances, settings))
+	{
+		printf("The scene doesn't fit a %u texel atlas\n", settings.atlasSize);
+		return 1;
+	}
+	ProbeGrid grid = LightmapBaker::PlaceProbes(boundsMin, boundsMax, settings);
+
+	std::string lightmapPath = argv[1], probePath = argv[2];
+	if (!LightmapBaker::BakeFiles(instances, lights, skySH, settings, grid, lightmapPath, probePath))
+	{
+		printf("Couldn't write %s or %s\n", lightmapPath.c_str(), probePath.c_str());
+		return 1;
+	}
+
+	if (checkDeterminism)
+	{
+		std::string repeatLightmapPath = lightmapPath + ".repeat";
+		std::string repeatProbePath = probePath + ".repeat";
+		bool same = LightmapBaker::BakeFiles(instances, lights, skySH, settings, grid, repeatLightmapPath, repeatProbePath) &&
+			SameFiles(lightmapPath, repeatLightmapPath) && SameFiles(probePath, repeatProbePath);
+		remove(repeatLightmapPath.c_str());
+		remove(repeatProbePath.c_str());
+
+		printf(same ? "Both bakes match\n" : "The bakes differ\n");
+		if (!same)
+			return 1;
+	}
+	return 0;
+}
@@ -4,6 +4,7 @@ using namespace DirectX;
 
 Transform::Transform()
 {
+    version = 0;
     SetPosition(0, 0, 0);
     SetScale(1, 1, 1);
     SetRotation(0, 0, 0);
@@ -18,8 +19,10 @@ void Transform::SetPosition(float x, float y, float z)
     position.y = y;
     position.z = z;
 
-    // Set dirty matrix as true whenever a transformation is made
+    // Set dirty matrix as true whenever a transformation is made,
+    // and bump the version so cached data (like bounds) is rebuilt
     dirtyMatrix = true;
+    version++;
 }
 
 void Transform::SetRotation(float pitch, float yaw, float roll)
@@ -29,6 +32,7 @@ void Transform::SetRotation(float pitch, float yaw, float roll)
     rotationPitchYawRoll.z = roll;
 
     dirtyMatrix = true;
+    version++;
 }
 
 void Transform::SetScale(float x, float y, float z)
@@ -38,6 +42,7 @@ void Transform::SetScale(float x, float y, float z)
     scale.z = z;
 
     dirtyMatrix = true;
+    version++;
 }
 
 DirectX::XMFLOAT3 Transform::GetPosition()
@@ -92,6 +97,7 @@ void Transform::MoveAbsolute(float x, float y, float z)
     position.z += z;
 
     dirtyMatrix = true;
+    version++;
 }
 
 void Transform::MoveRelative(float x, float y, float z)
@@ -109,6 +115,7 @@ void Transform::MoveRelative(float x, float y, float z)
     XMStoreFloat3(&position, newPos);
 
     dirtyMatrix = true;
+    version++;
 }
 
 DirectX::XMFLOAT3 Transform::GetRight()
@@ -163,6 +170,7 @@ void Transform::Rotate(float pitch, float yaw, float roll)
     rotationPitchYawRoll.z += roll;
 
     dirtyMatrix = true;
+    version++;
 }
 
 void Transform::Scale(float x, float y, float z)
@@ -172,4 +180,5 @@ void Transform::Scale(float x, float y, float z)
     scale.z *= z;
 
     dirtyMatrix = true;
+    version++;
 }
@@ -21,6 +21,9 @@ public:
 	void Rotate(float pitch, float yaw, float roll);
 	void Scale(float x, float y, float z);
 
+	// Changes every time the transform does
+	unsigned int GetVersion() { return version; }
+
 private:
 	DirectX::XMFLOAT4X4 worldMatrix;
 	DirectX::XMFLOAT4X4 worldInverseTransposeMatrix;
@@ -31,5 +34,6 @@ private:
 	DirectX::XMFLOAT3 upVec;
 	DirectX::XMFLOAT3 forwardVec;
 	bool dirtyMatrix;
+	unsigned int version;
 };
 
@@ -0,0 +1,269 @@
+#include "TriangleBVH.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+
+using namespace DirectX;
+
+void TriangleBVH::Build(const std::vector<XMFLOAT3>& triangleVertices)
+{
+	unsigned int count = (unsigned int)(triangleVertices.size() / 3);
+	std::vector<XMFLOAT3> centroids(count);
+	triangleIndices.resize(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const XMFLOAT3* v = &triangleVertices[i * 3];
+		centroids[i] = XMFLOAT3((v[0].x + v[1].x + v[2].x) / 3.0f, (v[0].y + v[1].y + v[2].y) / 3.0f, (v[0].z + v[1].z + v[2].z) / 3.0f);
+		triangleIndices[i] = i;
+	}
+
+	buildNodes.clear();
+	nodes.clear();
+	triangles.clear();
+	if (count == 0)
+		return;
+
+	int root = BuildRecursive(0, count, centroids, triangleVertices);
+
+	// Triangles in leaf order, so a leaf's are together
+	triangles.resize(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const XMFLOAT3* v = &triangleVertices[triangleIndices[i] * 3];
+		Triangle& triangle = triangles[i];
+		triangle.v0 = v[0];
+		triangle.edge1 = XMFLOAT3(v[1].x - v[0].x, v[1].y - v[0].y, v[1].z - v[0].z);
+		triangle.edge2 = XMFLOAT3(v[2].x - v[0].x, v[2].y - v[0].y, v[2].z - v[0].z);
+	}
+
+	// A lone leaf still needs a node above it
+	if (buildNodes[root].left < 0)
+	{
+		BuildNode wrapper = buildNodes[root];
+		wrapper.left = root;
+		wrapper.right = -1;
+		buildNodes.push_back(wrapper);
+		root = (int)buildNodes.size() - 1;
+	}
+	Collapse(root);
+	buildNodes.clear();
+}
+
+int TriangleBVH::BuildRecursive(unsigned int first, unsigned int count, const std::vector<XMFLOAT3>& centroids, const std::vector<XMFLOAT3>& triangleVertices)
+{
+	BuildNode node = {};
+	node.min = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+	node.max = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	XMFLOAT3 centroidMin = node.min, centroidMax = node.max;
+	for (unsigned int i = first; i < first + count; i++)
+	{
+		for (unsigned int corner = 0; corner < 3; corner++)
+		{
+			const XMFLOAT3& p = triangleVertices[triangleIndices[i] * 3 + corner];
+			node.min = XMFLOAT3(std::min(node.min.x, p.x), std::min(node.min.y, p.y), std::min(node.min.z, p.z));
+			node.max = XMFLOAT3(std::max(node.max.x, p.x), std::max(node.max.y, p.y), std::max(node.max.z, p.z));
+		}
+		const XMFLOAT3& c = centroids[triangleIndices[i]];
+		centroidMin = XMFLOAT3(std::min(centroidMin.x, c.x), std::min(centroidMin.y, c.y), std::min(centroidMin.z, c.z));
+		centroidMax = XMFLOAT3(std::max(centroidMax.x, c.x), std::max(centroidMax.y, c.y), std::max(centroidMax.z, c.z));
+	}
+	node.first = first;
+	node.count = count;
+	node.left = -1;
+	node.right = -1;
+
+	int index = (int)buildNodes.size();
+	buildNodes.push_back(node);
+	if (count <= MaxLeafTriangles)
+		return index;
+
+	// Median split on the axis the centroids spread furthest along
+	XMFLOAT3 extent(centroidMax.x - centroidMin.x, centroidMax.y - centroidMin.y, centroidMax.z - centroidMin.z);
+	int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+	unsigned int half = count / 2;
+	std::nth_element(triangleIndices.begin() + first, triangleIndices.begin() + first + half, triangleIndices.begin() + first + count,
+		[&](unsigned int a, unsigned int b)
+		{
+			const float* ca = &centroids[a].x;
+			const float* cb = &centroids[b].x;
+			return ca[axis] < cb[axis] || (ca[axis] == cb[axis] && a < b);
+		});
+
+	int left = BuildRecursive(first, half, centroids, triangleVertices);
+	int right = BuildRecursive(first + half, count - half, centroids, triangleVertices);
+	buildNodes[index].left = left;
+	buildNodes[index].right = right;
+	return index;
+}
+
+static float SurfaceArea(const XMFLOAT3& min, const XMFLOAT3& max)
+{
+	float x = max.x - min.x, y = max.y - min.y, z = max.z - min.z;
+	return x * y + y * z + z * x;
+}
+
+// --------------------------------------------------------
+// Pulls grandchildren up into a node until it has four
+// children, opening the largest interior child each time
+// --------------------------------------------------------
+unsigned int TriangleBVH::Collapse(int buildNode)
+{
+	int children[4] = { buildNodes[buildNode].left, buildNodes[buildNode].right, -1, -1 };
+	unsigned int childCount = children[1] >= 0 ? 2 : 1;
+	while (childCount < 4)
+	{
+		int largest = -1;
+		float largestArea = -1.0f;
+		for (unsigned int c = 0; c < childCount; c++)
+		{
+			const BuildNode& child = buildNodes[children[c]];
+			float area = SurfaceArea(child.min, child.max);
+			if (child.left >= 0 && area > largestArea)
+			{
+				largest = (int)c;
+				largestArea = area;
+			}
+		}
+		if (largest < 0)
+			break;
+
+		const BuildNode& opened = buildNodes[children[largest]];
+		children[largest] = opened.left;
+		children[childCount++] = opened.right;
+	}
+
+	unsigned int index = (unsigned int)nodes.size();
+	nodes.push_back(Node());
+
+	// Empty slots are skipped by childCount, but still get ordinary numbers
+	Node node = {};
+	node.childCount = childCount;
+	float* boxLanes[6] = { &node.minX.x, &node.minY.x, &node.minZ.x, &node.maxX.x, &node.maxY.x, &node.maxZ.x };
+	for (unsigned int c = 0; c < 4; c++)
+	{
+		if (c >= childCount)
+		{
+			for (unsigned int i = 0; i < 6; i++)
+				boxLanes[i][c] = 0.0f;
+			node.count[c] = 0;
+			node.first[c] = 0;
+			continue;
+		}
+
+		const BuildNode& child = buildNodes[children[c]];
+		boxLanes[0][c] = child.min.x;
+		boxLanes[1][c] = child.min.y;
+		boxLanes[2][c] = child.min.z;
+		boxLanes[3][c] = child.max.x;
+		boxLanes[4][c] = child.max.y;
+		boxLanes[5][c] = child.max.z;
+		node.count[c] = child.left < 0 ? child.count : 0;
+		node.first[c] = child.left < 0 ? child.first : Collapse(children[c]);
+	}
+
+	nodes[index] = node;
+	return index;
+}
+
+bool TriangleBVH::Intersect(XMFLOAT3 origin, XMFLOAT3 direction, float maxDistance, TriangleHit& hit) const
+{
+	return Trace(origin, direction, maxDistance, false, hit);
+}
+
+bool TriangleBVH::Occluded(XMFLOAT3 origin, XMFLOAT3 direction, float maxDistance) const
+{
+	TriangleHit hit;
+	return Trace(origin, direction, maxDistance, true, hit);
+}
+
+// --------------------------------------------------------
+// Slab tests four child boxes at a time, then Moller-
+// Trumbore against the triangles of any leaf reached
+// --------------------------------------------------------
+bool TriangleBVH::Trace(XMFLOAT3 origin, XMFLOAT3 direction, float maxDistance, bool anyHit, TriangleHit& hit) const
+{
+	if (nodes.empty())
+		return false;
+
+	// Avoids dividing by zero, an axis the ray doesn't move along never limits it
+	auto inverse = [](float d) { return 1.0f / (fabsf(d) > 1e-12f ? d : (d < 0.0f ? -1e-12f : 1e-12f)); };
+	XMVECTOR originX = XMVectorReplicate(origin.x), originY = XMVectorReplicate(origin.y), originZ = XMVectorReplicate(origin.z);
+	XMVECTOR invX = XMVectorReplicate(inverse(direction.x)), invY = XMVectorReplicate(inverse(direction.y)), invZ = XMVectorReplicate(inverse(direction.z));
+	XMVECTOR zero = XMVectorZero();
+
+	bool found = false;
+	hit.distance = maxDistance;
+
+	unsigned int stack[64];
+	unsigned int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		const Node& node = nodes[stack[--stackSize]];
+
+		XMVECTOR t0x = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4(&node.minX), originX), invX);
+		XMVECTOR t1x = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4(&node.maxX), originX), invX);
+		XMVECTOR t0y = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4(&node.minY), originY), invY);
+		XMVECTOR t1y = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4(&node.maxY), originY), invY);
+		XMVECTOR t0z = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4(&node.minZ), originZ), invZ);
+		XMVECTOR t1z = XMVectorMultiply(XMVectorSubtract(XMLoadFloat4(&node.maxZ), originZ), invZ);
+		XMVECTOR tNear = XMVectorMax(XMVectorMax(XMVectorMin(t0x, t1x), XMVectorMin(t0y, t1y)), XMVectorMax(XMVectorMin(t0z, t1z), zero));
+		XMVECTOR tFar = XMVectorMin(XMVectorMin(XMVectorMax(t0x, t1x), XMVectorMax(t0y, t1y)), XMVectorMin(XMVectorMax(t0z, t1z), XMVectorReplicate(hit.distance)));
+
+		uint32_t lanes[4];
+		XMStoreInt4(lanes, XMVectorLessOrEqual(tNear, tFar));
+		for (unsigned int c = 0; c < node.childCount; c++)
+		{
+			if (!lanes[c])
+				continue;
+
+			if (node.count[c] == 0)
+			{
+				stack[stackSize++] = node.first[c];
+				continue;
+			}
+
+			for (unsigned int t = node.first[c]; t < node.first[c] + node.count[c]; t++)
+			{
+				const Triangle& triangle = triangles[t];
+				XMFLOAT3 p(
+					direction.y * triangle.edge2.z - direction.z * triangle.edge2.y,
+					direction.z * triangle.edge2.x - direction.x * triangle.edge2.z,
+					direction.x * triangle.edge2.y - direction.y * triangle.edge2.x);
+				float determinant = triangle.edge1.x * p.x + triangle.edge1.y * p.y + triangle.edge1.z * p.z;
+				if (fabsf(determinant) < 1e-12f)
+					continue;
+
+				float invDeterminant = 1.0f / determinant;
+				XMFLOAT3 s(origin.x - triangle.v0.x, origin.y - triangle.v0.y, origin.z - triangle.v0.z);
+				float u = (s.x * p.x + s.y * p.y + s.z * p.z) * invDeterminant;
+				if (u < 0.0f || u > 1.0f)
+					continue;
+
+				XMFLOAT3 q(
+					s.y * triangle.edge1.z - s.z * triangle.edge1.y,
+					s.z * triangle.edge1.x - s.x * triangle.edge1.z,
+					s.x * triangle.edge1.y - s.y * triangle.edge1.x);
+				float v = (direction.x * q.x + direction.y * q.y + direction.z * q.z) * invDeterminant;
+				if (v < 0.0f || u + v > 1.0f)
+					continue;
+
+				float distance = (triangle.edge2.x * q.x + triangle.edge2.y * q.y + triangle.edge2.z * q.z) * invDeterminant;
+				if (distance <= 0.0f || distance >= hit.distance)
+					continue;
+
+				hit.distance = distance;
+				hit.u = u;
+				hit.v = v;
+				hit.triangle = triangleIndices[t];
+				found = true;
+				if (anyHit)
+					return true;
+			}
+		}
+	}
+
+	return found;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+
+// Where a ray hit a triangle
+struct TriangleHit
+{
+	float distance;
+	float u;				// Barycentrics of the second and third vertices
+	float v;
+	unsigned int triangle;	// Index in the order triangles were given to Build()
+};
+
+// --------------------------------------------------------
+// A static bounding volume hierarchy over triangles, for
+// tracing rays through a scene that doesn't move.
+//
+// It's built as a binary tree split at the median centroid
+// of the longest axis, then collapsed so each node holds up
+// to four children's boxes side by side.  A ray tests all
+// four boxes at once with XMVECTORs.  Triangles are kept
+// in leaf order as a base vertex and two edges.
+// --------------------------------------------------------
+class TriangleBVH
+{
+public:
+	// Three positions per triangle
+	void Build(const std::vector<DirectX::XMFLOAT3>& triangleVertices);
+
+	// The closest hit within maxDistance
+	bool Intersect(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, TriangleHit& hit) const;
+
+	// True if anything is hit within maxDistance, stopping at the first
+	bool Occluded(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance) const;
+
+	unsigned int GetTriangleCount() const { return (unsigned int)triangleIndices.size(); }
+
+private:
+	static const unsigned int MaxLeafTriangles = 4;
+
+	// A child is a node if count is 0, otherwise count triangles from first
+	struct Node
+	{
+		DirectX::XMFLOAT4 minX, minY, minZ;
+		DirectX::XMFLOAT4 maxX, maxY, maxZ;
+		unsigned int first[4];
+		unsigned int count[4];
+		unsigned int childCount;
+	};
+
+	struct BuildNode
+	{
+		DirectX::XMFLOAT3 min;
+		DirectX::XMFLOAT3 max;
+		int left;			// -1 for leaves
+		int right;
+		unsigned int first;
+		unsigned int count;
+	};
+
+	struct Triangle
+	{
+		DirectX::XMFLOAT3 v0;
+		DirectX::XMFLOAT3 edge1;
+		DirectX::XMFLOAT3 edge2;
+	};
+
+	int BuildRecursive(unsigned int first, unsigned int count, const std::vector<DirectX::XMFLOAT3>& centroids, const std::vector<DirectX::XMFLOAT3>& triangleVertices);
+	unsigned int Collapse(int buildNode);
+	bool Trace(DirectX::XMFLOAT3 origin, DirectX::XMFLOAT3 direction, float maxDistance, bool anyHit, TriangleHit& hit) const;
+
+	std::vector<BuildNode> buildNodes;
+	std::vector<Node> nodes;
+	std::vector<Triangle> triangles;
+	std::vector<unsigned int> triangleIndices;		// Original index of each triangle in leaf order
+};
@@ -13,4 +13,5 @@ struct Vertex
 	DirectX::XMFLOAT3 Normal;	    // The normal
 	DirectX::XMFLOAT3 Tangent;		// The tangent vector for normal mapping
 	DirectX::XMFLOAT2 UV;			// The uv coordinates
+	DirectX::XMFLOAT2 LightmapUV;	// Non-overlapping uvs for lightmaps (see LightmapUVs)
 };
\ No newline at end of file
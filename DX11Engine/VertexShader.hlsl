@@ -1,14 +1,19 @@
 #include "ShaderInclude.hlsli"
 
-// Declaring constant buffer
-cbuffer ExternalData : register(b0)
+// Camera data, uploaded once per frame
+cbuffer PerFrame : register(b0)
 {
-	matrix world;
-	matrix worldInvTranspose;
 	matrix view;
 	matrix projection;
-	matrix lightView;
-	matrix lightProj;
+}
+
+// Uploaded for every entity that is drawn
+cbuffer PerObject : register(b2)
+{
+	matrix world;
+	matrix worldInvTranspose;
+	uint4 objectLights;
+	float4 lightmapRect;		// Scale in xy, offset in zw, zero if not lightmapped
 }
 
 // --------------------------------------------------------
@@ -18,10 +23,10 @@ cbuffer ExternalData : register(b0)
 // - Output is a single struct of data to pass down the pipeline
 // - Named "main" because that's the default the shader compiler looks for
 // --------------------------------------------------------
-VertexToPixelWithShadowPos main(VertexShaderInput input)
+VertexToPixel main(VertexShaderInput input)
 {
 	// Set up output struct
-	VertexToPixelWithShadowPos output;
+	VertexToPixel output;
 
 	// Here we're essentially passing the input position directly through to the next
 	// stage (rasterizer), though it needs to be a 4-component vector now.  
@@ -36,16 +41,14 @@ VertexToPixelWithShadowPos main(VertexShaderInput input)
 	matrix wvp = mul(mul(projection, view), world);
 	output.screenPosition = mul(wvp, float4(input.localPosition, 1.0f));
 
-	// Calculate position of this vertex on the shadow map
-	// Basically just wvp from the light's perspective
-	matrix shadowWVP = mul(lightProj, mul(lightView, world));
-	output.shadowMapPos = mul(shadowWVP, float4(input.localPosition, 1.0f));
-
 	output.uv = input.uv;
 
 	output.normal = normalize(mul((float3x3)worldInvTranspose, input.normal));
 	output.tangent = normalize(mul((float3x3)worldInvTranspose, input.tangent));
 	output.worldPosition = mul(world, float4(input.localPosition, 1)).xyz;
+	output.lights = objectLights;
+	output.lightmapUV = input.lightmapUV * lightmapRect.xy + lightmapRect.zw;
+	output.lightmapped = lightmapRect.x > 0.0f ? 1 : 0;
 
 	// Whatever we return will make its way through the pipeline to the
 	// next programmable stage we're using (the pixel shader for now)